@@ -0,0 +1,381 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Batch file I/O through utils/async_io next to the stdio path of the wav classes. Writes a set of
+// wav files with CWaveFileWrite (stdio, then through an AsyncFileWriter) and reads them back with
+// CWaveFileRead (loading each file with ifstream, then from images read ahead by a FilePrefetcher).
+// Reports GB/s, files/s and I/O requests per second. The page cache is dropped for the files before
+// every read run (Linux), so reads come from the device.
+//
+// Usage: batch_io_bench [--dir D] [--files N] [--secs S] [--queue-depth Q] [--buffer-kb K]
+//                       [--lookahead N] [--backend auto|uring|threads] [--direct] [--sync] [--runs N] [--keep]
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utils/async_io/BatchIo.hpp>
+#include <utils/async_io/IoEngine.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+struct Options {
+  std::string dir = "batch_io_bench_files";
+  unsigned files = 128;
+  // Audio per file, 48 kHz mono float
+  double secs = 10.0;
+  async_io::IoOptions io;
+  // Files read or written ahead of the current one
+  unsigned lookahead = 8;
+  bool direct = false;
+  // Flush every written file to disk before it is committed, otherwise writes end in the page cache
+  bool sync = false;
+  int runs = 3;
+  // Keep the files after the run
+  bool keep = false;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--direct") {
+      options->direct = true;
+      continue;
+    }
+    if (arg == "--sync") {
+      options->sync = true;
+      continue;
+    }
+    if (arg == "--keep") {
+      options->keep = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--dir") {
+      options->dir = value;
+    } else if (arg == "--files") {
+      options->files = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--queue-depth") {
+      options->io.queue_depth = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--buffer-kb") {
+      options->io.buffer_size = std::strtoul(value.c_str(), nullptr, 10) * 1024;
+    } else if (arg == "--lookahead") {
+      options->lookahead = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--backend") {
+      if (value == "auto") {
+        options->io.backend = async_io::IoBackend::kAuto;
+      } else if (value == "uring") {
+        options->io.backend = async_io::IoBackend::kUring;
+      } else if (value == "threads") {
+        options->io.backend = async_io::IoBackend::kThreadPool;
+      } else {
+        std::cerr << "--backend must be auto, uring or threads" << std::endl;
+        return false;
+      }
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(value.c_str());
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->files == 0 || options->secs <= 0.0 || options->runs <= 0 || options->io.queue_depth == 0 ||
+      options->io.buffer_size == 0 || options->lookahead == 0) {
+    std::cerr << "All counts and sizes must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Read and write system calls of the process so far, the request count of the stdio path. Not
+// available outside Linux.
+bool GetSyscallCounts(uint64_t* reads, uint64_t* writes) {
+#ifdef __linux__
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  uint64_t value;
+  bool found_reads = false, found_writes = false;
+  while (io >> key >> value) {
+    if (key == "syscr:") {
+      *reads = value;
+      found_reads = true;
+    } else if (key == "syscw:") {
+      *writes = value;
+      found_writes = true;
+    }
+  }
+  return found_reads && found_writes;
+#else
+  (void)reads;
+  (void)writes;
+  return false;
+#endif
+}
+
+// Writes back and drops the cached pages of path, so the next read goes to the device
+void EvictFromCache(const std::string& path) {
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  close(fd);
+#else
+  (void)path;
+#endif
+}
+
+struct Result {
+  double secs = 1e30;
+  uint64_t bytes = 0;
+  // I/O requests of the best run, 0 if unknown
+  uint64_t requests = 0;
+  bool ok = true;
+};
+
+void PrintResult(const char* name, const Result& result, unsigned files) {
+  std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << result.bytes / result.secs / 1e9 << std::setw(12) << files / result.secs;
+  if (result.requests > 0) {
+    std::cout << std::setw(12) << std::setprecision(0) << result.requests / result.secs << std::setw(14)
+              << std::setprecision(1) << result.bytes / 1024.0 / result.requests;
+  } else {
+    std::cout << std::setw(12) << "-" << std::setw(14) << "-";
+  }
+  std::cout << (result.ok ? "" : "  FAILED") << std::endl;
+}
+
+// Runs body runs times and keeps the fastest run
+template <typename Body>
+Result Measure(int runs, const std::function<void()>& before, Body body) {
+  Result best;
+  for (int run = 0; run < runs; run++) {
+    if (before)
+      before();
+    Result result;
+    auto start = std::chrono::high_resolution_clock::now();
+    body(&result);
+    result.secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    best.ok = best.ok && result.ok;
+    if (result.secs < best.secs) {
+      best.secs = result.secs;
+      best.bytes = result.bytes;
+      best.requests = result.requests;
+    }
+  }
+  return best;
+}
+
+// Writes every file frame by frame, as effects_demo writes its output. With engine, each file goes
+// through an AsyncFileWriter and up to lookahead files are committed late so their writes overlap.
+void WriteFiles(const std::vector<std::string>& paths, const std::vector<float>& audio, async_io::IoEngine* engine,
+                unsigned lookahead, bool sync, Result* result) {
+  const uint32_t kFrameBytes = 480 * sizeof(float);
+  std::deque<std::unique_ptr<CWaveFileWrite>> pending;
+  for (const std::string& path : paths) {
+    std::unique_ptr<CWaveFileWrite> writer(new CWaveFileWrite(path, 48000, 1, 32, true));
+    if (engine) {
+      std::unique_ptr<async_io::AsyncFileWriter> file = async_io::AsyncFileWriter::Open(*engine, path);
+      if (!file || !writer->setOutputFile(std::move(file))) {
+        result->ok = false;
+        return;
+      }
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(audio.data());
+    const uint32_t size = static_cast<uint32_t>(audio.size() * sizeof(float));
+    for (uint32_t offset = 0; offset < size; offset += kFrameBytes) {
+      if (!writer->writeChunk(data + offset, std::min(kFrameBytes, size - offset))) {
+        result->ok = false;
+        return;
+      }
+    }
+    pending.push_back(std::move(writer));
+    while (pending.size() > (engine ? lookahead : 0)) {
+      result->ok = (!sync || pending.front()->sync()) && pending.front()->commitFile() && result->ok;
+      pending.pop_front();
+    }
+    result->bytes += size;
+  }
+  for (std::unique_ptr<CWaveFileWrite>& writer : pending)
+    result->ok = (!sync || writer->sync()) && writer->commitFile() && result->ok;
+}
+
+// Reads every file and converts it to float, checksum adds up the samples to compare both paths
+void ReadFiles(const std::vector<std::string>& paths, async_io::IoEngine* engine, unsigned lookahead, bool direct,
+               Result* result, double* checksum) {
+  *checksum = 0.0;
+  auto consume = [&](CWaveFileRead& wave) {
+    const float* samples = wave.isValid() ? wave.GetFloatPCMData() : nullptr;
+    if (!samples) {
+      result->ok = false;
+      return;
+    }
+    for (uint32_t i = 0; i < wave.GetNumSamples(); i += 997)
+      *checksum += samples[i];
+    result->bytes += wave.GetRawPCMDataSizeInBytes();
+  };
+  if (!engine) {
+    for (const std::string& path : paths) {
+      CWaveFileRead wave(path);
+      consume(wave);
+    }
+    return;
+  }
+  async_io::FilePrefetcher prefetcher(*engine, paths, lookahead, direct);
+  std::string path;
+  std::vector<uint8_t> image;
+  bool ok;
+  while (prefetcher.Next(&path, &image, &ok)) {
+    if (!ok) {
+      result->ok = false;
+      continue;
+    }
+    CWaveFileRead wave(path, image.data(), image.size());
+    consume(wave);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: batch_io_bench [--dir D] [--files N] [--secs S] [--queue-depth Q] [--buffer-kb K]"
+              << std::endl
+              << "                      [--lookahead N] [--backend auto|uring|threads] [--direct] [--sync] [--runs N]"
+              << " [--keep]" << std::endl;
+    return -1;
+  }
+#ifdef _WIN32
+  _mkdir(options.dir.c_str());
+#else
+  mkdir(options.dir.c_str(), 0755);
+#endif
+
+  std::unique_ptr<async_io::IoEngine> engine = async_io::CreateIoEngine(options.io);
+  if (!engine)
+    return -1;
+
+  std::vector<std::string> paths;
+  for (unsigned i = 0; i < options.files; i++)
+    paths.push_back(options.dir + "/batch_" + std::to_string(i) + ".wav");
+  std::vector<float> audio(static_cast<size_t>(options.secs * 48000));
+  for (size_t i = 0; i < audio.size(); i++)
+    audio[i] = 0.5f * static_cast<float>(std::sin(0.001 * static_cast<double>(i) * (1.0 + i % 7)));
+
+  std::cout << "I/O engine: " << engine->GetName() << ", queue depth " << engine->GetQueueDepth() << ", "
+            << engine->GetBufferSize() / 1024 << " KiB buffers, lookahead " << options.lookahead << " files"
+            << (options.direct ? ", direct reads" : "") << (options.sync ? ", synced writes" : "") << std::endl
+            << options.files << " files of " << std::fixed << std::setprecision(1)
+            << audio.size() * sizeof(float) / 1e6 << " MB, best of " << options.runs << std::endl
+            << std::endl;
+
+  std::cout << std::left << std::setw(26) << "Path" << std::right << std::setw(10) << "GB/s" << std::setw(12)
+            << "files/s" << std::setw(12) << "IOPS" << std::setw(14) << "KiB/request" << std::endl;
+
+  uint64_t syscalls_read = 0, syscalls_written = 0;
+  Result stdio_write = Measure(options.runs, nullptr, [&](Result* result) {
+    uint64_t reads_before = 0, writes_before = 0;
+    bool counted = GetSyscallCounts(&reads_before, &writes_before);
+    WriteFiles(paths, audio, nullptr, options.lookahead, options.sync, result);
+    if (counted && GetSyscallCounts(&syscalls_read, &syscalls_written))
+      result->requests = syscalls_written - writes_before;
+  });
+  PrintResult("write, stdio", stdio_write, options.files);
+
+  Result async_write = Measure(options.runs, nullptr, [&](Result* result) {
+    uint64_t requests_before = engine->GetStats().requests;
+    WriteFiles(paths, audio, engine.get(), options.lookahead, options.sync, result);
+    result->requests = engine->GetStats().requests - requests_before;
+  });
+  PrintResult("write, async", async_write, options.files);
+
+  auto evict = [&]() {
+    for (const std::string& path : paths)
+      EvictFromCache(path);
+  };
+  double stdio_checksum = 0.0, async_checksum = 0.0;
+  Result stdio_read = Measure(options.runs, evict, [&](Result* result) {
+    uint64_t reads_before = 0, writes_before = 0;
+    bool counted = GetSyscallCounts(&reads_before, &writes_before);
+    ReadFiles(paths, nullptr, options.lookahead, false, result, &stdio_checksum);
+    if (counted && GetSyscallCounts(&syscalls_read, &syscalls_written))
+      result->requests = syscalls_read - reads_before;
+  });
+  PrintResult("read, stdio", stdio_read, options.files);
+
+  Result async_read = Measure(options.runs, evict, [&](Result* result) {
+    uint64_t requests_before = engine->GetStats().requests;
+    ReadFiles(paths, engine.get(), options.lookahead, options.direct, result, &async_checksum);
+    result->requests = engine->GetStats().requests - requests_before;
+  });
+  PrintResult("read, async", async_read, options.files);
+
+  bool passed = stdio_write.ok && async_write.ok && stdio_read.ok && async_read.ok &&
+                stdio_checksum == async_checksum;
+  std::cout << std::endl << "Read speedup " << std::setprecision(2) << stdio_read.secs / async_read.secs
+            << "x, write speedup " << stdio_write.secs / async_write.secs << "x, contents "
+            << (stdio_checksum == async_checksum ? "match" : "DIFFER") << std::endl;
+
+  if (!options.keep) {
+    for (const std::string& path : paths)
+      std::remove(path.c_str());
+#ifdef _WIN32
+    _rmdir(options.dir.c_str());
+#else
+    rmdir(options.dir.c_str());
+#endif
+  }
+  return passed ? 0 : 1;
+}
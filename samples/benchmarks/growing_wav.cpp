@@ -0,0 +1,446 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Recorder simulator for testing followed inputs (follow_input 1 in effects_demo). Appends a wav
+// file to --output at its real-time rate in --chunk-ms chunks. While recording, the RIFF and data
+// sizes are 0 or 0xFFFFFFFF, or the actual sizes rewritten every --header-ms, as recorders do; the
+// header is completed at the end unless --no-finalize (a recorder that crashed).
+//   --watch FILE: checks the processed file while the follower writes it. Its header must describe
+//   the data it has, and the lag of each chunk is the time from its append to the processed audio
+//   of it appearing in FILE.
+//   --local: the recording is followed here by an audio_io::FollowWaveSource in --frame-ms frames
+//   and copied to the --watch file, standing in for effects_demo. The copy is compared with the input.
+//
+// Usage: growing_wav --input in.wav --output rec.wav [--watch out.wav] [--local] [--chunk-ms MS]
+//                    [--speed X] [--sizes zero|max|periodic] [--header-ms MS] [--format pcm16|float]
+//                    [--no-finalize] [--frame-ms MS] [--settle-ms MS]
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/audio_io/AudioStream.hpp>
+#include <utils/audio_io/FollowSource.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+struct Options {
+  std::string input;
+  std::string output;
+  std::string watch;
+  bool local = false;
+  double chunk_ms = 10.0;
+  // Real-time factor of the recording, 0 appends as fast as possible
+  double speed = 1.0;
+  std::string sizes = "zero";
+  double header_ms = 1000.0;
+  std::string format = "pcm16";
+  bool finalize = true;
+  double frame_ms = 10.0;
+  // Time the watched file may take to catch up after the recording ended
+  double settle_ms = 5000.0;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--local") {
+      options->local = true;
+      continue;
+    }
+    if (arg == "--no-finalize") {
+      options->finalize = false;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--input") {
+      options->input = value;
+    } else if (arg == "--output") {
+      options->output = value;
+    } else if (arg == "--watch") {
+      options->watch = value;
+    } else if (arg == "--chunk-ms") {
+      options->chunk_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--speed") {
+      options->speed = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--sizes") {
+      if (value != "zero" && value != "max" && value != "periodic") {
+        std::cerr << "--sizes must be zero, max or periodic" << std::endl;
+        return false;
+      }
+      options->sizes = value;
+    } else if (arg == "--header-ms") {
+      options->header_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--format") {
+      if (value != "pcm16" && value != "float") {
+        std::cerr << "--format must be pcm16 or float" << std::endl;
+        return false;
+      }
+      options->format = value;
+    } else if (arg == "--frame-ms") {
+      options->frame_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--settle-ms") {
+      options->settle_ms = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->local && options->watch.empty())
+    options->watch = options->output + ".follow.wav";
+  return !options->input.empty() && !options->output.empty() && options->chunk_ms > 0.0 &&
+         options->frame_ms > 0.0;
+}
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PutU32(std::vector<uint8_t>* out, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void PutU16(std::vector<uint8_t>* out, uint16_t value) {
+  out->push_back(static_cast<uint8_t>(value));
+  out->push_back(static_cast<uint8_t>(value >> 8));
+}
+
+// A wav file appended the way recorders write it
+class Recorder {
+ public:
+  Recorder(const std::string& path, uint32_t sample_rate, uint32_t num_channels, bool is_float)
+    : is_float_(is_float) {
+    uint16_t bits = is_float ? 32 : 16;
+    header_.insert(header_.end(), { 'R', 'I', 'F', 'F' });
+    PutU32(&header_, 0);
+    header_.insert(header_.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    PutU32(&header_, 16);
+    PutU16(&header_, is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    PutU16(&header_, static_cast<uint16_t>(num_channels));
+    PutU32(&header_, sample_rate);
+    PutU32(&header_, sample_rate * num_channels * bits / 8);
+    PutU16(&header_, static_cast<uint16_t>(num_channels * bits / 8));
+    PutU16(&header_, bits);
+    header_.insert(header_.end(), { 'd', 'a', 't', 'a' });
+    PutU32(&header_, 0);
+    fp_ = fopen(path.c_str(), "wb");
+  }
+
+  ~Recorder() { Close(); }
+
+  // The end of the recording, a follower is notified by the close
+  void Close() {
+    if (fp_)
+      fclose(fp_);
+    fp_ = nullptr;
+  }
+
+  bool IsValid() const { return fp_ != nullptr; }
+
+  // Writes the header with the given sizes, the first call starts the file
+  bool WriteSizes(uint32_t riff_size, uint32_t data_size) {
+    memcpy(&header_[4], &riff_size, sizeof(riff_size));
+    memcpy(&header_[header_.size() - 4], &data_size, sizeof(data_size));
+    bool started = data_bytes_ > 0 || ftell(fp_) > 0;
+    bool written = fseek(fp_, 0, SEEK_SET) == 0 && fwrite(header_.data(), header_.size(), 1, fp_) == 1;
+    if (started)
+      written = written && fseek(fp_, 0, SEEK_END) == 0;
+    return written && fflush(fp_) == 0;
+  }
+
+  // Sizes of the data appended so far
+  bool WriteActualSizes() {
+    uint32_t data_size = static_cast<uint32_t>(data_bytes_);
+    return WriteSizes(static_cast<uint32_t>(header_.size() - 8) + data_size, data_size);
+  }
+
+  bool Append(const float* samples, size_t count) {
+    raw_.clear();
+    for (size_t i = 0; i < count; i++) {
+      if (is_float_) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&samples[i]);
+        raw_.insert(raw_.end(), bytes, bytes + sizeof(float));
+      } else {
+        float scaled = std::round(std::max(-1.f, std::min(1.f, samples[i])) * 32767.f);
+        PutU16(&raw_, static_cast<uint16_t>(static_cast<int16_t>(scaled)));
+      }
+    }
+    data_bytes_ += raw_.size();
+    // Lands in the file at once, as a recorder's write() would
+    return fwrite(raw_.data(), raw_.size(), 1, fp_) == 1 && fflush(fp_) == 0;
+  }
+
+ private:
+  const bool is_float_;
+  FILE* fp_ = nullptr;
+  std::vector<uint8_t> header_;
+  std::vector<uint8_t> raw_;
+  uint64_t data_bytes_ = 0;
+};
+
+// Input frames appended so far and when
+struct AppendLog {
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, double>> appends;
+  std::atomic<bool> done{ false };
+};
+
+struct WatchResult {
+  std::vector<double> lags_ms;
+  uint64_t checks = 0;
+  // Checks where the header did not describe the data in the file
+  uint64_t stale_headers = 0;
+  uint64_t frames = 0;
+};
+
+bool ReadU32(FILE* fp, uint64_t offset, uint32_t* value) {
+  return fseek(fp, static_cast<long>(offset), SEEK_SET) == 0 && fread(value, sizeof(*value), 1, fp) == 1;
+}
+
+// Follows the processed file, matching its length against the appends of the recording
+void WatchOutput(const std::string& path, uint32_t input_rate, double settle_ms, AppendLog* log,
+                 WatchResult* result) {
+  FILE* fp = nullptr;
+  size_t next = 0;
+  double done_time = 0.0;
+  while (true) {
+    double now = Now();
+    if (log->done && done_time == 0.0)
+      done_time = now;
+    size_t num_appends;
+    {
+      std::lock_guard<std::mutex> lock(log->mutex);
+      num_appends = log->appends.size();
+    }
+    if (done_time > 0.0 && (next >= num_appends || (now - done_time) * 1000.0 > settle_ms))
+      break;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+    if (!fp) {
+      fp = fopen(path.c_str(), "rb");
+      if (!fp)
+        continue;
+      setvbuf(fp, nullptr, _IONBF, 0);
+    }
+    CRiffChunkIndex index;
+    const RiffChunkEntry* format;
+    const RiffChunkEntry* data;
+    waveFormat_basic wf;
+    if (!index.Build(fp) || !(format = index.Find(MAKEFOURCC('f', 'm', 't', ' '))) ||
+        !(data = index.Find(MAKEFOURCC('d', 'a', 't', 'a'))) || format->size < sizeof(wf) ||
+        fseek(fp, static_cast<long>(format->offset), SEEK_SET) != 0 || fread(&wf, sizeof(wf), 1, fp) != 1 ||
+        wf.nBlockAlign == 0 || wf.nSamplesPerSec == 0) {
+      continue;
+    }
+    uint32_t riff_size = 0;
+    uint32_t data_size = 0;
+    if (fseek(fp, 0, SEEK_END) != 0)
+      continue;
+    uint64_t file_size = static_cast<uint64_t>(ftell(fp));
+    if (!ReadU32(fp, 4, &riff_size) || !ReadU32(fp, data->offset - 4, &data_size))
+      continue;
+    // A follower keeps the header valid: the sizes cover exactly what is in the file
+    result->checks++;
+    if (riff_size + 8ull != file_size || data->offset + static_cast<uint64_t>(data_size) != file_size)
+      result->stale_headers++;
+    result->frames = data_size / wf.nBlockAlign;
+    uint64_t covered = result->frames * input_rate / wf.nSamplesPerSec;
+    double seen = Now();
+    std::lock_guard<std::mutex> lock(log->mutex);
+    for (; next < log->appends.size() && log->appends[next].first <= covered; next++)
+      result->lags_ms.push_back((seen - log->appends[next].second) * 1000.0);
+  }
+  if (fp)
+    fclose(fp);
+}
+
+// Stands in for effects_demo: copies the followed recording frame by frame
+void FollowLocal(const Options& options, uint32_t* frames_copied) {
+  audio_io::FollowOptions follow_options;
+  follow_options.idle_secs = 2.0;
+  audio_io::FollowWaveSource source(options.output, follow_options);
+  if (!source.IsValid())
+    return;
+  std::unique_ptr<audio_io::AudioSink> sink =
+    audio_io::CreateAudioSink(options.watch, source.GetSampleRate(), source.GetNumChannels());
+  if (!sink)
+    return;
+  uint32_t frame_samples =
+    std::max(1u, static_cast<uint32_t>(options.frame_ms * source.GetSampleRate() / 1000.0)) * source.GetNumChannels();
+  std::vector<float> frame(frame_samples);
+  uint32_t count;
+  *frames_copied = 0;
+  while ((count = source.Read(frame.data(), frame_samples)) > 0) {
+    if (!sink->Write(frame.data(), count) || !sink->Flush())
+      return;
+    source.RecordOutput();
+    *frames_copied += count / source.GetNumChannels();
+  }
+  sink->Commit();
+  source.PrintReport(std::cout, frame_samples / source.GetNumChannels());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: growing_wav --input in.wav --output rec.wav [--watch out.wav] [--local] [--chunk-ms MS]"
+              << std::endl
+              << "                   [--speed X] [--sizes zero|max|periodic] [--header-ms MS]"
+              << " [--format pcm16|float]" << std::endl
+              << "                   [--no-finalize] [--frame-ms MS] [--settle-ms MS]" << std::endl;
+    return -1;
+  }
+  std::unique_ptr<audio_io::AudioSource> input = audio_io::OpenAudioSource(options.input);
+  if (!input)
+    return -1;
+  const uint32_t sample_rate = input->GetSampleRate();
+  const uint32_t num_channels = input->GetNumChannels();
+  std::vector<float> audio;
+  std::vector<float> block(4096 * num_channels);
+  uint32_t num_read;
+  while ((num_read = input->Read(block.data(), static_cast<uint32_t>(block.size()))) > 0)
+    audio.insert(audio.end(), block.begin(), block.begin() + num_read);
+  const uint64_t num_frames = audio.size() / num_channels;
+
+  Recorder recorder(options.output, sample_rate, num_channels, options.format == "float");
+  uint32_t sizes = options.sizes == "max" ? UINT32_MAX : 0;
+  if (!recorder.IsValid() || !recorder.WriteSizes(sizes, sizes)) {
+    std::cerr << "Unable to create " << options.output << std::endl;
+    return -1;
+  }
+  std::cout << std::fixed << std::setprecision(2) << "Recording " << options.input << " ("
+            << static_cast<double>(num_frames) / sample_rate << " secs, " << sample_rate << " Hz, " << num_channels
+            << " channel(s)) to " << options.output << " as " << options.format << " in " << options.chunk_ms
+            << " ms chunks at " << options.speed << "x, sizes " << options.sizes << std::endl;
+
+  AppendLog log;
+  WatchResult watched;
+  std::thread watcher;
+  if (!options.watch.empty()) {
+    // A stale copy would count as processed audio
+    std::remove(options.watch.c_str());
+    watcher = std::thread(WatchOutput, options.watch, sample_rate, options.settle_ms, &log, &watched);
+  }
+  uint32_t frames_copied = 0;
+  std::thread follower;
+  if (options.local)
+    follower = std::thread(FollowLocal, std::cref(options), &frames_copied);
+
+  const uint64_t chunk_frames = std::max<uint64_t>(1, static_cast<uint64_t>(options.chunk_ms * sample_rate / 1000.0));
+  double start = Now();
+  double last_header = start;
+  uint64_t num_chunks = 0;
+  double max_late_ms = 0.0;
+  for (uint64_t pos = 0; pos < num_frames; pos += chunk_frames, num_chunks++) {
+    if (options.speed > 0.0) {
+      double due = start + static_cast<double>(pos) / sample_rate / options.speed;
+      double wait = due - Now();
+      if (wait > 0.0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+      max_late_ms = std::max(max_late_ms, (Now() - due) * 1000.0);
+    }
+    uint64_t count = std::min(chunk_frames, num_frames - pos);
+    if (!recorder.Append(&audio[pos * num_channels], count * num_channels)) {
+      std::cerr << "Unable to write " << options.output << std::endl;
+      return -1;
+    }
+    {
+      std::lock_guard<std::mutex> lock(log.mutex);
+      log.appends.emplace_back(pos + count, Now());
+    }
+    if (options.sizes == "periodic" && (Now() - last_header) * 1000.0 >= options.header_ms) {
+      recorder.WriteActualSizes();
+      last_header = Now();
+    }
+  }
+  if (options.finalize)
+    recorder.WriteActualSizes();
+  recorder.Close();
+  std::cout << "Recorded " << num_chunks << " chunks in " << Now() - start << " secs, appends up to " << max_late_ms
+            << " ms late, header " << (options.finalize ? "completed" : "left incomplete") << std::endl;
+  log.done = true;
+
+  if (follower.joinable())
+    follower.join();
+  if (watcher.joinable())
+    watcher.join();
+
+  int result = 0;
+  if (!options.watch.empty()) {
+    std::vector<double> lags = watched.lags_ms;
+    std::sort(lags.begin(), lags.end());
+    std::cout << "Watched " << options.watch << ": " << watched.frames << " frames, " << lags.size() << " of "
+              << num_chunks << " chunks arrived, header stale in " << watched.stale_headers << " of "
+              << watched.checks << " checks" << std::endl;
+    if (!lags.empty()) {
+      double sum = 0.0;
+      for (double lag : lags)
+        sum += lag;
+      std::cout << "  lag append to processed output: " << sum / lags.size() << " ms average, "
+                << lags[lags.size() / 2] << " ms p50, " << lags[std::min(lags.size() - 1, lags.size() * 99 / 100)]
+                << " ms p99, " << lags.back() << " ms max" << std::endl;
+    }
+    if (lags.size() < num_chunks)
+      result = -1;
+  }
+  if (options.local) {
+    // The copy went through the same sample format as the recording
+    std::unique_ptr<audio_io::AudioSource> copy = audio_io::OpenAudioSource(options.watch);
+    double max_error = 0.0;
+    uint64_t compared = 0;
+    while (copy && (num_read = copy->Read(block.data(), static_cast<uint32_t>(block.size()))) > 0) {
+      for (uint32_t i = 0; i < num_read && compared < audio.size(); i++, compared++) {
+        float expected = audio[compared];
+        if (options.format == "pcm16")
+          expected = static_cast<int16_t>(std::round(std::max(-1.f, std::min(1.f, expected)) * 32767.f)) / 32768.f;
+        max_error = std::max(max_error, static_cast<double>(std::fabs(block[i] - expected)));
+      }
+    }
+    std::cout << "Copy: " << frames_copied << " of " << num_frames << " frames, max difference " << std::setprecision(6)
+              << max_error << std::endl;
+    if (frames_copied != num_frames || max_error > 0.0)
+      result = -1;
+  }
+  return result;
+}
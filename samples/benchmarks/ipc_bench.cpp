@@ -0,0 +1,374 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Added latency and CPU of moving audio frames from a capture process to the effects process,
+// through the shared memory rings of utils/ipc against a Unix domain socket per stream. A child
+// process plays the capture side: one thread per stream sends a frame every --frame-ms at its own
+// phase. The parent plays the effects side: one thread per stream waits for each frame and reads
+// it in place, as NvAFX_Run() would. Latency is taken from the capture side's publish time to the
+// wakeup of the effects side, CPU from both processes' rusage. Linux and other POSIX systems.
+//
+// Usage: ipc_bench [--transport both|shm|socket] [--streams N] [--secs S] [--frame-ms MS] [--rate HZ]
+//                  [--channels N] [--slots N] [--spin-us US]
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/ipc/ShmRing.hpp>
+
+namespace {
+
+struct Options {
+  std::string transport = "both";
+  unsigned num_streams = 8;
+  double secs = 5.0;
+  double frame_ms = 10.0;
+  unsigned rate = 48000;
+  unsigned num_channels = 1;
+  unsigned num_slots = 8;
+  double spin_us = 50.0;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--transport") {
+      options->transport = value;
+    } else if (arg == "--streams") {
+      options->num_streams = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--frame-ms") {
+      options->frame_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--rate") {
+      options->rate = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--channels") {
+      options->num_channels = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--slots") {
+      options->num_slots = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--spin-us") {
+      options->spin_us = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if ((options->transport != "both" && options->transport != "shm" && options->transport != "socket") ||
+      options->num_streams == 0 || options->secs <= 0.0 || options->frame_ms <= 0.0 || options->rate == 0 ||
+      options->num_channels == 0 || options->num_slots < 2 || options->spin_us < 0.0) {
+    std::cerr << "Invalid options" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Precedes the samples of a socket message, the rings keep the same in their slot headers
+struct MessageHeader {
+  int64_t publish_ns;
+  uint64_t frame;
+};
+
+struct Result {
+  std::vector<double> latencies_us;
+  uint64_t frames = 0;
+  uint64_t errors = 0;
+  double parent_cpu_secs = 0.0;
+  double child_cpu_secs = 0.0;
+  ipc::RingStats ring_stats;
+};
+
+// First sample of channel c of a frame, checked by the receiving side
+float GetMarker(uint64_t frame, unsigned channel) { return static_cast<float>(frame % 1000) + 0.25f * channel; }
+
+void FillFrame(float* planar, unsigned frame_samples, unsigned num_channels, uint64_t frame) {
+  for (unsigned ch = 0; ch < num_channels; ch++) {
+    float* channel = planar + ch * frame_samples;
+    channel[0] = GetMarker(frame, ch);
+    for (unsigned i = 1; i < frame_samples; i++)
+      channel[i] = 0.001f * static_cast<float>((frame + i) % 1000);
+  }
+}
+
+// Reads every sample like the effect would, false if the frame is not the expected one
+bool CheckFrame(const float* planar, unsigned frame_samples, unsigned num_channels, uint64_t frame) {
+  float sum = 0.f;
+  for (unsigned ch = 0; ch < num_channels; ch++) {
+    const float* channel = planar + ch * frame_samples;
+    if (channel[0] != GetMarker(frame, ch))
+      return false;
+    for (unsigned i = 0; i < frame_samples; i++)
+      sum += channel[i];
+  }
+  return sum >= 0.f;
+}
+
+double GetCpuSecs(const rusage& usage) {
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+double GetSelfCpuSecs() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return GetCpuSecs(usage);
+}
+
+std::string GetRingName(unsigned stream) {
+  return "ipc_bench." + std::to_string(getpid()) + "." + std::to_string(stream);
+}
+
+// Capture side, in the child process: sends the frames of stream on its schedule
+bool SendStream(const Options& options, unsigned stream, int64_t start_ns, const std::string& ring_name,
+                int socket_fd) {
+  const unsigned frame_samples = static_cast<unsigned>(options.rate * options.frame_ms / 1000.0);
+  const int64_t frame_ns = static_cast<int64_t>(options.frame_ms * 1e6);
+  const uint64_t num_frames = static_cast<uint64_t>(options.secs * 1000.0 / options.frame_ms);
+  // Phases spread over one frame
+  int64_t due = start_ns + frame_ns * stream / options.num_streams;
+  std::unique_ptr<ipc::ShmRing> ring;
+  std::vector<uint8_t> message;
+  if (socket_fd < 0) {
+    ring = ipc::ShmRing::Open(ring_name, ipc::RingRole::kProducer, 5000.0, options.spin_us);
+    if (!ring)
+      return false;
+  } else {
+    message.resize(sizeof(MessageHeader) + sizeof(float) * frame_samples * options.num_channels);
+  }
+  for (uint64_t frame = 0; frame < num_frames; frame++, due += frame_ns) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(0, due - ipc::ShmRing::Now())));
+    if (ring) {
+      float* slot = ring->BeginWrite(-1.0);
+      if (!slot)
+        return false;
+      FillFrame(slot, frame_samples, options.num_channels, frame);
+      ring->EndWrite(frame_samples);
+    } else {
+      FillFrame(reinterpret_cast<float*>(message.data() + sizeof(MessageHeader)), frame_samples,
+                options.num_channels, frame);
+      MessageHeader header = { ipc::ShmRing::Now(), frame };
+      std::memcpy(message.data(), &header, sizeof(header));
+      if (send(socket_fd, message.data(), message.size(), 0) != static_cast<ssize_t>(message.size()))
+        return false;
+    }
+  }
+  if (ring)
+    ring->Close();
+  else
+    close(socket_fd);
+  return true;
+}
+
+// Effects side, in the parent: receives the frames of one stream
+void ReceiveStream(const Options& options, ipc::ShmRing* ring, int socket_fd, std::vector<double>* latencies_us,
+                   uint64_t* frames, uint64_t* errors) {
+  const unsigned frame_samples = static_cast<unsigned>(options.rate * options.frame_ms / 1000.0);
+  std::vector<uint8_t> message(sizeof(MessageHeader) + sizeof(float) * frame_samples * options.num_channels);
+  for (uint64_t frame = 0;; frame++) {
+    const float* planar;
+    int64_t publish_ns;
+    if (ring) {
+      uint32_t num_samples;
+      planar = ring->BeginRead(frame == 0 ? 10000.0 : -1.0, &num_samples, &publish_ns);
+      if (!planar)
+        break;
+    } else {
+      ssize_t size = recv(socket_fd, message.data(), message.size(), 0);
+      if (size <= 0)
+        break;
+      MessageHeader header;
+      std::memcpy(&header, message.data(), sizeof(header));
+      publish_ns = header.publish_ns;
+      planar = reinterpret_cast<const float*>(message.data() + sizeof(MessageHeader));
+    }
+    latencies_us->push_back((ipc::ShmRing::Now() - publish_ns) / 1000.0);
+    if (!CheckFrame(planar, frame_samples, options.num_channels, frame))
+      (*errors)++;
+    (*frames)++;
+    if (ring)
+      ring->EndRead();
+  }
+}
+
+bool RunTransport(const Options& options, bool use_shm, Result* result) {
+  const unsigned frame_samples = static_cast<unsigned>(options.rate * options.frame_ms / 1000.0);
+  // Created before the fork, the child attaches by name like a separate capture process would
+  std::vector<std::unique_ptr<ipc::ShmRing>> rings(options.num_streams);
+  std::vector<int> sockets(2 * options.num_streams, -1);
+  for (unsigned i = 0; i < options.num_streams; i++) {
+    if (use_shm) {
+      ipc::RingLayout layout;
+      layout.sample_rate = options.rate;
+      layout.num_channels = options.num_channels;
+      layout.frame_samples = frame_samples;
+      layout.num_slots = options.num_slots;
+      rings[i] = ipc::ShmRing::Create(GetRingName(i), layout, ipc::RingRole::kConsumer, options.spin_us);
+      if (!rings[i])
+        return false;
+    } else if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, &sockets[2 * i]) != 0) {
+      std::cerr << "socketpair() failed: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+  }
+  const int64_t start_ns = ipc::ShmRing::Now() + 200000000;
+  const std::string parent_pid = std::to_string(getpid());
+
+  pid_t child = fork();
+  if (child < 0) {
+    std::cerr << "fork() failed: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (child == 0) {
+    bool success = true;
+    std::vector<std::thread> senders;
+    std::atomic<bool> failed{ false };
+    for (unsigned i = 0; i < options.num_streams; i++) {
+      if (!use_shm)
+        close(sockets[2 * i]);
+      std::string ring_name = "ipc_bench." + parent_pid + "." + std::to_string(i);
+      int fd = use_shm ? -1 : sockets[2 * i + 1];
+      senders.emplace_back([&, i, ring_name, fd] {
+        if (!SendStream(options, i, start_ns, ring_name, fd))
+          failed = true;
+      });
+    }
+    for (std::thread& sender : senders)
+      sender.join();
+    success = !failed;
+    // Skips the destructors of the parent's rings, which would remove their names
+    _exit(success ? 0 : 1);
+  }
+
+  double cpu_begin = GetSelfCpuSecs();
+  std::vector<std::vector<double>> latencies(options.num_streams);
+  std::vector<uint64_t> frames(options.num_streams, 0);
+  std::vector<uint64_t> errors(options.num_streams, 0);
+  std::vector<std::thread> receivers;
+  for (unsigned i = 0; i < options.num_streams; i++) {
+    if (!use_shm)
+      close(sockets[2 * i + 1]);
+    receivers.emplace_back([&, i] {
+      ReceiveStream(options, rings[i].get(), use_shm ? -1 : sockets[2 * i], &latencies[i], &frames[i], &errors[i]);
+    });
+  }
+  for (std::thread& receiver : receivers)
+    receiver.join();
+  result->parent_cpu_secs = GetSelfCpuSecs() - cpu_begin;
+
+  int status = 0;
+  rusage child_usage;
+  if (wait4(child, &status, 0, &child_usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::cerr << "The capture process failed" << std::endl;
+    return false;
+  }
+  result->child_cpu_secs = GetCpuSecs(child_usage);
+  for (unsigned i = 0; i < options.num_streams; i++) {
+    result->latencies_us.insert(result->latencies_us.end(), latencies[i].begin(), latencies[i].end());
+    result->frames += frames[i];
+    result->errors += errors[i];
+    if (rings[i]) {
+      ipc::RingStats stats = rings[i]->GetStats();
+      result->ring_stats.spin_waits += stats.spin_waits;
+      result->ring_stats.sleep_waits += stats.sleep_waits;
+      result->ring_stats.wakes += stats.wakes;
+    } else {
+      close(sockets[2 * i]);
+    }
+  }
+  return true;
+}
+
+double GetPercentile(const std::vector<double>& sorted, double fraction) {
+  if (sorted.empty())
+    return 0.0;
+  return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+void PrintResult(const Options& options, const char* transport, Result* result) {
+  std::sort(result->latencies_us.begin(), result->latencies_us.end());
+  const double cpu_secs = result->parent_cpu_secs + result->child_cpu_secs;
+  std::cout << std::left << std::setw(8) << transport << std::right << std::fixed << std::setprecision(1)
+            << "latency p50 " << GetPercentile(result->latencies_us, 0.5) << " us, p99 "
+            << GetPercentile(result->latencies_us, 0.99) << " us, max "
+            << (result->latencies_us.empty() ? 0.0 : result->latencies_us.back()) << " us, CPU "
+            << std::setprecision(3) << 100.0 * cpu_secs / options.secs / options.num_streams << "% of a core per stream ("
+            << std::setprecision(1) << 1e6 * cpu_secs / std::max<uint64_t>(result->frames, 1) << " us per frame, effects "
+            << 1e6 * result->parent_cpu_secs / std::max<uint64_t>(result->frames, 1) << " us), " << result->frames
+            << " frames, " << result->errors << " wrong" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: ipc_bench [--transport both|shm|socket] [--streams N] [--secs S] [--frame-ms MS] [--rate HZ]"
+              << " [--channels N] [--slots N] [--spin-us US]" << std::endl;
+    return -1;
+  }
+  const unsigned frame_samples = static_cast<unsigned>(options.rate * options.frame_ms / 1000.0);
+  std::cout << options.num_streams << " streams of " << options.frame_ms << " ms frames (" << frame_samples << " x "
+            << options.num_channels << " samples) for " << options.secs << " secs, " << std::thread::hardware_concurrency()
+            << " cores" << std::endl;
+
+  bool success = true;
+  if (options.transport != "socket") {
+    Result result;
+    success = RunTransport(options, true, &result);
+    if (success) {
+      PrintResult(options, "shm", &result);
+      const uint64_t waits = result.ring_stats.spin_waits + result.ring_stats.sleep_waits;
+      std::cout << "        " << waits << " waits for a frame, " << result.ring_stats.spin_waits << " ended spinning, "
+                << result.ring_stats.sleep_waits << " slept on the futex, no copies" << std::endl;
+      success = result.errors == 0;
+    }
+  }
+  if (success && options.transport != "shm") {
+    Result result;
+    success = RunTransport(options, false, &result);
+    if (success) {
+      PrintResult(options, "socket", &result);
+      std::cout << "        2 copies and 2 system calls per frame" << std::endl;
+      success = result.errors == 0;
+    }
+  }
+  return success ? 0 : -1;
+}
@@ -0,0 +1,237 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Checks the loudness utilities (utils/dsp/Loudness) against known values and measures their
+// throughput: the vectorized K-weighting filter against the scalar biquad cascade, the true-peak
+// detector, the loudness meter and the streaming normalizer with its limiter.
+//
+// Usage: loudness_bench [--sample-rate N] [--secs S] [--runs N]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <utils/dsp/Loudness.hpp>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+struct Options {
+  uint32_t sample_rate = 48000;
+  double secs = 60.0;
+  int runs = 5;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    if (arg == "--sample-rate") {
+      options->sample_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->sample_rate < 8000 || options->secs <= 0.0 || options->runs <= 0) {
+    std::cerr << "--sample-rate must be >= 8000, --secs and --runs positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::vector<float> Sine(uint32_t sample_rate, double secs, double frequency, double amplitude) {
+  std::vector<float> signal(static_cast<size_t>(secs * sample_rate));
+  for (size_t i = 0; i < signal.size(); i++)
+    signal[i] = static_cast<float>(amplitude * std::sin(2.0 * kPi * frequency * i / sample_rate));
+  return signal;
+}
+
+// Speech-like test signal: noise bursts with a slow envelope and pauses
+std::vector<float> Bursts(uint32_t sample_rate, double secs, double amplitude) {
+  std::mt19937 generator(1);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  std::vector<float> signal(static_cast<size_t>(secs * sample_rate));
+  for (size_t i = 0; i < signal.size(); i++) {
+    double t = static_cast<double>(i) / sample_rate;
+    double envelope = std::max(0.0, std::sin(2.0 * kPi * 0.7 * t));
+    signal[i] = static_cast<float>(amplitude * envelope * noise(generator));
+  }
+  return signal;
+}
+
+double MaxTruePeakDb(const std::vector<float>& signal) {
+  dsp::TruePeakDetector detector;
+  std::vector<float> peaks(signal.size());
+  detector.Process(signal.data(), peaks.data(), signal.size());
+  float peak = *std::max_element(peaks.begin(), peaks.end());
+  return 20.0 * std::log10(peak);
+}
+
+// Best of runs, in million samples per second
+double Throughput(size_t num_samples, int runs, const std::function<void()>& body) {
+  double best = 1e30;
+  for (int run = 0; run < runs; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+  return num_samples / best / 1e6;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: loudness_bench [--sample-rate N] [--secs S] [--runs N]" << std::endl;
+    return -1;
+  }
+  const uint32_t rate = options.sample_rate;
+  bool passed = true;
+  std::cout << std::fixed << std::setprecision(2);
+
+  // A full scale 997 Hz sine reads -3.01 LUFS, so -20 dBFS reads -23.01 LUFS
+  {
+    std::vector<float> sine = Sine(rate, 20.0, 997.0, 0.1);
+    dsp::LoudnessMeter meter(rate);
+    meter.Add(sine.data(), sine.size());
+    double loudness = meter.GetIntegratedLoudness();
+    bool ok = std::fabs(loudness + 23.01) < 0.05;
+    passed = passed && ok;
+    std::cout << "997 Hz sine at -20 dBFS:        " << loudness << " LUFS (expected -23.01) "
+              << (ok ? "ok" : "FAILED") << std::endl;
+  }
+
+  std::vector<float> signal = Bursts(rate, options.secs, 0.05);
+  std::vector<float> output(signal.size());
+
+  // Vector and scalar K-weighting against a double precision cascade
+  {
+    dsp::BiquadCoefficients shelf, highpass;
+    dsp::KWeightingFilter::Design(rate, &shelf, &highpass);
+    double s[4] = {};
+    std::vector<double> reference(signal.size());
+    for (size_t i = 0; i < signal.size(); i++) {
+      double v = shelf.b0 * signal[i] + s[0];
+      s[0] = shelf.b1 * signal[i] - shelf.a1 * v + s[1];
+      s[1] = shelf.b2 * signal[i] - shelf.a2 * v;
+      double y = highpass.b0 * v + s[2];
+      s[2] = highpass.b1 * v - highpass.a1 * y + s[3];
+      s[3] = highpass.b2 * v - highpass.a2 * y;
+      reference[i] = y;
+    }
+    for (int vector = 0; vector < 2; vector++) {
+      dsp::KWeightingFilter filter(rate);
+      if (vector)
+        filter.Process(signal.data(), output.data(), signal.size());
+      else
+        filter.ProcessScalar(signal.data(), output.data(), signal.size());
+      double signal_energy = 0.0, error_energy = 0.0;
+      for (size_t i = 0; i < signal.size(); i++) {
+        signal_energy += reference[i] * reference[i];
+        error_energy += (reference[i] - output[i]) * (reference[i] - output[i]);
+      }
+      double snr = 10.0 * std::log10(signal_energy / error_energy);
+      bool ok = snr > 80.0;
+      passed = passed && ok;
+      std::cout << "K-weighting " << (vector ? "vector" : "scalar") << " vs double:     SNR " << snr << " dB "
+                << (ok ? "ok" : "FAILED") << std::endl;
+    }
+  }
+
+  // Streaming and two pass normalization to -23 LUFS, then to -10 LUFS where the limiter has to
+  // hold the true peak at -1 dBTP
+  dsp::LoudnessOptions loudness_options;
+  for (int run = 0; run < 4; run++) {
+    bool two_pass = run % 2 != 0;
+    loudness_options.target_lufs = run < 2 ? -23.0 : -10.0;
+    std::vector<float> normalized(signal);
+    dsp::LoudnessNormalizer normalizer(rate, loudness_options);
+    if (two_pass) {
+      dsp::LoudnessMeter meter(rate);
+      meter.Add(signal.data(), signal.size());
+      normalizer.SetKnownLoudness(meter.GetIntegratedLoudness());
+    }
+    normalizer.ProcessBuffer(normalized.data(), normalized.size());
+    dsp::LoudnessMeter meter(rate);
+    meter.Add(normalized.data(), normalized.size());
+    double loudness = meter.GetIntegratedLoudness();
+    double true_peak = MaxTruePeakDb(normalized);
+    // Limiting lowers the loudness a little
+    double tolerance = (two_pass ? 0.5 : 1.5) + normalizer.GetMaxReductionDb();
+    bool ok = std::fabs(loudness - loudness_options.target_lufs) < tolerance &&
+              true_peak < loudness_options.true_peak_db + 0.1;
+    passed = passed && ok;
+    std::cout << (two_pass ? "Two pass  " : "Streaming ") << "to " << std::setw(3) << std::setprecision(0)
+              << loudness_options.target_lufs << std::setprecision(2) << " LUFS:       " << loudness << " LUFS, true peak "
+              << true_peak << " dBTP, limiter max " << normalizer.GetMaxReductionDb() << " dB "
+              << (ok ? "ok" : "FAILED") << std::endl;
+  }
+
+  std::cout << std::endl << "Throughput (" << rate << " Hz, " << options.secs << " secs, best of " << options.runs
+            << ")" << std::endl;
+  std::cout << std::left << std::setw(28) << "Kernel" << std::setw(16) << "Msamples/s" << "x real time" << std::endl;
+  auto report = [&](const char* name, double msamples) {
+    std::cout << std::setw(28) << name << std::setw(16) << msamples << msamples * 1e6 / rate << std::endl;
+  };
+  dsp::KWeightingFilter filter(rate);
+  report("K-weighting scalar", Throughput(signal.size(), options.runs, [&] {
+           filter.ProcessScalar(signal.data(), output.data(), signal.size());
+         }));
+  report("K-weighting vector", Throughput(signal.size(), options.runs, [&] {
+           filter.Process(signal.data(), output.data(), signal.size());
+         }));
+  dsp::TruePeakDetector detector;
+  report("True peak 4x", Throughput(signal.size(), options.runs, [&] {
+           detector.Process(signal.data(), output.data(), signal.size());
+         }));
+  report("Loudness meter", Throughput(signal.size(), options.runs, [&] {
+           dsp::LoudnessMeter meter(rate);
+           meter.Add(signal.data(), signal.size());
+         }));
+  loudness_options.target_lufs = -23.0;
+  report("Normalizer + limiter", Throughput(signal.size(), options.runs, [&] {
+           std::copy(signal.begin(), signal.end(), output.begin());
+           dsp::LoudnessNormalizer normalizer(rate, loudness_options);
+           normalizer.Process(output.data(), output.size());
+         }));
+  std::cout << std::right;
+
+  return passed ? 0 : 1;
+}
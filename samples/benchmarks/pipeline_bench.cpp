@@ -0,0 +1,257 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Measures the per-frame overhead of the templated frame pipeline (utils/pipeline) against the
+// runtime dispatched frame loop effects_demo used before. The effect is a null stage that copies
+// input to output through a function pointer, like a call into the SDK library, so the timings
+// isolate the host side loop. The loops cycle over --block-frames frames of input that stay in the
+// cache; with --block-frames 0 they stream all --frames from memory, which mostly measures memory
+// bandwidth.
+//
+// Usage: pipeline_bench [--frames N] [--frame-size N] [--block-frames N] [--runs N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <utils/pipeline/EffectPipeline.hpp>
+
+namespace {
+
+typedef int (*RunFunction)(const float** input, float** output, unsigned num_samples, unsigned num_channels);
+
+// Null effect, first input channel to output
+int NullRun(const float** input, float** output, unsigned num_samples, unsigned) {
+  std::memcpy(output[0], input[0], num_samples * sizeof(float));
+  return 0;
+}
+
+// Stands in for the import table entry of NvAFX_Run
+RunFunction volatile g_run = NullRun;
+
+// Output sink replacing the wav writer
+struct Sink {
+  std::vector<float> data;
+  size_t position = 0;
+  double sum = 0.0;
+
+  void Write(const float* frame, unsigned num_samples) {
+    if (position + num_samples > data.size())
+      position = 0;
+    std::memcpy(&data[position], frame, num_samples * sizeof(float));
+    position += num_samples;
+    sum += frame[0];
+  }
+};
+
+struct Options {
+  size_t num_frames = 360000;  // 1 hour of 10 ms frames
+  unsigned frame_size = 480;
+  size_t block_frames = 64;
+  int runs = 5;
+};
+
+// Frame loop as it was written in effects_demo: channel layout and optional features are checked
+// for every frame. Runs over the input repeats times.
+double RunLegacyLoop(const std::vector<float>& nearend, const std::vector<float>& farend, bool is_aec,
+                     unsigned num_input_channels, unsigned frame_size, bool real_time, float checkpoint_interval,
+                     size_t repeats, Sink* sink) {
+  std::vector<float> frame(frame_size);
+  size_t progress = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t repeat = 0; repeat < repeats; repeat++) {
+    for (size_t offset = 0; offset < nearend.size(); offset += frame_size) {
+      if (is_aec) {
+        const float* input[2];
+        float* output[1];
+        input[0] = &nearend.data()[offset];
+        input[1] = &farend.data()[offset];
+        output[0] = frame.data();
+        if (g_run(input, output, frame_size, num_input_channels) != 0)
+          return -1.0;
+      } else {
+        const float* input[1];
+        float* output[1];
+        input[0] = &nearend.data()[offset];
+        output[0] = frame.data();
+        if (g_run(input, output, frame_size, num_input_channels) != 0)
+          return -1.0;
+      }
+      progress++;
+      sink->Write(frame.data(), frame_size);
+      if (checkpoint_interval > 0.f && progress % 1000000 == 0)
+        sink->sum = 0.0;
+      if (real_time)
+        sink->sum += 1.0;
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+class NullRunStage {
+ public:
+  explicit NullRunStage(unsigned frame_size) : frame_size_(frame_size) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    return g_run(frame.input, frame.output, frame_size_, FrameT::kNumInputChannels) == 0;
+  }
+
+ private:
+  const unsigned frame_size_;
+};
+
+class ProgressStage {
+ public:
+  template <typename FrameT>
+  bool Process(FrameT&) {
+    progress_++;
+    return true;
+  }
+
+ private:
+  size_t progress_ = 0;
+};
+
+class SinkStage {
+ public:
+  SinkStage(Sink* sink, unsigned frame_size) : sink_(sink), frame_size_(frame_size) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    sink_->Write(frame.output[0], frame_size_);
+    return true;
+  }
+
+ private:
+  Sink* sink_;
+  const unsigned frame_size_;
+};
+
+double RunPipeline(const std::vector<float>& nearend, const std::vector<float>& farend, unsigned num_input_channels,
+                   unsigned frame_size, size_t repeats, Sink* sink) {
+  std::vector<float> frame(frame_size);
+  const float* inputs[2] = { nearend.data(), farend.data() };
+  float* outputs[1] = { frame.data() };
+  NullRunStage run_stage(frame_size);
+  ProgressStage progress_stage;
+  SinkStage sink_stage(sink, frame_size);
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t repeat = 0; repeat < repeats; repeat++) {
+    if (!pipeline::Dispatch(num_input_channels, 1, frame_size, inputs, outputs, 0, nearend.size(), run_stage,
+                            progress_stage, sink_stage)) {
+      return -1.0;
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    if (arg == "--frames") {
+      options->num_frames = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--frame-size") {
+      options->frame_size = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--block-frames") {
+      options->block_frames = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->num_frames == 0 || options->frame_size == 0 || options->runs <= 0) {
+    std::cerr << "--frames, --frame-size and --runs must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: pipeline_bench [--frames N] [--frame-size N] [--block-frames N] [--runs N]" << std::endl;
+    return -1;
+  }
+
+  // A block that fits the cache is processed repeatedly, the whole input otherwise
+  size_t input_frames = options.num_frames;
+  size_t repeats = 1;
+  if (options.block_frames > 0 && options.block_frames < options.num_frames) {
+    input_frames = options.block_frames;
+    repeats = options.num_frames / options.block_frames;
+  }
+  const size_t num_frames = input_frames * repeats;
+  std::vector<float> nearend(input_frames * options.frame_size);
+  std::vector<float> farend(nearend.size());
+  for (size_t i = 0; i < nearend.size(); i++) {
+    nearend[i] = static_cast<float>(i % 997) / 997.f;
+    farend[i] = 1.f - nearend[i];
+  }
+  Sink sink;
+  sink.data.resize(options.frame_size * 64);
+
+  std::cout << num_frames << " frames of " << options.frame_size << " samples";
+  if (repeats > 1)
+    std::cout << " (" << repeats << " times a block of " << input_frames << ")";
+  std::cout << ", best of " << options.runs << " runs" << std::endl;
+  std::cout << std::left << std::setw(12) << "layout" << std::setw(18) << "loop ns/frame" << std::setw(18)
+            << "pipeline ns/frame" << "change" << std::endl;
+  for (unsigned num_input_channels = 1; num_input_channels <= 2; num_input_channels++) {
+    double best_loop = 1e30;
+    double best_pipeline = 1e30;
+    for (int run = 0; run < options.runs; run++) {
+      double loop_time = RunLegacyLoop(nearend, farend, num_input_channels == 2, num_input_channels,
+                                       options.frame_size, false, 0.f, repeats, &sink);
+      double pipeline_time = RunPipeline(nearend, farend, num_input_channels, options.frame_size, repeats, &sink);
+      if (loop_time < 0.0 || pipeline_time < 0.0) {
+        std::cerr << "Run failed" << std::endl;
+        return -1;
+      }
+      best_loop = std::min(best_loop, loop_time);
+      best_pipeline = std::min(best_pipeline, pipeline_time);
+    }
+    double loop_ns = best_loop * 1e9 / num_frames;
+    double pipeline_ns = best_pipeline * 1e9 / num_frames;
+    std::cout << std::left << std::setw(12) << (num_input_channels == 2 ? "2 in/1 out" : "1 in/1 out")
+              << std::fixed << std::setprecision(1) << std::setw(18) << loop_ns << std::setw(18) << pipeline_ns
+              << std::showpos << (pipeline_ns - loop_ns) / loop_ns * 100.0 << "%" << std::noshowpos << std::endl;
+  }
+  // Keeps the sink writes observable
+  if (sink.sum == 12345.0)
+    std::cout << std::endl;
+  return 0;
+}
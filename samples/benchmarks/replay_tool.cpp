@@ -0,0 +1,406 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Re-drives a session recorded with the replay_capture option of effects_demo (utils/replay): the
+// effects are created, configured and loaded as in the capture, then every Run and Reset is issued
+// with the captured input, either on the captured schedule (--timing original) or back to back
+// (--timing fast). Call latencies are reported next to the captured ones and each output is checked
+// against the captured hash, so a slow or non-deterministic build can be bisected offline.
+//
+// Usage: replay_tool LOG [--timing original|fast] [--csv FILE] [--dump]
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/replay/ReplayLog.hpp>
+
+#include <nvAudioEffects.h>
+
+namespace {
+
+// Calls more than this far behind the captured schedule count as late
+const double kLateMs = 1.0;
+
+struct Options {
+  std::string log;
+  bool original_timing = true;
+  // Per-run latencies
+  std::string csv;
+  // Only list the records
+  bool dump = false;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--dump") {
+      options->dump = true;
+      continue;
+    }
+    if (arg.compare(0, 2, "--") != 0) {
+      options->log = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--timing") {
+      if (value != "original" && value != "fast") {
+        std::cerr << "--timing expects original or fast" << std::endl;
+        return false;
+      }
+      options->original_timing = value == "original";
+    } else if (arg == "--csv") {
+      options->csv = value;
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return !options->log.empty();
+}
+
+// Latencies of one kind of call, in microseconds
+struct CallStats {
+  std::vector<double> captured;
+  std::vector<double> replayed;
+};
+
+double Percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0.0;
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+double Max(const std::vector<double>& values) {
+  return values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+}
+
+bool Dump(replay::LogReader& reader) {
+  replay::Record record;
+  std::cout << std::fixed << std::setprecision(3);
+  while (reader.Next(&record)) {
+    const replay::RecordHeader& header = record.header;
+    std::cout << std::setw(12) << header.timestamp_ns / 1e6 << " ms  handle " << header.handle << "  "
+              << std::left << std::setw(16) << replay::RecordTypeName(header.type) << std::right
+              << std::setw(10) << header.duration_ns / 1e3 << " us  status " << header.status;
+    replay::PayloadReader payload(record);
+    std::string param, value;
+    uint32_t u32;
+    float f32;
+    replay::RunInfo info;
+    switch (header.type) {
+    case replay::RecordType::kCreate:
+      if (payload.ReadU32(&u32) && payload.ReadString(&value))
+        std::cout << "  " << value << (u32 ? " (chained)" : "");
+      break;
+    case replay::RecordType::kSetString:
+      if (payload.ReadString(&param) && payload.ReadString(&value))
+        std::cout << "  " << param << " = " << value;
+      break;
+    case replay::RecordType::kSetFloat:
+      if (payload.ReadString(&param) && payload.ReadFloat(&f32))
+        std::cout << "  " << param << " = " << f32;
+      break;
+    case replay::RecordType::kSetU32:
+      if (payload.ReadString(&param) && payload.ReadU32(&u32))
+        std::cout << "  " << param << " = " << u32;
+      break;
+    case replay::RecordType::kSetStringList:
+    case replay::RecordType::kSetFloatList:
+      if (payload.ReadString(&param) && payload.ReadU32(&u32))
+        std::cout << "  " << param << " [" << u32 << " values]";
+      break;
+    case replay::RecordType::kRun:
+      if (payload.ReadRunInfo(&info))
+        std::cout << "  " << info.num_input_channels << "x" << info.num_input_samples << " -> "
+                  << info.num_output_channels << "x" << info.num_output_samples;
+      break;
+    default:
+      break;
+    }
+    std::cout << std::endl;
+  }
+  return !reader.IsTruncated();
+}
+
+class Replayer {
+ public:
+  explicit Replayer(const Options& options) : options_(options) {}
+  ~Replayer() {
+    for (auto& handle : handles_)
+      NvAFX_DestroyEffect(handle.second);
+  }
+
+  bool Run(replay::LogReader& reader);
+  // Prints the latency comparison, returns false if an output differs from the capture
+  bool Report() const;
+
+ private:
+  // Issues the call of a record, returns its status
+  NvAFX_Status issue(const replay::Record& record, NvAFX_Handle handle);
+  // Waits for the captured start of the record when replaying with the original timing
+  void wait(const replay::Record& record);
+
+ private:
+  const Options& options_;
+  std::map<uint32_t, NvAFX_Handle> handles_;
+  std::map<replay::RecordType, CallStats> stats_;
+  // Schedule anchor, set by the first Run: replay time = capture time + offset
+  bool anchored_ = false;
+  std::chrono::steady_clock::time_point anchor_;
+  uint64_t anchor_ns_ = 0;
+  size_t late_ = 0;
+  double max_late_ms_ = 0.0;
+  size_t output_mismatches_ = 0;
+  size_t status_mismatches_ = 0;
+  size_t skipped_ = 0;
+  size_t runs_ = 0;
+  std::vector<float> output_;
+  std::vector<float*> output_channels_;
+  std::vector<const float*> input_channels_;
+  std::ofstream csv_;
+};
+
+void Replayer::wait(const replay::Record& record) {
+  if (!options_.original_timing)
+    return;
+  if (!anchored_) {
+    if (record.header.type != replay::RecordType::kRun)
+      return;
+    anchored_ = true;
+    anchor_ = std::chrono::steady_clock::now();
+    anchor_ns_ = record.header.timestamp_ns;
+    return;
+  }
+  auto due = anchor_ + std::chrono::nanoseconds(record.header.timestamp_ns - anchor_ns_);
+  auto now = std::chrono::steady_clock::now();
+  if (now < due) {
+    std::this_thread::sleep_until(due);
+    return;
+  }
+  double late_ms = std::chrono::duration<double, std::milli>(now - due).count();
+  if (late_ms > kLateMs)
+    late_++;
+  max_late_ms_ = std::max(max_late_ms_, late_ms);
+}
+
+NvAFX_Status Replayer::issue(const replay::Record& record, NvAFX_Handle handle) {
+  replay::PayloadReader payload(record);
+  std::string param, value;
+  uint32_t u32;
+  float f32;
+  switch (record.header.type) {
+  case replay::RecordType::kSetString:
+    if (!payload.ReadString(&param) || !payload.ReadString(&value))
+      break;
+    return NvAFX_SetString(handle, param.c_str(), value.c_str());
+  case replay::RecordType::kSetStringList: {
+    if (!payload.ReadString(&param) || !payload.ReadU32(&u32))
+      break;
+    std::vector<std::string> values(u32);
+    std::vector<const char*> pointers(u32);
+    for (uint32_t i = 0; i < u32; i++) {
+      if (!payload.ReadString(&values[i]))
+        return NVAFX_STATUS_FAILED;
+      pointers[i] = values[i].c_str();
+    }
+    return NvAFX_SetStringList(handle, param.c_str(), pointers.data(), u32);
+  }
+  case replay::RecordType::kSetFloat:
+    if (!payload.ReadString(&param) || !payload.ReadFloat(&f32))
+      break;
+    return NvAFX_SetFloat(handle, param.c_str(), f32);
+  case replay::RecordType::kSetFloatList: {
+    const float* values;
+    if (!payload.ReadString(&param) || !payload.ReadU32(&u32) || !payload.ReadFloats(&values, u32))
+      break;
+    std::vector<float> copy(values, values + u32);
+    return NvAFX_SetFloatList(handle, param.c_str(), copy.data(), u32);
+  }
+  case replay::RecordType::kSetU32:
+    if (!payload.ReadString(&param) || !payload.ReadU32(&u32))
+      break;
+    return NvAFX_SetU32(handle, param.c_str(), u32);
+  case replay::RecordType::kLoad:
+    return NvAFX_Load(handle);
+  case replay::RecordType::kReset:
+    return NvAFX_Reset(handle);
+  case replay::RecordType::kDestroy:
+    return NvAFX_DestroyEffect(handle);
+  default:
+    break;
+  }
+  return NVAFX_STATUS_FAILED;
+}
+
+bool Replayer::Run(replay::LogReader& reader) {
+  if (!options_.csv.empty()) {
+    csv_.open(options_.csv, std::ios_base::out | std::ios_base::trunc);
+    if (!csv_.good()) {
+      std::cerr << "Unable to write " << options_.csv << std::endl;
+      return false;
+    }
+    csv_ << "run,handle,captured_us,replayed_us,output_match" << std::endl;
+  }
+
+  replay::Record record;
+  while (reader.Next(&record)) {
+    const replay::RecordHeader& header = record.header;
+    wait(record);
+
+    NvAFX_Status status = NVAFX_STATUS_FAILED;
+    double replayed_us = 0.0;
+    if (header.type == replay::RecordType::kCreate) {
+      replay::PayloadReader payload(record);
+      uint32_t chained;
+      std::string effect;
+      if (!payload.ReadU32(&chained) || !payload.ReadString(&effect)) {
+        skipped_++;
+        continue;
+      }
+      NvAFX_Handle handle = nullptr;
+      auto begin = std::chrono::steady_clock::now();
+      status = chained ? NvAFX_CreateChainedEffect(effect.c_str(), &handle)
+                       : NvAFX_CreateEffect(effect.c_str(), &handle);
+      replayed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "Unable to create " << effect << " for handle " << header.handle << std::endl;
+        return false;
+      }
+      handles_[header.handle] = handle;
+    } else {
+      auto it = handles_.find(header.handle);
+      if (it == handles_.end()) {
+        skipped_++;
+        continue;
+      }
+      NvAFX_Handle handle = it->second;
+      if (header.type == replay::RecordType::kRun) {
+        replay::PayloadReader payload(record);
+        replay::RunInfo info;
+        if (!payload.ReadRunInfo(&info) || info.num_input_channels == 0) {
+          skipped_++;
+          continue;
+        }
+        input_channels_.resize(info.num_input_channels);
+        bool complete = true;
+        for (auto& channel : input_channels_)
+          complete = complete && payload.ReadFloats(&channel, info.num_input_samples);
+        if (!complete) {
+          skipped_++;
+          continue;
+        }
+        output_.assign(static_cast<size_t>(info.num_output_samples) * info.num_output_channels, 0.f);
+        output_channels_.resize(info.num_output_channels);
+        for (uint32_t c = 0; c < info.num_output_channels; c++)
+          output_channels_[c] = output_.data() + c * info.num_output_samples;
+
+        auto begin = std::chrono::steady_clock::now();
+        status = NvAFX_Run(handle, input_channels_.data(), output_channels_.data(), info.num_input_samples,
+                           info.num_input_channels);
+        replayed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        bool match = replay::OutputHash(output_channels_.data(), info.num_output_channels,
+                                        info.num_output_samples) == info.output_hash;
+        if (!match)
+          output_mismatches_++;
+        if (csv_.is_open()) {
+          csv_ << runs_ << "," << header.handle << "," << header.duration_ns / 1e3 << "," << replayed_us << ","
+               << (match ? 1 : 0) << "\n";
+        }
+        runs_++;
+      } else {
+        auto begin = std::chrono::steady_clock::now();
+        status = issue(record, handle);
+        replayed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        if (header.type == replay::RecordType::kDestroy)
+          handles_.erase(it);
+      }
+    }
+    if (static_cast<int32_t>(status) != header.status)
+      status_mismatches_++;
+    CallStats& stats = stats_[header.type];
+    stats.captured.push_back(header.duration_ns / 1e3);
+    stats.replayed.push_back(replayed_us);
+  }
+  if (reader.IsTruncated())
+    std::cerr << "Log ends in a damaged record, replayed up to it" << std::endl;
+  return true;
+}
+
+bool Replayer::Report() const {
+  std::cout << std::left << std::setw(16) << "call" << std::right << std::setw(8) << "count" << std::setw(30)
+            << "captured p50 / p99 / max us" << std::setw(30) << "replayed p50 / p99 / max us" << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  for (const auto& entry : stats_) {
+    const CallStats& stats = entry.second;
+    std::ostringstream captured, replayed;
+    captured << std::fixed << std::setprecision(1) << Percentile(stats.captured, 0.5) << " / "
+             << Percentile(stats.captured, 0.99) << " / " << Max(stats.captured);
+    replayed << std::fixed << std::setprecision(1) << Percentile(stats.replayed, 0.5) << " / "
+             << Percentile(stats.replayed, 0.99) << " / " << Max(stats.replayed);
+    std::cout << std::left << std::setw(16) << replay::RecordTypeName(entry.first) << std::right << std::setw(8)
+              << stats.captured.size() << std::setw(30) << captured.str() << std::setw(30) << replayed.str()
+              << std::endl;
+  }
+  if (options_.original_timing)
+    std::cout << "Late calls (> " << kLateMs << " ms): " << late_ << ", max " << max_late_ms_ << " ms" << std::endl;
+  std::cout << "Outputs matching the capture: " << runs_ - output_mismatches_ << " / " << runs_ << std::endl;
+  if (status_mismatches_ > 0)
+    std::cout << "Calls returning a different status: " << status_mismatches_ << std::endl;
+  if (skipped_ > 0)
+    std::cout << "Records skipped: " << skipped_ << std::endl;
+  return output_mismatches_ == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: replay_tool LOG [--timing original|fast] [--csv FILE] [--dump]" << std::endl;
+    return -1;
+  }
+  replay::LogReader reader;
+  if (!reader.Open(options.log))
+    return -1;
+  if (options.dump)
+    return Dump(reader) ? 0 : -1;
+
+  Replayer replayer(options);
+  bool success = replayer.Run(reader);
+  success = replayer.Report() && success;
+  return success ? 0 : -1;
+}
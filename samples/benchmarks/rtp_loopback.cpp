@@ -0,0 +1,384 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Local RTP sender for testing network input. Streams a wav file as RTP at its real-time rate to
+// --dest, with injected network jitter (each packet is delayed by up to --jitter-ms, so packets
+// overtake each other), loss bursts and duplicates. The first packet is always sent on time.
+//   Default mode: effects_demo receives the stream (input_wav rtp://...) and sends its output
+//   (output_wav rtp://...) back to --listen. The received audio is written to --output, with the
+//   end-to-end latency of each output packet beyond its own duration.
+//   --local: the stream is received here by an rtp::RtpSource in --frame-ms frames, standing in
+//   for effects_demo, and written to --output with the jitter buffer report and the SNR against
+//   the input.
+//
+// Usage: rtp_loopback --input in.wav [--dest host:port] [--listen port] [--output out.wav] [--local]
+//                     [--format l16|float] [--packet-ms MS] [--jitter-ms MS] [--loss P] [--burst N]
+//                     [--duplicate P] [--seed N] [--frame-ms MS] [--output-rate HZ] [--min-delay-ms MS]
+//                     [--max-delay-ms MS]
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/audio_io/AudioStream.hpp>
+#include <utils/rtp/RtpStream.hpp>
+
+namespace {
+
+struct Options {
+  std::string input;
+  std::string output = "rtp_loopback_out.wav";
+  std::string dest_host = "127.0.0.1";
+  uint16_t dest_port = 5004;
+  uint16_t listen_port = 0;
+  bool local = false;
+  std::string format = "l16";
+  double packet_ms = 20.0;
+  double jitter_ms = 0.0;
+  // Probability that a loss burst of burst packets starts at a packet
+  double loss = 0.0;
+  unsigned burst = 1;
+  double duplicate = 0.0;
+  unsigned seed = 1;
+  double frame_ms = 10.0;
+  // Format of the returned stream, the input rate if 0
+  uint32_t output_rate = 0;
+  double min_delay_ms = 20.0;
+  double max_delay_ms = 200.0;
+};
+
+bool ParseHostPort(const std::string& text, std::string* host, uint16_t* port) {
+  std::size_t colon = text.rfind(':');
+  long value = std::strtol(text.c_str() + (colon == std::string::npos ? 0 : colon + 1), nullptr, 10);
+  if (value <= 0 || value > 65535)
+    return false;
+  if (colon != std::string::npos)
+    *host = text.substr(0, colon);
+  *port = static_cast<uint16_t>(value);
+  return true;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--local") {
+      options->local = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--input") {
+      options->input = value;
+    } else if (arg == "--output") {
+      options->output = value;
+    } else if (arg == "--dest") {
+      if (!ParseHostPort(value, &options->dest_host, &options->dest_port)) {
+        std::cerr << "--dest must be host:port" << std::endl;
+        return false;
+      }
+    } else if (arg == "--listen") {
+      options->listen_port = static_cast<uint16_t>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--format") {
+      if (value != "l16" && value != "float") {
+        std::cerr << "--format must be l16 or float" << std::endl;
+        return false;
+      }
+      options->format = value;
+    } else if (arg == "--packet-ms") {
+      options->packet_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--jitter-ms") {
+      options->jitter_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--loss") {
+      options->loss = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--burst") {
+      options->burst = std::max(1u, static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10)));
+    } else if (arg == "--duplicate") {
+      options->duplicate = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--seed") {
+      options->seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--frame-ms") {
+      options->frame_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--output-rate") {
+      options->output_rate = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--min-delay-ms") {
+      options->min_delay_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--max-delay-ms") {
+      options->max_delay_ms = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return !options->input.empty() && options->packet_ms > 0.0 && options->frame_ms > 0.0;
+}
+
+struct SendStats {
+  size_t packets = 0;
+  size_t dropped = 0;
+  size_t duplicated = 0;
+  // Sent after a packet with a higher sequence number
+  size_t reordered = 0;
+};
+
+// Sends audio in packets on the schedule of a jittery network, starting at start_secs
+SendStats SendStream(const Options& options, const std::vector<float>& audio, uint32_t sample_rate,
+                     uint32_t num_channels, double start_secs) {
+  struct Send {
+    double time;
+    size_t packet;
+  };
+  const rtp::PayloadFormat format = options.format == "l16" ? rtp::PayloadFormat::kL16 : rtp::PayloadFormat::kFloat32;
+  const size_t packet_frames = std::max<size_t>(1, static_cast<size_t>(options.packet_ms * sample_rate / 1000.0));
+  const size_t num_frames = audio.size() / num_channels;
+  const size_t num_packets = (num_frames + packet_frames - 1) / packet_frames;
+
+  std::mt19937 random(options.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  SendStats stats;
+  std::vector<Send> schedule;
+  unsigned burst_left = 0;
+  for (size_t i = 0; i < num_packets; i++) {
+    double nominal = static_cast<double>(i * packet_frames) / sample_rate;
+    if (i > 0 && burst_left == 0 && uniform(random) < options.loss)
+      burst_left = options.burst;
+    if (i > 0 && burst_left > 0) {
+      burst_left--;
+      stats.dropped++;
+      continue;
+    }
+    double delay = i > 0 ? uniform(random) * options.jitter_ms / 1000.0 : 0.0;
+    schedule.push_back({ nominal + delay, i });
+    if (i > 0 && uniform(random) < options.duplicate) {
+      schedule.push_back({ nominal + delay + 0.001, i });
+      stats.duplicated++;
+    }
+  }
+  std::stable_sort(schedule.begin(), schedule.end(), [](const Send& a, const Send& b) { return a.time < b.time; });
+
+  rtp::UdpSocket socket;
+  if (!socket.Connect(options.dest_host, options.dest_port))
+    return stats;
+  std::random_device seed;
+  rtp::RtpHeader header;
+  header.payload_type = 96;
+  const uint16_t first_sequence = static_cast<uint16_t>(seed());
+  const uint32_t first_timestamp = seed();
+  header.ssrc = seed();
+  std::vector<uint8_t> packet(rtp::kRtpHeaderSize + packet_frames * num_channels * rtp::GetBytesPerSample(format));
+  size_t highest_sent = 0;
+  for (const Send& send : schedule) {
+    double wait = start_secs + send.time - rtp::Now();
+    if (wait > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    size_t first_frame = send.packet * packet_frames;
+    size_t frames = std::min(packet_frames, num_frames - first_frame);
+    header.marker = send.packet == 0;
+    header.sequence = static_cast<uint16_t>(first_sequence + send.packet);
+    header.timestamp = first_timestamp + static_cast<uint32_t>(first_frame);
+    rtp::WriteRtpHeader(header, packet.data());
+    rtp::EncodePayload(format, audio.data() + first_frame * num_channels, frames * num_channels,
+                       packet.data() + rtp::kRtpHeaderSize);
+    socket.Send(packet.data(), rtp::kRtpHeaderSize + frames * num_channels * rtp::GetBytesPerSample(format));
+    stats.packets++;
+    if (send.packet < highest_sent)
+      stats.reordered++;
+    highest_sent = std::max(highest_sent, send.packet);
+  }
+  return stats;
+}
+
+// Receives the stream returned by effects_demo. The output is placed by timestamp, gaps stay silent.
+struct ReturnStream {
+  std::vector<float> audio;
+  size_t packets = 0;
+  double latency_sum_ms = 0.0;
+  double min_latency_ms = 1e9;
+  double max_latency_ms = 0.0;
+};
+
+void ReceiveStream(rtp::UdpSocket* socket, rtp::PayloadFormat format, uint32_t sample_rate, double start_secs,
+                   const std::atomic<bool>* sending, ReturnStream* result) {
+  const double kIdleSecs = 2.0;
+  std::vector<uint8_t> datagram(65536);
+  std::vector<float> samples;
+  bool started = false;
+  int64_t first_timestamp = 0;
+  int64_t last_timestamp = 0;
+  double last_arrival = rtp::Now();
+  while (*sending || rtp::Now() - last_arrival < kIdleSecs) {
+    int size = socket->Receive(datagram.data(), datagram.size(), 100);
+    if (size <= 0)
+      continue;
+    double arrival = rtp::Now();
+    rtp::RtpHeader header;
+    const uint8_t* payload;
+    size_t payload_size;
+    if (!rtp::ParseRtpPacket(datagram.data(), static_cast<size_t>(size), &header, &payload, &payload_size))
+      continue;
+    size_t num_frames = payload_size / rtp::GetBytesPerSample(format);
+    int64_t timestamp;
+    if (!started) {
+      started = true;
+      first_timestamp = last_timestamp = header.timestamp;
+    }
+    timestamp = last_timestamp + static_cast<int32_t>(header.timestamp - static_cast<uint32_t>(last_timestamp));
+    last_timestamp = std::max(last_timestamp, timestamp);
+    last_arrival = arrival;
+    size_t position = static_cast<size_t>(timestamp - first_timestamp);
+    samples.resize(num_frames);
+    rtp::DecodePayload(format, payload, num_frames, samples.data());
+    if (result->audio.size() < position + num_frames)
+      result->audio.resize(position + num_frames, 0.f);
+    std::copy(samples.begin(), samples.end(), result->audio.begin() + position);
+    // The packet could not have been complete before the input up to its end was sent
+    double latency_ms = (arrival - start_secs - static_cast<double>(position + num_frames) / sample_rate) * 1000.0;
+    result->latency_sum_ms += latency_ms;
+    result->min_latency_ms = std::min(result->min_latency_ms, latency_ms);
+    result->max_latency_ms = std::max(result->max_latency_ms, latency_ms);
+    result->packets++;
+  }
+}
+
+bool WriteOutput(const std::string& path, const std::vector<float>& audio, uint32_t sample_rate,
+                 uint32_t num_channels) {
+  std::unique_ptr<audio_io::AudioSink> sink = audio_io::CreateAudioSink(path, sample_rate, num_channels);
+  if (!sink || !sink->Write(audio.data(), static_cast<uint32_t>(audio.size())) || !sink->Commit()) {
+    std::cerr << "Unable to write " << path << std::endl;
+    return false;
+  }
+  std::cout << "Output written to " << path << std::endl;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: rtp_loopback --input in.wav [--dest host:port] [--listen port] [--output out.wav] [--local]"
+              << std::endl
+              << "                    [--format l16|float] [--packet-ms MS] [--jitter-ms MS] [--loss P] [--burst N]"
+              << std::endl
+              << "                    [--duplicate P] [--seed N] [--frame-ms MS] [--output-rate HZ]"
+              << " [--min-delay-ms MS] [--max-delay-ms MS]" << std::endl;
+    return -1;
+  }
+  std::unique_ptr<audio_io::AudioSource> input = audio_io::OpenAudioSource(options.input);
+  if (!input)
+    return -1;
+  const uint32_t sample_rate = input->GetSampleRate();
+  const uint32_t num_channels = input->GetNumChannels();
+  std::vector<float> audio;
+  std::vector<float> block(4096 * num_channels);
+  uint32_t num_read;
+  while ((num_read = input->Read(block.data(), static_cast<uint32_t>(block.size()))) > 0)
+    audio.insert(audio.end(), block.begin(), block.begin() + num_read);
+
+  std::cout << std::fixed << std::setprecision(2) << "Sending " << options.input << " ("
+            << static_cast<double>(audio.size()) / num_channels / sample_rate << " secs, " << sample_rate << " Hz, "
+            << num_channels << " channel(s)) to " << options.dest_host << ":" << options.dest_port << " as "
+            << options.format << " in " << options.packet_ms << " ms packets, jitter up to " << options.jitter_ms
+            << " ms, loss " << options.loss * 100.0 << "% in bursts of " << options.burst << ", duplicates "
+            << options.duplicate * 100.0 << "%" << std::endl;
+
+  if (options.local) {
+    std::string url = "rtp://0.0.0.0:" + std::to_string(options.dest_port) + "?rate=" + std::to_string(sample_rate) +
+                      "&channels=" + std::to_string(num_channels) + "&format=" + options.format +
+                      "&min_delay_ms=" + std::to_string(options.min_delay_ms) +
+                      "&max_delay_ms=" + std::to_string(options.max_delay_ms);
+    std::unique_ptr<rtp::RtpSource> source = rtp::OpenRtpSource(url);
+    if (!source)
+      return -1;
+    std::vector<float> received;
+    std::thread reader([&]() {
+      std::vector<float> frame(static_cast<size_t>(options.frame_ms * sample_rate / 1000.0) * num_channels);
+      uint32_t count;
+      while ((count = source->Read(frame.data(), static_cast<uint32_t>(frame.size()))) > 0)
+        received.insert(received.end(), frame.begin(), frame.begin() + count);
+    });
+    SendStats sent = SendStream(options, audio, sample_rate, num_channels, rtp::Now());
+    reader.join();
+    std::cout << "Sent " << sent.packets << " packets, " << sent.dropped << " dropped, " << sent.duplicated
+              << " duplicated, " << sent.reordered << " reordered" << std::endl;
+    source->PrintReport(std::cout);
+
+    // Playout starts at the first packet, so the received stream is aligned with the input
+    size_t compared = std::min(received.size(), audio.size());
+    double signal = 0.0, error = 0.0;
+    for (size_t i = 0; i < compared; i++) {
+      signal += static_cast<double>(audio[i]) * audio[i];
+      error += static_cast<double>(received[i] - audio[i]) * (received[i] - audio[i]);
+    }
+    if (compared > 0) {
+      std::cout << "SNR against the input: "
+                << (error > 0.0 ? 10.0 * std::log10(signal / error) : INFINITY) << " dB over "
+                << static_cast<double>(compared) / num_channels / sample_rate << " secs" << std::endl;
+    }
+    return WriteOutput(options.output, received, sample_rate, num_channels) ? 0 : -1;
+  }
+
+  const rtp::PayloadFormat format = options.format == "l16" ? rtp::PayloadFormat::kL16 : rtp::PayloadFormat::kFloat32;
+  const uint32_t output_rate = options.output_rate ? options.output_rate : sample_rate;
+  rtp::UdpSocket return_socket;
+  if (options.listen_port && !return_socket.Bind("0.0.0.0", options.listen_port))
+    return -1;
+  std::atomic<bool> sending{ true };
+  ReturnStream returned;
+  double start = rtp::Now();
+  std::thread receiver;
+  if (options.listen_port)
+    receiver = std::thread(ReceiveStream, &return_socket, format, output_rate, start, &sending, &returned);
+  SendStats sent = SendStream(options, audio, sample_rate, num_channels, start);
+  std::cout << "Sent " << sent.packets << " packets, " << sent.dropped << " dropped, " << sent.duplicated
+            << " duplicated, " << sent.reordered << " reordered" << std::endl;
+  if (!options.listen_port)
+    return 0;
+  sending = false;
+  receiver.join();
+  if (returned.packets == 0) {
+    std::cerr << "Nothing received on port " << options.listen_port << std::endl;
+    return -1;
+  }
+  std::cout << "Received " << returned.packets << " packets, "
+            << static_cast<double>(returned.audio.size()) / output_rate << " secs at " << output_rate << " Hz"
+            << std::endl
+            << "End-to-end latency beyond the packet duration: " << returned.latency_sum_ms / returned.packets
+            << " ms average, " << returned.min_latency_ms << " ms min, " << returned.max_latency_ms << " ms max"
+            << std::endl;
+  return WriteOutput(options.output, returned.audio, output_rate, 1) ? 0 : -1;
+}
@@ -0,0 +1,208 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Exercises the device scheduler (utils/scheduler) on simulated devices of different speeds, so the
+// placement and rebalancing can be checked on machines without GPUs. Jobs of varying length are
+// run with the scheduler and with a static round robin assignment for comparison. --saturate slows
+// a device down while the jobs run.
+//
+// Usage: scheduler_sim [--speeds 40,20,10] [--instances N] [--jobs N] [--job-secs S]
+//                      [--saturate DEVICE:SPEED:AFTER_SECS] [--seed N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/scheduler/DeviceScheduler.hpp>
+#include <utils/scheduler/SimulatedBackend.hpp>
+
+namespace {
+
+struct Options {
+  // Multiples of real time
+  std::vector<double> speeds = { 40.0, 20.0, 10.0 };
+  unsigned instances = 1;
+  size_t num_jobs = 48;
+  double job_secs = 4.0;
+  int saturate_device = -1;
+  double saturate_speed = 0.0;
+  double saturate_after_secs = 0.0;
+  unsigned seed = 1;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--speeds") {
+      options->speeds.clear();
+      std::istringstream list(value);
+      std::string speed;
+      while (std::getline(list, speed, ','))
+        options->speeds.push_back(std::strtod(speed.c_str(), nullptr));
+    } else if (arg == "--instances") {
+      options->instances = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--jobs") {
+      options->num_jobs = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (arg == "--job-secs") {
+      options->job_secs = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--saturate") {
+      char separator;
+      std::istringstream fields(value);
+      if (!(fields >> options->saturate_device >> separator >> options->saturate_speed >> separator >>
+            options->saturate_after_secs)) {
+        std::cerr << "--saturate expects DEVICE:SPEED:AFTER_SECS" << std::endl;
+        return false;
+      }
+    } else if (arg == "--seed") {
+      options->seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->speeds.empty() || options->instances == 0 || options->num_jobs == 0 || options->job_secs <= 0.0 ||
+      options->saturate_device >= static_cast<int>(options->speeds.size())) {
+    std::cerr << "Invalid options" << std::endl;
+    return false;
+  }
+  for (double speed : options->speeds) {
+    if (speed <= 0.0) {
+      std::cerr << "--speeds must be positive" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Applies --saturate after the configured delay
+class Saturation {
+ public:
+  Saturation(const Options& options, scheduler::SimulatedBackend* backend) {
+    if (options.saturate_device < 0)
+      return;
+    thread_ = std::thread([&options, backend] {
+      std::this_thread::sleep_for(std::chrono::duration<double>(options.saturate_after_secs));
+      backend->SetSpeed(options.saturate_device, options.saturate_speed);
+    });
+  }
+  ~Saturation() {
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+ private:
+  std::thread thread_;
+};
+
+double RunScheduler(const Options& options, const std::vector<double>& jobs) {
+  scheduler::SimulatedBackend backend(options.speeds);
+  scheduler::DeviceScheduler device_scheduler(&backend, options.instances);
+  if (!device_scheduler.Start())
+    return -1.0;
+
+  auto start = std::chrono::steady_clock::now();
+  Saturation saturation(options, &backend);
+  for (double audio_secs : jobs) {
+    scheduler::Job job;
+    job.audio_secs = audio_secs;
+    job.run = [&backend, audio_secs](void* instance, int) { return backend.Process(instance, audio_secs); };
+    device_scheduler.Submit(std::move(job));
+  }
+  if (!device_scheduler.Wait())
+    return -1.0;
+  double wall_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  device_scheduler.PrintStats(std::cout);
+  return wall_secs;
+}
+
+// Static assignment, job i goes to instance i modulo the number of instances
+double RunRoundRobin(const Options& options, const std::vector<double>& jobs) {
+  scheduler::SimulatedBackend backend(options.speeds);
+  const size_t num_workers = options.speeds.size() * options.instances;
+  auto start = std::chrono::steady_clock::now();
+  Saturation saturation(options, &backend);
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < num_workers; w++) {
+    workers.emplace_back([&, w] {
+      int device = static_cast<int>(w % options.speeds.size());
+      void* instance = backend.CreateInstance(device);
+      for (size_t i = w; i < jobs.size(); i += num_workers)
+        backend.Process(instance, jobs[i]);
+      backend.DestroyInstance(instance);
+    });
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: scheduler_sim [--speeds 40,20,10] [--instances N] [--jobs N] [--job-secs S]"
+              << " [--saturate DEVICE:SPEED:AFTER_SECS] [--seed N]" << std::endl;
+    return -1;
+  }
+
+  // Job lengths vary between half and one and a half times --job-secs
+  std::mt19937 generator(options.seed);
+  std::uniform_real_distribution<double> length(0.5 * options.job_secs, 1.5 * options.job_secs);
+  std::vector<double> jobs(options.num_jobs);
+  double total_secs = 0.0;
+  for (double& job : jobs) {
+    job = length(generator);
+    total_secs += job;
+  }
+
+  double capacity = 0.0;
+  for (double speed : options.speeds)
+    capacity += speed * options.instances;
+  std::cout << options.num_jobs << " jobs, " << std::fixed << std::setprecision(1) << total_secs << " secs of audio on "
+            << options.speeds.size() << " devices x " << options.instances << " instances, ideal wall time "
+            << std::setprecision(3) << total_secs / capacity << " secs" << std::endl;
+  std::cout.unsetf(std::ios_base::floatfield);
+
+  double scheduler_secs = RunScheduler(options, jobs);
+  if (scheduler_secs < 0.0) {
+    std::cerr << "Scheduler run failed" << std::endl;
+    return -1;
+  }
+  double round_robin_secs = RunRoundRobin(options, jobs);
+  std::cout << std::fixed << std::setprecision(3) << "Scheduler wall time   " << scheduler_secs << " secs" << std::endl
+            << "Round robin wall time " << round_robin_secs << " secs" << std::endl;
+  return 0;
+}
@@ -0,0 +1,369 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Load test of the coroutine session API (utils/session): many streams, each a coroutine sending a
+// frame every --frame-ms at its own phase, on a few threads. Batches run on a simulated effect which
+// sleeps like one of NVAFX_PARAM_NUM_STREAMS streams would and returns half its input, which every
+// session checks. Reports the frame latency from the time a frame was due until its session resumed,
+// and the memory per session. Needs C++20.
+//
+// The session_load_sdk build runs the batches on SDK handles instead with --sdk EFFECT --model PATH,
+// through session::NvAFXBatchRunner. The frame sizes then come from the effect, --rate and the
+// simulated costs are ignored and outputs are not checked.
+//
+// Usage: session_load [--sessions N] [--threads N] [--streams N] [--secs S] [--frame-ms MS]
+//                     [--rate HZ] [--batch-overhead-us US] [--stream-cost-us US] [--max-wait-ms MS]
+//                     [--phase-window-ms MS] [--seed N] [--sdk EFFECT --model PATH]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#include <utils/session/SimulatedBatchRunner.hpp>
+#include <utils/session/StreamSession.hpp>
+#ifdef NVAFX_SESSION_SDK
+#include <utils/session/NvAFXBatchRunner.hpp>
+#endif
+
+namespace {
+
+using session::Clock;
+
+struct Options {
+  size_t num_sessions = 1000;
+  unsigned num_threads = 4;
+  unsigned num_streams = 64;
+  double secs = 10.0;
+  double frame_ms = 10.0;
+  unsigned rate = 48000;
+  unsigned batch_overhead_us = 300;
+  unsigned stream_cost_us = 10;
+  double max_wait_ms = 5.0;
+  double phase_window_ms = 1.0;
+  unsigned seed = 1;
+  // Effect and model of the SDK handles, empty for the simulated effect
+  std::string sdk_effect;
+  std::string model;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--sessions") {
+      options->num_sessions = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (arg == "--threads") {
+      options->num_threads = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--streams") {
+      options->num_streams = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--frame-ms") {
+      options->frame_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--rate") {
+      options->rate = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--batch-overhead-us") {
+      options->batch_overhead_us = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--stream-cost-us") {
+      options->stream_cost_us = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--max-wait-ms") {
+      options->max_wait_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--phase-window-ms") {
+      options->phase_window_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--seed") {
+      options->seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--sdk") {
+      options->sdk_effect = value;
+    } else if (arg == "--model") {
+      options->model = value;
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->num_sessions == 0 || options->num_threads == 0 || options->num_streams == 0 || options->secs <= 0.0 ||
+      options->frame_ms <= 0.0 || options->rate == 0 || options->max_wait_ms < 0.0 ||
+      options->phase_window_ms < 0.0) {
+    std::cerr << "Invalid options" << std::endl;
+    return false;
+  }
+  if (options->sdk_effect.empty() != options->model.empty()) {
+    std::cerr << "--sdk and --model go together" << std::endl;
+    return false;
+  }
+#ifndef NVAFX_SESSION_SDK
+  if (!options->sdk_effect.empty()) {
+    std::cerr << "This build has no SDK, --sdk needs session_load_sdk" << std::endl;
+    return false;
+  }
+#endif
+  return true;
+}
+
+// Latencies in buckets of 10 us up to 1 s, filled by all threads
+class LatencyHistogram {
+ public:
+  static const size_t kBucketUs = 10;
+  static const size_t kNumBuckets = 100000;
+
+  LatencyHistogram() : buckets_(new std::atomic<uint64_t>[kNumBuckets]) {
+    for (size_t i = 0; i < kNumBuckets; i++)
+      buckets_[i].store(0, std::memory_order_relaxed);
+  }
+
+  void Add(Clock::duration latency) {
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    size_t bucket = std::min(static_cast<size_t>(std::max<int64_t>(us, 0)) / kBucketUs, kNumBuckets - 1);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    int64_t max = max_us_.load(std::memory_order_relaxed);
+    while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Upper edge of the bucket holding the given fraction of the latencies, in ms
+  double GetPercentileMs(double fraction) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < kNumBuckets; i++)
+      total += buckets_[i].load(std::memory_order_relaxed);
+    uint64_t rank = static_cast<uint64_t>(fraction * total);
+    uint64_t count = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+      count += buckets_[i].load(std::memory_order_relaxed);
+      if (count > rank)
+        return (i + 1) * kBucketUs / 1000.0;
+    }
+    return kNumBuckets * kBucketUs / 1000.0;
+  }
+
+  double GetMaxMs() const { return max_us_.load(std::memory_order_relaxed) / 1000.0; }
+
+ private:
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<int64_t> max_us_{ 0 };
+};
+
+struct Results {
+  LatencyHistogram latency;
+  std::atomic<uint64_t> frames{ 0 };
+  std::atomic<uint64_t> failures{ 0 };
+  std::atomic<uint64_t> mismatches{ 0 };
+  // Sessions which had their slot, counted at their second frame
+  std::atomic<size_t> running{ 0 };
+};
+
+float GetSample(size_t session_id, uint64_t frame, unsigned i) {
+  return static_cast<float>((session_id * 131 + frame * 7 + i) % 2000) / 1000.f - 1.f;
+}
+
+// One stream: a frame every frame_duration from start + phase until end. input_samples counts all input
+// channels. With check_output the output must be half the first input channel, as the simulated effect
+// returns it.
+session::Task RunStream(session::Executor* executor, Results* results, size_t session_id, unsigned input_samples,
+                        unsigned output_samples, bool check_output, Clock::time_point due, Clock::time_point end,
+                        Clock::duration frame_duration) {
+  session::Session stream = executor->OpenSession();
+  std::vector<float> input(input_samples);
+  std::vector<float> output(output_samples);
+  for (uint64_t frame = 0; due < end; frame++, due += frame_duration) {
+    co_await executor->SleepUntil(due);
+    for (unsigned i = 0; i < input_samples; i++)
+      input[i] = GetSample(session_id, frame, i);
+    bool ok = co_await stream.Process(input.data(), output.data());
+    results->latency.Add(Clock::now() - due);
+    results->frames.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+      results->failures.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    if (frame == 1)
+      results->running.fetch_add(1, std::memory_order_relaxed);
+    if (!check_output)
+      continue;
+    for (unsigned i = 0; i < output_samples; i++) {
+      if (output[i] != 0.5f * input[i]) {
+        results->mismatches.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+}
+
+// Current resident set in bytes, -1 if unknown
+double GetRss() {
+  double rss = -1.0;
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  while (status >> key) {
+    double kb;
+    if (key == "VmRSS:" && status >> kb)
+      rss = kb * 1024.0;
+  }
+#endif
+  return rss;
+}
+
+// Stack reserved for a new thread, what a thread per stream would cost at least in address space
+size_t GetDefaultStackBytes() {
+  size_t bytes = 0;
+#if !defined(_WIN32)
+  pthread_attr_t attributes;
+  if (pthread_attr_init(&attributes) == 0) {
+    pthread_attr_getstacksize(&attributes, &bytes);
+    pthread_attr_destroy(&attributes);
+  }
+#else
+  bytes = 1 << 20;
+#endif
+  return bytes;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: session_load [--sessions N] [--threads N] [--streams N] [--secs S] [--frame-ms MS]"
+              << " [--rate HZ] [--batch-overhead-us US] [--stream-cost-us US] [--max-wait-ms MS]"
+              << " [--phase-window-ms MS] [--seed N] [--sdk EFFECT --model PATH]" << std::endl;
+    return -1;
+  }
+
+  const Clock::duration frame_duration =
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.frame_ms));
+  std::unique_ptr<session::BatchRunner> runner;
+  if (options.sdk_effect.empty()) {
+    const unsigned frame_samples = static_cast<unsigned>(options.rate * options.frame_ms / 1000.0);
+    runner.reset(new session::SimulatedBatchRunner(options.num_streams, frame_samples,
+                                                   std::chrono::microseconds(options.batch_overhead_us),
+                                                   std::chrono::microseconds(options.stream_cost_us)));
+  } else {
+#ifdef NVAFX_SESSION_SDK
+    auto create = [&options](NvAFX_Handle* handle) {
+      if (NvAFX_CreateEffect(options.sdk_effect.c_str(), handle) != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed for " << options.sdk_effect << std::endl;
+        return false;
+      }
+      if (NvAFX_SetString(*handle, NVAFX_PARAM_MODEL_PATH, options.model.c_str()) != NVAFX_STATUS_SUCCESS ||
+          NvAFX_SetU32(*handle, NVAFX_PARAM_NUM_STREAMS, options.num_streams) != NVAFX_STATUS_SUCCESS ||
+          NvAFX_Load(*handle) != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "Unable to load " << options.model << " with " << options.num_streams << " streams"
+                  << std::endl;
+        NvAFX_DestroyEffect(*handle);
+        return false;
+      }
+      return true;
+    };
+    auto destroy = [](NvAFX_Handle handle) { NvAFX_DestroyEffect(handle); };
+    std::unique_ptr<session::NvAFXBatchRunner> sdk_runner(
+      new session::NvAFXBatchRunner(options.num_streams, create, destroy));
+    if (!sdk_runner->Init())
+      return -1;
+    runner = std::move(sdk_runner);
+#endif
+  }
+  const unsigned input_samples = runner->GetNumInputChannels() * runner->GetInputSamples();
+  const unsigned output_samples = runner->GetOutputSamples();
+  const bool check_output = options.sdk_effect.empty();
+  session::ExecutorOptions executor_options;
+  executor_options.num_threads = options.num_threads;
+  executor_options.max_wait = std::chrono::microseconds(static_cast<int64_t>(options.max_wait_ms * 1000.0));
+  executor_options.phase_window = std::chrono::microseconds(static_cast<int64_t>(options.phase_window_ms * 1000.0));
+
+  std::cout << options.num_sessions << " sessions of " << options.frame_ms << " ms frames on " << options.num_threads
+            << " threads, " << options.num_streams << " streams per "
+            << (check_output ? "simulated instance" : options.sdk_effect + " handle") << std::endl;
+
+  Results results;
+  session::ExecutorStats stats;
+  size_t task_bytes = 0;
+  double rss_growth = -1.0;
+  double wall_secs = 0.0;
+  {
+    double rss_before = GetRss();
+    session::Executor executor(runner.get(), executor_options);
+    if (!executor.Reserve(options.num_sessions)) {
+      std::cerr << "Unable to create the instances" << std::endl;
+      return -1;
+    }
+    // Phases spread over one frame, streams start within the first frame
+    std::mt19937 generator(options.seed);
+    std::uniform_int_distribution<int64_t> phase(0, frame_duration.count() - 1);
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(100);
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.secs));
+    for (size_t i = 0; i < options.num_sessions; i++) {
+      executor.Spawn(RunStream(&executor, &results, i, input_samples, output_samples, check_output,
+                               start + Clock::duration(phase(generator)), end, frame_duration));
+    }
+    // Every coroutine frame exists by now, the sessions sleep until start and allocate their buffers
+    task_bytes = session::Task::GetFrameBytes() / std::max<size_t>(session::Task::GetNumFrames(), 1);
+    std::this_thread::sleep_until(start + frame_duration);
+    double rss_running = GetRss();
+    if (rss_before >= 0.0 && rss_running >= 0.0)
+      rss_growth = rss_running - rss_before;
+    executor.Wait();
+    wall_secs = std::chrono::duration<double>(Clock::now() - start).count();
+    stats = executor.GetStats();
+  }
+
+  stats.Print(std::cout, options.num_streams);
+  // Below 100% of real time the sessions fell behind, the batches need more threads than given
+  const double real_time_rate = options.num_sessions * 1000.0 / options.frame_ms;
+  std::cout << std::fixed << std::setprecision(0) << results.frames / wall_secs << " frames/s ("
+            << std::setprecision(1) << 100.0 * results.frames / wall_secs / real_time_rate << "% of real time), "
+            << results.failures << " failed, " << results.mismatches << " wrong outputs, " << results.running
+            << " sessions had a slot" << std::endl;
+  std::cout << std::setprecision(2) << "Frame latency p50 " << results.latency.GetPercentileMs(0.5) << " ms, p99 "
+            << results.latency.GetPercentileMs(0.99) << " ms, max " << results.latency.GetMaxMs()
+            << " ms, batch run time " << 1000.0 * stats.run_secs / std::max<uint64_t>(stats.batches, 1) << " ms"
+            << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+
+  // Share of a session: its coroutine frame, its frame buffers and its slot in the executor
+  const size_t buffer_bytes = (input_samples + output_samples) * sizeof(float);
+  const size_t slot_bytes = session::Executor::GetSlotBytes();
+  std::cout << "Memory per session " << task_bytes + buffer_bytes + slot_bytes << " bytes (coroutine frame "
+            << task_bytes << ", buffers " << buffer_bytes << ", slot " << slot_bytes << ")";
+  if (rss_growth >= 0.0)
+    std::cout << ", resident growth " << static_cast<size_t>(rss_growth / options.num_sessions) << " bytes";
+  std::cout << ", vs. " << GetDefaultStackBytes() / 1024 << " KiB stack per thread with a thread per stream"
+            << std::endl;
+  return results.failures == 0 && results.mismatches == 0 ? 0 : -1;
+}
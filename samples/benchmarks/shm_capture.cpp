@@ -0,0 +1,211 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Capture process for the shared memory input of effects_demo (input_wav shm://name). Attaches to
+// the input ring effects_demo created and publishes --input frame by frame at its real-time rate,
+// --farend as the second channel for AEC. With --output-ring it also reads the processed frames
+// from the ring of output_wav shm://name into --output and prints the latency from publishing each
+// input frame until its output frame was readable.
+//
+// Usage: shm_capture --input in.wav --input-ring NAME [--farend farend.wav] [--output-ring NAME]
+//                    [--output out.wav] [--fast] [--wait-ms MS] [--spin-us US]
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/audio_io/AudioStream.hpp>
+#include <utils/ipc/ShmRing.hpp>
+
+namespace {
+
+struct Options {
+  std::string input;
+  std::string farend;
+  std::string input_ring;
+  std::string output_ring;
+  std::string output;
+  // Publish frames as fast as the effect takes them rather than at the real-time rate
+  bool fast = false;
+  double wait_ms = 10000.0;
+  double spin_us = 50.0;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--fast") {
+      options->fast = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--input") {
+      options->input = value;
+    } else if (arg == "--farend") {
+      options->farend = value;
+    } else if (arg == "--input-ring") {
+      options->input_ring = value;
+    } else if (arg == "--output-ring") {
+      options->output_ring = value;
+    } else if (arg == "--output") {
+      options->output = value;
+    } else if (arg == "--wait-ms") {
+      options->wait_ms = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--spin-us") {
+      options->spin_us = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->input.empty() || options->input_ring.empty() || options->output.empty() != options->output_ring.empty()) {
+    std::cerr << "--input and --input-ring are required, --output and --output-ring go together" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool LoadMono(const std::string& path, uint32_t sample_rate, std::vector<float>* audio) {
+  std::unique_ptr<audio_io::AudioSource> source = audio_io::OpenAudioSource(path);
+  if (!source)
+    return false;
+  if (source->GetNumChannels() != 1 || source->GetSampleRate() != sample_rate) {
+    std::cerr << path << " must be mono at " << sample_rate << " Hz, the rate of the ring" << std::endl;
+    return false;
+  }
+  std::vector<float> block(4096);
+  uint32_t num_read;
+  while ((num_read = source->Read(block.data(), static_cast<uint32_t>(block.size()))) > 0)
+    audio->insert(audio->end(), block.begin(), block.begin() + num_read);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: shm_capture --input in.wav --input-ring NAME [--farend farend.wav] [--output-ring NAME]"
+              << std::endl
+              << "                   [--output out.wav] [--fast] [--wait-ms MS] [--spin-us US]" << std::endl;
+    return -1;
+  }
+  std::unique_ptr<ipc::ShmRing> input_ring =
+    ipc::ShmRing::Open(options.input_ring, ipc::RingRole::kProducer, options.wait_ms, options.spin_us);
+  if (!input_ring)
+    return -1;
+  const ipc::RingLayout layout = input_ring->GetLayout();
+  const uint32_t num_channels = options.farend.empty() ? 1 : 2;
+  if (layout.num_channels != num_channels) {
+    std::cerr << "The ring takes " << layout.num_channels << " channel(s), " << num_channels << " given" << std::endl;
+    return -1;
+  }
+  std::vector<float> channels[2];
+  if (!LoadMono(options.input, layout.sample_rate, &channels[0]) ||
+      (num_channels == 2 && !LoadMono(options.farend, layout.sample_rate, &channels[1]))) {
+    return -1;
+  }
+  const size_t num_frames = (channels[0].size() + layout.frame_samples - 1) / layout.frame_samples;
+  channels[1].resize(channels[0].size());
+
+  std::unique_ptr<ipc::ShmRing> output_ring;
+  if (!options.output_ring.empty()) {
+    output_ring = ipc::ShmRing::Open(options.output_ring, ipc::RingRole::kConsumer, options.wait_ms, options.spin_us);
+    if (!output_ring)
+      return -1;
+  }
+  std::cout << "Publishing " << options.input << " in " << num_frames << " frames of " << layout.frame_samples
+            << " samples to " << options.input_ring << (options.fast ? "" : " in real time") << std::endl;
+
+  // Written before each frame is published, read once its output arrived
+  std::vector<int64_t> publish_ns(num_frames, 0);
+  std::vector<double> latencies_ms;
+  std::vector<float> received;
+  std::thread reader;
+  if (output_ring) {
+    reader = std::thread([&]() {
+      uint32_t num_samples;
+      const float* slot;
+      while ((slot = output_ring->BeginRead(-1.0, &num_samples)) != nullptr) {
+        size_t frame = received.size() / output_ring->GetLayout().frame_samples;
+        if (frame < num_frames)
+          latencies_ms.push_back((ipc::ShmRing::Now() - publish_ns[frame]) / 1e6);
+        received.insert(received.end(), slot, slot + num_samples);
+        output_ring->EndRead();
+      }
+    });
+  }
+
+  const int64_t frame_ns = static_cast<int64_t>(1e9 * layout.frame_samples / layout.sample_rate);
+  int64_t due = ipc::ShmRing::Now();
+  bool success = true;
+  for (size_t frame = 0; frame < num_frames; frame++, due += frame_ns) {
+    if (!options.fast)
+      std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(0, due - ipc::ShmRing::Now())));
+    float* slot = input_ring->BeginWrite(options.wait_ms);
+    if (!slot) {
+      std::cerr << "effects_demo is gone or stopped reading" << std::endl;
+      success = false;
+      break;
+    }
+    const size_t begin = frame * layout.frame_samples;
+    const uint32_t count = static_cast<uint32_t>(std::min<size_t>(layout.frame_samples, channels[0].size() - begin));
+    for (uint32_t ch = 0; ch < num_channels; ch++)
+      std::copy(channels[ch].begin() + begin, channels[ch].begin() + begin + count, input_ring->GetChannel(slot, ch));
+    publish_ns[frame] = ipc::ShmRing::Now();
+    input_ring->EndWrite(count);
+  }
+  input_ring->Close();
+  input_ring->PrintReport(std::cout, "Input");
+  if (!output_ring)
+    return success ? 0 : -1;
+
+  reader.join();
+  output_ring->PrintReport(std::cout, "Output");
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+  if (!latencies_ms.empty()) {
+    std::cout << std::fixed << std::setprecision(3) << "Latency from publishing a frame to its output: p50 "
+              << latencies_ms[latencies_ms.size() / 2] << " ms, p99 " << latencies_ms[latencies_ms.size() * 99 / 100]
+              << " ms, max " << latencies_ms.back() << " ms over " << latencies_ms.size() << " frames" << std::endl;
+  }
+  std::unique_ptr<audio_io::AudioSink> sink =
+    audio_io::CreateAudioSink(options.output, output_ring->GetLayout().sample_rate, 1);
+  if (!sink || !sink->Write(received.data(), static_cast<uint32_t>(received.size())) || !sink->Commit()) {
+    std::cerr << "Unable to write " << options.output << std::endl;
+    return -1;
+  }
+  std::cout << "Output written to " << options.output << ", " << received.size() << " samples" << std::endl;
+  return success ? 0 : -1;
+}
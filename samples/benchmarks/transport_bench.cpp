@@ -0,0 +1,288 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Checks the reduced precision transport formats of utils/pipeline/PackedFrames and measures them:
+// conversions against known values, the vector paths (F16C / AVX-512 / SSE2, whatever the CPU
+// runs) against the scalar path on a sweep of float bit patterns, the error each format adds to
+// speech-like audio, pack / unpack throughput and the bytes per second of audio.
+//
+// Usage: transport_bench [--sample-rate N] [--frame-ms MS] [--secs S] [--runs N]
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <utils/dsp/SimdKernels.hpp>
+#include <utils/pipeline/PackedFrames.hpp>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+struct Options {
+  uint32_t sample_rate = 48000;
+  double frame_ms = 10.0;
+  double secs = 600.0;
+  int runs = 5;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    if (arg == "--sample-rate") {
+      options->sample_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--frame-ms") {
+      options->frame_ms = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->sample_rate < 8000 || options->frame_ms <= 0.0 || options->secs <= 0.0 || options->runs <= 0) {
+    std::cerr << "--sample-rate must be >= 8000, --frame-ms, --secs and --runs positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+float BitsToFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Speech-like test signal: noise bursts with a slow envelope, pauses and a quiet noise floor
+std::vector<float> Bursts(size_t num_samples, uint32_t sample_rate, double amplitude) {
+  std::mt19937 generator(1);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  std::vector<float> signal(num_samples);
+  for (size_t i = 0; i < signal.size(); i++) {
+    double t = static_cast<double>(i) / sample_rate;
+    double envelope = std::max(0.0, std::sin(2.0 * kPi * 0.7 * t)) + 1e-3;
+    signal[i] = static_cast<float>(amplitude * envelope * noise(generator));
+  }
+  return signal;
+}
+
+// Best of runs, in seconds
+double BestTime(int runs, const std::function<void()>& body) {
+  double best = 1e30;
+  for (int run = 0; run < runs; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+  return best;
+}
+
+bool Report(const char* name, bool ok) {
+  std::cout << std::left << std::setw(48) << name << (ok ? "ok" : "FAILED") << std::endl << std::right;
+  return ok;
+}
+
+// Known conversions, including rounding ties, subnormals, overflow and NaN
+bool CheckKnownValues() {
+  struct HalfCase {
+    uint32_t bits;
+    uint16_t half;
+  };
+  const HalfCase half_cases[] = {
+    { 0x3f800000, 0x3c00 },  // 1
+    { 0xbf800000, 0xbc00 },  // -1
+    { 0x80000000, 0x8000 },  // -0
+    { 0x477fe000, 0x7bff },  // 65504, largest half
+    { 0x477fefff, 0x7bff },  // just below the rounding point to infinity
+    { 0x477ff000, 0x7c00 },  // 65520 rounds to infinity
+    { 0x7f800000, 0x7c00 },  // infinity
+    { 0x38800000, 0x0400 },  // 2^-14, smallest normal
+    { 0x33800000, 0x0001 },  // 2^-24, smallest subnormal
+    { 0x33000000, 0x0000 },  // 2^-25, tie to even zero
+    { 0x33c00000, 0x0002 },  // 3 * 2^-25, tie to even 2
+    { 0x3f801000, 0x3c00 },  // 1 + 2^-11, tie to even
+    { 0x3f803000, 0x3c02 },  // 1 + 3 * 2^-11, tie to even
+  };
+  bool ok = true;
+  for (const HalfCase& test : half_cases) {
+    float value = BitsToFloat(test.bits);
+    uint16_t half;
+    dsp::FloatToHalf(&value, &half, 1);
+    ok = ok && half == test.half;
+  }
+  float nan = BitsToFloat(0x7fc00000);
+  uint16_t half_nan;
+  dsp::FloatToHalf(&nan, &half_nan, 1);
+  ok = ok && (half_nan & 0x7c00) == 0x7c00 && (half_nan & 0x3ff) != 0;
+  bool passed = Report("fp16 known values", ok);
+
+  const uint32_t bf16_cases[][2] = {
+    { 0x3f800000, 0x3f80 }, { 0x3f808000, 0x3f80 }, { 0x3f818000, 0x3f82 }, { 0x3f808001, 0x3f81 },
+    { 0x7f7fffff, 0x7f80 }, { 0xff800000, 0xff80 }, { 0x7f800001, 0x7fc0 },
+  };
+  ok = true;
+  for (const auto& test : bf16_cases) {
+    float value = BitsToFloat(test[0]);
+    uint16_t bf16;
+    dsp::FloatToBFloat16(&value, &bf16, 1);
+    ok = ok && bf16 == test[1];
+  }
+  passed = Report("bf16 known values", ok) && passed;
+
+  const float samples[] = { 1.f, -1.f, 0.5f, -0.25f, 0.f, 1e-6f, -1e-6f, 0.999f };
+  int16_t q[8];
+  dsp::FloatToInt16(samples, 32767.f, q, 8);
+  const int16_t expected[] = { 32767, -32767, 16384, -8192, 0, 0, 0, 32734 };
+  passed = Report("int16 known values", std::equal(q, q + 8, expected)) && passed;
+  return passed;
+}
+
+// Converts a sweep of float bit patterns in one call (vector path) and one value per call (scalar
+// path), and checks that every half and bfloat16 survives the round trip through float
+bool CheckVectorPaths() {
+  const size_t kStride = 251;
+  std::vector<float> values;
+  values.reserve((UINT64_C(1) << 32) / kStride + 1);
+  for (uint64_t bits = 0; bits <= UINT32_MAX; bits += kStride)
+    values.push_back(BitsToFloat(static_cast<uint32_t>(bits)));
+  std::vector<uint16_t> vector_out(values.size());
+
+  dsp::FloatToHalf(values.data(), vector_out.data(), values.size());
+  bool ok = true;
+  for (size_t i = 0; i < values.size() && ok; i++) {
+    uint16_t scalar;
+    dsp::FloatToHalf(&values[i], &scalar, 1);
+    ok = scalar == vector_out[i];
+  }
+  bool passed = Report("fp16 vector == scalar", ok);
+
+  dsp::FloatToBFloat16(values.data(), vector_out.data(), values.size());
+  ok = true;
+  for (size_t i = 0; i < values.size() && ok; i++) {
+    uint16_t scalar;
+    dsp::FloatToBFloat16(&values[i], &scalar, 1);
+    ok = scalar == vector_out[i];
+  }
+  passed = Report("bf16 vector == scalar", ok) && passed;
+
+  // All 16 bit patterns: to float in one call, each one separately, and back
+  std::vector<uint16_t> patterns(65536);
+  for (size_t i = 0; i < patterns.size(); i++)
+    patterns[i] = static_cast<uint16_t>(i);
+  std::vector<float> floats(patterns.size());
+  std::vector<uint16_t> back(patterns.size());
+  bool half_ok = true;
+  bool bf16_ok = true;
+  dsp::HalfToFloat(patterns.data(), floats.data(), patterns.size());
+  dsp::FloatToHalf(floats.data(), back.data(), patterns.size());
+  for (size_t i = 0; i < patterns.size(); i++) {
+    float scalar;
+    dsp::HalfToFloat(&patterns[i], &scalar, 1);
+    bool is_nan = (i & 0x7c00) == 0x7c00 && (i & 0x3ff) != 0;
+    half_ok = half_ok && (is_nan ? std::isnan(floats[i]) && std::isnan(scalar)
+                                 : back[i] == patterns[i] && memcmp(&scalar, &floats[i], sizeof(float)) == 0);
+  }
+  dsp::BFloat16ToFloat(patterns.data(), floats.data(), patterns.size());
+  dsp::FloatToBFloat16(floats.data(), back.data(), patterns.size());
+  for (size_t i = 0; i < patterns.size(); i++) {
+    bool is_nan = (i & 0x7f80) == 0x7f80 && (i & 0x7f) != 0;
+    bf16_ok = bf16_ok && (is_nan ? std::isnan(floats[i]) : back[i] == patterns[i]);
+  }
+  passed = Report("fp16 round trip of all halves", half_ok) && passed;
+  passed = Report("bf16 round trip of all bfloat16", bf16_ok) && passed;
+
+  std::vector<float> audio = Bursts(48000, 48000, 0.3);
+  std::vector<int16_t> int16_vector(audio.size());
+  dsp::FloatToInt16(audio.data(), 32767.f / 1.5f, int16_vector.data(), audio.size());
+  ok = true;
+  for (size_t i = 0; i < audio.size() && ok; i++) {
+    int16_t scalar;
+    dsp::FloatToInt16(&audio[i], 32767.f / 1.5f, &scalar, 1);
+    ok = scalar == int16_vector[i];
+  }
+  return Report("int16 vector == scalar", ok) && passed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: transport_bench [--sample-rate N] [--frame-ms MS] [--secs S] [--runs N]" << std::endl;
+    return -1;
+  }
+  bool passed = CheckKnownValues();
+  passed = CheckVectorPaths() && passed;
+
+  const size_t frame_samples = std::max<size_t>(1, static_cast<size_t>(options.sample_rate * options.frame_ms / 1000.0));
+  const size_t num_frames = std::max<size_t>(1, static_cast<size_t>(options.secs * 1000.0 / options.frame_ms));
+  // Speech at about -20 dBFS RMS with quiet passages
+  std::vector<float> audio = Bursts(num_frames * frame_samples, options.sample_rate, 0.1);
+  const double float_bytes = static_cast<double>(audio.size()) * sizeof(float);
+
+  std::cout << std::endl
+            << options.secs << " secs at " << options.sample_rate << " Hz in " << frame_samples
+            << " sample frames, best of " << options.runs << " runs" << std::endl
+            << std::setw(8) << "Format" << std::setw(14) << "KB per sec" << std::setw(12) << "Buffer MB"
+            << std::setw(14) << "Pack GB/s" << std::setw(14) << "Unpack GB/s" << std::setw(12) << "Max error"
+            << std::setw(10) << "SNR dB" << std::endl;
+  const pipeline::TransportFormat formats[] = { pipeline::TransportFormat::kFloat32,
+                                                pipeline::TransportFormat::kFloat16,
+                                                pipeline::TransportFormat::kBFloat16,
+                                                pipeline::TransportFormat::kInt16 };
+  for (pipeline::TransportFormat format : formats) {
+    pipeline::PackedFrames packed(format, frame_samples);
+    double pack_secs = BestTime(options.runs, [&]() { packed.Assign(audio.data(), num_frames); });
+    std::vector<float> frame(frame_samples);
+    double unpack_secs = BestTime(options.runs, [&]() {
+      for (size_t i = 0; i < num_frames; i++)
+        packed.Unpack(i, frame.data());
+    });
+    pipeline::TransportError error;
+    pipeline::MeasureTransportError(packed, audio.data(), num_frames, &error);
+    double bytes_per_sec = static_cast<double>(packed.GetFrameBytes()) * num_frames / options.secs;
+    std::cout << std::setw(8) << pipeline::GetTransportFormatName(format) << std::fixed << std::setprecision(1)
+              << std::setw(14) << bytes_per_sec / 1e3 << std::setw(12) << packed.GetBytes() / 1e6
+              << std::setprecision(2) << std::setw(14) << float_bytes / pack_secs / 1e9 << std::setw(14)
+              << float_bytes / unpack_secs / 1e9 << std::scientific << std::setw(12) << error.max_abs << std::fixed
+              << std::setprecision(1) << std::setw(10) << error.GetSnrDb() << std::endl;
+  }
+  std::cout << (passed ? "All checks passed" : "Some checks FAILED") << std::endl;
+  return passed ? 0 : -1;
+}
@@ -0,0 +1,173 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Checks that utils/verify/WaveVerifier passes outputs within tolerance and fails broken ones,
+// non-finite outputs included, and measures how fast it compares a pair of files.
+//
+// Usage: verify_bench [--dir D] [--secs S] [--frame N] [--runs N]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <utils/verify/WaveVerifier.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+const uint32_t kSampleRate = 48000;
+
+struct Options {
+  std::string dir = ".";
+  double secs = 60.0;
+  uint32_t frame = 480;
+  int runs = 3;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    if (arg == "--dir") {
+      options->dir = argv[++i];
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--frame") {
+      options->frame = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->secs <= 0.0 || options->frame == 0 || options->runs <= 0) {
+    std::cerr << "--secs, --frame and --runs must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool WriteWav(const std::string& path, const std::vector<float>& samples) {
+  CWaveFileWrite writer(path, kSampleRate, 1, 32, true);
+  return writer.writeChunk(samples.data(), static_cast<uint32_t>(samples.size() * sizeof(float))) &&
+         writer.commitFile();
+}
+
+// A sine with some noise, so every frame is loud enough for the SNR test
+std::vector<float> Reference(double secs) {
+  std::mt19937 generator(1);
+  std::normal_distribution<float> noise(0.f, 0.01f);
+  std::vector<float> signal(static_cast<size_t>(secs * kSampleRate));
+  for (size_t i = 0; i < signal.size(); i++)
+    signal[i] = static_cast<float>(0.3 * std::sin(2.0 * kPi * 440.0 * i / kSampleRate)) + noise(generator);
+  return signal;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: verify_bench [--dir D] [--secs S] [--frame N] [--runs N]" << std::endl;
+    return -1;
+  }
+  const std::string reference_wav = options.dir + "/verify_bench_reference.wav";
+  const std::string output_wav = options.dir + "/verify_bench_output.wav";
+  const std::vector<float> reference = Reference(options.secs);
+  if (!WriteWav(reference_wav, reference)) {
+    std::cerr << "Unable to write " << reference_wav << ", does --dir exist?" << std::endl;
+    return -1;
+  }
+
+  // Outputs of a working and of broken effects, each with the expected verdict. The short ones
+  // end in a partial frame, which takes the scalar tail of the kernels.
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  const float kInf = std::numeric_limits<float>::infinity();
+  struct Case {
+    const char* name;
+    bool expect_pass;
+    std::vector<float> output;
+  };
+  std::vector<Case> cases;
+  cases.push_back({ "identical", true, reference });
+  cases.push_back({ "within tolerance", true, reference });
+  for (float& sample : cases.back().output)
+    sample += 1e-5f;
+  cases.push_back({ "all NaN", false, std::vector<float>(reference.size(), kNaN) });
+  cases.push_back({ "one NaN in a vector lane", false, reference });
+  cases.back().output[options.frame + 3] = kNaN;
+  std::vector<float> short_reference(reference.begin(), reference.begin() + options.frame + 3);
+  cases.push_back({ "NaN in the partial frame", false, short_reference });
+  cases.back().output.back() = kNaN;
+  cases.push_back({ "one inf", false, reference });
+  cases.back().output[reference.size() / 2] = kInf;
+  cases.push_back({ "6 dB gain", false, reference });
+  for (float& sample : cases.back().output)
+    sample *= 2.f;
+
+  const std::string short_reference_wav = options.dir + "/verify_bench_short.wav";
+  bool passed = WriteWav(short_reference_wav, short_reference);
+  for (const Case& test : cases) {
+    const bool is_short = test.output.size() == short_reference.size();
+    VerifyReport report;
+    WaveVerifier verifier(options.frame, VerifyTolerance());
+    bool verdict = WriteWav(output_wav, test.output) &&
+                   verifier.Compare(output_wav, is_short ? short_reference_wav : reference_wav, &report);
+    bool ok = verdict == test.expect_pass;
+    passed = passed && ok;
+    std::cout << std::left << std::setw(28) << test.name << (verdict ? "passed" : "failed") << " ("
+              << (report.failure_reason.empty() ? "-" : report.failure_reason) << ") "
+              << (ok ? "ok" : "FAILED") << std::endl;
+  }
+  std::cout << std::right;
+
+  // Throughput on a passing pair, which is compared to the end
+  double best = 1e30;
+  for (int run = 0; run < options.runs; run++) {
+    WaveVerifier verifier(options.frame, VerifyTolerance());
+    VerifyReport report;
+    auto start = std::chrono::high_resolution_clock::now();
+    verifier.Compare(reference_wav, reference_wav, &report);
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+  std::cout << std::fixed << std::setprecision(1) << "Compare: " << reference.size() / best / 1e6
+            << " Msamples/s, " << options.secs / best << "x real time" << std::endl;
+
+  std::remove(reference_wav.c_str());
+  std::remove(short_reference_wav.c_str());
+  std::remove(output_wav.c_str());
+  return passed ? 0 : 1;
+}
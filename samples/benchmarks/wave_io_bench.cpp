@@ -0,0 +1,819 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// I/O paths of the wav classes (utils/wave_reader) on generated data sets of any size. The files
+// are generated deterministically for every combination of sample format, channel count, rate and
+// chunk layout: the same options give the same bytes on every machine, and files already in --dir
+// (created if missing) are reused. Per file it measures
+//   read      CWaveFileRead loading the file, with a cold (evicted, Linux) and a warm page cache
+//   stream    CWaveFileStreamRead reading it in 10 ms blocks, cold and warm
+//   float     GetFloatPCMData() on a loaded file
+//   aligned   GetFloatPCMDataAligned(480)
+//   write     CWaveFileWrite writing the float samples in 10 ms frames
+// and reports the throughput of the best of --runs runs, the operator new allocations of a run and
+// the peak RSS during it (Linux). --json writes the results, --compare prints the change between
+// two such files and fails on throughput regressions beyond --threshold percent.
+//
+// Usage: wave_io_bench [--dir D] [--mb MB | --secs S] [--formats 8,16,24,32,f32] [--channels 1,2]
+//                      [--rates 16000,48000] [--layouts plain,odd,crowded] [--ops read,stream,...]
+//                      [--runs N] [--json FILE] [--label TEXT] [--generate-only]
+//        wave_io_bench --compare OLD.json NEW.json [--threshold PCT]
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utils/cache/ContentHash.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+// Allocations through operator new, counted for the operation being measured
+namespace {
+std::atomic<uint64_t> g_allocations(0);
+std::atomic<uint64_t> g_allocated_bytes(0);
+
+void* CountedAlloc(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* memory = malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+}  // namespace
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+namespace {
+
+struct Options {
+  std::string dir = "wave_io_bench_files";
+  // Size of each file, or its duration if mb is 0
+  double mb = 0.0;
+  double secs = 30.0;
+  std::vector<std::string> formats = { "8", "16", "24", "32", "f32" };
+  std::vector<uint32_t> channels = { 1, 2 };
+  std::vector<uint32_t> rates = { 16000, 48000 };
+  std::vector<std::string> layouts = { "plain", "odd", "crowded" };
+  std::vector<std::string> ops = { "read", "stream", "float", "aligned", "write" };
+  int runs = 3;
+  std::string json;
+  std::string label;
+  bool generate_only = false;
+  // Compare mode
+  std::string compare_old;
+  std::string compare_new;
+  double threshold = 10.0;
+};
+
+std::vector<std::string> SplitList(const std::string& text) {
+  std::vector<std::string> items;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--generate-only") {
+      options->generate_only = true;
+      continue;
+    }
+    if (arg == "--compare") {
+      if (i + 2 >= argc) {
+        std::cerr << "--compare needs two result files" << std::endl;
+        return false;
+      }
+      options->compare_old = argv[++i];
+      options->compare_new = argv[++i];
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--dir") {
+      options->dir = value;
+    } else if (arg == "--mb") {
+      options->mb = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--secs") {
+      options->secs = std::strtod(value.c_str(), nullptr);
+    } else if (arg == "--formats") {
+      options->formats = SplitList(value);
+    } else if (arg == "--channels" || arg == "--rates") {
+      std::vector<uint32_t>& list = arg == "--channels" ? options->channels : options->rates;
+      list.clear();
+      for (const std::string& item : SplitList(value))
+        list.push_back(static_cast<uint32_t>(std::strtoul(item.c_str(), nullptr, 10)));
+    } else if (arg == "--layouts") {
+      options->layouts = SplitList(value);
+    } else if (arg == "--ops") {
+      options->ops = SplitList(value);
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(value.c_str());
+    } else if (arg == "--json") {
+      options->json = value;
+    } else if (arg == "--label") {
+      options->label = value;
+    } else if (arg == "--threshold") {
+      options->threshold = std::strtod(value.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (!options->compare_old.empty())
+    return true;
+  for (const std::string& format : options->formats) {
+    if (format != "8" && format != "16" && format != "24" && format != "32" && format != "f32") {
+      std::cerr << "--formats takes 8, 16, 24, 32 and f32" << std::endl;
+      return false;
+    }
+  }
+  for (const std::string& layout : options->layouts) {
+    if (layout != "plain" && layout != "odd" && layout != "crowded") {
+      std::cerr << "--layouts takes plain, odd and crowded" << std::endl;
+      return false;
+    }
+  }
+  for (const std::string& op : options->ops) {
+    if (op != "read" && op != "stream" && op != "float" && op != "aligned" && op != "write") {
+      std::cerr << "--ops takes read, stream, float, aligned and write" << std::endl;
+      return false;
+    }
+  }
+  for (uint32_t channels : options->channels) {
+    if (channels == 0 || channels > MAX_CHANNELS) {
+      std::cerr << "--channels must be 1 to " << MAX_CHANNELS << std::endl;
+      return false;
+    }
+  }
+  for (uint32_t rate : options->rates) {
+    if (rate == 0) {
+      std::cerr << "--rates must be positive" << std::endl;
+      return false;
+    }
+  }
+  if (options->runs <= 0 || (options->mb <= 0.0 && options->secs <= 0.0)) {
+    std::cerr << "--runs and --mb or --secs must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// One generated file of the data set
+struct FileSpec {
+  std::string name;
+  uint16_t bits;
+  bool is_float;
+  uint32_t channels;
+  uint32_t rate;
+  std::string layout;
+  // Sample frames
+  uint64_t frames;
+  uint64_t bytes = 0;
+  uint64_t hash = 0;
+
+  uint32_t BlockAlign() const { return channels * bits / 8; }
+};
+
+// Test signal from integer arithmetic only, so every platform produces the same bytes: a triangle
+// wave per channel, a different pitch each, plus noise from a 64 bit LCG. Samples are full scale
+// 32 bit values that the formats take the upper bits of.
+class SignalGenerator {
+ public:
+  SignalGenerator(uint32_t channels, uint32_t rate) : phases_(channels, 0), steps_(channels) {
+    for (uint32_t ch = 0; ch < channels; ch++)
+      steps_[ch] = static_cast<uint32_t>((UINT64_C(1) << 32) * (220u + 110u * ch) / rate);
+  }
+
+  int32_t Next(uint32_t ch) {
+    phases_[ch] += steps_[ch];
+    // Triangle from the phase, at about half of full scale
+    int64_t triangle = phases_[ch] < 0x80000000u ? static_cast<int64_t>(phases_[ch]) - 0x40000000
+                                                 : 0xC0000000ll - static_cast<int64_t>(phases_[ch]);
+    state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+    int64_t noise = static_cast<int32_t>(state_ >> 32) / 8;
+    return static_cast<int32_t>(triangle + noise);
+  }
+
+ private:
+  std::vector<uint32_t> phases_;
+  std::vector<uint32_t> steps_;
+  uint64_t state_ = 1;
+};
+
+void PutSample(int32_t value, const FileSpec& spec, std::vector<uint8_t>* out) {
+  if (spec.is_float) {
+    float sample = static_cast<float>(value) / 2147483648.f;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&sample);
+    out->insert(out->end(), bytes, bytes + sizeof(sample));
+    return;
+  }
+  uint32_t bits = static_cast<uint32_t>(value);
+  switch (spec.bits) {
+  case 8:
+    out->push_back(static_cast<uint8_t>((bits >> 24) ^ 0x80));
+    break;
+  case 16:
+    out->push_back(static_cast<uint8_t>(bits >> 16));
+    out->push_back(static_cast<uint8_t>(bits >> 24));
+    break;
+  case 24:
+    out->push_back(static_cast<uint8_t>(bits >> 8));
+    out->push_back(static_cast<uint8_t>(bits >> 16));
+    out->push_back(static_cast<uint8_t>(bits >> 24));
+    break;
+  default:
+    for (int i = 0; i < 4; i++)
+      out->push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    break;
+  }
+}
+
+void AppendChunk(std::vector<uint8_t>* out, uint32_t id, const std::vector<uint8_t>& payload) {
+  RiffChunk chunk = { id, static_cast<uint32_t>(payload.size()) };
+  const uint8_t* header = reinterpret_cast<const uint8_t*>(&chunk);
+  out->insert(out->end(), header, header + sizeof(chunk));
+  out->insert(out->end(), payload.begin(), payload.end());
+  if (payload.size() & 1)
+    out->push_back(0);
+}
+
+std::vector<uint8_t> Filler(size_t size, uint8_t seed) {
+  std::vector<uint8_t> payload(size);
+  for (size_t i = 0; i < size; i++)
+    payload[i] = static_cast<uint8_t>(seed + i * 7);
+  return payload;
+}
+
+// Chunks in front of the data chunk. plain: fmt only. odd: odd sized JUNK, LIST and unknown chunks
+// with pad bytes around an 18 byte fmt, and a LIST after the data. crowded: more chunks than the
+// chunk index holds, fmt last, so the index has to keep room for fmt and data.
+std::vector<uint8_t> MakeHeaderChunks(const FileSpec& spec) {
+  waveFormat_ext wfx;
+  memset(&wfx, 0, sizeof(wfx));
+  wfx.wFormatTag = spec.is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+  wfx.nChannels = static_cast<uint16_t>(spec.channels);
+  wfx.nSamplesPerSec = spec.rate;
+  wfx.nBlockAlign = static_cast<uint16_t>(spec.BlockAlign());
+  wfx.nAvgBytesPerSec = spec.rate * spec.BlockAlign();
+  wfx.wBitsPerSample = spec.bits;
+  std::vector<uint8_t> fmt(reinterpret_cast<const uint8_t*>(&wfx), reinterpret_cast<const uint8_t*>(&wfx) + 16);
+
+  std::vector<uint8_t> chunks;
+  if (spec.layout == "odd") {
+    AppendChunk(&chunks, MAKEFOURCC('J', 'U', 'N', 'K'), Filler(27, 1));
+    fmt.resize(18, 0);
+    AppendChunk(&chunks, MAKEFOURCC('f', 'm', 't', ' '), fmt);
+    AppendChunk(&chunks, MAKEFOURCC('L', 'I', 'S', 'T'), Filler(101, 2));
+    AppendChunk(&chunks, MAKEFOURCC('x', 'y', 'z', ' '), Filler(3, 3));
+  } else if (spec.layout == "crowded") {
+    for (unsigned i = 0; i < RIFF_INDEX_CAPACITY + 8; i++)
+      AppendChunk(&chunks, MAKEFOURCC('p', 'a', 'd', static_cast<char>('a' + i % 26)), Filler(5 + i % 3, i));
+    AppendChunk(&chunks, MAKEFOURCC('f', 'm', 't', ' '), fmt);
+  } else {
+    AppendChunk(&chunks, MAKEFOURCC('f', 'm', 't', ' '), fmt);
+  }
+  return chunks;
+}
+
+std::vector<uint8_t> MakeTrailingChunks(const FileSpec& spec) {
+  std::vector<uint8_t> chunks;
+  if (spec.layout == "odd")
+    AppendChunk(&chunks, MAKEFOURCC('L', 'I', 'S', 'T'), Filler(45, 4));
+  return chunks;
+}
+
+// Writes the file block by block, hashing it on the way
+bool Generate(const std::string& path, FileSpec* spec) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return false;
+  std::vector<uint8_t> header_chunks = MakeHeaderChunks(*spec);
+  std::vector<uint8_t> trailing_chunks = MakeTrailingChunks(*spec);
+  uint64_t data_bytes = spec->frames * spec->BlockAlign();
+  uint64_t riff_size = 4 + header_chunks.size() + sizeof(RiffChunk) + data_bytes + (data_bytes & 1) +
+                       trailing_chunks.size();
+
+  std::vector<uint8_t> block;
+  RiffHeader riff = { MAKEFOURCC('R', 'I', 'F', 'F'), static_cast<uint32_t>(riff_size), MAKEFOURCC('W', 'A', 'V', 'E') };
+  RiffChunk data = { MAKEFOURCC('d', 'a', 't', 'a'), static_cast<uint32_t>(data_bytes) };
+  block.insert(block.end(), reinterpret_cast<uint8_t*>(&riff), reinterpret_cast<uint8_t*>(&riff) + sizeof(riff));
+  block.insert(block.end(), header_chunks.begin(), header_chunks.end());
+  block.insert(block.end(), reinterpret_cast<uint8_t*>(&data), reinterpret_cast<uint8_t*>(&data) + sizeof(data));
+
+  cache::StreamHash hash;
+  SignalGenerator generator(spec->channels, spec->rate);
+  const size_t kBlockBytes = 1 << 20;
+  bool ok = true;
+  for (uint64_t frame = 0; frame < spec->frames && ok; frame++) {
+    for (uint32_t ch = 0; ch < spec->channels; ch++)
+      PutSample(generator.Next(ch), *spec, &block);
+    if (block.size() >= kBlockBytes || frame + 1 == spec->frames) {
+      if (frame + 1 == spec->frames) {
+        if (data_bytes & 1)
+          block.push_back(0);
+        block.insert(block.end(), trailing_chunks.begin(), trailing_chunks.end());
+      }
+      hash.Update(block.data(), block.size());
+      ok = fwrite(block.data(), block.size(), 1, fp) == 1;
+      block.clear();
+    }
+  }
+  ok = fclose(fp) == 0 && ok;
+  spec->bytes = hash.GetLength();
+  spec->hash = hash.Digest();
+  return ok;
+}
+
+// Writes back and drops the cached pages of path, so the next read goes to the device. Returns
+// false where that is not possible.
+bool EvictFromCache(const std::string& path) {
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  fdatasync(fd);
+  bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  close(fd);
+  return evicted;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+// Peak and current resident set in bytes, -1 if unknown. The peak is reset by ResetPeakRss().
+void GetRss(double* peak, double* current) {
+  *peak = -1.0;
+  *current = -1.0;
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  while (status >> key) {
+    double kb;
+    if (key == "VmHWM:" && status >> kb)
+      *peak = kb * 1024.0;
+    else if (key == "VmRSS:" && status >> kb)
+      *current = kb * 1024.0;
+  }
+#endif
+}
+
+void ResetPeakRss() {
+#ifdef __linux__
+  // Resets VmHWM to the current RSS (Linux 4.0 and later)
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+struct Measurement {
+  std::string op;
+  // cold, warm or empty for operations that do not touch the file
+  std::string cache;
+  double secs = 1e30;
+  uint64_t bytes = 0;
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  double peak_rss = -1.0;
+  double rss_growth = -1.0;
+  bool ok = true;
+};
+
+// Runs body runs times, each after before. Keeps the fastest run and the allocations and peak RSS of
+// the last. Only body is timed and counted.
+Measurement Measure(const std::string& op, const std::string& cache, int runs, const std::function<void()>& before,
+                    const std::function<bool(uint64_t*)>& body) {
+  Measurement result;
+  result.op = op;
+  result.cache = cache;
+  for (int run = 0; run < runs; run++) {
+    if (before)
+      before();
+    double peak, start_rss;
+    ResetPeakRss();
+    GetRss(&peak, &start_rss);
+    uint64_t allocations = g_allocations.load();
+    uint64_t allocated = g_allocated_bytes.load();
+    double start = Now();
+    uint64_t bytes = 0;
+    bool ok = body(&bytes);
+    double secs = Now() - start;
+    result.allocations = g_allocations.load() - allocations;
+    result.allocated_bytes = g_allocated_bytes.load() - allocated;
+    double current;
+    GetRss(&peak, &current);
+    result.peak_rss = peak;
+    result.rss_growth = peak >= 0.0 && start_rss >= 0.0 ? peak - start_rss : -1.0;
+    result.ok = result.ok && ok;
+    if (secs < result.secs) {
+      result.secs = secs;
+      result.bytes = bytes;
+    }
+  }
+  return result;
+}
+
+std::vector<Measurement> MeasureFile(const std::string& path, const FileSpec& spec, const Options& options,
+                                     const std::string& scratch) {
+  auto wants = [&](const char* op) {
+    return std::find(options.ops.begin(), options.ops.end(), op) != options.ops.end();
+  };
+  std::vector<std::string> caches = { "warm" };
+  if (EvictFromCache(path))
+    caches.insert(caches.begin(), "cold");
+  std::function<void()> warm_up = [&]() {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+    }
+  };
+
+  std::vector<Measurement> results;
+  for (const std::string& cache : caches) {
+    std::function<void()> before = cache == "cold" ? std::function<void()>([&]() { EvictFromCache(path); })
+                                                   : warm_up;
+    if (wants("read")) {
+      results.push_back(Measure("read", cache, options.runs, before, [&](uint64_t* bytes) {
+        CWaveFileRead reader(path);
+        *bytes = spec.bytes;
+        return reader.isValid() && reader.GetNumSamples() == spec.frames * spec.channels;
+      }));
+    }
+    if (wants("stream")) {
+      results.push_back(Measure("stream", cache, options.runs, before, [&](uint64_t* bytes) {
+        CWaveFileStreamRead reader(path);
+        std::vector<float> block(spec.rate / 100 * spec.channels);
+        uint64_t samples = 0;
+        uint32_t count;
+        while ((count = reader.ReadFloat(block.data(), static_cast<uint32_t>(block.size()))) > 0)
+          samples += count;
+        *bytes = spec.bytes;
+        return reader.isValid() && samples == spec.frames * spec.channels;
+      }));
+    }
+  }
+
+  // In-memory conversions and the write of a loaded file
+  if (!wants("float") && !wants("aligned") && !wants("write"))
+    return results;
+  std::unique_ptr<CWaveFileRead> reader;
+  auto load = [&]() { reader.reset(new CWaveFileRead(path)); };
+  const uint64_t float_bytes = spec.frames * spec.channels * sizeof(float);
+  if (wants("float")) {
+    // The float data is converted once per reader, every run gets a new one
+    results.push_back(Measure("float", "", options.runs, load, [&](uint64_t* bytes) {
+      *bytes = float_bytes;
+      return reader->GetFloatPCMData() != nullptr;
+    }));
+  }
+  if (wants("aligned")) {
+    load();
+    reader->GetFloatPCMData();
+    results.push_back(Measure("aligned", "", options.runs, nullptr, [&](uint64_t* bytes) {
+      *bytes = float_bytes;
+      return reader->GetFloatPCMDataAligned(480) != nullptr;
+    }));
+  }
+  if (wants("write")) {
+    load();
+    const float* samples = reader->GetFloatPCMData();
+    results.push_back(Measure("write", "", options.runs, nullptr, [&](uint64_t* bytes) {
+      CWaveFileWrite writer(scratch, spec.rate, spec.channels, 32, true);
+      const uint32_t frame = spec.rate / 100 * spec.channels;
+      const uint64_t total = spec.frames * spec.channels;
+      bool ok = samples != nullptr;
+      for (uint64_t offset = 0; ok && offset < total; offset += frame) {
+        uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(frame, total - offset));
+        ok = writer.writeChunk(samples + offset, count * sizeof(float));
+      }
+      *bytes = float_bytes;
+      return writer.commitFile() && ok;
+    }));
+    std::remove(scratch.c_str());
+  }
+  return results;
+}
+
+// JSON has no representation for inf or NaN, unknown values are null
+std::string JsonNumber(double value, int precision = 3) {
+  if (!std::isfinite(value) || value < 0.0)
+    return "null";
+  std::ostringstream text;
+  text << std::fixed << std::setprecision(precision) << value;
+  return text.str();
+}
+
+std::string JsonString(const std::string& value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    if (static_cast<unsigned char>(c) >= 0x20)
+      quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// One result per line, so --compare can read the files back without a JSON parser
+void WriteJson(std::ostream& out, const Options& options, const std::vector<FileSpec>& files,
+               const std::vector<std::vector<Measurement>>& results) {
+  std::time_t now = std::time(nullptr);
+  char timestamp[32];
+  std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  out << "{\n  \"benchmark\": \"wave_io_bench\",\n  \"version\": 1,\n  \"label\": " << JsonString(options.label)
+      << ",\n  \"timestamp\": \"" << timestamp << "\",\n  \"runs\": " << options.runs << ",\n  \"results\": [\n";
+  bool first = true;
+  for (size_t f = 0; f < files.size(); f++) {
+    const FileSpec& spec = files[f];
+    for (const Measurement& m : results[f]) {
+      out << (first ? "" : ",\n") << "    {\"file\": " << JsonString(spec.name) << ", \"hash\": \""
+          << cache::ToHex(spec.hash) << "\", \"bits\": " << spec.bits << ", \"float\": "
+          << (spec.is_float ? "true" : "false") << ", \"channels\": " << spec.channels << ", \"rate\": " << spec.rate
+          << ", \"layout\": " << JsonString(spec.layout) << ", \"bytes\": " << spec.bytes << ", \"op\": "
+          << JsonString(m.op) << ", \"cache\": " << (m.cache.empty() ? "null" : JsonString(m.cache))
+          << ", \"ok\": " << (m.ok ? "true" : "false") << ", \"secs\": " << JsonNumber(m.secs, 6)
+          << ", \"mb_per_s\": " << JsonNumber(m.bytes / m.secs / 1e6) << ", \"allocations\": " << m.allocations
+          << ", \"allocated_mb\": " << JsonNumber(m.allocated_bytes / 1e6) << ", \"peak_rss_mb\": "
+          << JsonNumber(m.peak_rss / 1e6) << ", \"rss_growth_mb\": " << JsonNumber(m.rss_growth / 1e6) << "}";
+      first = false;
+    }
+  }
+  out << "\n  ]\n}\n";
+}
+
+// Value of "key": in a result line without quotes, empty if missing
+std::string JsonField(const std::string& line, const std::string& key) {
+  std::string pattern = "\"" + key + "\": ";
+  std::size_t start = line.find(pattern);
+  if (start == std::string::npos)
+    return std::string();
+  start += pattern.size();
+  if (line[start] == '"') {
+    std::size_t end = line.find('"', start + 1);
+    return line.substr(start + 1, end - start - 1);
+  }
+  return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+struct ComparedResult {
+  std::string hash;
+  double mb_per_s;
+  double allocated_mb;
+};
+
+bool ReadResults(const std::string& path, std::map<std::string, ComparedResult>* results) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Unable to read " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::string op = JsonField(line, "op");
+    if (op.empty())
+      continue;
+    std::string cache = JsonField(line, "cache");
+    std::string key = JsonField(line, "file") + " " + op + (cache == "null" ? "" : " " + cache);
+    ComparedResult result;
+    result.hash = JsonField(line, "hash");
+    result.mb_per_s = std::strtod(JsonField(line, "mb_per_s").c_str(), nullptr);
+    result.allocated_mb = std::strtod(JsonField(line, "allocated_mb").c_str(), nullptr);
+    (*results)[key] = result;
+  }
+  return true;
+}
+
+int Compare(const Options& options) {
+  std::map<std::string, ComparedResult> old_results, new_results;
+  if (!ReadResults(options.compare_old, &old_results) || !ReadResults(options.compare_new, &new_results))
+    return -1;
+  std::cout << std::left << std::setw(64) << "File / op / cache" << std::right << std::setw(12) << "old MB/s"
+            << std::setw(12) << "new MB/s" << std::setw(10) << "change" << std::setw(14) << "alloc MB" << std::endl;
+  unsigned regressions = 0, compared = 0;
+  for (const auto& entry : new_results) {
+    auto old_entry = old_results.find(entry.first);
+    if (old_entry == old_results.end())
+      continue;
+    compared++;
+    const ComparedResult& before = old_entry->second;
+    const ComparedResult& after = entry.second;
+    double change = before.mb_per_s > 0.0 ? 100.0 * (after.mb_per_s / before.mb_per_s - 1.0) : 0.0;
+    bool regressed = change < -options.threshold;
+    regressions += regressed ? 1 : 0;
+    std::cout << std::left << std::setw(64) << entry.first << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << before.mb_per_s << std::setw(12) << after.mb_per_s << std::setw(9) << change
+              << "%" << std::setw(7) << before.allocated_mb << "->" << std::setw(5) << after.allocated_mb
+              << (regressed ? "  REGRESSION" : "") << (before.hash != after.hash ? "  (different input)" : "")
+              << std::endl;
+  }
+  std::cout << compared << " results compared, " << regressions << " slower by more than " << options.threshold
+            << "%" << std::endl;
+  return regressions > 0 ? -1 : 0;
+}
+
+std::string FormatName(const FileSpec& spec) {
+  return spec.is_float ? "f32" : std::to_string(spec.bits);
+}
+
+// Existing files with their size and hash, so an unchanged data set is not generated again
+std::map<std::string, std::pair<uint64_t, uint64_t>> ReadManifest(const std::string& path) {
+  std::map<std::string, std::pair<uint64_t, uint64_t>> manifest;
+  std::ifstream file(path);
+  std::string name, hash;
+  uint64_t bytes;
+  while (file >> name >> bytes >> hash)
+    manifest[name] = std::make_pair(bytes, std::strtoull(hash.c_str(), nullptr, 16));
+  return manifest;
+}
+
+// Creates dir and any missing parent directories. Returns false and prints the reason on failure.
+bool MakeDirectories(const std::string& dir) {
+  for (size_t end = dir.find_first_of("/\\", 1);; end = dir.find_first_of("/\\", end + 1)) {
+    std::string prefix = dir.substr(0, end);
+#ifdef _WIN32
+    int result = _mkdir(prefix.c_str());
+#else
+    int result = mkdir(prefix.c_str(), 0755);
+#endif
+    if (result != 0 && errno != EEXIST) {
+      std::cerr << "Unable to create directory " << prefix << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+    if (end == std::string::npos)
+      return true;
+  }
+}
+
+uint64_t GetFileSize(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  return file ? static_cast<uint64_t>(file.tellg()) : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: wave_io_bench [--dir D] [--mb MB | --secs S] [--formats 8,16,24,32,f32] [--channels 1,2]"
+              << std::endl
+              << "                     [--rates 16000,48000] [--layouts plain,odd,crowded]"
+              << " [--ops read,stream,float,aligned,write]" << std::endl
+              << "                     [--runs N] [--json FILE] [--label TEXT] [--generate-only]" << std::endl
+              << "       wave_io_bench --compare OLD.json NEW.json [--threshold PCT]" << std::endl;
+    return -1;
+  }
+  if (!options.compare_old.empty())
+    return Compare(options);
+
+  if (!MakeDirectories(options.dir))
+    return -1;
+  const std::string manifest_path = options.dir + "/manifest.txt";
+  std::map<std::string, std::pair<uint64_t, uint64_t>> manifest = ReadManifest(manifest_path);
+
+  // The data set: every format, channel count, rate and layout
+  std::vector<FileSpec> files;
+  for (const std::string& format : options.formats) {
+    for (uint32_t channels : options.channels) {
+      for (uint32_t rate : options.rates) {
+        for (const std::string& layout : options.layouts) {
+          FileSpec spec;
+          spec.is_float = format == "f32";
+          spec.bits = static_cast<uint16_t>(spec.is_float ? 32 : std::atoi(format.c_str()));
+          spec.channels = channels;
+          spec.rate = rate;
+          spec.layout = layout;
+          uint64_t frames = options.mb > 0.0 ? static_cast<uint64_t>(options.mb * 1e6 / spec.BlockAlign())
+                                             : static_cast<uint64_t>(options.secs * rate);
+          // RIFF sizes are 32 bit, and the whole-file reader counts samples in 32 bits
+          uint64_t max_frames = std::min<uint64_t>((UINT32_MAX - (1u << 16)) / spec.BlockAlign(),
+                                                   UINT32_MAX / channels);
+          spec.frames = std::max<uint64_t>(1, std::min(frames, max_frames));
+          std::ostringstream name;
+          name << FormatName(spec) << "_" << channels << "ch_" << rate << "_" << layout << "_" << spec.frames
+               << ".wav";
+          spec.name = name.str();
+          files.push_back(spec);
+        }
+      }
+    }
+  }
+
+  uint64_t total_bytes = 0;
+  unsigned generated = 0;
+  double generate_start = Now();
+  for (FileSpec& spec : files) {
+    std::string path = options.dir + "/" + spec.name;
+    auto known = manifest.find(spec.name);
+    if (known != manifest.end() && GetFileSize(path) == known->second.first) {
+      spec.bytes = known->second.first;
+      spec.hash = known->second.second;
+    } else {
+      if (!Generate(path, &spec)) {
+        std::cerr << "Unable to write " << path << std::endl;
+        return -1;
+      }
+      manifest[spec.name] = std::make_pair(spec.bytes, spec.hash);
+      generated++;
+    }
+    total_bytes += spec.bytes;
+  }
+  {
+    std::ofstream file(manifest_path);
+    for (const auto& entry : manifest)
+      file << entry.first << " " << entry.second.first << " " << cache::ToHex(entry.second.second) << "\n";
+  }
+  std::cout << std::fixed << std::setprecision(2) << "Data set " << options.dir << ": " << files.size()
+            << " files, " << total_bytes / 1e9 << " GB (" << generated << " generated in "
+            << Now() - generate_start << " secs)" << std::endl;
+  if (options.generate_only)
+    return 0;
+
+  std::vector<std::vector<Measurement>> results;
+  bool ok = true;
+  std::cout << std::left << std::setw(40) << "File" << std::setw(9) << "Op" << std::setw(6) << "Cache" << std::right
+            << std::setw(11) << "MB/s" << std::setw(10) << "allocs" << std::setw(11) << "alloc MB" << std::setw(10)
+            << "peak MB" << std::setw(10) << "+RSS MB" << std::endl;
+  for (const FileSpec& spec : files) {
+    results.push_back(MeasureFile(options.dir + "/" + spec.name, spec, options, options.dir + "/.write_scratch.wav"));
+    for (const Measurement& m : results.back()) {
+      ok = ok && m.ok;
+      std::cout << std::left << std::setw(40) << spec.name << std::setw(9) << m.op << std::setw(6)
+                << (m.cache.empty() ? "-" : m.cache) << std::right << std::fixed << std::setprecision(1)
+                << std::setw(11) << m.bytes / m.secs / 1e6 << std::setw(10) << m.allocations << std::setw(11)
+                << m.allocated_bytes / 1e6 << std::setw(10) << JsonNumber(m.peak_rss / 1e6, 1) << std::setw(10)
+                << JsonNumber(m.rss_growth / 1e6, 1) << (m.ok ? "" : "  FAILED") << std::endl;
+    }
+  }
+
+  if (!options.json.empty()) {
+    std::ofstream json(options.json);
+    WriteJson(json, options, files, results);
+    if (!json) {
+      std::cerr << "Unable to write " << options.json << std::endl;
+      return -1;
+    }
+    std::cout << "Results written to " << options.json << std::endl;
+  }
+  return ok ? 0 : -1;
+}
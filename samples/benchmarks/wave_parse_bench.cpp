@@ -0,0 +1,289 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// Measures the cost of the bounds-checked wav parser (utils/wave_reader): headers parsed per second
+// with ParseWaveImage() and conversion throughput of ConvertPCMToFloat() per sample format, next to
+// the unchecked converter it replaced. Randomly damaged headers are parsed as well and the returned
+// statuses counted, so the rejection paths are exercised too.
+//
+// Usage: wave_parse_bench [--secs S] [--chunks N] [--runs N]
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+struct Options {
+  // Audio per test file
+  double secs = 10.0;
+  // Metadata chunks in front of the data chunk
+  unsigned chunks = 8;
+  int runs = 5;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    if (arg == "--secs") {
+      options->secs = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--chunks") {
+      options->chunks = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--runs") {
+      options->runs = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->secs <= 0.0 || options->runs <= 0 || options->chunks > RIFF_INDEX_CAPACITY - 2) {
+    std::cerr << "--secs and --runs must be positive, --chunks at most " << RIFF_INDEX_CAPACITY - 2 << std::endl;
+    return false;
+  }
+  return true;
+}
+
+struct Format {
+  const char* name;
+  uint16_t tag;
+  uint16_t channels;
+  uint16_t bits;
+};
+
+const Format kFormats[] = {
+  { "8 bit mono", WAVE_FORMAT_PCM, 1, 8 },
+  { "16 bit mono", WAVE_FORMAT_PCM, 1, 16 },
+  { "24 bit stereo", WAVE_FORMAT_PCM, 2, 24 },
+  { "32 bit mono", WAVE_FORMAT_PCM, 1, 32 },
+  { "float mono", WAVE_FORMAT_IEEE_FLOAT, 1, 32 },
+};
+
+void Append(std::vector<uint8_t>* image, const void* data, size_t size) {
+  size_t offset = image->size();
+  image->resize(offset + size);
+  if (size > 0)
+    memcpy(image->data() + offset, data, size);
+}
+
+void AppendChunk(std::vector<uint8_t>* image, uint32_t id, const std::vector<uint8_t>& payload) {
+  RiffChunk chunk = { id, static_cast<uint32_t>(payload.size()) };
+  Append(image, &chunk, sizeof(chunk));
+  Append(image, payload.data(), payload.size());
+  if (payload.size() & 1)
+    image->push_back(0);
+}
+
+// wav file image with num_chunks odd sized metadata chunks in front of the audio
+std::vector<uint8_t> MakeImage(const Format& format, double secs, unsigned num_chunks) {
+  const uint32_t rate = 48000;
+  waveFormat_basic wfx;
+  wfx.formatTag = format.tag;
+  wfx.nChannels = format.channels;
+  wfx.nSamplesPerSec = rate;
+  wfx.nBlockAlign = static_cast<uint16_t>(format.channels * format.bits / 8);
+  wfx.nAvgBytesPerSec = rate * wfx.nBlockAlign;
+  wfx.wBitsPerSample = format.bits;
+
+  std::mt19937 generator(format.bits * 16 + format.channels);
+  std::vector<uint8_t> audio(static_cast<size_t>(secs * rate) * wfx.nBlockAlign);
+  for (uint8_t& byte : audio)
+    byte = static_cast<uint8_t>(generator());
+  if (format.tag == WAVE_FORMAT_IEEE_FLOAT) {
+    std::uniform_real_distribution<float> sample(-1.f, 1.f);
+    for (size_t i = 0; i + sizeof(float) <= audio.size(); i += sizeof(float)) {
+      float value = sample(generator);
+      memcpy(&audio[i], &value, sizeof(value));
+    }
+  }
+
+  std::vector<uint8_t> image;
+  RiffHeader header = { MAKEFOURCC('R', 'I', 'F', 'F'), 0, MAKEFOURCC('W', 'A', 'V', 'E') };
+  Append(&image, &header, sizeof(header));
+  std::vector<uint8_t> fmt(sizeof(wfx));
+  memcpy(fmt.data(), &wfx, sizeof(wfx));
+  AppendChunk(&image, MAKEFOURCC('f', 'm', 't', ' '), fmt);
+  for (unsigned i = 0; i < num_chunks; i++)
+    AppendChunk(&image, MAKEFOURCC('j', 'u', 'n', 'k'), std::vector<uint8_t>(33 + 10 * i, 0x20));
+  AppendChunk(&image, MAKEFOURCC('d', 'a', 't', 'a'), audio);
+  uint32_t riff_size = static_cast<uint32_t>(image.size() - sizeof(RiffChunk));
+  memcpy(&image[4], &riff_size, sizeof(riff_size));
+  return image;
+}
+
+// The converter before bounds hardening, for comparison. Loads a full int32 for 24 bit samples, so
+// the source needs a byte of slack after the last sample.
+void LegacyConvertPCMToFloat(const uint8_t* src, float* dst, uint32_t numSamples, const waveFormat_ext& wfx) {
+  const int8_t* audioDataPtr = reinterpret_cast<const int8_t*>(src);
+  if (wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT) {
+    memcpy(dst, audioDataPtr, numSamples * sizeof(float));
+    return;
+  }
+
+  const uint32_t bytesPerSample = wfx.nBlockAlign / wfx.nChannels;
+  for (uint32_t i = 0; i < numSamples; i++) {
+    switch (wfx.wBitsPerSample) {
+    case 8: {
+      uint8_t audioSample = *(reinterpret_cast<const uint8_t*>(audioDataPtr));
+      dst[i] = (audioSample - 128) / 128.0f;
+    } break;
+    case 16: {
+      int16_t audioSample = *(reinterpret_cast<const int16_t*>(audioDataPtr));
+      dst[i] = audioSample / 32768.0f;
+    } break;
+    case 24: {
+      int32_t audioSample = *(reinterpret_cast<const int32_t*>(audioDataPtr));
+      uint8_t data0 = audioSample & 0x000000ff;
+      uint8_t data1 = static_cast<uint8_t>((audioSample & 0x0000ff00) >> 8);
+      uint8_t data2 = static_cast<uint8_t>((audioSample & 0x00ff0000) >> 16);
+      int32_t Value = ((data2 << 24) | (data1 << 16) | (data0 << 8)) >> 8;
+      dst[i] = Value / 8388608.0f;
+    } break;
+    case 32: {
+      int32_t audioSample = *(reinterpret_cast<const int32_t*>(audioDataPtr));
+      dst[i] = audioSample / 2147483648.0f;
+    } break;
+    }
+    audioDataPtr += bytesPerSample;
+  }
+}
+
+// Best of runs, in seconds
+double BestTime(int runs, const std::function<void()>& body) {
+  double best = 1e30;
+  for (int run = 0; run < runs; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: wave_parse_bench [--secs S] [--chunks N] [--runs N]" << std::endl;
+    return -1;
+  }
+  bool passed = true;
+
+  std::vector<std::vector<uint8_t>> images;
+  for (const Format& format : kFormats)
+    images.push_back(MakeImage(format, options.secs, options.chunks));
+
+  // Both converters have to agree bit for bit on valid files
+  std::cout << "Conversion matches the unchecked converter:" << std::endl;
+  for (size_t f = 0; f < images.size(); f++) {
+    WaveFileInfo info;
+    WaveStatus status = ParseWaveImage(images[f].data(), images[f].size(), &info);
+    bool ok = status == WAVE_STATUS_OK;
+    if (ok) {
+      std::vector<uint8_t> padded(info.audioData, info.audioData + info.audioDataSize);
+      padded.resize(padded.size() + sizeof(int32_t));
+      std::vector<float> expected(info.numSamples), converted(info.numSamples);
+      LegacyConvertPCMToFloat(padded.data(), expected.data(), info.numSamples, info.wfx);
+      ConvertPCMToFloat(info.audioData, converted.data(), info.numSamples, info.wfx);
+      ok = memcmp(expected.data(), converted.data(), expected.size() * sizeof(float)) == 0;
+    }
+    passed = passed && ok;
+    std::cout << "  " << std::left << std::setw(16) << kFormats[f].name << std::right
+              << (ok ? "ok" : std::string("FAILED ") + GetWaveStatusString(status)) << std::endl;
+  }
+
+  // Damaged headers: a few bytes of the header area overwritten, or the file cut short
+  const size_t kDamaged = 100000;
+  std::vector<uint8_t> header(images[1].begin(), images[1].begin() + std::min<size_t>(images[1].size(), 4096));
+  std::mt19937 generator(7);
+  std::map<WaveStatus, size_t> statuses;
+  std::vector<uint8_t> damaged;
+  auto damaged_start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < kDamaged; i++) {
+    damaged = header;
+    size_t header_bytes = std::min<size_t>(damaged.size(), 64 + 50 * options.chunks);
+    for (unsigned k = 1 + generator() % 4; k > 0; k--)
+      damaged[generator() % header_bytes] = static_cast<uint8_t>(generator());
+    if (generator() % 4 == 0)
+      damaged.resize(generator() % damaged.size());
+    WaveFileInfo info;
+    statuses[ParseWaveImage(damaged.data(), damaged.size(), &info)]++;
+  }
+  double damaged_secs =
+    std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - damaged_start).count();
+  std::cout << std::endl << "Damaged headers (" << kDamaged << ", " << std::fixed << std::setprecision(2)
+            << kDamaged / damaged_secs / 1e6 << " M/s including mutation):" << std::endl;
+  for (const auto& entry : statuses) {
+    std::cout << "  " << std::left << std::setw(34) << GetWaveStatusString(entry.first) << std::right
+              << entry.second << std::endl;
+  }
+
+  std::cout << std::endl << "Throughput (" << options.secs << " secs at 48 kHz, " << options.chunks
+            << " metadata chunks, best of " << options.runs << ")" << std::endl;
+  std::cout << std::left << std::setw(16) << "Format" << std::right << std::setw(16) << "Mheaders/s"
+            << std::setw(18) << "checked GB/s" << std::setw(20) << "unchecked GB/s" << std::endl;
+  for (size_t f = 0; f < images.size(); f++) {
+    const std::vector<uint8_t>& image = images[f];
+    const size_t kHeaderParses = 200000;
+    WaveFileInfo info;
+    size_t parsed = 0;
+    double header_secs = BestTime(options.runs, [&] {
+      for (size_t i = 0; i < kHeaderParses; i++)
+        parsed += ParseWaveImage(image.data(), image.size(), &info) == WAVE_STATUS_OK;
+    });
+    if (parsed != kHeaderParses * options.runs)
+      passed = false;
+
+    std::vector<float> samples(info.numSamples);
+    double checked_secs = BestTime(options.runs, [&] {
+      WaveFileInfo parse;
+      if (ParseWaveImage(image.data(), image.size(), &parse) == WAVE_STATUS_OK)
+        ConvertPCMToFloat(parse.audioData, samples.data(), parse.numSamples, parse.wfx);
+    });
+    std::vector<uint8_t> padded(info.audioData, info.audioData + info.audioDataSize);
+    padded.resize(padded.size() + sizeof(int32_t));
+    double unchecked_secs = BestTime(options.runs, [&] {
+      LegacyConvertPCMToFloat(padded.data(), samples.data(), info.numSamples, info.wfx);
+    });
+    std::cout << std::left << std::setw(16) << kFormats[f].name << std::right << std::setw(16)
+              << kHeaderParses / header_secs / 1e6 << std::setw(18) << info.audioDataSize / checked_secs / 1e9
+              << std::setw(20) << info.audioDataSize / unchecked_secs / 1e9 << std::endl;
+  }
+
+  return passed ? 0 : 1;
+}
@@ -21,17 +21,50 @@
 #
 ###############################################################################*/
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <memory>
 #include <sstream>
 #include <chrono>
+#include <cstdio>
+#include <future>
 #include <thread>
 #include <set>
 
+#include <utils/analysis/SignalAnalyzer.hpp>
+#include <utils/audio_io/AudioStream.hpp>
+#include <utils/audio_io/DecodedInput.hpp>
+#include <utils/audio_io/LiveStream.hpp>
+#include <utils/cache/ResultCache.hpp>
+#include <utils/cache/ResultLookup.hpp>
 #include <utils/wave_reader/waveReadWrite.hpp>
 #include <utils/config_reader/ConfigReader.hpp>
+#include <utils/ipc/ShmRing.hpp>
+#include <utils/latency/EffectCalibration.hpp>
+#include <utils/latency/LatencyCalibration.hpp>
+#include <utils/metrics/EffectMetrics.hpp>
+#include <utils/metrics/Metrics.hpp>
+#include <utils/dsp/Loudness.hpp>
+#include <utils/dsp/SimdKernels.hpp>
+#include <utils/pipeline/EffectPipeline.hpp>
+#include <utils/pipeline/FrameStages.hpp>
+#include <utils/pipeline/Migration.hpp>
+#include <utils/pipeline/PackedFrames.hpp>
+#include <utils/pipeline/RunStage.hpp>
+#include <utils/pipeline/Segments.hpp>
+#include <utils/pipeline/SegmentRunner.hpp>
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/replay/CapturedCalls.hpp>
+#include <utils/replay/ReplayLog.hpp>
+#include <utils/rtp/RtpStream.hpp>
+#include <utils/scheduler/DeviceScheduler.hpp>
+#include <utils/scheduler/NvAFXBackend.hpp>
+#include <utils/startup/StartupProfile.hpp>
+#include <utils/trace/Trace.hpp>
+#include <utils/verify/WaveVerifier.hpp>
 
 #include <nvAudioEffects.h>
 
@@ -45,6 +78,79 @@ const char kConfigFileRTVariable[] = "real_time";
 const char kConfigIntensityRatioVariable[] = "intensity_ratio";
 const char kConfigVadEnable[] = "enable_vad";
 const char kConfigFileModelVariable[] = "model";
+const char kConfigVerifyMaxAbsError[] = "verify_max_abs_error";
+const char kConfigVerifyMinSnr[] = "verify_min_snr_db";
+const char kConfigVerifyMaxLsd[] = "verify_max_lsd_db";
+const char kConfigTraceFile[] = "trace_file";
+const char kConfigMetricsPort[] = "metrics_port";
+const char kConfigMetricsFile[] = "metrics_file";
+const char kConfigMetricsInterval[] = "metrics_interval_ms";
+const char kConfigCheckpointInterval[] = "checkpoint_interval_secs";
+const char kConfigResumePreroll[] = "resume_preroll_frames";
+const char kConfigOutputCompressionLevel[] = "output_compression_level";
+const char kConfigParallelSegments[] = "parallel_segments";
+const char kConfigSegmentPreroll[] = "segment_preroll_secs";
+const char kConfigSegmentCrossfade[] = "segment_crossfade_ms";
+const char kConfigSegmentCrossfadeShape[] = "segment_crossfade_shape";
+const char kConfigParallelCompare[] = "parallel_compare";
+const char kConfigPreserveMetadata[] = "preserve_metadata";
+const char kConfigParallelStartup[] = "parallel_startup";
+const char kConfigPropertyCache[] = "property_cache";
+const char kConfigStartupProfile[] = "startup_profile";
+const char kConfigDevices[] = "devices";
+const char kConfigInstancesPerDevice[] = "instances_per_device";
+const char kConfigAnalysis[] = "analysis";
+const char kConfigAnalysisSummary[] = "analysis_summary";
+const char kConfigAnalysisSeries[] = "analysis_series";
+const char kConfigLoudnessTarget[] = "loudness_target";
+const char kConfigLoudnessTruePeak[] = "loudness_true_peak";
+const char kConfigLoudnessLookahead[] = "loudness_lookahead_ms";
+const char kConfigLoudnessMode[] = "loudness_mode";
+const char kConfigReplayCapture[] = "replay_capture";
+const char kConfigMigrateInterval[] = "migrate_interval_secs";
+const char kConfigMigrationHistory[] = "migration_history_frames";
+const char kConfigMigrationWarmupRate[] = "migration_warmup_rate";
+const char kConfigMigrationCrossfade[] = "migration_crossfade_frames";
+const char kConfigCpuFeed[] = "cpu_feed";
+const char kConfigCpuIo[] = "cpu_io";
+const char kConfigCpuWorkers[] = "cpu_workers";
+const char kConfigRealtimePriority[] = "realtime_priority";
+const char kConfigResultCache[] = "result_cache";
+const char kConfigResultCacheMaxMb[] = "result_cache_max_mb";
+const char kConfigResultCacheLink[] = "result_cache_link";
+const char kConfigFollowInput[] = "follow_input";
+const char kConfigFollowIdle[] = "follow_idle_secs";
+const char kConfigTransportFormat[] = "transport_format";
+const char kConfigLatencyTable[] = "latency_table";
+const char kConfigLatencyCompensation[] = "latency_compensation";
+const char kConfigLatencyMs[] = "latency_ms";
+// Used when the config does not name a latency table
+const char kDefaultLatencyTable[] = "effects_demo_latency.cache";
+// Longest delay --calibrate-latency looks for
+const double kCalibrationMaxDelaySecs = 0.5;
+
+// Values of the "handle_state" trace counter
+enum HandleState {
+  kHandleCreated = 1,
+  kHandleLoaded = 2,
+  kHandleRunning = 3,
+  kHandleDestroyed = 4,
+};
+
+// Options passed on the command line
+struct CommandLineOptions {
+  std::string config_file;
+  // Golden wav the produced output is compared against
+  std::string verify_wav;
+  // Machine readable verification report
+  std::string verify_report;
+  // Continue from the checkpoint of a previous run
+  bool resume = false;
+  // Print the effects supported by the SDK
+  bool list_effects = false;
+  // Measure the algorithmic delay of the effect before processing
+  bool calibrate_latency = false;
+};
 
 } // namespace
 
@@ -61,50 +167,176 @@ std::vector<std::string> GetList(std::string effect, const char delimeter[] = ",
   }
   return List;
 }
-const std::string GetErrorCodeString(NvAFX_Status status) {
-  switch (status) {
-  case NVAFX_STATUS_SUCCESS:
-    return "NVAFX_STATUS_SUCCESS";
-  case NVAFX_STATUS_FAILED:
-    return "NVAFX_STATUS_FAILED";
-  case NVAFX_STATUS_INVALID_HANDLE:
-    return "NVAFX_STATUS_INVALID_HANDLE";
-  case NVAFX_STATUS_INVALID_PARAM:
-    return "NVAFX_STATUS_INVALID_PARAM";
-  case NVAFX_STATUS_IMMUTABLE_PARAM:
-    return "NVAFX_STATUS_IMMUTABLE_PARAM";
-  case NVAFX_STATUS_INSUFFICIENT_DATA:
-    return "NVAFX_STATUS_INSUFFICIENT_DATA";
-  case NVAFX_STATUS_EFFECT_NOT_AVAILABLE:
-    return "NVAFX_STATUS_EFFECT_NOT_AVAILABLE";
-  case NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL:
-    return "NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL";
-  case NVAFX_STATUS_MODEL_LOAD_FAILED:
-    return "NVAFX_STATUS_MODEL_LOAD_FAILED";
-  case NVAFX_STATUS_32_SERVER_NOT_REGISTERED:
-    return "NVAFX_STATUS_32_SERVER_NOT_REGISTERED";
-  case NVAFX_STATUS_32_COM_ERROR:
-    return "NVAFX_STATUS_32_COM_ERROR";
-  case NVAFX_STATUS_GPU_UNSUPPORTED:
-    return "NVAFX_STATUS_GPU_UNSUPPORTED";
-  default:
-    return "NVAFX_STATUS_SUCCESS";
+// Reads the loudness_* config. Returns false if the config is invalid, *enabled tells if a target is set.
+bool ReadLoudnessConfig(const ConfigReader& config_reader, bool* enabled, dsp::LoudnessOptions* options,
+                        bool* two_pass) {
+  std::string value;
+  *enabled = config_reader.IsConfigValueAvailable(kConfigLoudnessTarget) &&
+             config_reader.GetConfigValue(kConfigLoudnessTarget, &value);
+  if (!*enabled)
+    return true;
+  options->target_lufs = std::strtod(value.c_str(), nullptr);
+  if (config_reader.IsConfigValueAvailable(kConfigLoudnessTruePeak) &&
+      config_reader.GetConfigValue(kConfigLoudnessTruePeak, &value)) {
+    options->true_peak_db = std::strtod(value.c_str(), nullptr);
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigLoudnessLookahead) &&
+      config_reader.GetConfigValue(kConfigLoudnessLookahead, &value)) {
+    options->lookahead_ms = std::max(0.1, std::strtod(value.c_str(), nullptr));
+  }
+  *two_pass = false;
+  if (config_reader.IsConfigValueAvailable(kConfigLoudnessMode) &&
+      config_reader.GetConfigValue(kConfigLoudnessMode, &value)) {
+    if (value == "two_pass") {
+      *two_pass = true;
+    } else if (value != "stream") {
+      std::cerr << kConfigLoudnessMode << " must be stream or two_pass" << std::endl;
+      return false;
+    }
   }
+  return true;
 }
+
+// Reads the cpu_* and realtime_priority config into placement::ThreadPlacement. Returns false if the
+// config is invalid.
+bool ConfigurePlacement(const ConfigReader& config_reader) {
+  const struct {
+    const char* key;
+    placement::Role role;
+  } kRoleKeys[] = {
+    { kConfigCpuFeed, placement::Role::kFeed },
+    { kConfigCpuIo, placement::Role::kIo },
+    { kConfigCpuWorkers, placement::Role::kWorker },
+  };
+  std::string value;
+  for (const auto& role_key : kRoleKeys) {
+    if (config_reader.IsConfigValueAvailable(role_key.key) && config_reader.GetConfigValue(role_key.key, &value)) {
+      std::vector<int> cpus;
+      if (!placement::ParseCpuList(value, &cpus)) {
+        std::cerr << role_key.key << " must be a CPU list like 0-3,8" << std::endl;
+        return false;
+      }
+      placement::ThreadPlacement::Get().SetCpus(role_key.role, cpus);
+    }
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigRealtimePriority) &&
+      config_reader.GetConfigValue(kConfigRealtimePriority, &value)) {
+    int priority = std::atoi(value.c_str());
+    if (priority < 0 || priority > 99) {
+      std::cerr << kConfigRealtimePriority << " must be between 0 and 99" << std::endl;
+      return false;
+    }
+    // A SCHED_FIFO feed loop that never sleeps would starve everything else on its CPUs
+    std::string real_time;
+    if (priority > 0 && !(config_reader.GetConfigValue(kConfigFileRTVariable, &real_time) &&
+                          std::atoi(real_time.c_str()) != 0)) {
+      std::cout << "Note: " << kConfigRealtimePriority << " needs " << kConfigFileRTVariable << " 1, ignored"
+                << std::endl;
+    } else if (priority > 0) {
+      placement::ThreadPlacement::Get().SetRealtimePriority(placement::Role::kFeed, priority);
+    }
+  }
+  return true;
+}
+
+void PrintLoudness(const char* mode, double input_lufs, const dsp::LoudnessNormalizer& normalizer, double secs,
+                   size_t num_samples) {
+  std::ios_base::fmtflags flags = std::cout.flags();
+  std::streamsize precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(2) << "Loudness (" << mode << "): effect output " << input_lufs
+            << " LUFS, normalized " << normalizer.GetOutputMeter().GetIntegratedLoudness() << " LUFS, gain "
+            << normalizer.GetGainDb() << " dB" << std::endl
+            << "Limiter: " << normalizer.GetLimitedSamples() << " samples limited, up to "
+            << normalizer.GetMaxReductionDb() << " dB" << std::endl;
+  if (secs > 0.0)
+    std::cout << "Loudness stage: " << num_samples / secs / 1e6 << " Msamples/s" << std::endl;
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
 class EffectsDemoApp {
  public:
   bool run(const ConfigReader& config_reader, std::unordered_map<std::string, std::vector<std::string>>& map);
+  // Compare the produced output against a golden wav file
+  bool verify_output(const ConfigReader& config_reader, const std::string& reference_wav,
+                     const std::string& report_file);
+  // Continue processing from the output's checkpoint
+  void set_resume(bool resume) { resume_ = resume; }
+  // Measure the algorithmic delay and store it in the latency table before processing
+  void set_calibrate_latency(bool calibrate) { calibrate_latency_ = calibrate; }
+  // Prints the effects supported by the SDK. Only called when needed, enumeration is not free.
+  static bool print_effect_list();
  private:
   // Validate configuration data.
   bool validate_config(const ConfigReader& config_reader, std::unordered_map<std::string, std::vector<std::string>>& map);
   bool chaining_run(const ConfigReader& config_reader,std::unordered_map<std::string, std::vector<std::string>>& map);
+  // Creates the effect (single or chained) described by map, sets its parameters and loads it.
+  // With user_cuda_context the handle uses the CUDA context current on the calling thread.
+  bool create_handle(std::unordered_map<std::string, std::vector<std::string>>& map, NvAFX_Handle* handle,
+                     bool verbose, bool user_cuda_context = false);
   bool generate_output(const ConfigReader& config_reader, NvAFX_Handle& handle_);
+  // Processes a live rtp:// or shm:// input or a followed recording frame by frame as it arrives, to a
+  // file, an rtp:// or an shm:// output
+  bool generate_output_stream(const ConfigReader& config_reader, NvAFX_Handle handle, const std::string& input_url);
+  // Queries input / output format of a loaded effect, or takes it from the property cache
+  bool query_properties(NvAFX_Handle handle);
+  // The format found by query_properties()
+  startup::EffectProperties get_properties() const;
+  // Waits for an input decoded during startup (or reads it now) and checks it against the effect.
+  // content_hash, if given, receives the hash of the samples.
+  bool load_input(const std::string& filename, std::future<audio_io::DecodedAudio>* pending, std::vector<float>* data,
+                  std::vector<audio_io::MetadataChunk>* metadata, uint64_t* content_hash = nullptr);
+  // Opens the inputs to be decoded while they are processed. Leaves them to load_input() and returns
+  // false if an input can not be streamed.
+  bool open_stream_inputs(const ConfigReader& config_reader, uint32_t block_samples);
+  // Prints the startup breakdown once processing is about to start
+  void report_startup();
+  // Splits the input into segments processed in parallel on one handle each, writes the stitched output.
+  // With the devices config the segments are spread over the devices by a scheduler::DeviceScheduler.
+  bool generate_output_parallel(const ConfigReader& config_reader, NvAFX_Handle handle, unsigned num_segments,
+                                const float* const* inputs, size_t num_frames, audio_io::AudioSink* sink,
+                                analysis::SignalAnalyzer* analyzer, dsp::LoudnessNormalizer* normalizer);
+  // Waits for the analysis of all frames, prints it and writes the summary and time series files
+  bool report_analysis(const ConfigReader& config_reader, analysis::SignalAnalyzer* analyzer,
+                       const std::string& output_wav_file_name);
+  // Devices from the devices config, in preference order
+  std::vector<int> select_devices(const std::string& value) const;
+  // Packs the first num_frames frames of the inputs into packed_inputs_ and releases the float buffers.
+  // Prints the size, bandwidth and error of the transport format.
+  void pack_inputs(pipeline::TransportFormat format, size_t num_frames, std::vector<float>* audio_data,
+                   std::vector<float>* farend_audio_data);
+  // Decodes and hashes the inputs and looks their output up in the result cache, before the effect is
+  // created. *hit tells if the output was written from the cache.
+  bool lookup_result(const ConfigReader& config_reader, bool* hit);
+  bool destroy_handle(NvAFX_Handle handle);
+  // Takes the algorithmic delay from latency_ms or the latency table, measuring it first with
+  // --calibrate-latency, and sets the output compensation
+  bool prepare_latency(const ConfigReader& config_reader, NvAFX_Handle handle);
+  // Commits the output, removes a stale checkpoint and destroys the handle. With result_cache the
+  // output is stored as the entry for cache_key.
+  bool commit_output(audio_io::AudioSink* sink, const std::string& output_wav, const std::string& checkpoint_file,
+                     size_t num_samples, NvAFX_Handle handle, cache::ResultCache* result_cache = nullptr,
+                     const std::string& cache_key = std::string());
+  // Reads a checkpoint written by a pipeline::CheckpointStage for the same input and frame size
+  bool load_checkpoint(const std::string& checkpoint_file, const std::string& input_wav, size_t* frame_offset,
+                       uint32_t* output_bytes);
   // EffectsDemoApp intensity_ratio config
   float intensity_ratio_ = 1.0f;
   // inited from configuration
   bool real_time_ = false;
+  // Resume from checkpoint
+  bool resume_ = false;
+  bool calibrate_latency_ = false;
+  // Output samples dropped (or silence written for a negative delay) to align the output with the
+  // input, 0 without compensation. flush_frames_ frames of silence are processed after the input.
+  int64_t output_delay_ = 0;
+  size_t flush_frames_ = 0;
   // for aec effect only
   bool is_aec_ = false;
+  // input_wav is a recording that is still being written
+  bool follow_input_ = false;
+  // Whole-file inputs in the transport_format, null for float inputs
+  std::unique_ptr<pipeline::PackedFrames> packed_inputs_[2];
   // Inited from configuration
   bool vad_supported_ = false;
   //Model Params
@@ -114,73 +346,162 @@ class EffectsDemoApp {
   unsigned num_output_channels_ = 0;
   unsigned num_input_samples_per_frame_ = 0;
   unsigned num_output_samples_per_frame_ = 0;
+  // Effect description from the config, used to create additional handles
+  std::unordered_map<std::string, std::vector<std::string>> effect_config_;
+  // Inputs decoded while the effect is created and loaded. Hashed for the result cache, which waits for
+  // them before the effect is created.
+  bool hash_inputs_ = false;
+  std::future<audio_io::DecodedAudio> pending_input_;
+  std::future<audio_io::DecodedAudio> pending_farend_;
+  // Result cache of the run and the key of its output, set up by lookup_result()
+  std::unique_ptr<cache::ResultCache> result_cache_;
+  std::string cache_key_;
+  // Without a whole-file feature the inputs are decoded block by block as they are processed, see
+  // pipeline::ReadStage. stream_inputs_ are opened during startup or by generate_output().
+  bool stream_input_ = false;
+  std::unique_ptr<audio_io::AudioSource> stream_inputs_[2];
+  // Property cache file, empty if disabled
+  std::string property_cache_file_;
+  std::string property_cache_key_;
+  bool have_cached_properties_ = false;
+  startup::EffectProperties cached_properties_;
+  bool startup_profile_ = true;
+  // Reported by NvAFX_GetSupportedDevices, most preferred first
+  std::vector<int> supported_devices_;
 };
 
 
-bool ReadWavFile(const std::string& filename, uint32_t expected_sample_rate, std::vector<float>* data,
-  int align_samples) {
-  CWaveFileRead wave_file(filename);
-  if (wave_file.isValid() == false) {
+bool EffectsDemoApp::open_stream_inputs(const ConfigReader& config_reader, uint32_t block_samples) {
+  stream_inputs_[0] = audio_io::OpenStreamInput(config_reader.GetConfigValue(kConfigFileInputVariable), block_samples);
+  if (stream_inputs_[0] && is_aec_) {
+    stream_inputs_[1] = audio_io::OpenStreamInput(config_reader.GetConfigValue(kConfigFileInputFarEndVariable),
+                                                  block_samples);
+  }
+  if (!stream_inputs_[0] || (is_aec_ && !stream_inputs_[1])) {
+    stream_inputs_[0].reset();
+    stream_inputs_[1].reset();
+    stream_input_ = false;
     return false;
   }
-  std::cout << "Total number of samples: " << wave_file.GetNumSamples() << std::endl;
-  std::cout << "Size in bytes: " << wave_file.GetRawPCMDataSizeInBytes() << std::endl;
-  std::cout << "Sample rate: " << wave_file.GetSampleRate() << std::endl;
+  return true;
+}
 
-  auto bits_per_sample = wave_file.GetBitsPerSample();
-  std::cout << "Bits/sample: " << bits_per_sample << std::endl;
+bool EffectsDemoApp::load_input(const std::string& filename, std::future<audio_io::DecodedAudio>* pending,
+                                std::vector<float>* data, std::vector<audio_io::MetadataChunk>* metadata,
+                                uint64_t* content_hash) {
+  if (!pending->valid())
+    return audio_io::ReadAudioFile(filename, input_sample_rate_, data, num_input_samples_per_frame_, metadata,
+                                   content_hash);
 
-  if (wave_file.GetSampleRate() != expected_sample_rate) {
-    std::cout << "Sample rate mismatch" << std::endl;
-    return false;
-  }
-  if (wave_file.GetWaveFormat().nChannels != 1) {
-    std::cout << "Channel count needs to be 1" << std::endl;
-    return false;
+  audio_io::DecodedAudio decoded;
+  {
+    startup::ScopedPhase phase("wait_input");
+    decoded = pending->get();
   }
+  if (content_hash)
+    *content_hash = decoded.content_hash;
+  return audio_io::PrepareInput(&decoded, input_sample_rate_, num_input_samples_per_frame_, data, metadata);
+}
 
-  if (align_samples != -1) {
-    int num_frames = wave_file.GetNumSamples() / align_samples;
-    if (wave_file.GetNumSamples() % align_samples) {
-      num_frames++;
-    }
+void EffectsDemoApp::report_startup() {
+  startup::Profile::Get().MarkFirstFrame();
+  if (startup_profile_)
+    startup::Profile::Get().Print(std::cout);
+}
 
-    // allocate potentially a bigger sized buffer to align it to requested
-    data->resize(num_frames * align_samples);
-  } else {
-    data->resize(wave_file.GetNumSamples(), 0.f);
+bool EffectsDemoApp::load_checkpoint(const std::string& checkpoint_file, const std::string& input_wav,
+                                     size_t* frame_offset, uint32_t* output_bytes) {
+  pipeline::Checkpoint checkpoint;
+  if (!pipeline::ReadCheckpoint(checkpoint_file, &checkpoint)) {
+    std::cerr << "Invalid checkpoint file: " << checkpoint_file << std::endl;
+    return false;
+  }
+  if (checkpoint.input_wav != input_wav || checkpoint.frame_size != num_input_samples_per_frame_) {
+    std::cerr << "Checkpoint " << checkpoint_file << " was written for a different input or effect" << std::endl;
+    return false;
   }
 
-  const float* raw_data_array = wave_file.GetFloatPCMData();
-  std::copy(raw_data_array, raw_data_array + wave_file.GetNumSamples(), data->data());
+  *frame_offset = checkpoint.frame_offset;
+  *output_bytes = checkpoint.output_bytes;
   return true;
 }
 
 bool EffectsDemoApp::generate_output(const ConfigReader& config_reader, NvAFX_Handle& handle_) {
+  // Placed before the frame buffer is allocated, so it lands on the feed thread's NUMA node
+  placement::ThreadScope placement_scope(placement::Role::kFeed, "feed");
+  if (!prepare_latency(config_reader, handle_))
+    return false;
   std::string input_wav = config_reader.GetConfigValue(kConfigFileInputVariable);
+  if (rtp::IsRtpUrl(input_wav) || ipc::IsShmUrl(input_wav) || follow_input_)
+    return generate_output_stream(config_reader, handle_, input_wav);
 
+  // Streamed inputs stay empty, their frames are read by a ReadStage. The sizes are padded to whole frames.
+  const bool stream_input = stream_input_ &&
+                            (stream_inputs_[0] || open_stream_inputs(config_reader, num_input_samples_per_frame_));
   std::vector<float> audio_data;
-  if (!ReadWavFile(input_wav, input_sample_rate_, &audio_data, num_input_samples_per_frame_)) {
-    std::cerr << "Unable to read wav file: " << input_wav << std::endl;
-    return false;
+  std::vector<audio_io::MetadataChunk> metadata;
+  size_t input_size = 0;
+  if (stream_input) {
+    if (!audio_io::CheckStreamInput(*stream_inputs_[0], input_sample_rate_, num_input_samples_per_frame_,
+                                    &input_size)) {
+      std::cerr << "Unable to read wav file: " << input_wav << std::endl;
+      return false;
+    }
+    metadata = stream_inputs_[0]->GetMetadata();
+  } else {
+    if (!load_input(input_wav, &pending_input_, &audio_data, &metadata)) {
+      std::cerr << "Unable to read wav file: " << input_wav << std::endl;
+      return false;
+    }
+    input_size = audio_data.size();
   }
   std::cout << "Input wav file: " << input_wav << std::endl
-            << "Total " << audio_data.size() << " samples read" << std::endl;
+            << "Total " << input_size << " samples read" << std::endl;
 
   std::vector<float> farend_audio_data;
+  size_t farend_size = 0;
   if (is_aec_) {
     std::string input_farend_wav = config_reader.GetConfigValue(kConfigFileInputFarEndVariable);
-    if (!ReadWavFile(input_farend_wav, input_sample_rate_, &farend_audio_data, num_input_samples_per_frame_)) {
+    if (stream_input ? !audio_io::CheckStreamInput(*stream_inputs_[1], input_sample_rate_,
+                                                   num_input_samples_per_frame_, &farend_size)
+                     : !load_input(input_farend_wav, &pending_farend_, &farend_audio_data, nullptr)) {
       std::cerr << "Unable to read wav file: " << input_farend_wav << std::endl;
       return false;
     }
+    if (!stream_input)
+      farend_size = farend_audio_data.size();
     std::cout << "Input wav file: " << input_farend_wav << std::endl
-              << "Total " << farend_audio_data.size() << " samples read" << std::endl;
+              << "Total " << farend_size << " samples read" << std::endl;
   }
   std::string output_wav = config_reader.GetConfigValue(kConfigFileOutputVariable);
 
-  CWaveFileWrite wav_write(output_wav, output_sample_rate_, num_output_channels_, 32, true);
-  
+  int compression_level = -1;
+  std::string compression_value;
+  if (config_reader.IsConfigValueAvailable(kConfigOutputCompressionLevel) &&
+      config_reader.GetConfigValue(kConfigOutputCompressionLevel, &compression_value)) {
+    compression_level = std::atoi(compression_value.c_str());
+  }
+  std::unique_ptr<audio_io::AudioSink> output_sink;
+  {
+    startup::ScopedPhase phase("open_output");
+    output_sink = audio_io::CreateAudioSink(output_wav, output_sample_rate_, num_output_channels_, compression_level);
+  }
+  if (!output_sink) {
+    return false;
+  }
+
+  std::string preserve_value;
+  bool preserve_metadata = !(config_reader.IsConfigValueAvailable(kConfigPreserveMetadata) &&
+                             config_reader.GetConfigValue(kConfigPreserveMetadata, &preserve_value) &&
+                             std::atoi(preserve_value.c_str()) == 0);
+  if (preserve_metadata && !metadata.empty()) {
+    // Markers and time references count samples, follow the output sample rate
+    audio_io::RescaleMetadata(&metadata, input_sample_rate_, output_sample_rate_);
+    if (!output_sink->SetMetadata(metadata)) {
+      std::cout << "Metadata of " << input_wav << " is not preserved in " << output_wav << std::endl;
+    }
+  }
+
   std::size_t dot_pos = output_wav.find_last_of('.');
   std::string output_wav_file_name;
   if (dot_pos == std::string::npos || output_wav.substr(dot_pos+1) != "wav") {
@@ -189,95 +510,864 @@ bool EffectsDemoApp::generate_output(const ConfigReader& config_reader, NvAFX_Ha
     output_wav_file_name = output_wav.substr(0, dot_pos);
   }
 
-  float frame_in_secs = static_cast<float>(num_input_samples_per_frame_) / static_cast<float>(input_sample_rate_);
-  float total_run_time = 0.f;
-  float total_audio_duration = 0.f;
-  float checkpoint = 0.1f;
-  float expected_audio_duration = static_cast<float>(audio_data.size()) / static_cast<float>(input_sample_rate_);
-  auto frame = std::make_unique<float[]>(num_output_samples_per_frame_);
-  
-  std::string progress_bar = "[          ] ";
-  std::cout << "Processed: " << progress_bar << "0%\r";
-  std::cout.flush();
+  std::string analysis_value;
+  std::unique_ptr<analysis::SignalAnalyzer> analyzer;
+  if (config_reader.IsConfigValueAvailable(kConfigAnalysis) &&
+      config_reader.GetConfigValue(kConfigAnalysis, &analysis_value) && std::atoi(analysis_value.c_str()) != 0) {
+    analyzer.reset(new analysis::SignalAnalyzer(input_sample_rate_, num_input_samples_per_frame_, output_sample_rate_,
+                                                num_output_samples_per_frame_));
+  }
 
-  size_t final_audio_size = audio_data.size();
+  bool loudness = false;
+  bool loudness_two_pass = false;
+  dsp::LoudnessOptions loudness_options;
+  if (!ReadLoudnessConfig(config_reader, &loudness, &loudness_options, &loudness_two_pass))
+    return false;
+  std::unique_ptr<dsp::LoudnessNormalizer> normalizer;
+  if (loudness) {
+    if (resume_) {
+      std::cerr << kConfigLoudnessTarget << " can not be combined with --resume" << std::endl;
+      return false;
+    }
+    normalizer.reset(new dsp::LoudnessNormalizer(output_sample_rate_, loudness_options));
+  }
+
+  pipeline::ProcessingState state;
+  state.frame_in_secs = static_cast<float>(num_input_samples_per_frame_) / static_cast<float>(input_sample_rate_);
+  placement::LocalBuffer frame(num_output_samples_per_frame_ * num_output_channels_);
+  if (!frame.get()) {
+    std::cerr << "Unable to allocate the frame buffer" << std::endl;
+    return false;
+  }
+
+  size_t final_audio_size = input_size;
   //Taking the min size of farend and nearend if their sizes mismatch
   if (is_aec_) {
-    if (audio_data.size() != farend_audio_data.size()) {
-      final_audio_size = std::min(audio_data.size(), farend_audio_data.size());
-    }
-  }
-  // wav data is already padded to align to num_samples_per_frame by ReadWavFile()
-  for (size_t offset = 0; offset < final_audio_size; offset += num_input_samples_per_frame_) {
-    auto start_tick = std::chrono::high_resolution_clock::now();
-    if (is_aec_) {
-      const float* input[2];
-      float* output[1];
-      input[0] = &audio_data.data()[offset];
-      input[1] = &farend_audio_data.data()[offset];
-      output[0] = frame.get();
-      NvAFX_Status status = NvAFX_Run(handle_, input, output, num_input_samples_per_frame_, num_input_channels_);
-      if (status != NVAFX_STATUS_SUCCESS) {
-        std::cerr << "NvAFX_Run() failed with error " << GetErrorCodeString(status) << std::endl;
-        return false;
-      }
-    } else {
-      const float* input[1];
-      float* output[1];
-      input[0] = &audio_data.data()[offset];
-      output[0] = frame.get();
-      NvAFX_Status status = NvAFX_Run(handle_, input, output, num_input_samples_per_frame_, num_input_channels_);
-      if (status != NVAFX_STATUS_SUCCESS) {
-        std::cerr << "NvAFX_Run() failed with error " << GetErrorCodeString(status) << std::endl;
-        return false;
+    if (input_size != farend_size) {
+      final_audio_size = std::min(input_size, farend_size);
+    }
+  }
+
+  if (!pipeline::IsSupportedLayout(num_input_channels_, num_output_channels_)) {
+    std::cerr << "Unsupported channel layout: " << num_input_channels_ << " in, " << num_output_channels_ << " out"
+              << std::endl;
+    return false;
+  }
+  const size_t num_input_samples = input_size;
+  // Frames of silence after the input flush the delayed end of the output
+  const size_t output_length = final_audio_size / num_input_samples_per_frame_ * num_output_samples_per_frame_;
+  if (output_delay_ > 0) {
+    flush_frames_ = (static_cast<size_t>(output_delay_) + num_output_samples_per_frame_ - 1) /
+                    num_output_samples_per_frame_;
+    if (!stream_input) {
+      audio_data.resize(final_audio_size);
+      audio_data.resize(final_audio_size + flush_frames_ * num_input_samples_per_frame_, 0.f);
+      if (is_aec_) {
+        farend_audio_data.resize(final_audio_size);
+        farend_audio_data.resize(audio_data.size(), 0.f);
       }
     }
+    final_audio_size += flush_frames_ * num_input_samples_per_frame_;
+  }
+  std::string transport_value;
+  if (config_reader.IsConfigValueAvailable(kConfigTransportFormat) &&
+      config_reader.GetConfigValue(kConfigTransportFormat, &transport_value)) {
+    pipeline::TransportFormat transport;
+    if (!pipeline::ParseTransportFormat(transport_value, &transport)) {
+      std::cerr << kConfigTransportFormat << " must be float32, fp16, bf16 or int16" << std::endl;
+      return false;
+    }
+    if (transport != pipeline::TransportFormat::kFloat32)
+      pack_inputs(transport, final_audio_size / num_input_samples_per_frame_, &audio_data, &farend_audio_data);
+  }
+  // Planar input and output of the effect, farend_audio_data is only read by 2 channel (AEC) layouts.
+  // Packed inputs are restored frame by frame by an UnpackStage, streamed inputs read by a ReadStage.
+  const float* inputs[2] = { packed_inputs_[0] || stream_input ? nullptr : audio_data.data(),
+                             packed_inputs_[1] || stream_input ? nullptr : farend_audio_data.data() };
+  const pipeline::PackedFrames* packed_inputs[2] = { packed_inputs_[0].get(), packed_inputs_[1].get() };
+  std::unique_ptr<pipeline::UnpackStage> unpack_stage(
+    packed_inputs_[0] ? new pipeline::UnpackStage(packed_inputs, num_input_channels_) : nullptr);
+  audio_io::AudioSource* const sources[2] = { stream_inputs_[0].get(), stream_inputs_[1].get() };
+  std::unique_ptr<pipeline::ReadStage> read_stage(
+    stream_input ? new pipeline::ReadStage(sources, num_input_channels_, num_input_samples_per_frame_,
+                                           final_audio_size - flush_frames_ * num_input_samples_per_frame_)
+                 : nullptr);
+  float* outputs[1] = { frame.get() };
+
+  // Checkpoints record how far the input got once the output up to that point is on disk
+  std::string checkpoint_file = output_wav + ".ckpt";
+
+  unsigned num_segments = 1;
+  std::string segments_value;
+  if (config_reader.IsConfigValueAvailable(kConfigParallelSegments) &&
+      config_reader.GetConfigValue(kConfigParallelSegments, &segments_value)) {
+    num_segments = std::max(1, std::atoi(segments_value.c_str()));
+  } else if (config_reader.IsConfigValueAvailable(kConfigDevices)) {
+    // One segment per device instance
+    unsigned instances = 1;
+    if (config_reader.IsConfigValueAvailable(kConfigInstancesPerDevice) &&
+        config_reader.GetConfigValue(kConfigInstancesPerDevice, &segments_value)) {
+      instances = std::max(1, std::atoi(segments_value.c_str()));
+    }
+    size_t num_devices = select_devices(config_reader.GetConfigValue(kConfigDevices)).size();
+    num_segments = static_cast<unsigned>(num_devices) * instances;
+  }
+  if (num_segments > 1) {
+    if (real_time_ || resume_) {
+      std::cerr << kConfigParallelSegments << " can not be combined with real_time or --resume" << std::endl;
+      return false;
+    }
+    if (config_reader.IsConfigValueAvailable(kConfigMigrateInterval)) {
+      std::cout << "Note: segments run on their own handles, " << kConfigMigrateInterval << " is ignored"
+                << std::endl;
+    }
+    report_startup();
+    if (!generate_output_parallel(config_reader, handle_, num_segments, inputs,
+                                  final_audio_size / num_input_samples_per_frame_, output_sink.get(),
+                                  analyzer.get(), normalizer.get()) ||
+        !report_analysis(config_reader, analyzer.get(), output_wav_file_name)) {
+      return false;
+    }
+    return commit_output(output_sink.get(), output_wav, checkpoint_file, num_input_samples, handle_,
+                         result_cache_.get(), cache_key_);
+  }
+  float checkpoint_interval_secs = 0.f;
+  std::string checkpoint_value;
+  if (config_reader.IsConfigValueAvailable(kConfigCheckpointInterval) &&
+      config_reader.GetConfigValue(kConfigCheckpointInterval, &checkpoint_value)) {
+    checkpoint_interval_secs = std::strtof(checkpoint_value.c_str(), nullptr);
+  }
 
-    auto run_end_tick = std::chrono::high_resolution_clock::now();
-    total_run_time += (std::chrono::duration<float>(run_end_tick - start_tick)).count();
-    total_audio_duration += frame_in_secs;
+  // Only runs with replay_capture set read the clock and record every call
+  const bool capture = replay::Recorder::Get().IsOpen();
+  pipeline::RunStage<false> run_stage(handle_, num_input_samples_per_frame_, num_output_samples_per_frame_);
+  pipeline::RunStage<true> captured_run_stage(handle_, num_input_samples_per_frame_, num_output_samples_per_frame_);
+  size_t start_offset = 0;
+  if (resume_) {
+    size_t frame_offset = 0;
+    uint32_t output_bytes = 0;
+    if (!load_checkpoint(checkpoint_file, input_wav, &frame_offset, &output_bytes))
+      return false;
+    if (!output_sink->SupportsResume() || !output_sink->Resume(output_bytes)) {
+      std::cerr << "Unable to resume output file: " << output_wav << std::endl;
+      return false;
+    }
+    start_offset = std::min(frame_offset * num_input_samples_per_frame_, final_audio_size);
 
-    if ((total_audio_duration / expected_audio_duration) >= checkpoint) {
-      progress_bar[(int)(checkpoint * 10.0f)] = '=';
-      std::cout << "Processed: " << progress_bar << checkpoint * 100.f << "%" << (checkpoint >= 1 ? "\n" : "\r");
-      std::cout.flush();
-      checkpoint += 0.1f;
+    // Effect state was lost with the previous process, rebuild it from the audio just before the
+    // resume point. Output of the pre-roll was already written by the previous run.
+    NvAFX_Status status = replay::CapturedReset(handle_);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_Reset() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_Reset", status);
+      return false;
+    }
+    size_t preroll_frames = 50;
+    std::string preroll_value;
+    if (config_reader.IsConfigValueAvailable(kConfigResumePreroll) &&
+        config_reader.GetConfigValue(kConfigResumePreroll, &preroll_value)) {
+      preroll_frames = std::strtoul(preroll_value.c_str(), nullptr, 10);
+    }
+    size_t preroll_offset = start_offset - std::min(start_offset, preroll_frames * num_input_samples_per_frame_);
+    {
+      TRACE_SCOPE("resume_preroll");
+      auto preroll = [&](auto& run) {
+        return unpack_stage ? pipeline::Dispatch(num_input_channels_, num_output_channels_,
+                                                 num_input_samples_per_frame_, inputs, outputs, preroll_offset,
+                                                 start_offset, *unpack_stage, run)
+                            : pipeline::Dispatch(num_input_channels_, num_output_channels_,
+                                                 num_input_samples_per_frame_, inputs, outputs, preroll_offset,
+                                                 start_offset, run);
+      };
+      if (!(capture ? preroll(captured_run_stage) : preroll(run_stage)))
+        return false;
+    }
+    state.total_audio_duration = frame_offset * state.frame_in_secs;
+    std::cout << "Resuming at frame " << frame_offset << " (" << state.total_audio_duration << " secs) after "
+              << (start_offset - preroll_offset) / num_input_samples_per_frame_ << " pre-roll frames" << std::endl;
+  }
+  // Simulated rebalancing: the stream moves between handle_ and a second handle every interval
+  float migrate_interval_secs = 0.f;
+  std::string migrate_value;
+  if (config_reader.IsConfigValueAvailable(kConfigMigrateInterval) &&
+      config_reader.GetConfigValue(kConfigMigrateInterval, &migrate_value)) {
+    migrate_interval_secs = std::strtof(migrate_value.c_str(), nullptr);
+  }
+  NvAFX_Handle spare_handle = nullptr;
+  std::unique_ptr<pipeline::SessionMigration> migration;
+  std::unique_ptr<pipeline::MigratingRunStage> migrating_stage;
+  if (migrate_interval_secs > 0.f) {
+    pipeline::MigrationOptions migration_options;
+    if (config_reader.IsConfigValueAvailable(kConfigMigrationHistory) &&
+        config_reader.GetConfigValue(kConfigMigrationHistory, &migrate_value)) {
+      migration_options.history_frames = std::strtoul(migrate_value.c_str(), nullptr, 10);
+    }
+    if (config_reader.IsConfigValueAvailable(kConfigMigrationWarmupRate) &&
+        config_reader.GetConfigValue(kConfigMigrationWarmupRate, &migrate_value)) {
+      migration_options.warmup_rate = std::strtoul(migrate_value.c_str(), nullptr, 10);
     }
+    if (config_reader.IsConfigValueAvailable(kConfigMigrationCrossfade) &&
+        config_reader.GetConfigValue(kConfigMigrationCrossfade, &migrate_value)) {
+      migration_options.crossfade_frames = std::strtoul(migrate_value.c_str(), nullptr, 10);
+    }
+    if (!create_handle(effect_config_, &spare_handle, false))
+      return false;
+    const unsigned num_input_channels = num_input_channels_;
+    const unsigned num_output_channels = num_output_channels_;
+    auto make_run = [num_input_channels, num_output_channels](auto& stage) {
+      return pipeline::SessionMigration::RunFunction(
+        [&stage, num_input_channels, num_output_channels](void* instance, const float** input, float** output) {
+          return stage.Run(static_cast<NvAFX_Handle>(instance), input, output, num_input_channels,
+                           num_output_channels);
+        });
+    };
+    pipeline::SessionMigration::RunFunction run = capture ? make_run(captured_run_stage) : make_run(run_stage);
+    auto reset = [](void* instance) {
+      NvAFX_Status status = replay::CapturedReset(static_cast<NvAFX_Handle>(instance));
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_Reset() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_Reset", status);
+        return false;
+      }
+      return true;
+    };
+    migration.reset(new pipeline::SessionMigration(handle_, spare_handle, num_input_channels_,
+                                                   num_input_samples_per_frame_, num_output_channels_,
+                                                   num_output_samples_per_frame_, migration_options, run, reset));
+    size_t interval_frames = std::max<size_t>(1, static_cast<size_t>(migrate_interval_secs / state.frame_in_secs));
+    migrating_stage.reset(new pipeline::MigratingRunStage(*migration, interval_frames));
+    std::cout << "Migrating between two handles every " << interval_frames << " frames" << std::endl;
+  }
+  state.expected_audio_duration = static_cast<float>(num_input_samples + flush_frames_ * num_input_samples_per_frame_) /
+                                  static_cast<float>(input_sample_rate_);
 
-    wav_write.writeChunk(frame.get(), num_output_samples_per_frame_ * sizeof(float));
+  report_startup();
+  std::cout << "Processed: [          ] 0%\r";
+  std::cout.flush();
 
-    if (real_time_) {
-      auto end_tick = std::chrono::high_resolution_clock::now();
-      std::chrono::duration<float> elapsed = end_tick - start_tick;
-      float sleep_time_secs = frame_in_secs - elapsed.count();
-      std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(sleep_time_secs * 1000)));
+  TRACE_COUNTER("handle_state", kHandleRunning);
+  pipeline::FrameStartStage start_stage(state, final_audio_size, num_input_samples_per_frame_);
+  pipeline::StatsStage stats_stage(state, num_input_samples_per_frame_);
+  pipeline::ProgressStage progress_stage(state);
+  pipeline::WriteStage write_stage(*output_sink, num_output_samples_per_frame_, num_output_channels_);
+  if (output_delay_ != 0) {
+    write_stage.SetAlignment(output_delay_, start_offset / num_input_samples_per_frame_ * num_output_samples_per_frame_);
+    write_stage.SetLength(output_length);
+  }
+  pipeline::CheckpointStage checkpoint_stage(write_stage, *output_sink, checkpoint_file, input_wav,
+                                             num_input_samples_per_frame_, checkpoint_interval_secs);
+  pipeline::RealTimeStage real_time_stage(state);
+  std::unique_ptr<pipeline::AnalysisStage> analysis_stage(
+    analyzer ? new pipeline::AnalysisStage(*analyzer, final_audio_size / num_input_samples_per_frame_ - flush_frames_)
+             : nullptr);
+  auto dispatch = [&](auto&... stages) {
+    return pipeline::Dispatch(num_input_channels_, num_output_channels_, num_input_samples_per_frame_, inputs,
+                              outputs, start_offset, final_audio_size, stages...);
+  };
+  // The analysis sees the effect output before loudness normalization
+  auto run_frames_with = [&](auto& run, auto&... stages) {
+    if (read_stage) {
+      if (analysis_stage)
+        return dispatch(*read_stage, start_stage, run, stats_stage, *analysis_stage, progress_stage, stages...);
+      return dispatch(*read_stage, start_stage, run, stats_stage, progress_stage, stages...);
     }
+    if (unpack_stage) {
+      if (analysis_stage)
+        return dispatch(*unpack_stage, start_stage, run, stats_stage, *analysis_stage, progress_stage, stages...);
+      return dispatch(*unpack_stage, start_stage, run, stats_stage, progress_stage, stages...);
+    }
+    if (analysis_stage)
+      return dispatch(start_stage, run, stats_stage, *analysis_stage, progress_stage, stages...);
+    return dispatch(start_stage, run, stats_stage, progress_stage, stages...);
+  };
+  auto run_frames = [&](auto&... stages) {
+    if (migrating_stage)
+      return run_frames_with(*migrating_stage, stages...);
+    if (capture)
+      return run_frames_with(captured_run_stage, stages...);
+    return run_frames_with(run_stage, stages...);
+  };
+  // Optional stages are left out of the instantiation rather than skipped per frame.
+  // wav data is already padded to align to num_samples_per_frame by audio_io::PrepareInput() or the ReadStage
+  bool checkpoints = checkpoint_interval_secs > 0.f;
+  if (checkpoints && !output_sink->SupportsResume()) {
+    std::cout << "Note: checkpoints need wav output, " << kConfigCheckpointInterval << " is ignored" << std::endl;
+    checkpoints = false;
+  }
+  if (checkpoints && normalizer) {
+    // The normalization gain depends on everything before, a resumed run could not restore it
+    std::cout << "Note: checkpoints can not be combined with " << kConfigLoudnessTarget << ", "
+              << kConfigCheckpointInterval << " is ignored" << std::endl;
+    checkpoints = false;
   }
+  bool success;
+  if (normalizer && loudness_two_pass) {
+    pipeline::LoudnessTwoPassStage loudness_stage(*normalizer, write_stage, output_sample_rate_,
+                                                  num_output_samples_per_frame_);
+    success = (real_time_ ? run_frames(loudness_stage, real_time_stage) : run_frames(loudness_stage)) &&
+              loudness_stage.Finish();
+    if (success) {
+      PrintLoudness("two pass", loudness_stage.GetInputLoudness(), *normalizer, loudness_stage.GetSecs(),
+                    final_audio_size / num_input_samples_per_frame_ * num_output_samples_per_frame_);
+    }
+  } else if (normalizer) {
+    pipeline::LoudnessStreamStage loudness_stage(*normalizer, write_stage, num_output_samples_per_frame_);
+    success = (real_time_ ? run_frames(loudness_stage, real_time_stage) : run_frames(loudness_stage)) &&
+              loudness_stage.Finish();
+    if (success) {
+      PrintLoudness("stream", normalizer->GetInputMeter().GetIntegratedLoudness(), *normalizer,
+                    loudness_stage.GetSecs(),
+                    final_audio_size / num_input_samples_per_frame_ * num_output_samples_per_frame_);
+    }
+  } else if (real_time_ && checkpoints) {
+    success = run_frames(write_stage, checkpoint_stage, real_time_stage);
+  } else if (real_time_) {
+    success = run_frames(write_stage, real_time_stage);
+  } else if (checkpoints) {
+    success = run_frames(write_stage, checkpoint_stage);
+  } else {
+    success = run_frames(write_stage);
+  }
+  if (!success || !write_stage.Flush())
+    return false;
 
-  std::cout << "Processing time " << std::setprecision(2) << total_run_time
-            << " secs for " << total_audio_duration << std::setprecision(2)
-            << " secs audio file (" << total_run_time / total_audio_duration
+  std::cout << "Processing time " << std::setprecision(2) << state.total_run_time
+            << " secs for " << state.total_audio_duration << std::setprecision(2)
+            << " secs audio file (" << state.total_run_time / state.total_audio_duration
             << " secs processing time per sec of audio)" << std::endl;
 
   if (real_time_) {
     std::cout << "Note: App ran in real time mode i.e. simulated the input data rate of a mic" << std::endl
               << "'Processing time' could be less then actual run time" << std::endl;
   }
+  if (!report_analysis(config_reader, analyzer.get(), output_wav_file_name))
+    return false;
+
+  if (migration) {
+    migration->PrintReport(std::cout, 1000.0 * state.frame_in_secs);
+    NvAFX_Status status = replay::CapturedDestroy(spare_handle);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_DestroyEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_DestroyEffect", status);
+      return false;
+    }
+    metrics::EffectMetrics::Get().handles_active.Add(-1);
+  }
+
+  return commit_output(output_sink.get(), output_wav, checkpoint_file, num_input_samples, handle_,
+                       result_cache_.get(), cache_key_);
+}
+
+bool EffectsDemoApp::generate_output_stream(const ConfigReader& config_reader, NvAFX_Handle handle,
+                                            const std::string& input_url) {
+  audio_io::LiveOptions options;
+  options.input = input_url;
+  options.follow = follow_input_;
+  options.output = config_reader.GetConfigValue(kConfigFileOutputVariable);
+  options.output_delay = output_delay_;
+  std::string value;
+  if (config_reader.IsConfigValueAvailable(kConfigFollowIdle) &&
+      config_reader.GetConfigValue(kConfigFollowIdle, &value)) {
+    options.follow_options.idle_secs = std::atof(value.c_str());
+  }
+  const char* input_kind = audio_io::GetLiveInputKind(options);
+  if (resume_) {
+    std::cerr << "A " << input_kind << " can not be combined with --resume" << std::endl;
+    return false;
+  }
+  // Whole-file features, a live stream has no end to wait for or position to return to
+  const char* const kFileOnlyKeys[] = { kConfigParallelSegments, kConfigDevices, kConfigCheckpointInterval,
+                                        kConfigLoudnessTarget, kConfigMigrateInterval, kConfigAnalysis,
+                                        kConfigTransportFormat };
+  for (const char* key : kFileOnlyKeys) {
+    if (config_reader.IsConfigValueAvailable(key))
+      std::cout << "Note: " << key << " is not supported with a " << input_kind << ", ignored" << std::endl;
+  }
+
+  audio_io::LiveResult result;
+  auto on_start = [this]() {
+    report_startup();
+    TRACE_COUNTER("handle_state", kHandleRunning);
+  };
+  if (!audio_io::ProcessLiveInput(handle, get_properties(), options, on_start, &result))
+    return false;
+  // A ring output is closed already
+  if (!result.sink)
+    return destroy_handle(handle);
+  return commit_output(result.sink.get(), options.output, options.output + ".ckpt", result.num_samples, handle);
+}
+
+// Latency table of the config, empty if disabled
+std::string GetLatencyTable(const ConfigReader& config_reader) {
+  std::string value;
+  if (config_reader.IsConfigValueAvailable(kConfigLatencyTable) &&
+      config_reader.GetConfigValue(kConfigLatencyTable, &value)) {
+    return value == "off" ? std::string() : value;
+  }
+  return kDefaultLatencyTable;
+}
+
+// The chained effects and their models select the latency table entry, as in the property cache
+std::string GetLatencyKey(const ConfigReader& config_reader) {
+  return startup::PropertyCache::MakeKey(config_reader.GetConfigValue(kConfigEffectVariable),
+                                         GetList(config_reader.GetConfigValue(kConfigFileModelVariable)));
+}
+
+// Settings of the config that shape the output of a run at input_sample_rate, for the result cache key.
+// Only uses what is known before the effect is loaded.
+cache::ResultSettings GetResultSettings(const ConfigReader& config_reader, uint32_t input_sample_rate) {
+  // Settings that change the output bytes. Paths, timing, tracing and metrics do not.
+  const char* const kOutputKeys[] = {
+    kConfigEffectVariable, kConfigIntensityRatioVariable, kConfigVadEnable, kConfigOutputCompressionLevel,
+    kConfigPreserveMetadata, kConfigParallelSegments, kConfigSegmentPreroll, kConfigSegmentCrossfade,
+    kConfigSegmentCrossfadeShape, kConfigDevices, kConfigInstancesPerDevice, kConfigLoudnessTarget,
+    kConfigLoudnessTruePeak, kConfigLoudnessLookahead, kConfigLoudnessMode, kConfigMigrateInterval,
+    kConfigMigrationHistory, kConfigMigrationWarmupRate, kConfigMigrationCrossfade, kConfigTransportFormat,
+    kConfigLatencyMs, kConfigLatencyCompensation,
+  };
+  cache::ResultSettings settings;
+  std::string value;
+  for (const char* key : kOutputKeys) {
+    if (config_reader.IsConfigValueAvailable(key) && config_reader.GetConfigValue(key, &value))
+      settings.values.emplace_back(key, value);
+  }
+  settings.models = GetList(config_reader.GetConfigValue(kConfigFileModelVariable));
+  settings.sdk_symbol = reinterpret_cast<const void*>(&NvAFX_Run);
+  // Without latency_ms the compensated delay comes from the latency table
+  const std::string table_file = GetLatencyTable(config_reader);
+  if (!config_reader.IsConfigValueAvailable(kConfigLatencyMs) && !table_file.empty())
+    settings.delays = latency::DelayTable(table_file).LookupAll(GetLatencyKey(config_reader), input_sample_rate);
+  settings.preserve_metadata = !(config_reader.IsConfigValueAvailable(kConfigPreserveMetadata) &&
+                                 config_reader.GetConfigValue(kConfigPreserveMetadata, &value) &&
+                                 std::atoi(value.c_str()) == 0);
+  return settings;
+}
+
+bool EffectsDemoApp::lookup_result(const ConfigReader& config_reader, bool* hit) {
+  *hit = false;
+  std::string cache_value;
+  uint64_t max_mb = 1024;
+  if (config_reader.IsConfigValueAvailable(kConfigResultCacheMaxMb) &&
+      config_reader.GetConfigValue(kConfigResultCacheMaxMb, &cache_value)) {
+    max_mb = std::strtoull(cache_value.c_str(), nullptr, 10);
+  }
+  cache::LinkMode link_mode = cache::LinkMode::kReflink;
+  if (config_reader.IsConfigValueAvailable(kConfigResultCacheLink) &&
+      config_reader.GetConfigValue(kConfigResultCacheLink, &cache_value) &&
+      !cache::ParseLinkMode(cache_value, &link_mode)) {
+    std::cerr << kConfigResultCacheLink << " must be reflink or hardlink" << std::endl;
+    return false;
+  }
+  result_cache_.reset(new cache::ResultCache(config_reader.GetConfigValue(kConfigResultCache), max_mb << 20,
+                                             link_mode));
+
+  // The key needs the whole inputs, they are handed on to load_input() on a miss
+  const std::string input_wav = config_reader.GetConfigValue(kConfigFileInputVariable);
+  audio_io::DecodedAudio input;
+  {
+    startup::ScopedPhase phase("wait_input");
+    input = pending_input_.valid() ? pending_input_.get() : audio_io::DecodeAudioFile(input_wav, 0, false, true);
+  }
+  if (!input.valid) {
+    std::cerr << "Unable to read wav file: " << input_wav << std::endl;
+    return false;
+  }
+  uint64_t farend_hash = 0;
+  if (is_aec_) {
+    const std::string farend_wav = config_reader.GetConfigValue(kConfigFileInputFarEndVariable);
+    audio_io::DecodedAudio farend;
+    {
+      startup::ScopedPhase phase("wait_input");
+      farend = pending_farend_.valid() ? pending_farend_.get() : audio_io::DecodeAudioFile(farend_wav, 0, false, true);
+    }
+    if (!farend.valid) {
+      std::cerr << "Unable to read wav file: " << farend_wav << std::endl;
+      return false;
+    }
+    farend_hash = farend.content_hash;
+    pending_farend_ = audio_io::MakeReadyInput(std::move(farend));
+  }
+  const std::string output_wav = config_reader.GetConfigValue(kConfigFileOutputVariable);
+  cache_key_ = cache::MakeResultKey(input, farend_hash, GetResultSettings(config_reader, input.sample_rate),
+                                    output_wav);
+  const float input_secs = input.sample_rate ? static_cast<float>(input.samples.size()) / input.sample_rate : 0.f;
+  pending_input_ = audio_io::MakeReadyInput(std::move(input));
+  *hit = cache::FetchResult(result_cache_.get(), cache_key_, output_wav, input_secs);
+  return true;
+}
 
-  wav_write.commitFile();
+bool EffectsDemoApp::commit_output(audio_io::AudioSink* sink, const std::string& output_wav,
+                                   const std::string& checkpoint_file, size_t num_samples, NvAFX_Handle handle,
+                                   cache::ResultCache* result_cache, const std::string& cache_key) {
+  {
+    TRACE_SCOPE("commitFile");
+    if (!sink->Commit()) {
+      std::cerr << "Unable to write output file: " << output_wav << std::endl;
+      return false;
+    }
+  }
+  // Output is complete, nothing left to resume
+  std::remove(checkpoint_file.c_str());
 
-  std::cout << "Output wav file written. " << output_wav << std::endl
-            << "Total " << audio_data.size() << " samples written"
+  std::cout << "Output file written. " << output_wav << std::endl
+            << "Total " << num_samples << " samples written"
             << std::endl;
-  NvAFX_Status status = NvAFX_DestroyEffect(handle_);
+  if (result_cache)
+    cache::StoreResult(result_cache, cache_key, output_wav);
+  return destroy_handle(handle);
+}
+
+bool EffectsDemoApp::destroy_handle(NvAFX_Handle handle) {
+  NvAFX_Status status = replay::CapturedDestroy(handle);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_DestroyEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_DestroyEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_DestroyEffect", status);
+    return false;
+  }
+  TRACE_COUNTER("handle_state", kHandleDestroyed);
+  metrics::EffectMetrics::Get().handles_active.Add(-1);
+
+  return true;
+}
+
+bool EffectsDemoApp::prepare_latency(const ConfigReader& config_reader, NvAFX_Handle handle) {
+  std::string table_file = GetLatencyTable(config_reader);
+  std::string key = GetLatencyKey(config_reader);
+  std::string value;
+  const char* source = nullptr;
+  double delay_samples = 0.0;
+  latency::DelayEntry entry;
+  if (calibrate_latency_) {
+    latency::DelayEstimate estimate;
+    if (!latency::CalibrateEffect(handle, get_properties(), kCalibrationMaxDelaySecs, &estimate))
+      return false;
+    if (estimate.valid) {
+      entry.input_sample_rate = input_sample_rate_;
+      entry.output_sample_rate = output_sample_rate_;
+      entry.delay_samples = estimate.delay_samples;
+      entry.confidence = estimate.confidence;
+      if (!table_file.empty() && !latency::DelayTable(table_file).Store(key, entry))
+        std::cerr << "Unable to update latency table: " << table_file << std::endl;
+      source = "calibration";
+      delay_samples = estimate.delay_samples;
+    }
+  } else if (!table_file.empty() &&
+             latency::DelayTable(table_file).Lookup(key, input_sample_rate_, output_sample_rate_, &entry)) {
+    source = "latency table";
+    delay_samples = entry.delay_samples;
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigLatencyMs) &&
+      config_reader.GetConfigValue(kConfigLatencyMs, &value)) {
+    source = kConfigLatencyMs;
+    delay_samples = std::strtod(value.c_str(), nullptr) / 1000.0 * output_sample_rate_;
+  }
+
+  // Compensated whenever the delay is known, unless disabled
+  bool compensate = true;
+  if (config_reader.IsConfigValueAvailable(kConfigLatencyCompensation) &&
+      config_reader.GetConfigValue(kConfigLatencyCompensation, &value)) {
+    compensate = std::atoi(value.c_str()) != 0;
+  }
+  if (!source) {
+    if (config_reader.IsConfigValueAvailable(kConfigLatencyCompensation) && compensate) {
+      std::cout << "Note: the delay of this effect was not measured, run with --calibrate-latency. "
+                << "Output is not delay compensated" << std::endl;
+    }
+    return true;
+  }
+  double delay_secs = delay_samples / output_sample_rate_;
+  metrics::EffectMetrics::Get().algorithmic_delay.Set(delay_secs);
+  output_delay_ = compensate ? static_cast<int64_t>(std::llround(delay_samples)) : 0;
+  std::streamsize precision = std::cout.precision();
+  std::cout << "Algorithmic delay " << std::fixed << std::setprecision(2) << 1000.0 * delay_secs << " ms ("
+            << delay_samples << " samples at " << output_sample_rate_ << " Hz) from " << source
+            << (output_delay_ != 0 ? ", output is aligned with the input" : "") << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  std::cout.precision(precision);
+  return true;
+}
+
+bool EffectsDemoApp::report_analysis(const ConfigReader& config_reader, analysis::SignalAnalyzer* analyzer,
+                                     const std::string& output_wav_file_name) {
+  if (!analyzer)
+    return true;
+  analyzer->Finish();
+  analyzer->PrintSummary(std::cout);
+
+  std::string summary_file = output_wav_file_name + "_analysis.json";
+  if (config_reader.IsConfigValueAvailable(kConfigAnalysisSummary))
+    config_reader.GetConfigValue(kConfigAnalysisSummary, &summary_file);
+  if (!analyzer->WriteSummary(summary_file)) {
+    std::cerr << "Unable to write analysis summary: " << summary_file << std::endl;
+    return false;
+  }
+  std::cout << "Analysis summary written to " << summary_file << std::endl;
+
+  std::string series_file;
+  if (config_reader.IsConfigValueAvailable(kConfigAnalysisSeries) &&
+      config_reader.GetConfigValue(kConfigAnalysisSeries, &series_file)) {
+    if (!analyzer->WriteSeries(series_file)) {
+      std::cerr << "Unable to write analysis time series: " << series_file << std::endl;
+      return false;
+    }
+    std::cout << "Analysis time series written to " << series_file << std::endl;
+  }
+  return true;
+}
+
+bool EffectsDemoApp::generate_output_parallel(const ConfigReader& config_reader, NvAFX_Handle handle,
+                                              unsigned num_segments, const float* const* inputs, size_t num_frames,
+                                              audio_io::AudioSink* sink, analysis::SignalAnalyzer* analyzer,
+                                              dsp::LoudnessNormalizer* normalizer) {
+  float frame_in_secs = static_cast<float>(num_input_samples_per_frame_) / static_cast<float>(input_sample_rate_);
+  float preroll_secs = 1.f;
+  float crossfade_ms = 20.f;
+  pipeline::CrossfadeShape shape = pipeline::CrossfadeShape::kEqualPower;
+  bool compare = false;
+  std::string value;
+  if (config_reader.IsConfigValueAvailable(kConfigSegmentPreroll) &&
+      config_reader.GetConfigValue(kConfigSegmentPreroll, &value)) {
+    preroll_secs = std::max(0.f, std::strtof(value.c_str(), nullptr));
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigSegmentCrossfade) &&
+      config_reader.GetConfigValue(kConfigSegmentCrossfade, &value)) {
+    crossfade_ms = std::max(0.f, std::strtof(value.c_str(), nullptr));
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigSegmentCrossfadeShape) &&
+      config_reader.GetConfigValue(kConfigSegmentCrossfadeShape, &value)) {
+    if (value == "equal_gain") {
+      shape = pipeline::CrossfadeShape::kEqualGain;
+    } else if (value != "equal_power") {
+      std::cerr << kConfigSegmentCrossfadeShape << " must be equal_power or equal_gain" << std::endl;
+      return false;
+    }
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigParallelCompare) &&
+      config_reader.GetConfigValue(kConfigParallelCompare, &value)) {
+    compare = std::atoi(value.c_str()) != 0;
+  }
+  size_t preroll_frames = static_cast<size_t>(std::ceil(preroll_secs / frame_in_secs));
+  size_t crossfade_frames = static_cast<size_t>(std::ceil(crossfade_ms / 1000.f / frame_in_secs));
+  std::vector<pipeline::Segment> segments = pipeline::PlanSegments(num_frames, num_segments, preroll_frames,
+                                                                   crossfade_frames);
+  if (segments.empty()) {
+    std::cerr << "No input to process" << std::endl;
+    return false;
+  }
+
+  std::vector<NvAFX_Handle> handles(1, handle);
+  bool success = true;
+  std::unique_ptr<scheduler::NvAFXBackend> backend;
+  std::unique_ptr<scheduler::DeviceScheduler> device_scheduler;
+  if (config_reader.IsConfigValueAvailable(kConfigDevices)) {
+    // Handles per device instance run the segments as jobs
+    unsigned instances = 1;
+    if (config_reader.IsConfigValueAvailable(kConfigInstancesPerDevice) &&
+        config_reader.GetConfigValue(kConfigInstancesPerDevice, &value)) {
+      instances = std::max(1, std::atoi(value.c_str()));
+    }
+    std::vector<int> devices = select_devices(config_reader.GetConfigValue(kConfigDevices));
+    backend.reset(new scheduler::NvAFXBackend(
+      devices,
+      [this](int, bool user_cuda_context, NvAFX_Handle* device_handle) {
+        return create_handle(effect_config_, device_handle, false, user_cuda_context);
+      },
+      [](NvAFX_Handle device_handle) {
+        NvAFX_Status status = replay::CapturedDestroy(device_handle);
+        if (status != NVAFX_STATUS_SUCCESS) {
+          std::cerr << "NvAFX_DestroyEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+          replay::CountError("NvAFX_DestroyEffect", status);
+        }
+        metrics::EffectMetrics::Get().handles_active.Add(-1);
+      }));
+    device_scheduler.reset(new scheduler::DeviceScheduler(backend.get(), instances));
+    success = !devices.empty() && device_scheduler->Start();
+    if (!success)
+      std::cerr << "No usable device for " << kConfigDevices << " " << config_reader.GetConfigValue(kConfigDevices)
+                << std::endl;
+  } else {
+    // The handle passed in runs the first segment, every other segment gets its own
+    while (success && handles.size() < segments.size()) {
+      NvAFX_Handle segment_handle = nullptr;
+      success = create_handle(effect_config_, &segment_handle, false);
+      if (success)
+        handles.push_back(segment_handle);
+    }
+  }
+  std::cout << "Processing " << segments.size() << " segments in parallel (pre-roll " << preroll_frames
+            << " frames, crossfade " << crossfade_frames << " frames)" << std::endl;
+
+  const pipeline::PackedFrames* packed_inputs[2] = { packed_inputs_[0].get(), packed_inputs_[1].get() };
+  pipeline::SegmentRunner runner(get_properties(), inputs, packed_inputs);
+  std::vector<float> output;
+  if (success && compare) {
+    // Sequential reference, then the same input split into 2, 4, ... segments
+    std::vector<float> reference;
+    double reference_time = runner.Run(handles, device_scheduler.get(), pipeline::PlanSegments(num_frames, 1, 0, 0),
+                                       shape, &reference);
+    success = reference_time >= 0.0;
+    std::cout << std::left << std::setw(10) << "Segments" << std::setw(16) << "Wall time (s)" << std::setw(10)
+              << "Speedup" << "SNR vs sequential (dB)" << std::endl;
+    std::cout << std::setw(10) << 1 << std::setw(16) << reference_time << std::setw(10) << 1.0 << "-" << std::endl;
+    for (size_t count = 2; success && count <= segments.size(); count = std::min(count * 2, segments.size())) {
+      double wall_time = runner.Run(handles, device_scheduler.get(),
+                                    pipeline::PlanSegments(num_frames, static_cast<unsigned>(count), preroll_frames,
+                                                           crossfade_frames),
+                                    shape, &output);
+      success = wall_time >= 0.0;
+      double signal_energy = 0.0;
+      double error_energy = 0.0;
+      dsp::SignalErrorEnergy(reference.data(), output.data(), std::min(reference.size(), output.size()),
+                             &signal_energy, &error_energy);
+      std::cout << std::setw(10) << count << std::setw(16) << wall_time << std::setw(10) << reference_time / wall_time;
+      if (error_energy > 0.0)
+        std::cout << 10.0 * std::log10(signal_energy / error_energy) << std::endl;
+      else
+        std::cout << "identical" << std::endl;
+      if (count == segments.size())
+        break;
+    }
+    std::cout << std::right;
+  } else if (success) {
+    double wall_time = runner.Run(handles, device_scheduler.get(), segments, shape, &output);
+    success = wall_time >= 0.0;
+    if (success) {
+      float audio_duration = num_frames * frame_in_secs;
+      std::cout << "Processing time " << std::setprecision(2) << wall_time << " secs for " << audio_duration
+                << " secs audio file (" << wall_time / audio_duration << " secs wall time per sec of audio)"
+                << std::endl;
+    }
+  }
+
+  if (device_scheduler) {
+    device_scheduler->PrintStats(std::cout);
+    // Destroys the device handles
+    device_scheduler.reset();
+  }
+  for (size_t i = 1; i < handles.size(); i++) {
+    NvAFX_Status status = replay::CapturedDestroy(handles[i]);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_DestroyEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_DestroyEffect", status);
+    }
+    metrics::EffectMetrics::Get().handles_active.Add(-1);
+  }
+  if (!success)
     return false;
+
+  if (analyzer) {
+    // The stitched output is analyzed as a whole, frame by frame
+    std::vector<float> input_frame(packed_inputs_[0] ? num_input_samples_per_frame_ : 0);
+    for (size_t i = 0; i + flush_frames_ < num_frames && (i + 1) * num_output_samples_per_frame_ <= output.size();
+         i++) {
+      const float* input;
+      if (packed_inputs_[0]) {
+        packed_inputs_[0]->Unpack(i, input_frame.data());
+        input = input_frame.data();
+      } else {
+        input = inputs[0] + i * num_input_samples_per_frame_;
+      }
+      analyzer->Push(input, output.data() + i * num_output_samples_per_frame_);
+    }
+  }
+  if (normalizer) {
+    // The whole output is in memory, its loudness is known before normalizing
+    TRACE_SCOPE("loudness_normalize");
+    auto start = std::chrono::high_resolution_clock::now();
+    dsp::LoudnessMeter meter(output_sample_rate_);
+    meter.Add(output.data(), output.size());
+    normalizer->SetKnownLoudness(meter.GetIntegratedLoudness());
+    normalizer->ProcessBuffer(output.data(), output.size());
+    double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    PrintLoudness("two pass", meter.GetIntegratedLoudness(), *normalizer, secs, output.size());
   }
 
+  TRACE_SCOPE("writeChunk");
+  // Aligned with the input: the delay is dropped from the start, a negative delay written as silence
+  size_t length = std::min(output.size(), (num_frames - flush_frames_) * num_output_samples_per_frame_);
+  size_t begin = std::min(output.size(), static_cast<size_t>(std::max<int64_t>(0, output_delay_)));
+  size_t silence = std::min(length, static_cast<size_t>(std::max<int64_t>(0, -output_delay_)));
+  if (silence > 0) {
+    std::vector<float> zeros(silence, 0.f);
+    if (!sink->Write(zeros.data(), static_cast<uint32_t>(silence))) {
+      std::cerr << "Unable to write output" << std::endl;
+      return false;
+    }
+  }
+  size_t end = std::min(output.size(), begin + length - silence);
+  // Sinks take 32 bit sample counts
+  const size_t kWriteBlock = size_t(1) << 24;
+  for (size_t offset = begin; offset < end; offset += kWriteBlock) {
+    if (!sink->Write(output.data() + offset, static_cast<uint32_t>(std::min(kWriteBlock, end - offset)))) {
+      std::cerr << "Unable to write output" << std::endl;
+      return false;
+    }
+  }
   return true;
 }
 
+void EffectsDemoApp::pack_inputs(pipeline::TransportFormat format, size_t num_frames, std::vector<float>* audio_data,
+                                 std::vector<float>* farend_audio_data) {
+  TRACE_SCOPE("pack_inputs");
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<float>* channels[2] = { audio_data, farend_audio_data };
+  pipeline::TransportError error;
+  size_t packed_bytes = 0;
+  for (unsigned ch = 0; ch < num_input_channels_; ch++) {
+    packed_inputs_[ch].reset(new pipeline::PackedFrames(format, num_input_samples_per_frame_));
+    packed_inputs_[ch]->Assign(channels[ch]->data(), num_frames);
+    pipeline::MeasureTransportError(*packed_inputs_[ch], channels[ch]->data(), num_frames, &error);
+    packed_bytes += packed_inputs_[ch]->GetBytes();
+    std::vector<float>().swap(*channels[ch]);
+  }
+  double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+  // Every frame is read once per run, restored to float right before NvAFX_Run
+  double frames_per_sec = static_cast<double>(input_sample_rate_) / num_input_samples_per_frame_;
+  double packed_per_sec = frames_per_sec * num_input_channels_ *
+                          pipeline::GetPackedFrameBytes(format, num_input_samples_per_frame_);
+  double float_per_sec = static_cast<double>(input_sample_rate_) * num_input_channels_ * sizeof(float);
+  std::ios_base::fmtflags flags = std::cout.flags();
+  std::streamsize precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(2) << "Transport " << pipeline::GetTransportFormatName(format)
+            << ": input buffers " << packed_bytes / 1e6 << " MB (float32 "
+            << num_frames * num_input_samples_per_frame_ * num_input_channels_ * sizeof(float) / 1e6 << " MB), "
+            << std::setprecision(1) << packed_per_sec / 1e3 << " KB moved per second of audio (float32 "
+            << float_per_sec / 1e3 << " KB), packed in " << std::setprecision(3) << secs << " secs" << std::endl
+            << "Transport error: max " << std::scientific << std::setprecision(2) << error.max_abs << ", SNR "
+            << std::fixed << std::setprecision(1) << error.GetSnrDb() << " dB" << std::endl;
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
+std::vector<int> EffectsDemoApp::select_devices(const std::string& value) const {
+  if (value == "all") {
+    if (supported_devices_.empty()) {
+      // Chained effects do not report their devices
+      return std::vector<int>(1, 0);
+    }
+    return supported_devices_;
+  }
+
+  // Keep the SDK's preference order, devices it did not report go last
+  std::vector<int> requested;
+  for (const std::string& device : GetList(value))
+    requested.push_back(std::atoi(device.c_str()));
+  std::vector<int> devices;
+  for (int device : supported_devices_) {
+    if (std::find(requested.begin(), requested.end(), device) != requested.end())
+      devices.push_back(device);
+  }
+  for (int device : requested) {
+    if (std::find(devices.begin(), devices.end(), device) == devices.end()) {
+      if (!supported_devices_.empty())
+        std::cout << "Device " << device << " is not reported as supported by the model" << std::endl;
+      devices.push_back(device);
+    }
+  }
+  return devices;
+}
+
 bool EffectsDemoApp::validate_config(const ConfigReader& config_reader, std::unordered_map<std::string, std::vector<std::string>>& map)
 {
   if (config_reader.IsConfigValueAvailable(kConfigEffectVariable) == false) {
@@ -370,107 +1460,329 @@ bool EffectsDemoApp::validate_config(const ConfigReader& config_reader, std::uno
   return true;
 }
 
-bool EffectsDemoApp::chaining_run(const ConfigReader& config_reader,std::unordered_map<std::string, std::vector<std::string>>& map)
+bool EffectsDemoApp::create_handle(std::unordered_map<std::string, std::vector<std::string>>& map,
+                                   NvAFX_Handle* handle_out, bool verbose, bool user_cuda_context)
 {
-  NvAFX_Handle chained_handle = nullptr;
-  std::string effect = map[kConfigEffectVariable][0];
+  NvAFX_Handle handle = nullptr;
   NvAFX_Status status;
-  if (strcmp(effect.c_str(), "denoiser16k_superres16kto48k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_DENOISER_16k_SUPERRES_16k_TO_48k, &chained_handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+  startup::ScopedPhase phase("create_effect");
+  // Checking for Chaining
+  if (map[kConfigFileModelVariable].size() == 2) {
+    std::string effect = map[kConfigEffectVariable][0];
+    if (strcmp(effect.c_str(), "denoiser16k_superres16kto48k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_DENOISER_16k_SUPERRES_16k_TO_48k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "dereverb16k_superres16kto48k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_DEREVERB_16k_SUPERRES_16k_TO_48k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "dereverb_denoiser16k_superres16kto48k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_DEREVERB_DENOISER_16k_SUPERRES_16k_TO_48k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "superres8kto16k_denoiser16k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DENOISER_16k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "superres8kto16k_dereverb16k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DEREVERB_16k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "superres8kto16k_dereverb_denoiser16k") == 0) {
+      status = replay::CapturedCreate(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DEREVERB_DENOISER_16k, true, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateChainedEffect() failed with error " << replay::GetErrorCodeString(status)
+                  << std::endl;
+        replay::CountError("NvAFX_CreateChainedEffect", status);
+        return false;
+      }
+    } else {
+      std::cerr << "NvAFX_CreateChainedEffect() failed. Invalid Effect Value : " << effect << std::endl;
+      print_effect_list();
       return false;
     }
-  } else if (strcmp(effect.c_str(), "dereverb16k_superres16kto48k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_DEREVERB_16k_SUPERRES_16k_TO_48k, &chained_handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+    TRACE_COUNTER("handle_state", kHandleCreated);
+    metrics::EffectMetrics::Get().handles_active.Add(1);
+    phase.Next("set_parameters");
+    const char* model[] = {map[kConfigFileModelVariable][0].c_str(), map[kConfigFileModelVariable][1].c_str()};
+    status = replay::CapturedSetStringList(handle, NVAFX_PARAM_MODEL_PATH, model, map[kConfigFileModelVariable].size());
+    if (status!= NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_SetStringList() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_SetStringList", status);
       return false;
     }
-  } else if (strcmp(effect.c_str(), "dereverb_denoiser16k_superres16kto48k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_DEREVERB_DENOISER_16k_SUPERRES_16k_TO_48k, &chained_handle);
+    float intensity_ratio[2] = { std::strtof(map[kConfigIntensityRatioVariable][0].c_str(), nullptr),
+                                 std::strtof(map[kConfigIntensityRatioVariable][1].c_str(), nullptr) };
+    status = replay::CapturedSetFloatList(handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio, map[kConfigFileModelVariable].size());
     if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+      std::cerr << "NvAFX_SetFloatList(Intensity Ratio: " << intensity_ratio_ << ") failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_SetFloatList", status);
+    }
+  } else {
+    std::string effect = map[kConfigEffectVariable][0];
+    if (strcmp(effect.c_str(), "denoiser") == 0) {
+      status = replay::CapturedCreate(NVAFX_EFFECT_DENOISER, false, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_CreateEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "dereverb") == 0) {
+      status = replay::CapturedCreate(NVAFX_EFFECT_DEREVERB, false, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_CreateEffect", status);
+        return false;
+      }
+    } else if (strcmp(effect.c_str(), "dereverb_denoiser") == 0) {
+      status = replay::CapturedCreate(NVAFX_EFFECT_DEREVERB_DENOISER, false, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_CreateEffect", status);
+        return false;
+      }
+    }
+    else if (strcmp(effect.c_str(), "aec") == 0) {
+      status = replay::CapturedCreate(NVAFX_EFFECT_AEC, false, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_CreateEffect", status);
+        return false;
+      }
+    }
+    else if (strcmp(effect.c_str(), "superres") == 0) {
+      status = replay::CapturedCreate(NVAFX_EFFECT_SUPERRES, false, &handle);
+      if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_CreateEffect() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_CreateEffect", status);
+        return false;
+      }
+    } else {
+      std::cerr << "NvAFX_CreateEffect() failed. Invalid Effect Value : " << effect << std::endl;
+      print_effect_list();
       return false;
     }
-  } else if (strcmp(effect.c_str(), "superres8kto16k_denoiser16k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DENOISER_16k, &chained_handle);
+    TRACE_COUNTER("handle_state", kHandleCreated);
+    metrics::EffectMetrics::Get().handles_active.Add(1);
+    phase.Next("set_parameters");
+
+    // If the system has multiple supported GPUs, then the application can either
+    // use CUDA driver APIs or CUDA runtime APIs to enumerate the GPUs and select one based on the application's requirements
+    // or offload the responsibility to SDK to select the GPU by setting NVAFX_PARAM_USE_DEFAULT_GPU as 1
+    /*if (NvAFX_SetU32(handle, NVAFX_PARAM_USE_DEFAULT_GPU, 1) != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_SetBool(NVAFX_PARAM_USE_DEFAULT_GPU " << ") failed" << std::endl;
+      return false;
+    }*/
+
+    std::string model_file = map[kConfigFileModelVariable][0];
+    status = replay::CapturedSetString(handle, NVAFX_PARAM_MODEL_PATH, model_file.c_str());
     if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+      std::cerr << "NvAFX_SetString() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_SetString", status);
       return false;
     }
-  } else if (strcmp(effect.c_str(), "superres8kto16k_dereverb16k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DEREVERB_16k, &chained_handle);
+
+    status = replay::CapturedSetFloat(handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio_);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_SetFloat(Intensity Ratio: " << intensity_ratio_ << ") failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_SetFloat", status);
+    }
+
+    status = replay::CapturedSetU32(handle, NVAFX_PARAM_ENABLE_VAD, vad_supported_);
+    // Enabling VAD based on SDK user input!
     if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+      std::cerr << "Could not initialize VAD with error " << replay::GetErrorCodeString(status) << std::endl;
+    }
+  
+    // Another option could be to use cudaGetDeviceCount for num
+    // A buffer that fits typical systems avoids a separate query for the device count
+    phase.Next("get_supported_devices");
+    std::vector<int> ret(16);
+    int num_supported_devices = static_cast<int>(ret.size());
+    status = NvAFX_GetSupportedDevices(handle, &num_supported_devices, ret.data());
+    if (status == NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL) {
+      ret.resize(num_supported_devices);
+      status = NvAFX_GetSupportedDevices(handle, &num_supported_devices, ret.data());
+    }
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "No supported devices found with error " << replay::GetErrorCodeString(status) << std::endl;
       return false;
     }
-  } else if (strcmp(effect.c_str(), "superres8kto16k_dereverb_denoiser16k") == 0) {
-    status = NvAFX_CreateChainedEffect(NVAFX_CHAINED_EFFECT_SUPERRES_8k_TO_16k_DEREVERB_DENOISER_16k, &chained_handle);
+    ret.resize(num_supported_devices);
+    if (verbose)
+      supported_devices_ = ret;
+
+    if (verbose)
+      std::cout << "Number of supported devices for this model: " << num_supported_devices << std::endl;
+
+    if (verbose) {
+      std::cout << "Devices supported (sorted by preference)" << std::endl;
+      for (int device : ret) {
+        std::cout << "- " << device << std::endl;
+      }
+    }
+  }
+
+  if (user_cuda_context) {
+    status = replay::CapturedSetU32(handle, NVAFX_PARAM_USER_CUDA_CONTEXT, 1);
     if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateChainedEffect() failed with error " << GetErrorCodeString(status) << std::endl;
+      std::cerr << "NvAFX_SetU32(NVAFX_PARAM_USER_CUDA_CONTEXT) failed with error "
+                << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_SetU32", status);
       return false;
     }
-  } else {
-    std::cerr << "NvAFX_CreateChainedEffect() failed. Invalid Effect Value : " << effect << std::endl;
-    return false;
   }
-  const char* model[] = {map[kConfigFileModelVariable][0].c_str(), map[kConfigFileModelVariable][1].c_str()};
-  status = NvAFX_SetStringList(chained_handle, NVAFX_PARAM_MODEL_PATH, model, map[kConfigFileModelVariable].size());
-  if (status!= NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_SetStringList() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+
+  if (verbose)
+    std::cout << "Loading effect" << " ... ";
+  phase.Next("load");
+  {
+    TRACE_SCOPE("NvAFX_Load");
+    status = replay::CapturedLoad(handle);
   }
-  float intensity_ratio[2] = { std::strtof(map[kConfigIntensityRatioVariable][0].c_str(), nullptr),
-                               std::strtof(map[kConfigIntensityRatioVariable][1].c_str(), nullptr) };
-  status = NvAFX_SetFloatList(chained_handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio, map[kConfigFileModelVariable].size());
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_SetFloatList(Intensity Ratio: " << intensity_ratio_ << ") failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_Load() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_Load", status);
+    return false;
   }
+  phase.End();
+  TRACE_COUNTER("handle_state", kHandleLoaded);
+  if (verbose)
+    std::cout << "Done" << std::endl;
+  *handle_out = handle;
+  return true;
+}
 
-  std::cout << "Loading effect" << " ... ";
-  status = NvAFX_Load(chained_handle);
+bool EffectsDemoApp::print_effect_list()
+{
+  int num_effects;
+  NvAFX_EffectSelector* effects;
+  NvAFX_Status status;
+  {
+    startup::ScopedPhase phase("get_effect_list");
+    TRACE_SCOPE("NvAFX_GetEffectList");
+    status = NvAFX_GetEffectList(&num_effects, &effects);
+  }
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_Load() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetEffectList() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetEffectList", status);
     return false;
   }
-  std::cout << "Done" << std::endl;
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_INPUT_SAMPLE_RATE, &input_sample_rate_);
+  std::cout << "Total Effects supported: " << num_effects << std::endl;
+  for (int i = 0; i < num_effects; ++i) {
+    std::cout << "(" << i + 1 << ") " << effects[i] << std::endl;
+  }
+  return true;
+}
+
+bool EffectsDemoApp::query_properties(NvAFX_Handle handle)
+{
+  startup::ScopedPhase phase(have_cached_properties_ ? "cached_properties" : "query_properties");
+  if (have_cached_properties_) {
+    input_sample_rate_ = cached_properties_.input_sample_rate;
+    output_sample_rate_ = cached_properties_.output_sample_rate;
+    num_input_channels_ = cached_properties_.num_input_channels;
+    num_output_channels_ = cached_properties_.num_output_channels;
+    num_input_samples_per_frame_ = cached_properties_.num_input_samples_per_frame;
+    num_output_samples_per_frame_ = cached_properties_.num_output_samples_per_frame;
+    return true;
+  }
+
+  NvAFX_Status status;
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_INPUT_SAMPLE_RATE, &input_sample_rate_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_OUTPUT_SAMPLE_RATE, &output_sample_rate_);
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_OUTPUT_SAMPLE_RATE, &output_sample_rate_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_NUM_INPUT_CHANNELS, &num_input_channels_);
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_INPUT_CHANNELS, &num_input_channels_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_NUM_OUTPUT_CHANNELS, &num_output_channels_);
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_OUTPUT_CHANNELS, &num_output_channels_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_NUM_INPUT_SAMPLES_PER_FRAME, &num_input_samples_per_frame_);
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_INPUT_SAMPLES_PER_FRAME, &num_input_samples_per_frame_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
-  status = NvAFX_GetU32(chained_handle, NVAFX_PARAM_NUM_OUTPUT_SAMPLES_PER_FRAME, &num_output_samples_per_frame_);
+  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_OUTPUT_SAMPLES_PER_FRAME, &num_output_samples_per_frame_);
   if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+    std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_GetU32", status);
     return false;
   }
 
-  float intensity_ratio_local[2];
-  status = NvAFX_GetFloatList(chained_handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio_local, 2);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetFloatList() failed with error " << GetErrorCodeString(status) << std::endl;
+  if (!property_cache_file_.empty()) {
+    if (!startup::PropertyCache(property_cache_file_).Store(property_cache_key_, get_properties()))
+      std::cerr << "Unable to update property cache: " << property_cache_file_ << std::endl;
+  }
+  return true;
+}
+
+startup::EffectProperties EffectsDemoApp::get_properties() const {
+  startup::EffectProperties properties;
+  properties.input_sample_rate = input_sample_rate_;
+  properties.output_sample_rate = output_sample_rate_;
+  properties.num_input_channels = num_input_channels_;
+  properties.num_output_channels = num_output_channels_;
+  properties.num_input_samples_per_frame = num_input_samples_per_frame_;
+  properties.num_output_samples_per_frame = num_output_samples_per_frame_;
+  return properties;
+}
+
+bool EffectsDemoApp::chaining_run(const ConfigReader& config_reader,std::unordered_map<std::string, std::vector<std::string>>& map)
+{
+  NvAFX_Handle chained_handle = nullptr;
+  if (!create_handle(map, &chained_handle, true))
+    return false;
+  if (!query_properties(chained_handle))
     return false;
+
+  // Intensity ratios are set from the config, only read them back when the effect was queried anyway
+  float intensity_ratio_local[2] = { std::strtof(map[kConfigIntensityRatioVariable][0].c_str(), nullptr),
+                                     std::strtof(map[kConfigIntensityRatioVariable][1].c_str(), nullptr) };
+  if (!have_cached_properties_) {
+    NvAFX_Status status = NvAFX_GetFloatList(chained_handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio_local, 2);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_GetFloatList() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_GetFloatList", status);
+      return false;
+    }
   }
   std::cout << "  Effect properties            : " << std::endl
             << "  Input Sample rate            : " << input_sample_rate_ << std::endl
@@ -487,167 +1799,113 @@ bool EffectsDemoApp::chaining_run(const ConfigReader& config_reader,std::unorder
 
 bool EffectsDemoApp::run(const ConfigReader& config_reader, std::unordered_map<std::string, std::vector<std::string>>& map)
 {
-  if (validate_config(config_reader, map) == false)
-    return false;
+  {
+    startup::ScopedPhase phase("validate_config");
+    if (validate_config(config_reader, map) == false)
+      return false;
+  }
+  effect_config_ = map;
 
   if (real_time_ == true) {
     std::cout << "App will run in real time mode ..." << std::endl;
   }
-  NvAFX_Status status;
-
-  int num_effects;
-  NvAFX_EffectSelector* effects;
-  status = NvAFX_GetEffectList(&num_effects, &effects);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetEffectList() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
-  }
-  std::cout << "Total Effects supported: " << num_effects << std::endl;
-  for (int i = 0; i < num_effects; ++i) {
-    std::cout << "(" << i + 1 << ") " << effects[i] << std::endl;
-  }
-  // Checking for Chaining
-  if (map[kConfigFileModelVariable].size() == 2) {
-    return chaining_run(config_reader,map);
-  }
 
-  NvAFX_Handle handle;
-  std::string effect = config_reader.GetConfigValue(kConfigEffectVariable);
-  if (strcmp(effect.c_str(), "denoiser") == 0) {
-    status = NvAFX_CreateEffect(NVAFX_EFFECT_DENOISER, &handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateEffect() failed with error " << GetErrorCodeString(status) << std::endl;
-      return false;
-    }
-  } else if (strcmp(effect.c_str(), "dereverb") == 0) {
-    status = NvAFX_CreateEffect(NVAFX_EFFECT_DEREVERB, &handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateEffect() failed with error " << GetErrorCodeString(status) << std::endl;
-      return false;
-    }
-  } else if (strcmp(effect.c_str(), "dereverb_denoiser") == 0) {
-    status = NvAFX_CreateEffect(NVAFX_EFFECT_DEREVERB_DENOISER, &handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateEffect() failed with error " << GetErrorCodeString(status) << std::endl;
-      return false;
-    }
+  std::string value;
+  if (config_reader.IsConfigValueAvailable(kConfigStartupProfile) &&
+      config_reader.GetConfigValue(kConfigStartupProfile, &value)) {
+    startup_profile_ = std::atoi(value.c_str()) != 0;
   }
-  else if (strcmp(effect.c_str(), "aec") == 0) {
-    status = NvAFX_CreateEffect(NVAFX_EFFECT_AEC, &handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateEffect() failed with error " << GetErrorCodeString(status) << std::endl;
-      return false;
-    }
-  }
-  else if (strcmp(effect.c_str(), "superres") == 0) {
-    status = NvAFX_CreateEffect(NVAFX_EFFECT_SUPERRES, &handle);
-    if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_CreateEffect() failed with error " << GetErrorCodeString(status) << std::endl;
-      return false;
-    }
-  } else {
-    std::cerr << "NvAFX_CreateEffect() failed. Invalid Effect Value : " << effect << std::endl;
-    return false;
-  }
-
-  // If the system has multiple supported GPUs, then the application can either
-  // use CUDA driver APIs or CUDA runtime APIs to enumerate the GPUs and select one based on the application's requirements
-  // or offload the responsibility to SDK to select the GPU by setting NVAFX_PARAM_USE_DEFAULT_GPU as 1
-  /*if (NvAFX_SetU32(handle, NVAFX_PARAM_USE_DEFAULT_GPU, 1) != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_SetBool(NVAFX_PARAM_USE_DEFAULT_GPU " << ") failed" << std::endl;
-    return false;
-  }*/
 
-  std::string model_file = config_reader.GetConfigValue(kConfigFileModelVariable);
-  status = NvAFX_SetString(handle, NVAFX_PARAM_MODEL_PATH, model_file.c_str());
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_SetString() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+  // Properties of the same effect and models from an earlier run make the queries after loading unnecessary
+  if (config_reader.IsConfigValueAvailable(kConfigPropertyCache) &&
+      config_reader.GetConfigValue(kConfigPropertyCache, &value)) {
+    property_cache_file_ = value == "off" ? std::string() : value;
   }
-
-  status = NvAFX_SetFloat(handle, NVAFX_PARAM_INTENSITY_RATIO, intensity_ratio_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_SetFloat(Intensity Ratio: " << intensity_ratio_ << ") failed with error " << GetErrorCodeString(status) << std::endl;
+  if (!property_cache_file_.empty()) {
+    startup::ScopedPhase phase("property_cache_lookup");
+    property_cache_key_ = startup::PropertyCache::MakeKey(map[kConfigEffectVariable][0], map[kConfigFileModelVariable]);
+    have_cached_properties_ =
+      startup::PropertyCache(property_cache_file_).Lookup(property_cache_key_, &cached_properties_);
   }
 
-  status = NvAFX_SetU32(handle, NVAFX_PARAM_ENABLE_VAD, vad_supported_);
-  // Enabling VAD based on SDK user input!
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "Could not initialize VAD with error " << GetErrorCodeString(status) << std::endl;
+  if (config_reader.IsConfigValueAvailable(kConfigFollowInput) &&
+      config_reader.GetConfigValue(kConfigFollowInput, &value)) {
+    follow_input_ = std::atoi(value.c_str()) != 0;
   }
-  
-  // Another option could be to use cudaGetDeviceCount for num
-  int num_supported_devices = 0;
-  status = NvAFX_GetSupportedDevices(handle, &num_supported_devices, nullptr);
-  if (status != NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL) {
-    std::cerr << "Could not get number of supported devices with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+  // Hashing the inputs for the result cache rides along with decoding them. Calibration needs the loaded
+  // effect and changes the delay the output is keyed by, so it always processes.
+  const std::string input_url = config_reader.GetConfigValue(kConfigFileInputVariable);
+  hash_inputs_ = config_reader.IsConfigValueAvailable(kConfigResultCache) && !resume_ && !follow_input_ &&
+                 !calibrate_latency_ && !rtp::IsRtpUrl(input_url) && !ipc::IsShmUrl(input_url);
+  if (config_reader.IsConfigValueAvailable(kConfigResultCache) && calibrate_latency_)
+    std::cout << "Note: " << kConfigResultCache << " is not used with --calibrate-latency" << std::endl;
+
+  // Result caching, resuming, parallel segments and a packed transport format need the whole input up
+  // front, otherwise it is decoded block by block as it is processed
+  stream_input_ = !hash_inputs_ && !resume_ && !config_reader.IsConfigValueAvailable(kConfigParallelSegments) &&
+                  !config_reader.IsConfigValueAvailable(kConfigDevices) &&
+                  !(config_reader.IsConfigValueAvailable(kConfigTransportFormat) &&
+                    config_reader.GetConfigValue(kConfigTransportFormat, &value) && value != "float32");
+
+  // Decode the inputs while the effect is created and loaded
+  bool parallel_startup = true;
+  if (config_reader.IsConfigValueAvailable(kConfigParallelStartup) &&
+      config_reader.GetConfigValue(kConfigParallelStartup, &value)) {
+    parallel_startup = std::atoi(value.c_str()) != 0;
   }
-
-  std::cout << "Number of supported devices for this model: " << num_supported_devices << std::endl;
-
-  std::vector<int> ret(num_supported_devices);
-  status = NvAFX_GetSupportedDevices(handle, &num_supported_devices, ret.data());
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "No supported devices found with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+  // Network, shared memory and followed inputs are only opened once the effect is ready to process them
+  const std::string input_file = config_reader.GetConfigValue(kConfigFileInputVariable);
+  if (parallel_startup && !follow_input_ && !rtp::IsRtpUrl(input_file) && !ipc::IsShmUrl(input_file)) {
+    uint32_t block_samples = have_cached_properties_ ? cached_properties_.num_input_samples_per_frame : 0;
+    if (!(stream_input_ && open_stream_inputs(config_reader, block_samples))) {
+      pending_input_ = std::async(std::launch::async, audio_io::DecodeAudioFile,
+                                  config_reader.GetConfigValue(kConfigFileInputVariable), block_samples, true,
+                                  hash_inputs_);
+      if (is_aec_) {
+        pending_farend_ = std::async(std::launch::async, audio_io::DecodeAudioFile,
+                                     config_reader.GetConfigValue(kConfigFileInputFarEndVariable), block_samples,
+                                     true, hash_inputs_);
+      }
+    }
   }
 
-  std::cout << "Devices supported (sorted by preference)" << std::endl;
-  for (int device : ret) {
-    std::cout << "- " << device << std::endl;
+  // An earlier run on the same audio with the same settings already produced the output, the effect is
+  // only created and loaded on a miss
+  if (hash_inputs_) {
+    bool hit = false;
+    if (!lookup_result(config_reader, &hit))
+      return false;
+    if (hit)
+      return true;
   }
 
-  std::cout << "Loading effect" << " ... ";
-  status = NvAFX_Load(handle);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_Load() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+  // Checking for Chaining
+  if (map[kConfigFileModelVariable].size() == 2) {
+    return chaining_run(config_reader,map);
   }
-  std::cout << "Done" << std::endl;
 
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_INPUT_SAMPLE_RATE, &input_sample_rate_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
-  }
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_OUTPUT_SAMPLE_RATE, &output_sample_rate_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
-  }
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_INPUT_CHANNELS, &num_input_channels_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
-  }
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_OUTPUT_CHANNELS, &num_output_channels_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+  NvAFX_Handle handle = nullptr;
+  if (!create_handle(map, &handle, true))
     return false;
-  }
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_INPUT_SAMPLES_PER_FRAME, &num_input_samples_per_frame_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
-  }
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_NUM_OUTPUT_SAMPLES_PER_FRAME, &num_output_samples_per_frame_);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+  if (!query_properties(handle))
     return false;
-  }
 
-  unsigned vad_enabled_local;
-  status = NvAFX_GetU32(handle, NVAFX_PARAM_ENABLE_VAD, &vad_enabled_local);
-  if (status != NVAFX_STATUS_SUCCESS) {
-      std::cerr << "NvAFX_GetU32() failed with error " << GetErrorCodeString(status) << std::endl;
+  // VAD and intensity ratio are set from the config, only read them back when the effect was queried anyway
+  unsigned vad_enabled_local = vad_supported_;
+  float intensity_ratio_local = intensity_ratio_;
+  if (!have_cached_properties_) {
+    NvAFX_Status status = NvAFX_GetU32(handle, NVAFX_PARAM_ENABLE_VAD, &vad_enabled_local);
+    if (status != NVAFX_STATUS_SUCCESS) {
+        std::cerr << "NvAFX_GetU32() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+        replay::CountError("NvAFX_GetU32", status);
+        return false;
+    }
+    status = NvAFX_GetFloat(handle, NVAFX_PARAM_INTENSITY_RATIO, &intensity_ratio_local);
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_GetFloat() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_GetFloat", status);
       return false;
-  }
-  float intensity_ratio_local;
-  status = NvAFX_GetFloat(handle, NVAFX_PARAM_INTENSITY_RATIO, &intensity_ratio_local);
-  if (status != NVAFX_STATUS_SUCCESS) {
-    std::cerr << "NvAFX_GetFloat() failed with error " << GetErrorCodeString(status) << std::endl;
-    return false;
+    }
   }
 
   std::cout << "  Effect properties          : " << std::endl
@@ -663,13 +1921,67 @@ bool EffectsDemoApp::run(const ConfigReader& config_reader, std::unordered_map<s
   return (generate_output(config_reader, handle));
 }
 
+bool EffectsDemoApp::verify_output(const ConfigReader& config_reader, const std::string& reference_wav,
+                                   const std::string& report_file) {
+  VerifyTolerance tolerance;
+  std::string value;
+  if (config_reader.IsConfigValueAvailable(kConfigVerifyMaxAbsError) &&
+      config_reader.GetConfigValue(kConfigVerifyMaxAbsError, &value)) {
+    tolerance.max_abs_error = std::strtof(value.c_str(), nullptr);
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigVerifyMinSnr) &&
+      config_reader.GetConfigValue(kConfigVerifyMinSnr, &value)) {
+    tolerance.min_snr_db = std::strtof(value.c_str(), nullptr);
+  }
+  if (config_reader.IsConfigValueAvailable(kConfigVerifyMaxLsd) &&
+      config_reader.GetConfigValue(kConfigVerifyMaxLsd, &value)) {
+    tolerance.max_lsd_db = std::strtof(value.c_str(), nullptr);
+  }
+
+  std::string output_wav = config_reader.GetConfigValue(kConfigFileOutputVariable);
+  std::string report_wav = report_file;
+  if (report_wav.empty()) {
+    std::size_t dot_pos = output_wav.find_last_of('.');
+    report_wav = (dot_pos == std::string::npos ? output_wav : output_wav.substr(0, dot_pos)) + "_verify.json";
+  }
+
+  std::cout << "Verifying " << output_wav << " against " << reference_wav << " ... ";
+  // After a result cache hit the effect was not loaded, 10 ms frames at 48 kHz are compared then
+  WaveVerifier verifier(num_output_samples_per_frame_ ? num_output_samples_per_frame_ : 480, tolerance);
+  VerifyReport report;
+  bool passed = verifier.Compare(output_wav, reference_wav, &report);
+  std::cout << (passed ? "Passed" : "Failed") << std::endl
+            << "  Frames compared   : " << report.frames_compared << std::endl
+            << "  Max abs error     : " << report.max_abs_error << std::endl
+            << "  SNR (dB)          : " << report.snr_db << std::endl
+            << "  Mean LSD (dB)     : " << report.mean_lsd_db << std::endl;
+  if (!passed) {
+    std::cerr << "Verification failed at frame " << report.first_failed_frame << ": " << report.failure_reason
+              << std::endl;
+  }
+
+  if (!WaveVerifier::WriteReport(report, report_wav)) {
+    std::cerr << "Unable to write verification report: " << report_wav << std::endl;
+    return false;
+  }
+  std::cout << "Verification report written. " << report_wav << std::endl;
+
+  return passed;
+}
+
 void ShowHelpAndExit(const char* bad_option) {
   std::ostringstream oss;
   if (bad_option) {
     oss << "Error parsing \"" << bad_option << "\"" << std::endl;
   }
   std::cout << "Command Line Options:" << std::endl
-            << "-c Config file" << std::endl;
+            << "-c Config file" << std::endl
+            << "--verify Golden wav file to compare the output against" << std::endl
+            << "--verify-report Verification report file (default: <output_wav>_verify.json)" << std::endl
+            << "--resume Continue from the checkpoint of an interrupted run" << std::endl
+            << "--list-effects Print the effects supported by the SDK" << std::endl
+            << "--calibrate-latency Measure the algorithmic delay of the effect and store it in the latency table"
+            << std::endl;
 }
 
 
@@ -678,7 +1990,7 @@ void ShowHelpAndExit(const char* bad_option) {
 #define strcasecmp _stricmp
 #endif
 
-void ParseCommandLine(int argc, char* argv[], std::string* config_file) {
+void ParseCommandLine(int argc, char* argv[], CommandLineOptions* options) {
   if (argc == 1) {
     ShowHelpAndExit(nullptr);
   }
@@ -688,10 +2000,38 @@ void ParseCommandLine(int argc, char* argv[], std::string* config_file) {
       ShowHelpAndExit(nullptr);
     }
     if (!strcasecmp(argv[i], "-c")) {
-      if (++i == argc || !config_file->empty()) {
+      if (++i == argc || !options->config_file.empty()) {
         ShowHelpAndExit("-f");
       }
-      config_file->assign(argv[i]);
+      options->config_file.assign(argv[i]);
+      continue;
+    }
+    if (!strcasecmp(argv[i], "--verify")) {
+      if (++i == argc) {
+        ShowHelpAndExit("--verify");
+        break;
+      }
+      options->verify_wav.assign(argv[i]);
+      continue;
+    }
+    if (!strcasecmp(argv[i], "--resume")) {
+      options->resume = true;
+      continue;
+    }
+    if (!strcasecmp(argv[i], "--list-effects")) {
+      options->list_effects = true;
+      continue;
+    }
+    if (!strcasecmp(argv[i], "--calibrate-latency")) {
+      options->calibrate_latency = true;
+      continue;
+    }
+    if (!strcasecmp(argv[i], "--verify-report")) {
+      if (++i == argc) {
+        ShowHelpAndExit("--verify-report");
+        break;
+      }
+      options->verify_report.assign(argv[i]);
       continue;
     }
 
@@ -700,21 +2040,94 @@ void ParseCommandLine(int argc, char* argv[], std::string* config_file) {
 }
 
 int main(int argc, char* argv[]) {
-  std::string config_file;
+  CommandLineOptions options;
   try
   {
-    ParseCommandLine(argc, argv, &config_file);
+    startup::Profile::Get().Start();
+    ParseCommandLine(argc, argv, &options);
+    if (options.list_effects) {
+      bool listed = EffectsDemoApp::print_effect_list();
+      if (options.config_file.empty())
+        return listed ? 0 : -1;
+    }
 
     ConfigReader config_reader;
-    if (config_reader.Load(config_file) == false) {
+    bool config_loaded;
+    {
+      startup::ScopedPhase phase("load_config");
+      config_loaded = config_reader.Load(options.config_file);
+    }
+    if (config_loaded == false) {
       std::cerr << "Config file load failed" << std::endl;
       return -1;
     }
+    std::string trace_file;
+    if (config_reader.IsConfigValueAvailable(kConfigTraceFile) &&
+        config_reader.GetConfigValue(kConfigTraceFile, &trace_file)) {
+      if (trace::Tracer::IsCompiledIn())
+        trace::Tracer::Get().Start(trace_file);
+      else
+        std::cout << "Ignoring " << kConfigTraceFile << ", tracing was not enabled at build time" << std::endl;
+    }
+    std::string replay_capture;
+    if (config_reader.IsConfigValueAvailable(kConfigReplayCapture) &&
+        config_reader.GetConfigValue(kConfigReplayCapture, &replay_capture) &&
+        !replay::Recorder::Get().Open(replay_capture)) {
+      return -1;
+    }
+
+    if (!ConfigurePlacement(config_reader))
+      return -1;
+
+    metrics::Exporter metrics_exporter;
+    std::string metrics_value;
+    if (config_reader.IsConfigValueAvailable(kConfigMetricsPort) &&
+        config_reader.GetConfigValue(kConfigMetricsPort, &metrics_value)) {
+      uint16_t port = static_cast<uint16_t>(std::strtoul(metrics_value.c_str(), nullptr, 10));
+      if (metrics_exporter.StartHttp(port))
+        std::cout << "Serving metrics on http://127.0.0.1:" << port << "/metrics" << std::endl;
+      else
+        std::cerr << "Unable to serve metrics on port " << port << std::endl;
+    }
+    if (config_reader.IsConfigValueAvailable(kConfigMetricsFile) &&
+        config_reader.GetConfigValue(kConfigMetricsFile, &metrics_value)) {
+      std::string interval;
+      uint32_t interval_ms = 1000;
+      if (config_reader.IsConfigValueAvailable(kConfigMetricsInterval) &&
+          config_reader.GetConfigValue(kConfigMetricsInterval, &interval)) {
+        interval_ms = static_cast<uint32_t>(std::strtoul(interval.c_str(), nullptr, 10));
+      }
+      metrics_exporter.StartFileDump(metrics_value, interval_ms);
+    }
+
     std::unordered_map<std::string, std::vector<std::string>> effectConfigMap;
     EffectsDemoApp app;
-    if (app.run(config_reader, effectConfigMap))
-      return 0;
-    else return -1;
+    app.set_resume(options.resume);
+    app.set_calibrate_latency(options.calibrate_latency);
+    bool success = app.run(config_reader, effectConfigMap);
+    if (success && !options.verify_wav.empty())
+      success = app.verify_output(config_reader, options.verify_wav, options.verify_report);
+    if (placement::ThreadPlacement::Get().IsEnabled())
+      placement::ThreadPlacement::Get().PrintReport(std::cout);
+
+    if (trace::Tracer::Get().IsEnabled()) {
+      if (trace::Tracer::Get().Flush())
+        std::cout << "Trace written. " << trace_file << std::endl;
+      else
+        std::cerr << "Unable to write trace file: " << trace_file << std::endl;
+    }
+    if (replay::Recorder::Get().IsOpen()) {
+      replay::Recorder& recorder = replay::Recorder::Get();
+      uint64_t num_records = recorder.GetNumRecords();
+      uint64_t bytes = recorder.GetBytes();
+      if (recorder.Close())
+        std::cout << "Replay capture written. " << replay_capture << " (" << num_records << " calls, " << bytes
+                  << " bytes)" << std::endl;
+      else
+        std::cerr << "Replay capture incomplete: " << replay_capture << std::endl;
+    }
+    metrics_exporter.Stop();
+    return success ? 0 : -1;
   }
   catch (const std::exception& e)
   {
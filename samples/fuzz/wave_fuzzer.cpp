@@ -0,0 +1,107 @@
+/*###############################################################################
+#
+# Copyright 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+// libFuzzer target for the wav readers (utils/wave_reader). Every input is parsed from memory with
+// ParseWaveImage() and converted to float, then written to a file and read back with
+// CWaveFileStreamRead the way effects_demo reads its inputs. Build with clang and
+// cmake -DENABLE_FUZZING=ON, then run e.g.
+//
+//   wave_fuzzer -max_len=65536 corpus_dir ../samples/effects_demo/input_files
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+// File the stream reader is run on, one per fuzzing process
+class ScratchFile {
+ public:
+  ScratchFile() : path_("wave_fuzzer_" + std::to_string(getpid()) + ".wav") {}
+  ~ScratchFile() { std::remove(path_.c_str()); }
+  bool Write(const uint8_t* data, size_t size) const {
+    FILE* fp = fopen(path_.c_str(), "wb");
+    if (!fp)
+      return false;
+    bool written = size == 0 || fwrite(data, size, 1, fp) == 1;
+    return fclose(fp) == 0 && written;
+  }
+  const std::string& GetPath() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+void FuzzImage(const uint8_t* data, size_t size) {
+  WaveFileInfo info;
+  if (ParseWaveImage(data, size, &info) != WAVE_STATUS_OK)
+    return;
+  // The data chunk is clamped to the input, so numSamples is bounded by size
+  std::vector<float> samples(info.numSamples);
+  ConvertPCMToFloat(info.audioData, samples.data(), info.numSamples, info.wfx);
+}
+
+void FuzzStream(const std::string& path) {
+  CWaveFileStreamRead reader(path);
+  if (!reader.isValid())
+    return;
+  std::vector<float> block(4096);
+  while (reader.ReadFloat(block.data(), static_cast<uint32_t>(block.size())) > 0) {
+  }
+  reader.SeekSample(reader.GetNumSamples() / 2);
+  reader.ReadFloat(block.data(), static_cast<uint32_t>(block.size()));
+
+  const CRiffChunkIndex& index = reader.GetChunkIndex();
+  std::vector<uint8_t> payload;
+  for (uint32_t i = 0; i < index.GetNumChunks(); i++)
+    reader.ReadChunk(index.GetChunk(i), &payload);
+}
+
+void FuzzLoad(const std::string& path) {
+  CWaveFileRead reader(path);
+  if (reader.isValid())
+    reader.GetFloatPCMDataAligned(480);
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static const ScratchFile scratch;
+  FuzzImage(data, size);
+  if (scratch.Write(data, size)) {
+    FuzzStream(scratch.GetPath());
+    FuzzLoad(scratch.GetPath());
+  }
+  return 0;
+}
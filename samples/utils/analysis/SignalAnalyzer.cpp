@@ -0,0 +1,332 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "SignalAnalyzer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include <utils/dsp/SimdKernels.hpp>
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/trace/Trace.hpp>
+
+namespace analysis {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Frames below -120 dBFS are digital silence and say nothing about the noise floor
+const double kSilencePower = 1e-12;
+// Frames at least this far over the noise floor count as active (6 dB)
+const double kActiveRatio = 4.0;
+const double kNoiseFloorPercentile = 0.1;
+
+double PowerToDb(double power) {
+  return power > 0.0 ? 10.0 * std::log10(power) : -std::numeric_limits<double>::infinity();
+}
+
+double AmplitudeToDb(double amplitude) {
+  return amplitude > 0.0 ? 20.0 * std::log10(amplitude) : -std::numeric_limits<double>::infinity();
+}
+
+// Level of power over noise, noise excluded
+double SnrDb(double power, double noise) {
+  return power > noise ? PowerToDb((power - noise) / noise) : 0.0;
+}
+
+// JSON has no representation for inf or NaN, emit null instead
+std::string JsonNumber(double value) {
+  if (!std::isfinite(value))
+    return "null";
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2) << value;
+  return oss.str();
+}
+
+// CSV leaves unknown values empty
+std::string CsvNumber(double value) {
+  return std::isfinite(value) ? JsonNumber(value) : std::string();
+}
+
+void WriteSignal(std::ostream& out, const char* name, const SignalSummary& summary, bool last) {
+  out << "  \"" << name << "\": {\"sample_rate\": " << summary.sample_rate << ", \"frames\": " << summary.frames
+      << ", \"rms_dbfs\": " << JsonNumber(summary.rms_db) << ", \"peak_dbfs\": " << JsonNumber(summary.peak_db)
+      << ", \"crest_db\": " << JsonNumber(summary.crest_db) << ", \"centroid_hz\": " << JsonNumber(summary.centroid_hz)
+      << ", \"noise_floor_dbfs\": " << JsonNumber(summary.noise_floor_db) << ", \"snr_db\": "
+      << JsonNumber(summary.snr_db) << "}" << (last ? "\n" : ",\n");
+}
+
+}  // namespace
+
+SignalMeter::SignalMeter(uint32_t sample_rate, uint32_t frame_size)
+  : sample_rate_(sample_rate)
+  , frame_size_(frame_size)
+  , fft_(dsp::RealFFT::NextPowerOfTwo(frame_size)) {
+  window_.resize(frame_size_);
+  for (uint32_t i = 0; i < frame_size_; i++)
+    window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * i / frame_size_));
+  bin_hz_.resize(fft_.GetNumBins());
+  for (uint32_t k = 0; k < fft_.GetNumBins(); k++)
+    bin_hz_[k] = static_cast<float>(static_cast<double>(k) * sample_rate_ / fft_.GetSize());
+  fft_input_.assign(fft_.GetSize(), 0.f);
+  power_.resize(fft_.GetNumBins());
+}
+
+void SignalMeter::AddFrame(const float* frame) {
+  double energy = 0.0;
+  float peak = 0.f;
+  dsp::EnergyAndPeak(frame, frame_size_, &energy, &peak);
+
+  dsp::ApplyWindow(frame, window_.data(), fft_input_.data(), frame_size_);
+  fft_.PowerSpectrum(fft_input_.data(), power_.data());
+  double spectral_total = 0.0;
+  double spectral_weighted = 0.0;
+  dsp::WeightedSum(power_.data(), bin_hz_.data(), power_.size(), &spectral_total, &spectral_weighted);
+
+  size_t second = static_cast<size_t>(static_cast<uint64_t>(frame_power_.size()) * frame_size_ / sample_rate_);
+  if (second >= seconds_.size())
+    seconds_.resize(second + 1);
+  Second& current = seconds_[second];
+  current.energy += energy;
+  current.peak = std::max(current.peak, peak);
+  current.spectral_total += spectral_total;
+  current.spectral_weighted += spectral_weighted;
+  current.frames++;
+
+  frame_power_.push_back(static_cast<float>(energy / frame_size_));
+  peak_ = std::max(peak_, peak);
+}
+
+SignalSummary SignalMeter::Summarize() const {
+  SignalSummary summary;
+  summary.sample_rate = sample_rate_;
+  summary.frames = frame_power_.size();
+
+  std::vector<float> sorted;
+  sorted.reserve(frame_power_.size());
+  for (float power : frame_power_) {
+    if (power >= kSilencePower)
+      sorted.push_back(power);
+  }
+  double noise = kSilencePower;
+  if (!sorted.empty()) {
+    auto nth = sorted.begin() + static_cast<size_t>(kNoiseFloorPercentile * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    noise = *nth;
+  }
+  summary.noise_floor_db = PowerToDb(noise);
+
+  double energy = 0.0;
+  double spectral_total = 0.0;
+  double spectral_weighted = 0.0;
+  double active_power = 0.0;
+  uint64_t active_frames = 0;
+  size_t frame = 0;
+  for (const Second& second : seconds_) {
+    double second_active_power = 0.0;
+    uint32_t second_active_frames = 0;
+    for (uint32_t i = 0; i < second.frames; i++, frame++) {
+      if (frame_power_[frame] >= kActiveRatio * noise) {
+        second_active_power += frame_power_[frame];
+        second_active_frames++;
+      }
+    }
+    SecondStats stats;
+    double rms = std::sqrt(second.energy / (static_cast<double>(second.frames) * frame_size_));
+    stats.rms_db = AmplitudeToDb(rms);
+    stats.peak_db = AmplitudeToDb(second.peak);
+    stats.crest_db = rms > 0.0 ? AmplitudeToDb(second.peak / rms) : 0.0;
+    stats.centroid_hz = second.spectral_total > 0.0 ? second.spectral_weighted / second.spectral_total : 0.0;
+    stats.snr_db = second_active_frames ? SnrDb(second_active_power / second_active_frames, noise)
+                                        : std::numeric_limits<double>::quiet_NaN();
+    summary.seconds.push_back(stats);
+
+    energy += second.energy;
+    spectral_total += second.spectral_total;
+    spectral_weighted += second.spectral_weighted;
+    active_power += second_active_power;
+    active_frames += second_active_frames;
+  }
+
+  double rms = summary.frames ? std::sqrt(energy / (static_cast<double>(summary.frames) * frame_size_)) : 0.0;
+  summary.rms_db = AmplitudeToDb(rms);
+  summary.peak_db = AmplitudeToDb(peak_);
+  summary.crest_db = rms > 0.0 ? AmplitudeToDb(peak_ / rms) : 0.0;
+  summary.centroid_hz = spectral_total > 0.0 ? spectral_weighted / spectral_total : 0.0;
+  summary.snr_db = active_frames ? SnrDb(active_power / active_frames, noise) : 0.0;
+  return summary;
+}
+
+SignalAnalyzer::SignalAnalyzer(uint32_t input_sample_rate, uint32_t input_frame_size, uint32_t output_sample_rate,
+                               uint32_t output_frame_size, uint32_t ring_frames)
+  : input_meter_(input_sample_rate, input_frame_size)
+  , output_meter_(output_sample_rate, output_frame_size)
+  , input_frame_size_(input_frame_size)
+  , output_frame_size_(output_frame_size)
+  , ring_frames_(ring_frames)
+  , input_ring_(static_cast<size_t>(input_frame_size) * ring_frames)
+  , output_ring_(static_cast<size_t>(output_frame_size) * ring_frames)
+  , wake_batch_(std::max(1u, ring_frames / 4)) {
+  worker_ = std::thread(&SignalAnalyzer::workerLoop, this);
+}
+
+SignalAnalyzer::~SignalAnalyzer() {
+  stopWorker();
+}
+
+void SignalAnalyzer::Push(const float* input, const float* output) {
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) >= ring_frames_) {
+    // The analysis thread is a full ring behind, wait rather than drop frames. Only happens when the
+    // effect is faster than the analysis, the wait is not accounted as push time.
+    TRACE_SCOPE("analysis_wait");
+    stalled_frames_++;
+    while (head - tail_.load(std::memory_order_acquire) >= ring_frames_)
+      std::this_thread::yield();
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t slot = static_cast<size_t>(head % ring_frames_);
+  std::copy(input, input + input_frame_size_, &input_ring_[slot * input_frame_size_]);
+  std::copy(output, output + output_frame_size_, &output_ring_[slot * output_frame_size_]);
+  head_.store(head + 1);
+  // Waking the analysis thread costs a syscall, it is only woken once a batch of frames is queued
+  if (head + 1 - tail_.load() >= wake_batch_ && worker_idle_.load()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeup_.notify_one();
+  }
+  push_secs_ += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  frames_++;
+}
+
+void SignalAnalyzer::workerLoop() {
+  placement::ThreadScope placement_scope(placement::Role::kWorker, "analysis");
+  for (;;) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load()) {
+      if (stop_.load())
+        return;
+      std::unique_lock<std::mutex> lock(mutex_);
+      worker_idle_.store(true);
+      wakeup_.wait(lock, [this, tail] { return head_.load() - tail >= wake_batch_ || stop_.load(); });
+      worker_idle_.store(false);
+      continue;
+    }
+
+    TRACE_SCOPE("analysis");
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t slot = static_cast<size_t>(tail % ring_frames_);
+    input_meter_.AddFrame(&input_ring_[slot * input_frame_size_]);
+    output_meter_.AddFrame(&output_ring_[slot * output_frame_size_]);
+    tail_.store(tail + 1, std::memory_order_release);
+    analysis_secs_ += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  }
+}
+
+void SignalAnalyzer::stopWorker() {
+  if (!worker_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_.store(true);
+    wakeup_.notify_one();
+  }
+  worker_.join();
+}
+
+void SignalAnalyzer::Finish() {
+  if (!worker_.joinable())
+    return;
+  stopWorker();
+  input_summary_ = input_meter_.Summarize();
+  output_summary_ = output_meter_.Summarize();
+}
+
+double SignalAnalyzer::GetPushSecsPerFrame() const {
+  return frames_ ? push_secs_ / frames_ : 0.0;
+}
+
+double SignalAnalyzer::GetAnalysisSecsPerFrame() const {
+  return frames_ ? analysis_secs_ / frames_ : 0.0;
+}
+
+bool SignalAnalyzer::WriteSummary(const std::string& file) const {
+  std::ofstream out(file, std::ios_base::out | std::ios_base::trunc);
+  if (!out.is_open())
+    return false;
+
+  out << "{\n";
+  WriteSignal(out, "input", input_summary_, false);
+  WriteSignal(out, "output", output_summary_, false);
+  out << "  \"noise_floor_change_db\": " << JsonNumber(output_summary_.noise_floor_db - input_summary_.noise_floor_db)
+      << ",\n"
+      << "  \"snr_change_db\": " << JsonNumber(output_summary_.snr_db - input_summary_.snr_db) << ",\n"
+      << "  \"push_us_per_frame\": " << JsonNumber(GetPushSecsPerFrame() * 1e6) << ",\n"
+      << "  \"analysis_us_per_frame\": " << JsonNumber(GetAnalysisSecsPerFrame() * 1e6) << ",\n"
+      << "  \"stalled_frames\": " << stalled_frames_ << "\n"
+      << "}\n";
+  return out.good();
+}
+
+bool SignalAnalyzer::WriteSeries(const std::string& file) const {
+  std::ofstream out(file, std::ios_base::out | std::ios_base::trunc);
+  if (!out.is_open())
+    return false;
+
+  out << "second,input_rms_dbfs,input_peak_dbfs,input_crest_db,input_centroid_hz,input_snr_db,"
+      << "output_rms_dbfs,output_peak_dbfs,output_crest_db,output_centroid_hz,output_snr_db\n";
+  size_t num_seconds = std::max(input_summary_.seconds.size(), output_summary_.seconds.size());
+  for (size_t i = 0; i < num_seconds; i++) {
+    out << i;
+    for (const SignalSummary* summary : { &input_summary_, &output_summary_ }) {
+      if (i < summary->seconds.size()) {
+        const SecondStats& stats = summary->seconds[i];
+        out << "," << CsvNumber(stats.rms_db) << "," << CsvNumber(stats.peak_db) << "," << CsvNumber(stats.crest_db)
+            << "," << CsvNumber(stats.centroid_hz) << "," << CsvNumber(stats.snr_db);
+      } else {
+        out << ",,,,,";
+      }
+    }
+    out << "\n";
+  }
+  return out.good();
+}
+
+void SignalAnalyzer::PrintSummary(std::ostream& out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(1) << std::left << std::setw(10) << "Signal" << std::setw(12) << "RMS (dBFS)"
+      << std::setw(13) << "Peak (dBFS)" << std::setw(12) << "Crest (dB)" << std::setw(15) << "Centroid (Hz)"
+      << std::setw(19) << "Noise floor (dBFS)" << "SNR (dB)" << std::endl;
+  for (const SignalSummary* summary : { &input_summary_, &output_summary_ }) {
+    out << std::setw(10) << (summary == &input_summary_ ? "input" : "output") << std::setw(12) << summary->rms_db
+        << std::setw(13) << summary->peak_db << std::setw(12) << summary->crest_db << std::setw(15)
+        << summary->centroid_hz << std::setw(19) << summary->noise_floor_db << summary->snr_db << std::endl;
+  }
+  out << "Noise floor change " << output_summary_.noise_floor_db - input_summary_.noise_floor_db
+      << " dB, SNR change " << output_summary_.snr_db - input_summary_.snr_db << " dB" << std::endl
+      << std::setprecision(2) << "Analysis cost per frame: " << GetPushSecsPerFrame() * 1e6
+      << " us on the processing thread, " << GetAnalysisSecsPerFrame() * 1e6 << " us on the analysis thread"
+      << std::endl;
+  if (stalled_frames_) {
+    out << stalled_frames_ << " of " << frames_ << " frames waited for the analysis thread, the effect ran faster than"
+        << " the analysis" << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace analysis
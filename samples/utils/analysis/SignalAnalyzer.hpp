@@ -0,0 +1,148 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/dsp/RealFFT.hpp>
+
+// Level and spectrum measurements of the effect input and output, used to report how much noise an
+// effect removed. Levels are in dB relative to full scale.
+
+namespace analysis {
+
+// One second of a signal
+struct SecondStats {
+  double rms_db = 0.0;
+  double peak_db = 0.0;
+  double crest_db = 0.0;
+  double centroid_hz = 0.0;
+  // Active level over the noise floor of the file, NaN if the second has no active frame
+  double snr_db = 0.0;
+};
+
+// A signal over the whole file
+struct SignalSummary {
+  uint32_t sample_rate = 0;
+  uint64_t frames = 0;
+  double rms_db = 0.0;
+  double peak_db = 0.0;
+  double crest_db = 0.0;
+  // Power weighted mean of the per-frame spectral centroids
+  double centroid_hz = 0.0;
+  // 10th percentile of the frame powers, digital silence excluded
+  double noise_floor_db = 0.0;
+  // Mean power of the frames 6 dB or more over the noise floor, relative to the noise floor
+  double snr_db = 0.0;
+  std::vector<SecondStats> seconds;
+};
+
+// Per-frame RMS, peak, crest factor and spectral centroid of one signal. The FFT plan, window and
+// bin frequencies are built once for the frame size and reused for every frame.
+class SignalMeter {
+ public:
+  SignalMeter(uint32_t sample_rate, uint32_t frame_size);
+  // Measures frame_size samples
+  void AddFrame(const float* frame);
+  // Noise floor and SNR need all frames, they are estimated here
+  SignalSummary Summarize() const;
+
+ private:
+  struct Second {
+    double energy = 0.0;
+    float peak = 0.f;
+    double spectral_total = 0.0;
+    double spectral_weighted = 0.0;
+    uint32_t frames = 0;
+  };
+
+  uint32_t sample_rate_;
+  uint32_t frame_size_;
+  dsp::RealFFT fft_;
+  // Hann window of frame_size_ samples
+  std::vector<float> window_;
+  // Center frequency of every bin
+  std::vector<float> bin_hz_;
+  // Windowed, zero padded frame
+  std::vector<float> fft_input_;
+  std::vector<float> power_;
+  // Mean square of every frame
+  std::vector<float> frame_power_;
+  std::vector<Second> seconds_;
+  float peak_ = 0.f;
+};
+
+// Runs a SignalMeter on the effect input and one on its output on a background thread, so the frame
+// loop only pays for copying the frames into a bounded ring.
+class SignalAnalyzer {
+ public:
+  SignalAnalyzer(uint32_t input_sample_rate, uint32_t input_frame_size, uint32_t output_sample_rate,
+                 uint32_t output_frame_size, uint32_t ring_frames = 256);
+  ~SignalAnalyzer();
+  // Queues one input and one output frame. Blocks only if the analysis thread is a full ring behind.
+  void Push(const float* input, const float* output);
+  // Waits until every queued frame is analyzed and summarizes both signals
+  void Finish();
+  const SignalSummary& GetInput() const { return input_summary_; }
+  const SignalSummary& GetOutput() const { return output_summary_; }
+  // Time spent in Push() and on the analysis thread, per frame. Push() time excludes waiting for a
+  // full ring.
+  double GetPushSecsPerFrame() const;
+  double GetAnalysisSecsPerFrame() const;
+  // Writes the per-file summary as JSON. Returns false if the file could not be written.
+  bool WriteSummary(const std::string& file) const;
+  // Writes one CSV line per second of audio. Returns false if the file could not be written.
+  bool WriteSeries(const std::string& file) const;
+  void PrintSummary(std::ostream& out) const;
+
+ private:
+  void workerLoop();
+  // Drains the ring and joins the analysis thread
+  void stopWorker();
+
+ private:
+  SignalMeter input_meter_;
+  SignalMeter output_meter_;
+  uint32_t input_frame_size_;
+  uint32_t output_frame_size_;
+  uint32_t ring_frames_;
+  // Frame slots, written by Push() at head_ and read by the worker at tail_
+  std::vector<float> input_ring_;
+  std::vector<float> output_ring_;
+  // Queued frames that wake the idle analysis thread
+  uint32_t wake_batch_;
+  std::atomic<uint64_t> head_{ 0 };
+  std::atomic<uint64_t> tail_{ 0 };
+  std::atomic<bool> worker_idle_{ false };
+  std::atomic<bool> stop_{ false };
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::thread worker_;
+  double push_secs_ = 0.0;
+  double analysis_secs_ = 0.0;
+  uint64_t frames_ = 0;
+  // Frames pushed while the ring was full
+  uint64_t stalled_frames_ = 0;
+  SignalSummary input_summary_;
+  SignalSummary output_summary_;
+};
+
+}  // namespace analysis
@@ -0,0 +1,262 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "BatchIo.hpp"
+
+#include <string.h>
+
+#include <utility>
+
+namespace async_io {
+
+FilePrefetcher::FilePrefetcher(IoEngine& engine, std::vector<std::string> paths, unsigned lookahead_files,
+                               bool direct)
+  : engine_(engine), paths_(std::move(paths)), lookahead_files_(lookahead_files > 0 ? lookahead_files : 1),
+    direct_(direct), requests_(engine.GetNumBuffers()) {}
+
+FilePrefetcher::~FilePrefetcher() {
+  // Buffers of reads in flight are handed back through OnIoComplete()
+  for (File& file : files_) {
+    while (file.in_flight > 0 && engine_.Poll(true) > 0) {
+    }
+    closeFile(&file);
+  }
+}
+
+bool FilePrefetcher::Next(std::string* path, std::vector<uint8_t>* data, bool* ok) {
+  if (first_file_ >= paths_.size())
+    return false;
+
+  fill();
+  File& file = files_.front();
+  while (!isDone(file)) {
+    // Nothing in flight means no buffer was left for the file's reads
+    if (engine_.GetInFlight() == 0 || engine_.Poll(true) == 0) {
+      file.failed = true;
+      break;
+    }
+    fill();
+  }
+  // Reads of a failed file still in flight complete into its buffers
+  while (file.in_flight > 0 && engine_.Poll(true) > 0) {
+  }
+  *path = paths_[first_file_];
+  *ok = !file.failed;
+  data->clear();
+  if (*ok)
+    data->swap(file.data);
+  closeFile(&file);
+  files_.pop_front();
+  first_file_++;
+  fill();
+  return true;
+}
+
+void FilePrefetcher::fill() {
+  while (files_.size() < lookahead_files_ && first_file_ + files_.size() < paths_.size()) {
+    const std::string& path = paths_[first_file_ + files_.size()];
+    File file;
+    file.fd = OpenFile(path, direct_ ? FileMode::kReadDirect : FileMode::kRead);
+    // Not every file system supports O_DIRECT
+    if (file.fd < 0 && direct_)
+      file.fd = OpenFile(path, FileMode::kRead);
+    int64_t size = file.fd >= 0 ? GetFileSize(file.fd) : -1;
+    if (size < 0) {
+      file.failed = true;
+    } else {
+      file.size = static_cast<uint64_t>(size);
+      file.data.resize(static_cast<size_t>(size));
+    }
+    files_.push_back(std::move(file));
+  }
+
+  // Earlier files first, Next() waits for the front one
+  const size_t buffer_size = engine_.GetBufferSize();
+  for (size_t i = 0; i < files_.size(); i++) {
+    File& file = files_[i];
+    while (!file.failed && file.submitted < file.size && engine_.GetInFlight() < engine_.GetQueueDepth()) {
+      unsigned buffer;
+      if (!engine_.AcquireBuffer(&buffer)) {
+        engine_.Flush();
+        return;
+      }
+      uint64_t remaining = file.size - file.submitted;
+      size_t len = remaining < buffer_size ? static_cast<size_t>(remaining) : buffer_size;
+      // Direct reads cover whole blocks, the last one ends early at the end of the file
+      size_t request_len = direct_ ? (len + IoEngine::kBufferAlignment - 1) / IoEngine::kBufferAlignment *
+                                     IoEngine::kBufferAlignment
+                                   : len;
+      requests_[buffer] = std::make_pair(first_file_ + i, file.submitted);
+      if (!engine_.SubmitRead(file.fd, buffer, request_len, file.submitted, this, len)) {
+        engine_.ReleaseBuffer(buffer);
+        break;
+      }
+      file.submitted += len;
+      file.in_flight++;
+    }
+  }
+  engine_.Flush();
+}
+
+void FilePrefetcher::OnIoComplete(unsigned buffer, uint64_t tag, int64_t result) {
+  File& file = files_[requests_[buffer].first - first_file_];
+  file.in_flight--;
+  if (result < static_cast<int64_t>(tag)) {
+    file.failed = true;
+  } else if (!file.failed) {
+    memcpy(file.data.data() + requests_[buffer].second, engine_.GetBuffer(buffer), static_cast<size_t>(tag));
+    file.completed += tag;
+  }
+  engine_.ReleaseBuffer(buffer);
+}
+
+void FilePrefetcher::closeFile(File* file) {
+  if (file->fd >= 0)
+    CloseFile(file->fd);
+  file->fd = -1;
+}
+
+std::unique_ptr<AsyncFileWriter> AsyncFileWriter::Open(IoEngine& engine, const std::string& path) {
+  int fd = OpenFile(path, FileMode::kWrite);
+  if (fd < 0)
+    return nullptr;
+  return std::unique_ptr<AsyncFileWriter>(new AsyncFileWriter(engine, fd));
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  Close();
+}
+
+bool AsyncFileWriter::Append(const void* data, size_t len) {
+  if (fd_ < 0 || failed_)
+    return false;
+
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  const size_t buffer_size = engine_.GetBufferSize();
+  while (len > 0) {
+    if (staging_ < 0) {
+      unsigned buffer;
+      if (!acquireBuffer(&buffer))
+        return false;
+      staging_ = static_cast<int>(buffer);
+      staging_offset_ = size_;
+      staging_used_ = 0;
+    }
+    size_t count = buffer_size - staging_used_ < len ? buffer_size - staging_used_ : len;
+    memcpy(engine_.GetBuffer(staging_) + staging_used_, src, count);
+    staging_used_ += count;
+    size_ += count;
+    src += count;
+    len -= count;
+    if (staging_used_ == buffer_size && !submitStaging())
+      return false;
+  }
+  return true;
+}
+
+bool AsyncFileWriter::WriteAt(uint64_t offset, const void* data, size_t len) {
+  if (fd_ < 0 || failed_ || offset + len > size_)
+    return false;
+
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  // The part still in the staging buffer is patched there
+  uint64_t written_end = staging_ >= 0 ? staging_offset_ : size_;
+  if (offset + len > written_end) {
+    uint64_t begin = offset > written_end ? offset : written_end;
+    memcpy(engine_.GetBuffer(staging_) + (begin - staging_offset_), src + (begin - offset),
+           static_cast<size_t>(offset + len - begin));
+    len = static_cast<size_t>(begin - offset);
+  }
+  if (len == 0)
+    return true;
+
+  if (!drain())
+    return false;
+  const size_t buffer_size = engine_.GetBufferSize();
+  while (len > 0) {
+    unsigned buffer;
+    if (!acquireBuffer(&buffer))
+      return false;
+    size_t count = len < buffer_size ? len : buffer_size;
+    memcpy(engine_.GetBuffer(buffer), src, count);
+    if (!submit(buffer, count, offset))
+      return false;
+    src += count;
+    offset += count;
+    len -= count;
+  }
+  return drain();
+}
+
+bool AsyncFileWriter::Sync() {
+  if (fd_ < 0)
+    return false;
+  return submitStaging() && drain() && SyncFile(fd_);
+}
+
+bool AsyncFileWriter::Close() {
+  if (fd_ < 0)
+    return !failed_;
+  bool written = submitStaging() && drain();
+  bool closed = CloseFile(fd_);
+  fd_ = -1;
+  return written && closed;
+}
+
+void AsyncFileWriter::OnIoComplete(unsigned buffer, uint64_t tag, int64_t result) {
+  in_flight_--;
+  if (result != static_cast<int64_t>(tag))
+    failed_ = true;
+  engine_.ReleaseBuffer(buffer);
+}
+
+bool AsyncFileWriter::submitStaging() {
+  if (staging_ < 0)
+    return true;
+  unsigned buffer = static_cast<unsigned>(staging_);
+  staging_ = -1;
+  return submit(buffer, staging_used_, staging_offset_);
+}
+
+bool AsyncFileWriter::acquireBuffer(unsigned* buffer) {
+  while (!engine_.AcquireBuffer(buffer)) {
+    if (engine_.Poll(true) == 0) {
+      failed_ = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AsyncFileWriter::submit(unsigned buffer, size_t len, uint64_t offset) {
+  while (!engine_.SubmitWrite(fd_, buffer, len, offset, this, len)) {
+    if (engine_.Poll(true) == 0) {
+      engine_.ReleaseBuffer(buffer);
+      failed_ = true;
+      return false;
+    }
+  }
+  in_flight_++;
+  engine_.Flush();
+  return true;
+}
+
+bool AsyncFileWriter::drain() {
+  while (in_flight_ > 0) {
+    if (engine_.Poll(true) == 0) {
+      failed_ = true;
+      return false;
+    }
+  }
+  return !failed_;
+}
+
+}  // namespace async_io
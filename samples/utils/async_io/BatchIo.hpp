@@ -0,0 +1,111 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+#include "IoEngine.hpp"
+
+// Batch file access on top of an IoEngine: reading many files ahead of their use and writing
+// outputs without blocking on each write. Plugs in under the wav classes, file images from
+// FilePrefetcher go to CWaveFileRead(name, image, size) and AsyncFileWriter is a WaveOutputFile for
+// CWaveFileWrite::setOutputFile().
+namespace async_io {
+
+// Reads a list of files in order, with up to lookahead_files files being read ahead of the one
+// returned by Next(). Each file is read with buffer sized requests, all files share the engine's
+// queue depth.
+class FilePrefetcher : private IoListener {
+ public:
+  FilePrefetcher(IoEngine& engine, std::vector<std::string> paths, unsigned lookahead_files, bool direct);
+  ~FilePrefetcher() override;
+
+  // Waits for the next file, false once all files were returned. *ok is false if the file could not
+  // be read, data is empty then.
+  bool Next(std::string* path, std::vector<uint8_t>* data, bool* ok);
+
+ private:
+  struct File {
+    int fd = -1;
+    uint64_t size = 0;
+    // Bytes requested and bytes received so far
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    unsigned in_flight = 0;
+    bool failed = false;
+    std::vector<uint8_t> data;
+  };
+
+  void OnIoComplete(unsigned buffer, uint64_t tag, int64_t result) override;
+  // Opens files up to the lookahead and submits reads while the engine has room
+  void fill();
+  bool isDone(const File& file) const { return file.in_flight == 0 && (file.failed || file.completed == file.size); }
+  void closeFile(File* file);
+
+  IoEngine& engine_;
+  const std::vector<std::string> paths_;
+  const unsigned lookahead_files_;
+  const bool direct_;
+  // Files [first_file_, first_file_ + files_.size()) are open
+  size_t first_file_ = 0;
+  std::deque<File> files_;
+  // File and offset of the request using each engine buffer
+  std::vector<std::pair<size_t, uint64_t>> requests_;
+};
+
+// Sequential writer that collects appended data in engine buffers and writes every full buffer
+// asynchronously, so up to queue_depth writes of one or several files are in flight.
+class AsyncFileWriter : public WaveOutputFile, private IoListener {
+ public:
+  // Creates or truncates path, nullptr on failure
+  static std::unique_ptr<AsyncFileWriter> Open(IoEngine& engine, const std::string& path);
+  ~AsyncFileWriter() override;
+
+  bool Append(const void* data, size_t len) override;
+  // Waits for the writes in flight, so the rewritten bytes are not overtaken by older data
+  bool WriteAt(uint64_t offset, const void* data, size_t len) override;
+  bool Sync() override;
+  bool Close() override;
+
+ private:
+  AsyncFileWriter(IoEngine& engine, int fd) : engine_(engine), fd_(fd) {}
+
+  void OnIoComplete(unsigned buffer, uint64_t tag, int64_t result) override;
+  // Submits the partly filled buffer
+  bool submitStaging();
+  // Polls the engine until a buffer is free or a request can be queued
+  bool acquireBuffer(unsigned* buffer);
+  bool submit(unsigned buffer, size_t len, uint64_t offset);
+  // Waits for all writes of this file
+  bool drain();
+
+  IoEngine& engine_;
+  int fd_;
+  // Bytes appended so far
+  uint64_t size_ = 0;
+  // Buffer collecting appended data from staging_offset_, -1 if none
+  int staging_ = -1;
+  uint64_t staging_offset_ = 0;
+  size_t staging_used_ = 0;
+  unsigned in_flight_ = 0;
+  bool failed_ = false;
+};
+
+}  // namespace async_io
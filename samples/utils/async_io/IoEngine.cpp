@@ -0,0 +1,468 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "IoEngine.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <utils/placement/ThreadPlacement.hpp>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace async_io {
+
+namespace {
+
+// One blocking positioned transfer, returns the bytes transferred or a negative error
+int64_t TransferAt(bool write, int fd, uint8_t* data, size_t len, uint64_t offset) {
+  size_t done = 0;
+  while (done < len) {
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset + done);
+    overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+    DWORD count = 0;
+    DWORD chunk = static_cast<DWORD>(len - done > 0x40000000 ? 0x40000000 : len - done);
+    BOOL ok = write ? WriteFile(handle, data + done, chunk, &count, &overlapped)
+                    : ReadFile(handle, data + done, chunk, &count, &overlapped);
+    if (!ok) {
+      if (GetLastError() == ERROR_HANDLE_EOF)
+        break;
+      return -static_cast<int64_t>(GetLastError());
+    }
+    int64_t n = count;
+#else
+    ssize_t n = write ? pwrite(fd, data + done, len - done, static_cast<off_t>(offset + done))
+                      : pread(fd, data + done, len - done, static_cast<off_t>(offset + done));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -errno;
+    }
+#endif
+    // End of file
+    if (n == 0)
+      break;
+    done += static_cast<size_t>(n);
+  }
+  return static_cast<int64_t>(done);
+}
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+class ThreadPoolEngine : public IoEngine {
+ public:
+  ThreadPoolEngine(const IoOptions& options) : IoEngine(options) {
+    unsigned num_threads = options.num_threads > 0 ? options.num_threads : 1;
+    for (unsigned i = 0; i < num_threads; i++)
+      threads_.emplace_back([this]() { work(); });
+  }
+
+  ~ThreadPoolEngine() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& thread : threads_)
+      thread.join();
+  }
+
+  const char* GetName() const override { return "thread pool"; }
+
+ protected:
+  bool queue(bool write, int fd, unsigned buffer, size_t len, uint64_t offset) override {
+    Work work;
+    work.write = write;
+    work.fd = fd;
+    work.buffer = buffer;
+    work.len = len;
+    work.offset = offset;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(work);
+    }
+    work_available_.notify_one();
+    return true;
+  }
+
+  bool reap(bool block, unsigned* buffer, int64_t* result) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (block)
+      work_done_.wait(lock, [this]() { return !completed_.empty(); });
+    if (completed_.empty())
+      return false;
+    *buffer = completed_.front().buffer;
+    *result = completed_.front().result;
+    completed_.pop_front();
+    return true;
+  }
+
+ private:
+  struct Work {
+    bool write;
+    int fd;
+    unsigned buffer;
+    size_t len;
+    uint64_t offset;
+  };
+  struct Completion {
+    unsigned buffer;
+    int64_t result;
+  };
+
+  void work() {
+    placement::ThreadScope placement_scope(placement::Role::kIo, "io_pool");
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      work_available_.wait(lock, [this]() { return stop_ || !pending_.empty(); });
+      if (stop_)
+        return;
+      Work work = pending_.front();
+      pending_.pop_front();
+      lock.unlock();
+      Completion completion;
+      completion.buffer = work.buffer;
+      completion.result = TransferAt(work.write, work.fd, GetBuffer(work.buffer), work.len, work.offset);
+      lock.lock();
+      completed_.push_back(completion);
+      work_done_.notify_one();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_done_;
+  std::deque<Work> pending_;
+  std::deque<Completion> completed_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+
+#ifdef ASYNC_IO_URING
+// io_uring through the raw system calls, no liburing dependency. One submitting and reaping
+// thread, so the only ordering needed is against the kernel side of the rings.
+class UringEngine : public IoEngine {
+ public:
+  UringEngine(const IoOptions& options) : IoEngine(options) {}
+
+  ~UringEngine() override {
+    if (sqes_)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_)
+      munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  // Sets up the rings and registers the buffers, false if io_uring is not available
+  bool Init() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, GetQueueDepth(), &params));
+    if (fd_ < 0)
+      return false;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_ring_size_ > sq_ring_size_)
+      sq_ring_size_ = cq_ring_size_;
+    sq_ring_ = mapRing(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_)
+      return false;
+    cq_ring_ = single_mmap ? sq_ring_ : mapRing(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mapRing(sqes_size_, IORING_OFF_SQES));
+    if (!cq_ring_ || !sqes_)
+      return false;
+
+    uint8_t* sq = static_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    uint8_t* cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Registered buffers skip the page pinning per request. Without them (e.g. RLIMIT_MEMLOCK too
+    // low) plain reads and writes are used.
+    std::vector<iovec> iovecs(GetNumBuffers());
+    for (unsigned i = 0; i < GetNumBuffers(); i++) {
+      iovecs[i].iov_base = GetBuffer(i);
+      iovecs[i].iov_len = GetBufferSize();
+    }
+    fixed_ = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iovecs.data(), GetNumBuffers()) == 0;
+    return true;
+  }
+
+  const char* GetName() const override { return fixed_ ? "io_uring (registered buffers)" : "io_uring"; }
+
+  void Flush() override { enter(false); }
+
+ protected:
+  bool queue(bool write, int fd, unsigned buffer, size_t len, uint64_t offset) override {
+    // The kernel consumes submissions in enter(), in flight requests never exceed the ring size
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    if (fixed_) {
+      sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = static_cast<uint16_t>(buffer);
+    } else {
+      sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(GetBuffer(buffer));
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->user_data = buffer;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+    return true;
+  }
+
+  bool reap(bool block, unsigned* buffer, int64_t* result) override {
+    for (;;) {
+      unsigned head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        *buffer = static_cast<unsigned>(cqe.user_data);
+        *result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+      if (!block) {
+        // Only submitting can produce completions without waiting
+        if (to_submit_ == 0 || !enter(false) || *cq_head_ == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+          return false;
+        continue;
+      }
+      if (!enter(true))
+        return false;
+    }
+  }
+
+ private:
+  void* mapRing(size_t size, uint64_t offset) {
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+    return ring == MAP_FAILED ? nullptr : ring;
+  }
+
+  // Submits the queued requests, with wait also waits for one completion
+  bool enter(bool wait) {
+    if (to_submit_ == 0 && !wait)
+      return true;
+    for (;;) {
+      long submitted = syscall(__NR_io_uring_enter, fd_, to_submit_, wait ? 1 : 0,
+                               wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (submitted >= 0) {
+        to_submit_ -= static_cast<unsigned>(submitted);
+        return true;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+        return false;
+      }
+    }
+  }
+
+  int fd_ = -1;
+  bool fixed_ = false;
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned to_submit_ = 0;
+};
+#endif  // ASYNC_IO_URING
+
+}  // namespace
+
+IoEngine::IoEngine(const IoOptions& options)
+  : queue_depth_(options.queue_depth > 0 ? options.queue_depth : 1),
+    buffer_size_(AlignUp(options.buffer_size > 0 ? options.buffer_size : kBufferAlignment, kBufferAlignment)),
+    num_buffers_(options.num_buffers > 0 ? options.num_buffers : 2 * queue_depth_),
+    requests_(num_buffers_) {
+  size_t total = buffer_size_ * num_buffers_;
+#ifdef _WIN32
+  buffers_ = static_cast<uint8_t*>(_aligned_malloc(total, kBufferAlignment));
+#else
+  void* memory = nullptr;
+  if (posix_memalign(&memory, kBufferAlignment, total) == 0)
+    buffers_ = static_cast<uint8_t*>(memory);
+#endif
+  free_buffers_.reserve(num_buffers_);
+  for (unsigned i = num_buffers_; i > 0; i--)
+    free_buffers_.push_back(i - 1);
+}
+
+IoEngine::~IoEngine() {
+#ifdef _WIN32
+  _aligned_free(buffers_);
+#else
+  free(buffers_);
+#endif
+}
+
+bool IoEngine::AcquireBuffer(unsigned* buffer) {
+  if (free_buffers_.empty() || !buffers_)
+    return false;
+  *buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return true;
+}
+
+void IoEngine::ReleaseBuffer(unsigned buffer) {
+  free_buffers_.push_back(buffer);
+}
+
+bool IoEngine::SubmitRead(int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener, uint64_t tag) {
+  return submit(false, fd, buffer, len, offset, listener, tag);
+}
+
+bool IoEngine::SubmitWrite(int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener, uint64_t tag) {
+  return submit(true, fd, buffer, len, offset, listener, tag);
+}
+
+bool IoEngine::submit(bool write, int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener,
+                      uint64_t tag) {
+  if (in_flight_ >= queue_depth_ || buffer >= num_buffers_ || len > buffer_size_)
+    return false;
+  requests_[buffer].listener = listener;
+  requests_[buffer].tag = tag;
+  if (!queue(write, fd, buffer, len, offset))
+    return false;
+  in_flight_++;
+  return true;
+}
+
+unsigned IoEngine::Poll(bool block) {
+  unsigned count = 0;
+  unsigned buffer;
+  int64_t result;
+  while (in_flight_ > 0 && reap(block && count == 0, &buffer, &result)) {
+    in_flight_--;
+    stats_.requests++;
+    if (result >= 0)
+      stats_.bytes += static_cast<uint64_t>(result);
+    else
+      stats_.errors++;
+    Request request = requests_[buffer];
+    request.listener->OnIoComplete(buffer, request.tag, result);
+    count++;
+  }
+  return count;
+}
+
+std::unique_ptr<IoEngine> CreateIoEngine(const IoOptions& options) {
+#ifdef ASYNC_IO_URING
+  if (options.backend != IoBackend::kThreadPool) {
+    std::unique_ptr<UringEngine> engine(new UringEngine(options));
+    if (engine->Init())
+      return std::unique_ptr<IoEngine>(engine.release());
+  }
+#endif
+  if (options.backend == IoBackend::kUring) {
+    std::cerr << "io_uring is not available" << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<IoEngine>(new ThreadPoolEngine(options));
+}
+
+int OpenFile(const std::string& path, FileMode mode) {
+#ifdef _WIN32
+  // Unbuffered reads need FILE_FLAG_NO_BUFFERING, not available through _open
+  int flags = mode == FileMode::kWrite ? _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY : _O_RDONLY | _O_BINARY;
+  return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+  int flags = mode == FileMode::kWrite ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+#ifdef O_DIRECT
+  if (mode == FileMode::kReadDirect)
+    flags |= O_DIRECT;
+#endif
+  return open(path.c_str(), flags | O_CLOEXEC, 0644);
+#endif
+}
+
+bool CloseFile(int fd) {
+#ifdef _WIN32
+  return _close(fd) == 0;
+#else
+  return close(fd) == 0;
+#endif
+}
+
+int64_t GetFileSize(int fd) {
+#ifdef _WIN32
+  return _filelengthi64(fd);
+#else
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+    return -1;
+  return info.st_size;
+#endif
+}
+
+bool SyncFile(int fd) {
+#ifdef _WIN32
+  return _commit(fd) == 0;
+#else
+  return fsync(fd) == 0;
+#endif
+}
+
+}  // namespace async_io
@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Asynchronous positioned file reads and writes with a fixed queue depth. On Linux requests go
+// through io_uring with the engine's buffers registered with the kernel, elsewhere (or if io_uring
+// is not available) a pool of threads issues blocking pread / pwrite calls. All requests use the
+// engine's page aligned buffers, which also makes O_DIRECT reads possible.
+namespace async_io {
+
+enum class IoBackend {
+  // io_uring if available, thread pool otherwise
+  kAuto,
+  kUring,
+  kThreadPool,
+};
+
+struct IoOptions {
+  IoBackend backend = IoBackend::kAuto;
+  // Requests in flight at most
+  unsigned queue_depth = 32;
+  // Size of every buffer, rounded up to kBufferAlignment
+  size_t buffer_size = 1 << 20;
+  // Buffers owned by the engine, 0 uses 2 * queue_depth so callers can fill buffers while others are in flight
+  unsigned num_buffers = 0;
+  // Threads of the thread pool backend
+  unsigned num_threads = 4;
+};
+
+// Receives the completion of a request, on the thread calling IoEngine::Poll()
+class IoListener {
+ public:
+  virtual ~IoListener() {}
+  // result is the number of bytes transferred or a negative error. The listener owns buffer again.
+  virtual void OnIoComplete(unsigned buffer, uint64_t tag, int64_t result) = 0;
+};
+
+struct IoStats {
+  uint64_t requests = 0;
+  uint64_t bytes = 0;
+  uint64_t errors = 0;
+};
+
+class IoEngine {
+ public:
+  static const size_t kBufferAlignment = 4096;
+
+  virtual ~IoEngine();
+  // Backend in use
+  virtual const char* GetName() const = 0;
+
+  // Takes a free buffer, false if all are in use
+  bool AcquireBuffer(unsigned* buffer);
+  void ReleaseBuffer(unsigned buffer);
+  uint8_t* GetBuffer(unsigned buffer) { return buffers_ + buffer * buffer_size_; }
+  size_t GetBufferSize() const { return buffer_size_; }
+  unsigned GetNumBuffers() const { return num_buffers_; }
+
+  // Queues a read of len bytes at offset of fd into buffer, which is handed to listener with the
+  // completion. Returns false if queue_depth requests are already in flight.
+  bool SubmitRead(int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener, uint64_t tag);
+  // Queues a write of the first len bytes of buffer to offset of fd
+  bool SubmitWrite(int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener, uint64_t tag);
+  // Starts the queued requests, io_uring collects them until here or the next Poll()
+  virtual void Flush() {}
+  // Hands completed requests to their listeners. With block, waits for at least one if any is in
+  // flight. Returns the number of completions.
+  unsigned Poll(bool block);
+
+  unsigned GetInFlight() const { return in_flight_; }
+  unsigned GetQueueDepth() const { return queue_depth_; }
+  const IoStats& GetStats() const { return stats_; }
+
+ protected:
+  explicit IoEngine(const IoOptions& options);
+
+  // Queues one request, buffer identifies it in the completion
+  virtual bool queue(bool write, int fd, unsigned buffer, size_t len, uint64_t offset) = 0;
+  // Returns one completed request, false if none completed (or with block, on error)
+  virtual bool reap(bool block, unsigned* buffer, int64_t* result) = 0;
+
+ private:
+  struct Request {
+    IoListener* listener = nullptr;
+    uint64_t tag = 0;
+  };
+
+  bool submit(bool write, int fd, unsigned buffer, size_t len, uint64_t offset, IoListener* listener, uint64_t tag);
+
+  const unsigned queue_depth_;
+  const size_t buffer_size_;
+  const unsigned num_buffers_;
+  uint8_t* buffers_ = nullptr;
+  std::vector<unsigned> free_buffers_;
+  std::vector<Request> requests_;
+  unsigned in_flight_ = 0;
+  IoStats stats_;
+};
+
+// Creates the engine for options.backend. kUring fails where io_uring is not available, kAuto falls
+// back to the thread pool then.
+std::unique_ptr<IoEngine> CreateIoEngine(const IoOptions& options);
+
+enum class FileMode {
+  kRead,
+  // Bypasses the page cache where supported (O_DIRECT), offsets and lengths must be multiples of
+  // IoEngine::kBufferAlignment except at the end of the file
+  kReadDirect,
+  // Creates or truncates the file
+  kWrite,
+};
+
+// File descriptors as used by IoEngine, -1 on failure
+int OpenFile(const std::string& path, FileMode mode);
+bool CloseFile(int fd);
+int64_t GetFileSize(int fd);
+bool SyncFile(int fd);
+
+}  // namespace async_io
@@ -0,0 +1,297 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "AudioStream.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+#ifdef NVAFX_HAVE_FLAC
+#include "FlacCodec.hpp"
+#endif
+#ifdef NVAFX_HAVE_OPUS
+#include "OpusSource.hpp"
+#endif
+
+namespace audio_io {
+
+namespace {
+
+// Lower case extension of path without the dot
+std::string GetExtension(const std::string& path) {
+  std::size_t dot_pos = path.find_last_of('.');
+  if (dot_pos == std::string::npos || path.find_first_of("/\\", dot_pos) != std::string::npos)
+    return std::string();
+  std::string extension = path.substr(dot_pos + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return static_cast<char>(::tolower(static_cast<unsigned char>(c))); });
+  return extension;
+}
+
+// Chunks that describe the recording rather than the audio format
+bool IsMetadataChunk(uint32_t id) {
+  return id == MAKEFOURCC('L', 'I', 'S', 'T') || id == MAKEFOURCC('b', 'e', 'x', 't') ||
+         id == MAKEFOURCC('c', 'u', 'e', ' ') || id == MAKEFOURCC('i', 'X', 'M', 'L');
+}
+
+uint64_t RescalePosition(uint64_t position, uint32_t in_rate, uint32_t out_rate) {
+  return (position * out_rate + in_rate / 2) / in_rate;
+}
+
+// Byte offset of TimeReference in the BWF bext chunk
+const size_t kBextTimeReferenceOffset = 338;
+// cue  chunk: point count followed by 24 byte points with dwPosition at 4 and dwSampleOffset at 20
+const size_t kCuePointSize = 24;
+
+}  // namespace
+
+const std::vector<MetadataChunk>& AudioSource::GetMetadata() const {
+  static const std::vector<MetadataChunk> kNoMetadata;
+  return kNoMetadata;
+}
+
+void RescaleMetadata(std::vector<MetadataChunk>* chunks, uint32_t in_rate, uint32_t out_rate) {
+  if (in_rate == out_rate || in_rate == 0)
+    return;
+
+  for (MetadataChunk& chunk : *chunks) {
+    if (chunk.id == MAKEFOURCC('b', 'e', 'x', 't') && chunk.data.size() >= kBextTimeReferenceOffset + 8) {
+      uint64_t time_reference;
+      memcpy(&time_reference, &chunk.data[kBextTimeReferenceOffset], sizeof(time_reference));
+      time_reference = RescalePosition(time_reference, in_rate, out_rate);
+      memcpy(&chunk.data[kBextTimeReferenceOffset], &time_reference, sizeof(time_reference));
+    } else if (chunk.id == MAKEFOURCC('c', 'u', 'e', ' ') && chunk.data.size() >= 4) {
+      uint32_t num_points;
+      memcpy(&num_points, chunk.data.data(), sizeof(num_points));
+      num_points = std::min<uint32_t>(num_points, static_cast<uint32_t>((chunk.data.size() - 4) / kCuePointSize));
+      for (uint32_t i = 0; i < num_points; i++) {
+        uint8_t* point = &chunk.data[4 + i * kCuePointSize];
+        for (size_t field : {size_t(4), size_t(20)}) {
+          uint32_t position;
+          memcpy(&position, point + field, sizeof(position));
+          position = static_cast<uint32_t>(std::min<uint64_t>(RescalePosition(position, in_rate, out_rate), UINT32_MAX));
+          memcpy(point + field, &position, sizeof(position));
+        }
+      }
+    }
+  }
+}
+
+std::unique_ptr<AudioSource> OpenAudioSource(const std::string& path) {
+  std::string extension = GetExtension(path);
+  std::unique_ptr<AudioSource> source;
+  if (extension == "wav") {
+    source.reset(new WaveSource(path));
+  } else if (extension == "flac") {
+#ifdef NVAFX_HAVE_FLAC
+    source.reset(new FlacSource(path));
+#else
+    std::cerr << "FLAC support was not compiled in: " << path << std::endl;
+    return nullptr;
+#endif
+  } else if (extension == "opus" || extension == "ogg") {
+#ifdef NVAFX_HAVE_OPUS
+    source.reset(new OpusSource(path));
+#else
+    std::cerr << "Opus support was not compiled in: " << path << std::endl;
+    return nullptr;
+#endif
+  } else {
+    std::cerr << "Unsupported audio file type: " << path << std::endl;
+    return nullptr;
+  }
+
+  if (!source->IsValid()) {
+    std::cerr << "Unable to open audio file: " << path << std::endl;
+    return nullptr;
+  }
+  return source;
+}
+
+std::unique_ptr<AudioSink> CreateAudioSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels,
+                                           int compression_level) {
+  std::string extension = GetExtension(path);
+  std::unique_ptr<AudioSink> sink;
+  if (extension == "flac") {
+#ifdef NVAFX_HAVE_FLAC
+    sink.reset(new FlacSink(path, sample_rate, num_channels, compression_level));
+#else
+    (void)compression_level;
+    std::cerr << "FLAC support was not compiled in: " << path << std::endl;
+    return nullptr;
+#endif
+  } else {
+    // Anything else keeps the previous behavior of writing wav
+    sink.reset(new WaveSink(path, sample_rate, num_channels));
+  }
+
+  if (!sink->IsValid()) {
+    std::cerr << "Unable to create audio file: " << path << std::endl;
+    return nullptr;
+  }
+  return sink;
+}
+
+WaveSource::WaveSource(const std::string& path) : reader_(new CWaveFileStreamRead(path)) {
+  if (!reader_->isValid()) {
+    std::cerr << "Invalid wav file (" << GetWaveStatusString(reader_->GetStatus()) << "): " << path << std::endl;
+    return;
+  }
+
+  // Read metadata now, so GetMetadata() never touches the file while audio is being decoded
+  const CRiffChunkIndex& index = reader_->GetChunkIndex();
+  for (uint32_t i = 0; i < index.GetNumChunks(); i++) {
+    const RiffChunkEntry& entry = index.GetChunk(i);
+    if (!IsMetadataChunk(entry.chunkId))
+      continue;
+    MetadataChunk chunk;
+    chunk.id = entry.chunkId;
+    if (reader_->ReadChunk(entry, &chunk.data))
+      metadata_.push_back(std::move(chunk));
+  }
+  if (index.IsTruncated())
+    std::cerr << "Too many chunks, some metadata was not read: " << path << std::endl;
+}
+
+WaveSource::~WaveSource() = default;
+
+bool WaveSource::IsValid() const { return reader_->isValid(); }
+
+uint32_t WaveSource::GetSampleRate() const { return reader_->GetSampleRate(); }
+
+uint32_t WaveSource::GetNumChannels() const { return reader_->GetNumChannels(); }
+
+uint64_t WaveSource::GetLength() const { return reader_->GetNumSamples() / std::max(1u, reader_->GetNumChannels()); }
+
+uint32_t WaveSource::Read(float* out, uint32_t num_samples) { return reader_->ReadFloat(out, num_samples); }
+
+WaveSink::WaveSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels)
+  : writer_(new CWaveFileWrite(path, sample_rate, num_channels, 32, true)) {}
+
+WaveSink::~WaveSink() = default;
+
+bool WaveSink::Write(const float* data, uint32_t num_samples) {
+  valid_ = valid_ && writer_->writeChunk(data, num_samples * sizeof(float));
+  return valid_;
+}
+
+bool WaveSink::Commit() { return writer_->commitFile(); }
+
+bool WaveSink::Flush() {
+  // The file is only created by the first write
+  if (writer_->getWrittenCount() == 0)
+    return true;
+  return writer_->updateHeader() && writer_->flush();
+}
+
+bool WaveSink::SetMetadata(const std::vector<MetadataChunk>& chunks) {
+  for (const MetadataChunk& chunk : chunks) {
+    if (!writer_->addChunk(chunk.id, chunk.data.data(), static_cast<uint32_t>(chunk.data.size())))
+      return false;
+  }
+  return true;
+}
+
+bool WaveSink::Checkpoint(uint64_t* position) {
+  if (!writer_->updateHeader() || !writer_->sync())
+    return false;
+  *position = writer_->getWrittenCount();
+  return true;
+}
+
+bool WaveSink::Resume(uint64_t position) {
+  if (position > UINT32_MAX)
+    return false;
+  return writer_->resume(static_cast<uint32_t>(position));
+}
+
+ThreadedSource::ThreadedSource(std::unique_ptr<AudioSource> source, uint32_t block_samples, size_t max_blocks)
+  : source_(std::move(source))
+  , sample_rate_(source_->GetSampleRate())
+  , num_channels_(source_->GetNumChannels())
+  , length_(source_->GetLength())
+  , block_samples_(std::max(1u, block_samples / std::max(1u, num_channels_)) * std::max(1u, num_channels_))
+  , max_blocks_(std::max<size_t>(1, max_blocks)) {
+  if (source_->IsValid())
+    decode_thread_ = std::thread(&ThreadedSource::decodeLoop, this);
+}
+
+ThreadedSource::~ThreadedSource() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  block_consumed_.notify_all();
+  if (decode_thread_.joinable())
+    decode_thread_.join();
+}
+
+void ThreadedSource::decodeLoop() {
+  placement::ThreadScope placement_scope(placement::Role::kIo, "decode");
+  std::vector<float> block;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      block_consumed_.wait(lock, [this] { return stop_ || blocks_.size() < max_blocks_; });
+      if (stop_)
+        return;
+      if (!free_blocks_.empty()) {
+        block.swap(free_blocks_.back());
+        free_blocks_.pop_back();
+      }
+    }
+
+    // Decode outside of the lock, the reader only waits for complete blocks
+    block.resize(block_samples_);
+    uint32_t num_read = source_->Read(block.data(), block_samples_);
+    block.resize(num_read);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_read == 0) {
+      decode_done_ = true;
+      block_ready_.notify_all();
+      return;
+    }
+    blocks_.push_back(std::move(block));
+    block = std::vector<float>();
+    block_ready_.notify_all();
+  }
+}
+
+uint32_t ThreadedSource::Read(float* out, uint32_t num_samples) {
+  uint32_t num_read = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_read < num_samples) {
+    block_ready_.wait(lock, [this] { return !blocks_.empty() || decode_done_; });
+    if (blocks_.empty())
+      break;
+
+    std::vector<float>& block = blocks_.front();
+    uint32_t count = static_cast<uint32_t>(std::min<size_t>(num_samples - num_read, block.size() - block_pos_));
+    std::memcpy(out + num_read, block.data() + block_pos_, count * sizeof(float));
+    num_read += count;
+    block_pos_ += count;
+    if (block_pos_ == block.size()) {
+      free_blocks_.push_back(std::move(block));
+      blocks_.pop_front();
+      block_pos_ = 0;
+      block_consumed_.notify_one();
+    }
+  }
+  return num_read;
+}
+
+}  // namespace audio_io
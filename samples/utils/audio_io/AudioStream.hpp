@@ -0,0 +1,159 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pluggable audio sources and sinks. Samples are interleaved floats in [-1, 1].
+// Wav is always available, FLAC and Opus depend on NVAFX_HAVE_FLAC / NVAFX_HAVE_OPUS
+// (set by CMake when libFLAC / opusfile are found).
+
+class CWaveFileStreamRead;
+class CWaveFileWrite;
+
+namespace audio_io {
+
+// A RIFF chunk carried from the input to the output unchanged (LIST, bext, cue , iXML)
+struct MetadataChunk {
+  uint32_t id;
+  std::vector<uint8_t> data;
+};
+
+class AudioSource {
+ public:
+  virtual ~AudioSource() = default;
+  virtual bool IsValid() const = 0;
+  virtual uint32_t GetSampleRate() const = 0;
+  virtual uint32_t GetNumChannels() const = 0;
+  // Samples per channel, 0 if the stream does not record its length
+  virtual uint64_t GetLength() const = 0;
+  // Reads up to num_samples interleaved samples (a multiple of the channel count).
+  // Returns the number of samples read, 0 at the end of the stream or on error.
+  virtual uint32_t Read(float* out, uint32_t num_samples) = 0;
+  // Metadata chunks found in the stream, in file order
+  virtual const std::vector<MetadataChunk>& GetMetadata() const;
+};
+
+class AudioSink {
+ public:
+  virtual ~AudioSink() = default;
+  virtual bool IsValid() const = 0;
+  // Appends num_samples interleaved samples
+  virtual bool Write(const float* data, uint32_t num_samples) = 0;
+  // Finalizes the stream, no writes are allowed afterwards
+  virtual bool Commit() = 0;
+  // Makes the samples written so far readable by other processes, under a header that describes
+  // them, without waiting for the disk. Sinks that can not do this do nothing.
+  virtual bool Flush() { return true; }
+  // Sinks that can continue a partially written stream (see Checkpoint / Resume)
+  virtual bool SupportsResume() const { return false; }
+  // Makes everything written so far durable and returns the position to pass to Resume()
+  virtual bool Checkpoint(uint64_t* /*position*/) { return false; }
+  // Reopens an existing stream and continues after position, discarding anything after it
+  virtual bool Resume(uint64_t /*position*/) { return false; }
+  // Stores chunks with the stream. Must be called before the first Write(), and before Resume() with
+  // the same chunks. Returns false if the sink has no place for them.
+  virtual bool SetMetadata(const std::vector<MetadataChunk>& /*chunks*/) { return false; }
+};
+
+// Opens path by its extension: .wav, .flac, .opus / .ogg. Returns nullptr and prints the reason if
+// the format is unknown, was not compiled in or the file can not be opened.
+std::unique_ptr<AudioSource> OpenAudioSource(const std::string& path);
+
+// Creates path by its extension: .wav (32 bit float) or .flac (24 bit). compression_level is the
+// FLAC level 0 (fastest) .. 8 (smallest), -1 for the encoder default, it is ignored for wav.
+std::unique_ptr<AudioSink> CreateAudioSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels,
+                                           int compression_level = -1);
+
+// Rewrites the sample positions in bext and cue chunks for audio resampled from in_rate to out_rate
+void RescaleMetadata(std::vector<MetadataChunk>* chunks, uint32_t in_rate, uint32_t out_rate);
+
+class WaveSource : public AudioSource {
+ public:
+  explicit WaveSource(const std::string& path);
+  ~WaveSource() override;
+  bool IsValid() const override;
+  uint32_t GetSampleRate() const override;
+  uint32_t GetNumChannels() const override;
+  uint64_t GetLength() const override;
+  uint32_t Read(float* out, uint32_t num_samples) override;
+  const std::vector<MetadataChunk>& GetMetadata() const override { return metadata_; }
+
+ private:
+  std::unique_ptr<CWaveFileStreamRead> reader_;
+  std::vector<MetadataChunk> metadata_;
+};
+
+class WaveSink : public AudioSink {
+ public:
+  WaveSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels);
+  ~WaveSink() override;
+  bool IsValid() const override { return valid_; }
+  bool Write(const float* data, uint32_t num_samples) override;
+  bool Commit() override;
+  bool Flush() override;
+  bool SupportsResume() const override { return true; }
+  bool Checkpoint(uint64_t* position) override;
+  bool Resume(uint64_t position) override;
+  bool SetMetadata(const std::vector<MetadataChunk>& chunks) override;
+
+ private:
+  std::unique_ptr<CWaveFileWrite> writer_;
+  bool valid_ = true;
+};
+
+// Decodes another source on a background thread into blocks of block_samples samples. Read() only
+// waits when the decoder falls behind; at most max_blocks blocks are buffered.
+class ThreadedSource : public AudioSource {
+ public:
+  ThreadedSource(std::unique_ptr<AudioSource> source, uint32_t block_samples, size_t max_blocks = 16);
+  ~ThreadedSource() override;
+  bool IsValid() const override { return source_->IsValid(); }
+  uint32_t GetSampleRate() const override { return sample_rate_; }
+  uint32_t GetNumChannels() const override { return num_channels_; }
+  uint64_t GetLength() const override { return length_; }
+  uint32_t Read(float* out, uint32_t num_samples) override;
+  // The wrapped source reads its metadata up front, so this is safe while decoding
+  const std::vector<MetadataChunk>& GetMetadata() const override { return source_->GetMetadata(); }
+
+ private:
+  void decodeLoop();
+
+ private:
+  std::unique_ptr<AudioSource> source_;
+  const uint32_t sample_rate_;
+  const uint32_t num_channels_;
+  const uint64_t length_;
+  const uint32_t block_samples_;
+  const size_t max_blocks_;
+  std::mutex mutex_;
+  std::condition_variable block_ready_;
+  std::condition_variable block_consumed_;
+  std::deque<std::vector<float>> blocks_;
+  // Recycled block buffers
+  std::vector<std::vector<float>> free_blocks_;
+  // Read position in blocks_.front()
+  size_t block_pos_ = 0;
+  bool decode_done_ = false;
+  bool stop_ = false;
+  std::thread decode_thread_;
+};
+
+}  // namespace audio_io
@@ -0,0 +1,122 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "DecodedInput.hpp"
+
+#include <iostream>
+#include <utility>
+
+#include <utils/cache/ContentHash.hpp>
+#include <utils/startup/StartupProfile.hpp>
+#include <utils/trace/Trace.hpp>
+
+namespace audio_io {
+
+DecodedAudio DecodeAudioFile(const std::string& filename, uint32_t block_samples, bool background, bool hash) {
+  startup::ScopedPhase phase("decode_input", background);
+  TRACE_SCOPE("ReadAudioFile");
+  DecodedAudio decoded;
+  std::unique_ptr<AudioSource> file = OpenAudioSource(filename);
+  if (!file) {
+    return decoded;
+  }
+  decoded.sample_rate = file->GetSampleRate();
+  decoded.num_channels = file->GetNumChannels();
+
+  if (block_samples == 0)
+    block_samples = 4096u;
+  ThreadedSource source(std::move(file), block_samples);
+  decoded.metadata = source.GetMetadata();
+  // The length is only a hint, some streams do not record it
+  decoded.samples.reserve(static_cast<size_t>(source.GetLength() * source.GetNumChannels()) + block_samples);
+  std::vector<float> block(block_samples);
+  cache::StreamHash content_hash;
+  uint32_t num_read;
+  while ((num_read = source.Read(block.data(), block_samples)) > 0) {
+    decoded.samples.insert(decoded.samples.end(), block.begin(), block.begin() + num_read);
+    if (hash)
+      content_hash.Update(block.data(), num_read * sizeof(float));
+  }
+  decoded.content_hash = content_hash.Digest();
+  decoded.valid = true;
+  return decoded;
+}
+
+bool PrepareInput(DecodedAudio* decoded, uint32_t expected_sample_rate, int align_samples, std::vector<float>* data,
+                  std::vector<MetadataChunk>* metadata) {
+  if (!decoded->valid) {
+    return false;
+  }
+  std::cout << "Total number of samples: " << decoded->samples.size() << std::endl;
+  std::cout << "Sample rate: " << decoded->sample_rate << std::endl;
+
+  if (decoded->sample_rate != expected_sample_rate) {
+    std::cout << "Sample rate mismatch" << std::endl;
+    return false;
+  }
+  if (decoded->num_channels != 1) {
+    std::cout << "Channel count needs to be 1" << std::endl;
+    return false;
+  }
+
+  data->swap(decoded->samples);
+  if (align_samples > 0 && data->size() % align_samples) {
+    // pad to a whole number of frames
+    data->resize((data->size() / align_samples + 1) * align_samples, 0.f);
+  }
+  if (metadata)
+    *metadata = std::move(decoded->metadata);
+  return true;
+}
+
+bool ReadAudioFile(const std::string& filename, uint32_t expected_sample_rate, std::vector<float>* data,
+                   int align_samples, std::vector<MetadataChunk>* metadata, uint64_t* content_hash) {
+  DecodedAudio decoded = DecodeAudioFile(filename, align_samples > 0 ? static_cast<uint32_t>(align_samples) : 0, false,
+                                         content_hash != nullptr);
+  if (content_hash)
+    *content_hash = decoded.content_hash;
+  return PrepareInput(&decoded, expected_sample_rate, align_samples, data, metadata);
+}
+
+std::unique_ptr<AudioSource> OpenStreamInput(const std::string& filename, uint32_t block_samples) {
+  startup::ScopedPhase phase("open_input");
+  std::unique_ptr<AudioSource> file = OpenAudioSource(filename);
+  if (!file || file->GetLength() == 0) {
+    return nullptr;
+  }
+  if (block_samples == 0)
+    block_samples = 4096u;
+  return std::unique_ptr<AudioSource>(new ThreadedSource(std::move(file), block_samples));
+}
+
+bool CheckStreamInput(const AudioSource& source, uint32_t expected_sample_rate, unsigned align_samples,
+                      size_t* size) {
+  std::cout << "Total number of samples: " << source.GetLength() << std::endl;
+  std::cout << "Sample rate: " << source.GetSampleRate() << std::endl;
+
+  if (source.GetSampleRate() != expected_sample_rate) {
+    std::cout << "Sample rate mismatch" << std::endl;
+    return false;
+  }
+  if (source.GetNumChannels() != 1) {
+    std::cout << "Channel count needs to be 1" << std::endl;
+    return false;
+  }
+  *size = static_cast<size_t>((source.GetLength() + align_samples - 1) / align_samples * align_samples);
+  return true;
+}
+
+std::future<DecodedAudio> MakeReadyInput(DecodedAudio decoded) {
+  std::promise<DecodedAudio> promise;
+  promise.set_value(std::move(decoded));
+  return promise.get_future();
+}
+
+}  // namespace audio_io
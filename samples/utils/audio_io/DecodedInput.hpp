@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AudioStream.hpp"
+
+// Mono input files of the effects, decoded whole or streamed block by block while they are processed.
+// Decoding can start before the effect is loaded, the format is checked against it afterwards.
+namespace audio_io {
+
+// Input file decoded before the effect properties are known, see DecodeAudioFile()
+struct DecodedAudio {
+  bool valid = false;
+  uint32_t sample_rate = 0;
+  uint32_t num_channels = 0;
+  std::vector<float> samples;
+  std::vector<MetadataChunk> metadata;
+  // XXH64 of the decoded samples, if requested
+  uint64_t content_hash = 0;
+};
+
+// Decodes a wav, FLAC or Opus file on a separate thread in blocks of block_samples samples (4096 if 0).
+// Formats are checked later by PrepareInput(), so decoding can start before the effect is loaded.
+// With hash the blocks are hashed as they arrive. background tells the startup profile that the
+// caller does not wait for it.
+DecodedAudio DecodeAudioFile(const std::string& filename, uint32_t block_samples, bool background, bool hash);
+
+// Checks that a decoded input is mono at the expected rate and pads it to a whole number of frames.
+// metadata, if given, receives the metadata chunks of the file.
+bool PrepareInput(DecodedAudio* decoded, uint32_t expected_sample_rate, int align_samples, std::vector<float>* data,
+                  std::vector<MetadataChunk>* metadata);
+
+// Reads a mono wav, FLAC or Opus file. Decoding runs on a separate thread in frame sized blocks.
+bool ReadAudioFile(const std::string& filename, uint32_t expected_sample_rate, std::vector<float>* data,
+                   int align_samples, std::vector<MetadataChunk>* metadata = nullptr, uint64_t* content_hash = nullptr);
+
+// Future of an input that is already decoded, for code waiting on an input decoded during startup
+std::future<DecodedAudio> MakeReadyInput(DecodedAudio decoded);
+
+// Opens a wav, FLAC or Opus file to be decoded in blocks of block_samples samples (4096 if 0) while it
+// is processed. Decoding starts right away. Returns null if the file can not be opened or does not
+// record its length, such a file is decoded whole by DecodeAudioFile().
+std::unique_ptr<AudioSource> OpenStreamInput(const std::string& filename, uint32_t block_samples);
+
+// Checks that a streamed input is mono at the expected rate, *size receives its length padded to a
+// whole number of frames
+bool CheckStreamInput(const AudioSource& source, uint32_t expected_sample_rate, unsigned align_samples,
+                      size_t* size);
+
+}  // namespace audio_io
@@ -0,0 +1,159 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#ifdef NVAFX_HAVE_FLAC
+
+#include "FlacCodec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace audio_io {
+
+namespace {
+
+const uint32_t kFlacBitsPerSample = 24;
+const float kFlacScale = static_cast<float>(1 << (kFlacBitsPerSample - 1));
+
+}  // namespace
+
+FlacSource::FlacSource(const std::string& path) {
+  decoder_ = FLAC__stream_decoder_new();
+  if (decoder_ == nullptr)
+    return;
+  if (FLAC__stream_decoder_init_file(decoder_, path.c_str(), &FlacSource::writeCallback,
+                                     &FlacSource::metadataCallback, &FlacSource::errorCallback,
+                                     this) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+    return;
+  }
+  // STREAMINFO is mandatory and always the first metadata block
+  if (!FLAC__stream_decoder_process_until_end_of_metadata(decoder_))
+    return;
+  valid_ = sample_rate_ > 0 && num_channels_ > 0 && bits_per_sample_ > 0;
+}
+
+FlacSource::~FlacSource() {
+  if (decoder_ != nullptr) {
+    FLAC__stream_decoder_finish(decoder_);
+    FLAC__stream_decoder_delete(decoder_);
+  }
+}
+
+uint32_t FlacSource::Read(float* out, uint32_t num_samples) {
+  if (!valid_)
+    return 0;
+  uint32_t num_read = 0;
+  while (num_read < num_samples) {
+    if (pending_pos_ == pending_.size()) {
+      pending_.clear();
+      pending_pos_ = 0;
+      if (FLAC__stream_decoder_get_state(decoder_) == FLAC__STREAM_DECODER_END_OF_STREAM ||
+          !FLAC__stream_decoder_process_single(decoder_)) {
+        break;
+      }
+      // Metadata blocks decode without producing samples
+      continue;
+    }
+    uint32_t count = static_cast<uint32_t>(std::min<size_t>(num_samples - num_read, pending_.size() - pending_pos_));
+    std::memcpy(out + num_read, pending_.data() + pending_pos_, count * sizeof(float));
+    num_read += count;
+    pending_pos_ += count;
+  }
+  return num_read;
+}
+
+FLAC__StreamDecoderWriteStatus FlacSource::writeCallback(const FLAC__StreamDecoder*, const FLAC__Frame* frame,
+                                                         const FLAC__int32* const buffer[], void* client_data) {
+  FlacSource* source = static_cast<FlacSource*>(client_data);
+  uint32_t num_channels = frame->header.channels;
+  uint32_t block_size = frame->header.blocksize;
+  if (num_channels != source->num_channels_)
+    return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+  float scale = 1.0f / static_cast<float>(1u << (frame->header.bits_per_sample - 1));
+  size_t base = source->pending_.size();
+  source->pending_.resize(base + static_cast<size_t>(block_size) * num_channels);
+  float* dst = source->pending_.data() + base;
+  for (uint32_t i = 0; i < block_size; i++) {
+    for (uint32_t ch = 0; ch < num_channels; ch++)
+      *dst++ = static_cast<float>(buffer[ch][i]) * scale;
+  }
+  return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FlacSource::metadataCallback(const FLAC__StreamDecoder*, const FLAC__StreamMetadata* metadata,
+                                  void* client_data) {
+  if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO)
+    return;
+  FlacSource* source = static_cast<FlacSource*>(client_data);
+  source->sample_rate_ = metadata->data.stream_info.sample_rate;
+  source->num_channels_ = metadata->data.stream_info.channels;
+  source->bits_per_sample_ = metadata->data.stream_info.bits_per_sample;
+  source->length_ = metadata->data.stream_info.total_samples;
+}
+
+void FlacSource::errorCallback(const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus status, void*) {
+  std::cerr << "FLAC decoder error: " << FLAC__StreamDecoderErrorStatusString[status] << std::endl;
+}
+
+FlacSink::FlacSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels, int compression_level)
+  : num_channels_(num_channels) {
+  encoder_ = FLAC__stream_encoder_new();
+  if (encoder_ == nullptr)
+    return;
+  bool configured = FLAC__stream_encoder_set_channels(encoder_, num_channels) &&
+                    FLAC__stream_encoder_set_bits_per_sample(encoder_, kFlacBitsPerSample) &&
+                    FLAC__stream_encoder_set_sample_rate(encoder_, sample_rate);
+  if (configured && compression_level >= 0)
+    configured = FLAC__stream_encoder_set_compression_level(encoder_, std::min(compression_level, 8));
+  if (!configured)
+    return;
+  FLAC__StreamEncoderInitStatus status = FLAC__stream_encoder_init_file(encoder_, path.c_str(), nullptr, nullptr);
+  if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+    std::cerr << "FLAC encoder error: " << FLAC__StreamEncoderInitStatusString[status] << std::endl;
+    return;
+  }
+  valid_ = true;
+}
+
+FlacSink::~FlacSink() {
+  if (encoder_ != nullptr) {
+    if (valid_ && !committed_)
+      FLAC__stream_encoder_finish(encoder_);
+    FLAC__stream_encoder_delete(encoder_);
+  }
+}
+
+bool FlacSink::Write(const float* data, uint32_t num_samples) {
+  if (!valid_ || committed_ || num_samples % num_channels_ != 0)
+    return false;
+  samples_.resize(num_samples);
+  const float max_value = kFlacScale - 1.0f;
+  for (uint32_t i = 0; i < num_samples; i++) {
+    float value = std::max(-kFlacScale, std::min(max_value, data[i] * kFlacScale));
+    samples_[i] = static_cast<FLAC__int32>(std::lrint(value));
+  }
+  valid_ = FLAC__stream_encoder_process_interleaved(encoder_, samples_.data(), num_samples / num_channels_) != 0;
+  return valid_;
+}
+
+bool FlacSink::Commit() {
+  if (!valid_ || committed_)
+    return false;
+  committed_ = true;
+  return FLAC__stream_encoder_finish(encoder_) != 0;
+}
+
+}  // namespace audio_io
+
+#endif  // NVAFX_HAVE_FLAC
@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#ifdef NVAFX_HAVE_FLAC
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <FLAC/stream_decoder.h>
+#include <FLAC/stream_encoder.h>
+
+#include "AudioStream.hpp"
+
+namespace audio_io {
+
+// Streaming FLAC decoder, decodes one FLAC frame at a time as samples are read
+class FlacSource : public AudioSource {
+ public:
+  explicit FlacSource(const std::string& path);
+  ~FlacSource() override;
+  bool IsValid() const override { return valid_; }
+  uint32_t GetSampleRate() const override { return sample_rate_; }
+  uint32_t GetNumChannels() const override { return num_channels_; }
+  uint64_t GetLength() const override { return length_; }
+  uint32_t Read(float* out, uint32_t num_samples) override;
+
+ private:
+  static FLAC__StreamDecoderWriteStatus writeCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame,
+                                                      const FLAC__int32* const buffer[], void* client_data);
+  static void metadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata,
+                               void* client_data);
+  static void errorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status,
+                            void* client_data);
+
+ private:
+  FLAC__StreamDecoder* decoder_ = nullptr;
+  bool valid_ = false;
+  uint32_t sample_rate_ = 0;
+  uint32_t num_channels_ = 0;
+  uint32_t bits_per_sample_ = 0;
+  uint64_t length_ = 0;
+  // Decoded interleaved samples not read yet, starting at pending_pos_
+  std::vector<float> pending_;
+  size_t pending_pos_ = 0;
+};
+
+// Streaming FLAC encoder, stores 24 bit samples
+class FlacSink : public AudioSink {
+ public:
+  FlacSink(const std::string& path, uint32_t sample_rate, uint32_t num_channels, int compression_level);
+  ~FlacSink() override;
+  bool IsValid() const override { return valid_; }
+  bool Write(const float* data, uint32_t num_samples) override;
+  bool Commit() override;
+
+ private:
+  FLAC__StreamEncoder* encoder_ = nullptr;
+  bool valid_ = false;
+  bool committed_ = false;
+  uint32_t num_channels_ = 0;
+  // Conversion buffer, reused across writes
+  std::vector<FLAC__int32> samples_;
+};
+
+}  // namespace audio_io
+
+#endif  // NVAFX_HAVE_FLAC
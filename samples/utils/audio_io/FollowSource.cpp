@@ -0,0 +1,317 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "FollowSource.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace audio_io {
+
+namespace {
+
+// Polling interval without inotify, and the longest wait for a notification. Files on network
+// file systems change without notifications, so waits never rely on them alone.
+const double kPollIntervalSecs = 0.002;
+const double kMaxWaitSecs = 0.1;
+// Without notifications a recording with a complete header ends once it stopped growing this long
+const double kCompleteIdleSecs = 0.5;
+// Lag histogram: 0.1 ms bins up to 2 s
+const double kLagBinMs = 0.1;
+const size_t kNumLagBins = 20000;
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+FollowWaveSource::FollowWaveSource(const std::string& path, const FollowOptions& options)
+  : path_(path), options_(options), lag_bins_(kNumLagBins + 1, 0) {
+  memset(&format_, 0, sizeof(format_));
+  double start = Now();
+  last_growth_ = start;
+  // The recorder may not have created the file or written the header yet
+  WaveStatus status = WAVE_STATUS_READ_FAILED;
+  while (true) {
+    if (!fp_) {
+      fp_ = fopen(path_.c_str(), "rb");
+      if (fp_) {
+        // Unbuffered, every read sees what the writer appended
+        setvbuf(fp_, nullptr, _IONBF, 0);
+#ifdef __linux__
+        notify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify_fd_ >= 0)
+          watch_ = inotify_add_watch(notify_fd_, path_.c_str(),
+                                     IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (watch_ < 0 && notify_fd_ >= 0) {
+          close(notify_fd_);
+          notify_fd_ = -1;
+        }
+#endif
+      }
+    }
+    if (fp_) {
+      status = readHeader();
+      if (status == WAVE_STATUS_OK)
+        break;
+      // Anything but a header still being written will not get better
+      if (status != WAVE_STATUS_MISSING_DATA) {
+        std::cerr << "Invalid wav file (" << GetWaveStatusString(status) << "): " << path_ << std::endl;
+        return;
+      }
+    }
+    double waited = Now() - start;
+    if (waited >= options_.idle_secs) {
+      std::cerr << "No wav header in " << path_ << " after " << options_.idle_secs << " secs" << std::endl;
+      return;
+    }
+    if (fp_)
+      waitForChange(options_.idle_secs - waited);
+    else
+      std::this_thread::sleep_for(std::chrono::duration<double>(kPollIntervalSecs));
+  }
+
+  bytes_per_sample_ = format_.nBlockAlign / format_.nChannels;
+  refresh();
+  initial_bytes_ = data_end_;
+  last_growth_ = Now();
+  valid_ = true;
+}
+
+FollowWaveSource::~FollowWaveSource() {
+#ifdef __linux__
+  if (notify_fd_ >= 0)
+    close(notify_fd_);
+#endif
+  if (fp_)
+    fclose(fp_);
+}
+
+bool FollowWaveSource::readAt(uint64_t offset, void* data, size_t size) {
+  clearerr(fp_);
+#ifdef _WIN32
+  if (_fseeki64(fp_, static_cast<__int64>(offset), SEEK_SET) != 0)
+#else
+  if (fseeko(fp_, static_cast<off_t>(offset), SEEK_SET) != 0)
+#endif
+    return false;
+  return size == 0 || fread(data, size, 1, fp_) == 1;
+}
+
+WaveStatus FollowWaveSource::readHeader() {
+  clearerr(fp_);
+#ifdef _WIN32
+  if (_fseeki64(fp_, 0, SEEK_END) != 0)
+    return WAVE_STATUS_READ_FAILED;
+  uint64_t size = static_cast<uint64_t>(_ftelli64(fp_));
+#else
+  if (fseeko(fp_, 0, SEEK_END) != 0)
+    return WAVE_STATUS_READ_FAILED;
+  uint64_t size = static_cast<uint64_t>(ftello(fp_));
+#endif
+  RiffHeader riff;
+  if (size < sizeof(riff))
+    return WAVE_STATUS_MISSING_DATA;
+  if (!readAt(0, &riff, sizeof(riff)))
+    return WAVE_STATUS_READ_FAILED;
+  if (riff.chunkId != MAKEFOURCC('R', 'I', 'F', 'F') || riff.fileTag != MAKEFOURCC('W', 'A', 'V', 'E'))
+    return WAVE_STATUS_NOT_WAVE;
+
+  // The RIFF size is not trusted, chunks are walked up to the end of the file
+  bool have_format = false;
+  uint64_t offset = sizeof(riff);
+  while (offset + sizeof(RiffChunk) <= size) {
+    RiffChunk chunk;
+    if (!readAt(offset, &chunk, sizeof(chunk)))
+      return WAVE_STATUS_READ_FAILED;
+    uint64_t payload = offset + sizeof(chunk);
+    if (chunk.chunkId == MAKEFOURCC('d', 'a', 't', 'a')) {
+      if (!have_format)
+        return WAVE_STATUS_MISSING_FORMAT;
+      data_offset_ = payload;
+      return WAVE_STATUS_OK;
+    }
+    // A chunk before the data that is still being written
+    if (payload + chunk.chunkSize > size)
+      return WAVE_STATUS_MISSING_DATA;
+    if (chunk.chunkId == MAKEFOURCC('f', 'm', 't', ' ')) {
+      if (chunk.chunkSize < sizeof(waveFormat_basic))
+        return WAVE_STATUS_MISSING_FORMAT;
+      waveFormat_ext wf;
+      memset(&wf, 0, sizeof(wf));
+      if (!readAt(payload, &wf, std::min<size_t>(chunk.chunkSize, sizeof(wf))))
+        return WAVE_STATUS_READ_FAILED;
+      if (wf.wFormatTag == WAVE_FORMAT_PCM)
+        wf.cbSize = 0;
+      WaveStatus status = ValidateWaveFormat(wf);
+      if (status != WAVE_STATUS_OK)
+        return status;
+      format_ = wf;
+      have_format = true;
+    }
+    offset = payload + chunk.chunkSize + (chunk.chunkSize & 1);
+  }
+  return WAVE_STATUS_MISSING_DATA;
+}
+
+bool FollowWaveSource::refresh() {
+  clearerr(fp_);
+#ifdef _WIN32
+  if (_fseeki64(fp_, 0, SEEK_END) != 0)
+    return false;
+  file_size_ = static_cast<uint64_t>(_ftelli64(fp_));
+#else
+  if (fseeko(fp_, 0, SEEK_END) != 0)
+    return false;
+  file_size_ = static_cast<uint64_t>(ftello(fp_));
+#endif
+  uint64_t end = file_size_ > data_offset_ ? file_size_ - data_offset_ : 0;
+  // Once the header describes the whole file the recording is finished, and chunks may follow the data
+  uint32_t riff_size = 0;
+  uint32_t data_size = 0;
+  complete_ = readAt(4, &riff_size, sizeof(riff_size)) &&
+              readAt(data_offset_ - sizeof(data_size), &data_size, sizeof(data_size)) && riff_size != 0 &&
+              riff_size != UINT32_MAX && riff_size + static_cast<uint64_t>(sizeof(RiffChunk)) == file_size_ &&
+              data_size != 0 && data_size <= end;
+  if (complete_)
+    end = data_size;
+  end -= end % format_.nBlockAlign;
+  if (end <= data_end_)
+    return false;
+
+  data_end_ = end;
+  last_growth_ = Now();
+  return true;
+}
+
+void FollowWaveSource::waitForChange(double timeout_secs) {
+  timeout_secs = std::max(0.0, std::min(timeout_secs, kMaxWaitSecs));
+#ifdef __linux__
+  if (notify_fd_ >= 0) {
+    pollfd fd = { notify_fd_, POLLIN, 0 };
+    if (poll(&fd, 1, static_cast<int>(timeout_secs * 1000.0 + 0.5)) <= 0)
+      return;
+    num_wakeups_++;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t size;
+    while ((size = read(notify_fd_, buffer, sizeof(buffer))) > 0) {
+      for (char* pos = buffer; pos < buffer + size;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(pos);
+        // Events arrive in order, a write after a close means the file was opened again
+        if (event->mask & IN_MODIFY)
+          closed_ = false;
+        if (event->mask & IN_CLOSE_WRITE)
+          closed_ = true;
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+          gone_ = true;
+        pos += sizeof(inotify_event) + event->len;
+      }
+    }
+    return;
+  }
+#endif
+  std::this_thread::sleep_for(std::chrono::duration<double>(std::min(timeout_secs, kPollIntervalSecs)));
+}
+
+uint32_t FollowWaveSource::Read(float* out, uint32_t num_samples) {
+  if (!valid_)
+    return 0;
+
+  uint64_t wanted = static_cast<uint64_t>(num_samples / format_.nChannels) * format_.nBlockAlign;
+  while (data_end_ - position_ < wanted && !ended_) {
+    if (refresh()) {
+      appends_.push_back({ data_end_, last_growth_ });
+      num_appends_++;
+      continue;
+    }
+    double idle = Now() - last_growth_;
+    bool finished = complete_ && (closed_ || (notify_fd_ < 0 && idle >= kCompleteIdleSecs));
+    if (finished || gone_ || idle >= options_.idle_secs) {
+      ended_ = true;
+      break;
+    }
+    waitForChange(options_.idle_secs - idle);
+  }
+
+  uint64_t count = std::min(wanted, data_end_ - position_);
+  if (count == 0)
+    return 0;
+  raw_.resize(static_cast<size_t>(count));
+  if (!readAt(data_offset_ + position_, raw_.data(), raw_.size())) {
+    std::cerr << "Unable to read " << path_ << std::endl;
+    ended_ = true;
+    return 0;
+  }
+  uint32_t samples = static_cast<uint32_t>(count / bytes_per_sample_);
+  ConvertPCMToFloat(raw_.data(), out, samples, format_);
+  position_ += count;
+
+  // The append that delivered the last sample read, audio present at the start has none
+  while (!appends_.empty() && appends_.front().end < position_)
+    appends_.pop_front();
+  last_arrival_ = position_ <= initial_bytes_ || appends_.empty() ? 0.0 : appends_.front().time;
+  return samples;
+}
+
+void FollowWaveSource::RecordOutput() {
+  if (last_arrival_ <= 0.0)
+    return;
+  double lag_ms = (Now() - last_arrival_) * 1000.0;
+  lag_bins_[std::min(static_cast<size_t>(lag_ms / kLagBinMs), kNumLagBins)]++;
+  num_lags_++;
+  lag_sum_ms_ += lag_ms;
+  lag_max_ms_ = std::max(lag_max_ms_, lag_ms);
+}
+
+void FollowWaveSource::PrintReport(std::ostream& out, uint32_t frame_samples) const {
+  auto percentile = [this](double fraction) {
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(num_lags_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < lag_bins_.size(); i++) {
+      seen += lag_bins_[i];
+      if (seen > rank)
+        return std::min((i + 0.5) * kLagBinMs, lag_max_ms_);
+    }
+    return lag_max_ms_;
+  };
+  double bytes_per_sec = static_cast<double>(format_.nAvgBytesPerSec);
+  double frame_ms = 1000.0 * frame_samples / std::max(1u, format_.nSamplesPerSec);
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(2) << "Followed " << path_ << ": " << initial_bytes_ / bytes_per_sec
+      << " secs present at the start, " << (data_end_ - initial_bytes_) / bytes_per_sec << " secs appended in "
+      << num_appends_ << " appends, " << num_wakeups_ << " wake-ups"
+      << (notify_fd_ >= 0 ? "" : " (polling)") << std::endl;
+  if (num_lags_ > 0) {
+    double average = lag_sum_ms_ / num_lags_;
+    out << "  lag input to output: " << average << " ms average, " << percentile(0.5) << " ms p50, "
+        << percentile(0.99) << " ms p99, " << lag_max_ms_ << " ms max";
+    if (frame_ms > 0.0)
+      out << " (" << average / frame_ms << " / " << lag_max_ms_ / frame_ms << " frames of " << frame_ms << " ms)";
+    out << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace audio_io
@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+#include "AudioStream.hpp"
+
+namespace audio_io {
+
+struct FollowOptions {
+  // Time without the file growing after which the recording is considered ended. Also the time
+  // to wait for the file and its header to appear.
+  double idle_secs = 10.0;
+};
+
+// Reads a wav file while another process is still writing it, e.g. a recorder. The RIFF and data
+// sizes of such files are 0, 0xFFFFFFFF or only updated now and then, so they are ignored: the
+// data chunk runs to the end of the file until the header describes the complete file. Read()
+// blocks until the requested samples were appended, woken by inotify on Linux and by polling
+// elsewhere. The recording ends when the writer closes a file with a complete header, the file
+// is removed or renamed, or it stops growing for idle_secs.
+class FollowWaveSource : public AudioSource {
+ public:
+  FollowWaveSource(const std::string& path, const FollowOptions& options);
+  ~FollowWaveSource() override;
+  bool IsValid() const override { return valid_; }
+  uint32_t GetSampleRate() const override { return format_.nSamplesPerSec; }
+  uint32_t GetNumChannels() const override { return format_.nChannels; }
+  // Unknown until the recording ends
+  uint64_t GetLength() const override { return 0; }
+  // Waits for num_samples samples, returns fewer only at the end of the recording
+  uint32_t Read(float* out, uint32_t num_samples) override;
+
+  // Records that the samples returned by the last Read() reached the output, for the lag report
+  void RecordOutput();
+  // Appends, wake-ups and the lag from a sample landing in the input to it reaching the output.
+  // frame_samples expresses the lag in effect frames as well.
+  void PrintReport(std::ostream& out, uint32_t frame_samples) const;
+
+ private:
+  // Parses the RIFF header as far as it was written. Returns WAVE_STATUS_MISSING_DATA until fmt and
+  // the start of data were written.
+  WaveStatus readHeader();
+  // Updates the file size and the end of the audio data, returns true if the data grew
+  bool refresh();
+  // Waits up to timeout_secs for the file to change
+  void waitForChange(double timeout_secs);
+  bool readAt(uint64_t offset, void* data, size_t size);
+
+  const std::string path_;
+  const FollowOptions options_;
+  bool valid_ = false;
+  FILE* fp_ = nullptr;
+  // inotify descriptor and watch, -1 when polling
+  int notify_fd_ = -1;
+  int watch_ = -1;
+  // The writer closed the file, or it was removed or renamed
+  bool closed_ = false;
+  bool gone_ = false;
+  // The header describes the whole file
+  bool complete_ = false;
+  bool ended_ = false;
+
+  waveFormat_ext format_;
+  uint32_t bytes_per_sample_ = 0;
+  uint64_t data_offset_ = 0;
+  uint64_t file_size_ = 0;
+  // End of the audio data known so far, in whole sample frames
+  uint64_t data_end_ = 0;
+  // Read position, relative to data_offset_
+  uint64_t position_ = 0;
+  double last_growth_ = 0.0;
+  std::vector<uint8_t> raw_;
+
+  // Audio found by each growth of the file: end relative to data_offset_ and the time it was seen
+  struct Append {
+    uint64_t end;
+    double time;
+  };
+  std::deque<Append> appends_;
+  // Time the last sample returned by Read() was seen, 0 for audio present at the start
+  double last_arrival_ = 0.0;
+
+  uint64_t num_appends_ = 0;
+  uint64_t num_wakeups_ = 0;
+  uint64_t initial_bytes_ = 0;
+  // Lag histogram in 0.1 ms bins, with the values beyond it counted in the last bin
+  std::vector<uint32_t> lag_bins_;
+  uint64_t num_lags_ = 0;
+  double lag_sum_ms_ = 0.0;
+  double lag_max_ms_ = 0.0;
+};
+
+}  // namespace audio_io
@@ -0,0 +1,229 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "LiveStream.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include <utils/ipc/ShmRing.hpp>
+#include <utils/pipeline/EffectPipeline.hpp>
+#include <utils/pipeline/FrameStages.hpp>
+#include <utils/pipeline/RunStage.hpp>
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/rtp/RtpStream.hpp>
+
+namespace audio_io {
+
+const char* GetLiveInputKind(const LiveOptions& options) {
+  return options.follow ? "followed input" : ipc::IsShmUrl(options.input) ? "shared memory input" : "network input";
+}
+
+bool ProcessLiveInput(NvAFX_Handle handle, const startup::EffectProperties& properties, const LiveOptions& options,
+                      const std::function<void()>& on_start, LiveResult* result) {
+  const unsigned num_input_channels = properties.num_input_channels;
+  const unsigned num_output_channels = properties.num_output_channels;
+  const unsigned input_frame_samples = properties.num_input_samples_per_frame;
+  const unsigned output_frame_samples = properties.num_output_samples_per_frame;
+  const std::string& input_url = options.input;
+  const std::string& output = options.output;
+  const bool shm_input = ipc::IsShmUrl(input_url);
+  const char* input_kind = GetLiveInputKind(options);
+  // A ring carries the planar channels of a frame, far end included
+  if (num_input_channels != 1 && !shm_input) {
+    std::cerr << "A " << input_kind << " needs an effect with one input channel" << std::endl;
+    return false;
+  }
+
+  std::unique_ptr<rtp::RtpSource> rtp_source;
+  std::unique_ptr<FollowWaveSource> follow_source;
+  std::unique_ptr<ipc::ShmRing> input_ring;
+  AudioSource* source = nullptr;
+  double input_wait_ms = 0.0;
+  if (shm_input) {
+    // Created with the effect's frame layout, the capture process attaches to it
+    ipc::RingLayout layout;
+    layout.sample_rate = properties.input_sample_rate;
+    layout.num_channels = num_input_channels;
+    layout.frame_samples = input_frame_samples;
+    input_ring = ipc::CreateShmRing(input_url, layout, ipc::RingRole::kConsumer, &input_wait_ms);
+    if (!input_ring)
+      return false;
+  } else if (options.follow) {
+    follow_source.reset(new FollowWaveSource(input_url, options.follow_options));
+    if (!follow_source->IsValid())
+      return false;
+    source = follow_source.get();
+  } else {
+    rtp_source = rtp::OpenRtpSource(input_url);
+    if (!rtp_source)
+      return false;
+    source = rtp_source.get();
+  }
+  if (source && (source->GetSampleRate() != properties.input_sample_rate || source->GetNumChannels() != 1)) {
+    std::cerr << "The " << input_kind << " must be mono at " << properties.input_sample_rate << " Hz" << std::endl;
+    return false;
+  }
+  std::unique_ptr<rtp::RtpSink> rtp_sink;
+  std::unique_ptr<AudioSink> file_sink;
+  std::unique_ptr<ipc::ShmRing> output_ring;
+  AudioSink* sink = nullptr;
+  double output_wait_ms = 0.0;
+  if (ipc::IsShmUrl(output)) {
+    // The effect writes into the ring's slots, there is no sink
+    ipc::RingLayout layout;
+    layout.sample_rate = properties.output_sample_rate;
+    layout.num_channels = num_output_channels;
+    layout.frame_samples = output_frame_samples;
+    output_ring = ipc::CreateShmRing(output, layout, ipc::RingRole::kProducer, &output_wait_ms);
+    if (!output_ring)
+      return false;
+  } else if (rtp::IsRtpUrl(output)) {
+    rtp_sink = rtp::CreateRtpSink(output, properties.output_sample_rate, num_output_channels);
+    sink = rtp_sink.get();
+  } else {
+    file_sink = CreateAudioSink(output, properties.output_sample_rate, num_output_channels);
+    sink = file_sink.get();
+  }
+  if (!sink && !output_ring)
+    return false;
+
+  pipeline::ProcessingState state;
+  state.frame_in_secs = static_cast<float>(input_frame_samples) / static_cast<float>(properties.input_sample_rate);
+  placement::LocalBuffer input_frame(input_frame_samples * num_input_channels);
+  placement::LocalBuffer frame(output_frame_samples * num_output_channels);
+  if (!input_frame.get() || !frame.get()) {
+    std::cerr << "Unable to allocate the frame buffer" << std::endl;
+    return false;
+  }
+  const float* inputs[2] = { input_frame.get(), input_frame.get() + input_frame_samples };
+  float* outputs[1] = { frame.get() };
+
+  pipeline::FrameStartStage start_stage(state, input_frame_samples, input_frame_samples);
+  pipeline::StatsStage stats_stage(state, input_frame_samples);
+  std::unique_ptr<pipeline::WriteStage> write_stage;
+  if (sink)
+    write_stage.reset(new pipeline::WriteStage(*sink, output_frame_samples, num_output_channels));
+  // A network or ring output keeps the timing of the input, receivers delay the picture by the reported delay
+  const bool compensate = options.output_delay != 0 && file_sink;
+  if (compensate)
+    write_stage->SetAlignment(options.output_delay, 0);
+  else if (options.output_delay != 0)
+    std::cout << "Note: " << output << " is not delay compensated" << std::endl;
+
+  on_start();
+  if (rtp_source)
+    std::cout << "Receiving RTP on port " << rtp_source->GetLocalPort() << ", output " << output << std::endl;
+  else if (input_ring)
+    std::cout << "Waiting for frames on " << input_url << ", output " << output << std::endl;
+  else
+    std::cout << "Following " << input_url << ", output " << output << std::endl;
+  // Runs the effect on inputs into outputs. A ring output slot is written by the effect itself,
+  // other outputs are written as soon as the frame is processed, so a file's header always covers them.
+  auto run_frame = [&](auto& run_stage) {
+    if (!write_stage) {
+      return pipeline::Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs, outputs, 0,
+                                input_frame_samples, start_stage, run_stage, stats_stage);
+    }
+    return pipeline::Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs, outputs, 0,
+                              input_frame_samples, start_stage, run_stage, stats_stage, *write_stage) &&
+           write_stage->Flush() && sink->Flush();
+  };
+  // The jitter buffer hands out frames of the effect's size whatever the packet size, each when it
+  // is due, a followed file each once it was appended, a ring each once the capture process
+  // published it. Ring slots are passed to the effect in place.
+  size_t num_samples = 0;
+  size_t num_frames = 0;
+  auto process_stream = [&](auto& run_stage) {
+    while (true) {
+      uint32_t num_read;
+      if (input_ring) {
+        const float* slot = input_ring->BeginRead(num_frames == 0 ? input_wait_ms : -1.0, &num_read);
+        if (!slot)
+          break;
+        for (unsigned ch = 0; ch < num_input_channels; ch++)
+          inputs[ch] = input_ring->GetChannel(slot, ch);
+      } else {
+        num_read = source->Read(input_frame.get(), input_frame_samples);
+        if (num_read == 0)
+          break;
+        std::fill(input_frame.get() + num_read, input_frame.get() + input_frame_samples, 0.f);
+      }
+      if (output_ring && !(outputs[0] = output_ring->BeginWrite(output_wait_ms))) {
+        std::cerr << "The reader of " << output << " is gone or stopped reading" << std::endl;
+        return false;
+      }
+      if (!run_frame(run_stage))
+        return false;
+      if (output_ring)
+        output_ring->EndWrite(output_frame_samples);
+      if (input_ring)
+        input_ring->EndRead();
+      if (follow_source)
+        follow_source->RecordOutput();
+      num_samples += num_read;
+      num_frames++;
+    }
+    if (input_ring && num_frames == 0)
+      std::cout << "Note: no frame arrived on " << input_url << std::endl;
+    if (compensate) {
+      // The input ended, silence flushes the delayed end of the output
+      write_stage->SetLength(num_frames * output_frame_samples);
+      std::fill(input_frame.get(), input_frame.get() + input_frame_samples * num_input_channels, 0.f);
+      inputs[0] = input_frame.get();
+      inputs[1] = input_frame.get() + input_frame_samples;
+      size_t flush_frames =
+        (static_cast<size_t>(std::max<int64_t>(0, options.output_delay)) + output_frame_samples - 1) /
+        output_frame_samples;
+      for (size_t i = 0; i < flush_frames; i++) {
+        if (!pipeline::Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs, outputs, 0,
+                                input_frame_samples, run_stage, *write_stage)) {
+          return false;
+        }
+      }
+      if (!write_stage->Flush())
+        return false;
+    }
+    return true;
+  };
+  if (!pipeline::WithRunStage(handle, input_frame_samples, output_frame_samples, process_stream))
+    return false;
+
+  if (state.total_audio_duration > 0.f) {
+    const char* audio_kind = follow_source ? "followed" : input_ring ? "shared memory" : "network";
+    std::cout << "Processing time " << std::setprecision(2) << state.total_run_time << " secs for "
+              << state.total_audio_duration << " secs of " << audio_kind << " audio ("
+              << state.total_run_time / state.total_audio_duration << " secs processing time per sec of audio)"
+              << std::endl;
+  }
+  if (rtp_source)
+    rtp_source->PrintReport(std::cout);
+  if (follow_source)
+    follow_source->PrintReport(std::cout, input_frame_samples);
+  if (rtp_sink)
+    rtp_sink->PrintReport(std::cout);
+  if (input_ring)
+    input_ring->PrintReport(std::cout, "Input");
+  if (output_ring) {
+    output_ring->PrintReport(std::cout, "Output");
+    // The reader sees the end once it read the remaining frames
+    output_ring->Close();
+    std::cout << "Total " << num_samples << " samples processed" << std::endl;
+  }
+  if (rtp_sink)
+    result->sink = std::move(rtp_sink);
+  else
+    result->sink = std::move(file_sink);
+  result->num_samples = num_samples;
+  return true;
+}
+
+}  // namespace audio_io
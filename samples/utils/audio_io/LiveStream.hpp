@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <nvAudioEffects.h>
+
+#include <utils/startup/StartupProfile.hpp>
+
+#include "AudioStream.hpp"
+#include "FollowSource.hpp"
+
+// Processing of live inputs frame by frame as they arrive: an RTP stream (utils/rtp), a shared memory
+// ring filled by a capture process (utils/ipc) or a recording that is still being written
+// (FollowSource.hpp). The output is a file, an RTP stream or a ring.
+namespace audio_io {
+
+struct LiveOptions {
+  // rtp:// or shm:// URL, or with follow the path of a wav file that is still being written
+  std::string input;
+  bool follow = false;
+  FollowOptions follow_options;
+  // File, rtp:// or shm:// output
+  std::string output;
+  // Output samples dropped, or silence written for a negative delay, to align a file output with the
+  // input. Network and ring outputs keep the timing of the input.
+  int64_t output_delay = 0;
+};
+
+// Outcome of ProcessLiveInput()
+struct LiveResult {
+  // File or RTP output still to be committed, null for a ring output, which is closed already
+  std::unique_ptr<AudioSink> sink;
+  size_t num_samples = 0;
+};
+
+// "network input", "shared memory input" or "followed input", for messages
+const char* GetLiveInputKind(const LiveOptions& options);
+
+// Opens the input and output and runs the loaded effect on every frame until the input ends.
+// on_start is called once both are open, before the first frame is waited for. Prints the transport
+// reports at the end.
+bool ProcessLiveInput(NvAFX_Handle handle, const startup::EffectProperties& properties, const LiveOptions& options,
+                      const std::function<void()>& on_start, LiveResult* result);
+
+}  // namespace audio_io
@@ -0,0 +1,61 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#ifdef NVAFX_HAVE_OPUS
+
+#include "OpusSource.hpp"
+
+#include <iostream>
+
+namespace audio_io {
+
+OpusSource::OpusSource(const std::string& path) {
+  int error = 0;
+  file_ = op_open_file(path.c_str(), &error);
+  if (file_ == nullptr) {
+    std::cerr << "Unable to open Opus file " << path << ", error " << error << std::endl;
+    return;
+  }
+  // Chained streams may change the channel count, the first link decides for the whole file
+  num_channels_ = static_cast<uint32_t>(op_channel_count(file_, 0));
+  ogg_int64_t length = op_pcm_total(file_, -1);
+  length_ = length > 0 ? static_cast<uint64_t>(length) : 0;
+}
+
+OpusSource::~OpusSource() {
+  if (file_ != nullptr)
+    op_free(file_);
+}
+
+uint32_t OpusSource::Read(float* out, uint32_t num_samples) {
+  if (file_ == nullptr)
+    return 0;
+  uint32_t num_read = 0;
+  while (num_read < num_samples) {
+    int link = 0;
+    int count = op_read_float(file_, out + num_read, static_cast<int>(num_samples - num_read), &link);
+    // OP_HOLE only reports a gap in the stream, decoding continues after it
+    if (count == OP_HOLE)
+      continue;
+    if (count <= 0)
+      break;
+    if (static_cast<uint32_t>(op_channel_count(file_, link)) != num_channels_) {
+      std::cerr << "Opus stream changes channel count, stopping" << std::endl;
+      break;
+    }
+    num_read += static_cast<uint32_t>(count) * num_channels_;
+  }
+  return num_read;
+}
+
+}  // namespace audio_io
+
+#endif  // NVAFX_HAVE_OPUS
@@ -0,0 +1,45 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#ifdef NVAFX_HAVE_OPUS
+
+#include <stdint.h>
+
+#include <string>
+
+#include <opusfile.h>
+
+#include "AudioStream.hpp"
+
+namespace audio_io {
+
+// Ogg/Opus decoder. Opus always decodes at 48 kHz whatever the original input rate was.
+class OpusSource : public AudioSource {
+ public:
+  explicit OpusSource(const std::string& path);
+  ~OpusSource() override;
+  bool IsValid() const override { return file_ != nullptr; }
+  uint32_t GetSampleRate() const override { return 48000; }
+  uint32_t GetNumChannels() const override { return num_channels_; }
+  uint64_t GetLength() const override { return length_; }
+  uint32_t Read(float* out, uint32_t num_samples) override;
+
+ private:
+  OggOpusFile* file_ = nullptr;
+  uint32_t num_channels_ = 0;
+  uint64_t length_ = 0;
+};
+
+}  // namespace audio_io
+
+#endif  // NVAFX_HAVE_OPUS
@@ -0,0 +1,141 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "ContentHash.hpp"
+
+#include <string.h>
+
+namespace cache {
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Little endian loads, the digest does not depend on the host byte order
+inline uint64_t Load64(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--)
+    value = value << 8 | data[i];
+  return value;
+}
+
+inline uint32_t Load32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+         static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+}
+
+inline uint64_t Round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * kPrime2;
+  return RotateLeft(accumulator, 31) * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t accumulator, uint64_t value) {
+  accumulator ^= Round(0, value);
+  return accumulator * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+StreamHash::StreamHash(uint64_t seed) : seed_(seed) {
+  accumulators_[0] = seed + kPrime1 + kPrime2;
+  accumulators_[1] = seed + kPrime2;
+  accumulators_[2] = seed;
+  accumulators_[3] = seed - kPrime1;
+}
+
+void StreamHash::consumeStripe(const uint8_t* stripe) {
+  for (int i = 0; i < 4; i++)
+    accumulators_[i] = Round(accumulators_[i], Load64(stripe + 8 * i));
+}
+
+void StreamHash::Update(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  length_ += size;
+  if (buffered_ > 0) {
+    size_t count = sizeof(buffer_) - buffered_;
+    if (size < count) {
+      memcpy(buffer_ + buffered_, bytes, size);
+      buffered_ += size;
+      return;
+    }
+    memcpy(buffer_ + buffered_, bytes, count);
+    consumeStripe(buffer_);
+    bytes += count;
+    size -= count;
+    buffered_ = 0;
+  }
+  for (; size >= sizeof(buffer_); bytes += sizeof(buffer_), size -= sizeof(buffer_))
+    consumeStripe(bytes);
+  memcpy(buffer_, bytes, size);
+  buffered_ = size;
+}
+
+void StreamHash::UpdateString(const std::string& value) {
+  UpdateU64(value.size());
+  Update(value.data(), value.size());
+}
+
+void StreamHash::UpdateU64(uint64_t value) {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; i++)
+    bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+  Update(bytes, sizeof(bytes));
+}
+
+uint64_t StreamHash::Digest() const {
+  uint64_t hash;
+  if (length_ >= sizeof(buffer_)) {
+    hash = RotateLeft(accumulators_[0], 1) + RotateLeft(accumulators_[1], 7) + RotateLeft(accumulators_[2], 12) +
+           RotateLeft(accumulators_[3], 18);
+    for (int i = 0; i < 4; i++)
+      hash = MergeRound(hash, accumulators_[i]);
+  } else {
+    hash = seed_ + kPrime5;
+  }
+  hash += length_;
+
+  const uint8_t* tail = buffer_;
+  size_t remaining = buffered_;
+  for (; remaining >= 8; tail += 8, remaining -= 8)
+    hash = RotateLeft(hash ^ Round(0, Load64(tail)), 27) * kPrime1 + kPrime4;
+  if (remaining >= 4) {
+    hash = RotateLeft(hash ^ (Load32(tail) * kPrime1), 23) * kPrime2 + kPrime3;
+    tail += 4;
+    remaining -= 4;
+  }
+  for (; remaining > 0; tail++, remaining--)
+    hash = RotateLeft(hash ^ (*tail * kPrime5), 11) * kPrime1;
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+std::string ToHex(uint64_t value) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex(16, '0');
+  for (int i = 15; i >= 0; i--, value >>= 4)
+    hex[i] = kDigits[value & 0xf];
+  return hex;
+}
+
+}  // namespace cache
@@ -0,0 +1,49 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace cache {
+
+// Streaming XXH64. Data can be added in pieces of any size while it is read, the digest matches
+// the one-shot XXH64 of the concatenation.
+class StreamHash {
+ public:
+  explicit StreamHash(uint64_t seed = 0);
+
+  void Update(const void* data, size_t size);
+  // Adds a string with its length, so consecutive strings can not run into each other
+  void UpdateString(const std::string& value);
+  void UpdateU64(uint64_t value);
+  // Digest of everything added so far, more can be added afterwards
+  uint64_t Digest() const;
+  uint64_t GetLength() const { return length_; }
+
+ private:
+  void consumeStripe(const uint8_t* stripe);
+
+  const uint64_t seed_;
+  uint64_t accumulators_[4];
+  // Bytes of the current 32 byte stripe not consumed yet
+  uint8_t buffer_[32];
+  size_t buffered_ = 0;
+  uint64_t length_ = 0;
+};
+
+// 16 lower case hex digits
+std::string ToHex(uint64_t value);
+
+}  // namespace cache
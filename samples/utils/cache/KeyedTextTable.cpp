@@ -0,0 +1,95 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "KeyedTextTable.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cache {
+
+void KeyedTextTable::load() {
+  loaded_ = true;
+  std::ifstream file(path_);
+  std::string line;
+  if (!file || !std::getline(file, line) || line != header_)
+    return;
+
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    std::string field;
+    unsigned count = 0;
+    for (; count < key_fields_ && fields >> field; count++)
+      key += (count ? " " : "") + field;
+    std::string value;
+    if (count < key_fields_ || !std::getline(fields >> std::ws, value) || value.empty())
+      continue;
+    entries_[key] = value;
+  }
+}
+
+bool KeyedTextTable::Lookup(const std::string& key, std::string* value) {
+  if (!loaded_)
+    load();
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  *value = it->second;
+  return true;
+}
+
+const std::map<std::string, std::string>& KeyedTextTable::GetEntries() {
+  if (!loaded_)
+    load();
+  return entries_;
+}
+
+bool KeyedTextTable::Store(const std::string& key, const std::string& value) {
+  if (!loaded_)
+    load();
+  entries_[key] = value;
+
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = static_cast<int>(getpid());
+#endif
+  std::string temp_path = path_ + ".tmp-" + std::to_string(pid);
+  {
+    std::ofstream file(temp_path, std::ios::trunc);
+    file << header_ << std::endl;
+    for (const auto& entry : entries_)
+      file << entry.first << ' ' << entry.second << std::endl;
+    if (!file) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+#ifdef _WIN32
+  std::remove(path_.c_str());
+#endif
+  if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace cache
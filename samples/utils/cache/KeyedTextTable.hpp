@@ -0,0 +1,45 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <string>
+
+namespace cache {
+
+// Small text file with a header line and one entry per line. The first key_fields space separated
+// fields of a line are its key, the rest its value. A file with another header is read as empty,
+// so a changed format just starts over.
+class KeyedTextTable {
+ public:
+  KeyedTextTable(const std::string& path, const std::string& header, unsigned key_fields = 1)
+    : path_(path), header_(header), key_fields_(key_fields) {}
+
+  bool Lookup(const std::string& key, std::string* value);
+  // All entries, ordered by key
+  const std::map<std::string, std::string>& GetEntries();
+  // Adds or replaces an entry and rewrites the file. Every writer writes its own temp file and
+  // renames it over the table, so concurrent runs never see a partial table; the last rename wins.
+  bool Store(const std::string& key, const std::string& value);
+
+ private:
+  void load();
+
+ private:
+  std::string path_;
+  std::string header_;
+  unsigned key_fields_;
+  bool loaded_ = false;
+  std::map<std::string, std::string> entries_;
+};
+
+}  // namespace cache
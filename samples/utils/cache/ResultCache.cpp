@@ -0,0 +1,366 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "ResultCache.hpp"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
+namespace cache {
+
+namespace {
+
+const char kStatsFile[] = "cache_stats.txt";
+// Prefix of files being stored, they are not entries yet
+const char kTempPrefix[] = ".tmp-";
+
+struct Entry {
+  std::string path;
+  uint64_t size;
+  int64_t last_use;
+};
+
+bool GetFileSize(const std::string& path, uint64_t* size) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0)
+    return false;
+  *size = static_cast<uint64_t>(info.st_size);
+  return true;
+}
+
+// Entries are read-only, so a hardlinked output can not be rewritten in place by accident
+void MakeReadOnly(const std::string& path) {
+#ifdef _WIN32
+  _chmod(path.c_str(), _S_IREAD);
+#else
+  chmod(path.c_str(), 0444);
+#endif
+}
+
+// Windows does not remove, replace or touch read-only files
+void MakeWritable(const std::string& path) {
+#ifdef _WIN32
+  _chmod(path.c_str(), _S_IREAD | _S_IWRITE);
+#else
+  (void)path;
+#endif
+}
+
+// Marks the entry as just used
+void Touch(const std::string& path) {
+#ifdef _WIN32
+  MakeWritable(path);
+  _utime(path.c_str(), nullptr);
+  MakeReadOnly(path);
+#else
+  utime(path.c_str(), nullptr);
+#endif
+}
+
+bool Reflink(const std::string& source, const std::string& destination) {
+#ifdef __linux__
+  int in = open(source.c_str(), O_RDONLY);
+  if (in < 0)
+    return false;
+  int out = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+  if (out >= 0)
+    close(out);
+  close(in);
+  if (!cloned)
+    remove(destination.c_str());
+  return cloned;
+#else
+  (void)source;
+  (void)destination;
+  return false;
+#endif
+}
+
+bool Hardlink(const std::string& source, const std::string& destination) {
+#ifdef _WIN32
+  return CreateHardLinkA(destination.c_str(), source.c_str(), nullptr) != 0;
+#else
+  return link(source.c_str(), destination.c_str()) == 0;
+#endif
+}
+
+bool Copy(const std::string& source, const std::string& destination) {
+  std::ifstream in(source, std::ios::binary);
+  std::ofstream out(destination, std::ios::binary | std::ios::trunc);
+  if (!in || !out)
+    return false;
+  out << in.rdbuf();
+  out.flush();
+  if (!out) {
+    out.close();
+    remove(destination.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Moves source over destination
+bool Replace(const std::string& source, const std::string& destination) {
+#ifdef _WIN32
+  MakeWritable(destination);
+  return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(source.c_str(), destination.c_str()) == 0;
+#endif
+}
+
+// Files in directory that are cache entries
+std::vector<Entry> ListEntries(const std::string& directory) {
+  std::vector<Entry> entries;
+  auto add = [&](const std::string& name) {
+    if (name.empty() || name[0] == '.' || name == kStatsFile)
+      return;
+    Entry entry;
+    entry.path = directory + "/" + name;
+    struct stat info;
+    if (stat(entry.path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
+      return;
+    entry.size = static_cast<uint64_t>(info.st_size);
+    entry.last_use = static_cast<int64_t>(info.st_mtime);
+    entries.push_back(entry);
+  };
+#ifdef _WIN32
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return entries;
+  do {
+    add(data.cFileName);
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+    return entries;
+  while (dirent* item = readdir(dir))
+    add(item->d_name);
+  closedir(dir);
+#endif
+  return entries;
+}
+
+}  // namespace
+
+bool ParseLinkMode(const std::string& name, LinkMode* mode) {
+  if (name == "reflink")
+    *mode = LinkMode::kReflink;
+  else if (name == "hardlink")
+    *mode = LinkMode::kHardlink;
+  else
+    return false;
+  return true;
+}
+
+const char* GetCopyMethodName(CopyMethod method) {
+  switch (method) {
+  case CopyMethod::kReflink:
+    return "reflink";
+  case CopyMethod::kHardlink:
+    return "hardlink";
+  default:
+    return "copy";
+  }
+}
+
+bool CloneFile(const std::string& source, const std::string& destination, LinkMode mode, CopyMethod* method) {
+  // Never write through an existing file, it may be linked to something else
+  MakeWritable(destination);
+  remove(destination.c_str());
+  if (mode == LinkMode::kHardlink && Hardlink(source, destination)) {
+    *method = CopyMethod::kHardlink;
+    return true;
+  }
+  if (mode == LinkMode::kReflink && Reflink(source, destination)) {
+    *method = CopyMethod::kReflink;
+    return true;
+  }
+  *method = CopyMethod::kCopy;
+  return Copy(source, destination);
+}
+
+std::string GetModuleIdentity(const void* symbol) {
+  std::string path;
+#ifdef _WIN32
+  HMODULE module = nullptr;
+  char name[MAX_PATH];
+  if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                         static_cast<LPCSTR>(symbol), &module) &&
+      GetModuleFileNameA(module, name, sizeof(name)) > 0) {
+    path = name;
+  }
+#else
+  Dl_info info;
+  if (dladdr(const_cast<void*>(symbol), &info) && info.dli_fname)
+    path = info.dli_fname;
+#endif
+  struct stat file_info;
+  if (path.empty() || stat(path.c_str(), &file_info) != 0)
+    return std::string();
+  std::ostringstream identity;
+  identity << path << ' ' << static_cast<long long>(file_info.st_size) << ' '
+           << static_cast<long long>(file_info.st_mtime);
+  return identity.str();
+}
+
+ResultCache::ResultCache(const std::string& directory, uint64_t max_bytes, LinkMode mode)
+  : directory_(directory), max_bytes_(max_bytes), mode_(mode) {
+#ifdef _WIN32
+  _mkdir(directory_.c_str());
+#else
+  mkdir(directory_.c_str(), 0755);
+#endif
+}
+
+std::string ResultCache::entryPath(const std::string& key) const {
+  return directory_ + "/" + key;
+}
+
+bool ResultCache::Fetch(const std::string& key, const std::string& output) {
+  std::string entry = entryPath(key);
+  uint64_t size = 0;
+  if (!GetFileSize(entry, &size) || !CloneFile(entry, output, mode_, &last_method_)) {
+    stats_.misses++;
+    return false;
+  }
+  Touch(entry);
+  stats_.hits++;
+  stats_.hit_bytes += size;
+  return true;
+}
+
+bool ResultCache::Store(const std::string& key, const std::string& output) {
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = static_cast<int>(getpid());
+#endif
+  // Concurrent jobs storing the same key each complete their own file before it becomes visible.
+  // Never a hardlink, the output may still be written to.
+  std::string temp = directory_ + "/" + kTempPrefix + std::to_string(pid) + "-" + key;
+  CopyMethod method;
+  if (!CloneFile(output, temp, LinkMode::kReflink, &method)) {
+    remove(temp.c_str());
+    return false;
+  }
+  MakeReadOnly(temp);
+  if (!Replace(temp, entryPath(key))) {
+    MakeWritable(temp);
+    remove(temp.c_str());
+    return false;
+  }
+  Touch(entryPath(key));
+  stats_.stores++;
+  evict();
+  return true;
+}
+
+void ResultCache::evict() {
+  std::vector<Entry> entries = ListEntries(directory_);
+  uint64_t total = 0;
+  for (const Entry& entry : entries)
+    total += entry.size;
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.last_use < b.last_use; });
+  for (size_t i = 0; i < entries.size() && total > max_bytes_; i++) {
+    MakeWritable(entries[i].path);
+    if (remove(entries[i].path.c_str()) != 0)
+      continue;
+    total -= entries[i].size;
+    stats_.evictions++;
+    stats_.evicted_bytes += entries[i].size;
+  }
+}
+
+void ResultCache::PrintReport(std::ostream& out) {
+  // Totals of all runs, concurrent runs may lose an update
+  std::string stats_path = entryPath(kStatsFile);
+  CacheStats totals;
+  std::ifstream in(stats_path);
+  std::string name;
+  uint64_t value;
+  while (in >> name >> value) {
+    if (name == "hits")
+      totals.hits = value;
+    else if (name == "misses")
+      totals.misses = value;
+    else if (name == "stores")
+      totals.stores = value;
+    else if (name == "evictions")
+      totals.evictions = value;
+  }
+  in.close();
+  totals.hits += stats_.hits;
+  totals.misses += stats_.misses;
+  totals.stores += stats_.stores;
+  totals.evictions += stats_.evictions;
+  std::string temp = directory_ + "/" + kTempPrefix + kStatsFile;
+  {
+    std::ofstream file(temp);
+    file << "hits " << totals.hits << "\nmisses " << totals.misses << "\nstores " << totals.stores << "\nevictions "
+         << totals.evictions << "\n";
+  }
+  Replace(temp, stats_path);
+
+  uint64_t size = 0;
+  std::vector<Entry> entries = ListEntries(directory_);
+  for (const Entry& entry : entries)
+    size += entry.size;
+  uint64_t lookups = totals.hits + totals.misses;
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(1) << "Result cache " << directory_ << ": " << entries.size()
+      << " entries, " << size / 1e6 << " of " << max_bytes_ / 1e6 << " MB" << std::endl
+      << "  this run: " << stats_.hits << " hits";
+  if (stats_.hits)
+    out << " (" << GetCopyMethodName(last_method_) << ", " << stats_.hit_bytes / 1e6 << " MB)";
+  out << ", " << stats_.misses << " misses, " << stats_.stores << " stored, " << stats_.evictions << " evicted ("
+      << stats_.evicted_bytes / 1e6 << " MB)" << std::endl
+      << "  all runs: " << totals.hits << " hits, " << totals.misses << " misses ("
+      << (lookups ? 100.0 * totals.hits / lookups : 0.0) << "% hit rate), " << totals.stores << " stored, "
+      << totals.evictions << " evicted" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace cache
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <ostream>
+#include <string>
+
+// On-disk cache of finished output files, keyed by the content of the input and everything else
+// that determines the output. Entries are read-only files named by their key in the cache directory;
+// a hit places the entry at the output path as a reflink (copy-on-write clone) or hardlink where
+// the file system allows, or as a copy. The modification time of an entry is its last use, the
+// least recently used entries are removed once the directory exceeds its size cap.
+namespace cache {
+
+enum class LinkMode {
+  // Clone where supported, copy otherwise. Output and entry never share data that can change.
+  kReflink,
+  // Hardlink where supported, copy otherwise. Only used to place entries at outputs, which are then
+  // the same read-only file as the entry: such an output must be removed, not rewritten in place.
+  kHardlink,
+};
+
+// reflink or hardlink
+bool ParseLinkMode(const std::string& name, LinkMode* mode);
+
+// How a file was placed
+enum class CopyMethod {
+  kReflink,
+  kHardlink,
+  kCopy,
+};
+
+const char* GetCopyMethodName(CopyMethod method);
+
+// Places a copy of source at destination, replacing it. Returns false if nothing could be placed.
+bool CloneFile(const std::string& source, const std::string& destination, LinkMode mode, CopyMethod* method);
+
+// Path, size and modification time of the executable or shared library containing symbol, so a
+// replaced library changes the keys that include it. Empty if it can not be determined.
+std::string GetModuleIdentity(const void* symbol);
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t evictions = 0;
+  // Bytes placed by hits, and bytes removed by evictions
+  uint64_t hit_bytes = 0;
+  uint64_t evicted_bytes = 0;
+};
+
+class ResultCache {
+ public:
+  ResultCache(const std::string& directory, uint64_t max_bytes, LinkMode mode);
+
+  // Places the entry for key at output. Returns false on a miss.
+  bool Fetch(const std::string& key, const std::string& output);
+  // Adds a clone or copy of output as the entry for key, then evicts the least recently used entries
+  // beyond the cap. The entry never shares its data with output, later writes to output keep it intact.
+  bool Store(const std::string& key, const std::string& output);
+
+  // Counters of this process
+  const CacheStats& GetStats() const { return stats_; }
+  // Adds the counters of this process to the totals kept in the directory, prints both
+  void PrintReport(std::ostream& out);
+
+ private:
+  std::string entryPath(const std::string& key) const;
+  void evict();
+
+  const std::string directory_;
+  const uint64_t max_bytes_;
+  const LinkMode mode_;
+  CacheStats stats_;
+  CopyMethod last_method_ = CopyMethod::kCopy;
+};
+
+}  // namespace cache
@@ -0,0 +1,82 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "ResultLookup.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+
+#include <utils/startup/StartupProfile.hpp>
+#include <utils/trace/Trace.hpp>
+
+#include "ContentHash.hpp"
+
+namespace cache {
+
+std::string MakeResultKey(const audio_io::DecodedAudio& input, uint64_t farend_hash, const ResultSettings& settings,
+                          const std::string& output) {
+  StreamHash hash;
+  hash.UpdateString("effects_demo result v1");
+  hash.UpdateU64(farend_hash);
+  hash.UpdateU64(input.samples.size());
+  hash.UpdateU64(input.sample_rate);
+  for (const auto& value : settings.values) {
+    hash.UpdateString(value.first);
+    hash.UpdateString(value.second);
+  }
+  // Models and the SDK library by path, size and modification time, as in the property cache
+  hash.UpdateString(startup::PropertyCache::MakeKey(std::string(), settings.models));
+  hash.UpdateString(GetModuleIdentity(settings.sdk_symbol));
+  for (const latency::DelayEntry& entry : settings.delays) {
+    hash.UpdateU64(entry.output_sample_rate);
+    hash.Update(&entry.delay_samples, sizeof(entry.delay_samples));
+  }
+  if (settings.preserve_metadata) {
+    for (const audio_io::MetadataChunk& chunk : input.metadata) {
+      hash.UpdateU64(chunk.id);
+      hash.UpdateU64(chunk.data.size());
+      hash.Update(chunk.data.data(), chunk.data.size());
+    }
+  }
+  // The extension selects the output format
+  std::size_t dot_pos = output.find_last_of("./\\");
+  std::string extension = dot_pos != std::string::npos && output[dot_pos] == '.' ? output.substr(dot_pos) : "";
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+  return ToHex(input.content_hash) + ToHex(hash.Digest()) + extension;
+}
+
+bool FetchResult(ResultCache* cache, const std::string& key, const std::string& output, float input_secs) {
+  bool hit;
+  {
+    TRACE_SCOPE("result_cache_fetch");
+    hit = cache->Fetch(key, output);
+  }
+  if (!hit) {
+    // The output of an earlier hit may be a hardlink to a read-only entry, it is replaced rather than rewritten
+    std::remove(output.c_str());
+    return false;
+  }
+  std::cout << "Result cache hit, " << input_secs << " secs of audio not processed, effect not loaded. "
+            << "Output file written. " << output << std::endl;
+  cache->PrintReport(std::cout);
+  return true;
+}
+
+void StoreResult(ResultCache* cache, const std::string& key, const std::string& output) {
+  TRACE_SCOPE("result_cache_store");
+  if (!cache->Store(key, output))
+    std::cout << "Note: unable to store " << output << " in the result cache" << std::endl;
+  cache->PrintReport(std::cout);
+}
+
+}  // namespace cache
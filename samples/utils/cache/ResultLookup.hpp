@@ -0,0 +1,54 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <utils/audio_io/DecodedInput.hpp>
+#include <utils/latency/LatencyCalibration.hpp>
+
+#include "ResultCache.hpp"
+
+// Lookup of a whole run in the ResultCache: the key covers the decoded inputs and everything else that
+// determines the output, so it is known before the effect is created and a hit skips loading it.
+namespace cache {
+
+// Everything besides the inputs that shapes the output of a run
+struct ResultSettings {
+  // Settings that change the output bytes, as name / value pairs. Paths, timing, tracing and metrics do not.
+  std::vector<std::pair<std::string, std::string>> values;
+  // Model files, identified by path, size and modification time as in the property cache
+  std::vector<std::string> models;
+  // A symbol of the SDK library, identified the same way
+  const void* sdk_symbol = nullptr;
+  // Delays the output may be compensated by. The output rate is only known once the effect is loaded,
+  // so these are the latency table entries for every output rate.
+  std::vector<latency::DelayEntry> delays;
+  // The metadata chunks of the input are copied to the output
+  bool preserve_metadata = true;
+};
+
+// Key of the entry for the output file output of input, farend_hash is the content hash of a far end
+// input or 0. The extension of output selects the output format and is part of the key.
+std::string MakeResultKey(const audio_io::DecodedAudio& input, uint64_t farend_hash, const ResultSettings& settings,
+                          const std::string& output);
+
+// Places the entry for key at output and prints the hit, input_secs of audio did not need processing.
+// Removes a stale output on a miss. Returns false on a miss.
+bool FetchResult(ResultCache* cache, const std::string& key, const std::string& output, float input_secs);
+// Adds the committed output as the entry for key and prints the cache report
+void StoreResult(ResultCache* cache, const std::string& key, const std::string& output);
+
+}  // namespace cache
@@ -0,0 +1,466 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "Loudness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "SimdKernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace dsp {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Absolute gate and upper end of the gating histogram
+const double kAbsoluteGateLufs = -70.0;
+const double kHistogramMaxLufs = 10.0;
+const double kHistogramStep = 0.1;
+const double kRelativeGateLu = -10.0;
+// Limiter gains this close to 1 are taken as 1 (-0.0001 dB)
+const float kUnityGain = 0.99999f;
+// Samples per internal block
+const size_t kBlockSamples = 4096;
+
+double MeanSquareToLufs(double mean_square) {
+  return mean_square > 0.0 ? -0.691 + 10.0 * std::log10(mean_square) : -std::numeric_limits<double>::infinity();
+}
+
+typedef double Matrix4[4][4];
+
+void Multiply(const Matrix4& a, const Matrix4& b, Matrix4& out) {
+  Matrix4 result = {};
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+      for (int k = 0; k < 4; k++)
+        result[r][c] += a[r][k] * b[k][c];
+  std::memcpy(out, result, sizeof(result));
+}
+
+void Multiply(const Matrix4& a, const double* v, double* out) {
+  double result[4] = {};
+  for (int r = 0; r < 4; r++)
+    for (int k = 0; k < 4; k++)
+      result[r] += a[r][k] * v[k];
+  std::memcpy(out, result, sizeof(result));
+}
+
+}  // namespace
+
+void KWeightingFilter::Design(uint32_t sample_rate, BiquadCoefficients* shelf, BiquadCoefficients* highpass) {
+  // Stage 1, high shelf modelling the acoustic effect of the head
+  double f0 = 1681.974450955533;
+  double gain_db = 3.999843853973347;
+  double q = 0.7071752369554196;
+  double k = std::tan(kPi * f0 / sample_rate);
+  double vh = std::pow(10.0, gain_db / 20.0);
+  double vb = std::pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  shelf->b0 = (vh + vb * k / q + k * k) / a0;
+  shelf->b1 = 2.0 * (k * k - vh) / a0;
+  shelf->b2 = (vh - vb * k / q + k * k) / a0;
+  shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+  shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+  // Stage 2, RLB high pass
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = std::tan(kPi * f0 / sample_rate);
+  a0 = 1.0 + k / q + k * k;
+  highpass->b0 = 1.0;
+  highpass->b1 = -2.0;
+  highpass->b2 = 1.0;
+  highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+  highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+KWeightingFilter::KWeightingFilter(uint32_t sample_rate) {
+  BiquadCoefficients a, b;
+  Design(sample_rate, &a, &b);
+  b0a_ = static_cast<float>(a.b0), b1a_ = static_cast<float>(a.b1), b2a_ = static_cast<float>(a.b2);
+  a1a_ = static_cast<float>(a.a1), a2a_ = static_cast<float>(a.a2);
+  b0b_ = static_cast<float>(b.b0), b1b_ = static_cast<float>(b.b1), b2b_ = static_cast<float>(b.b2);
+  a1b_ = static_cast<float>(b.a1), a2b_ = static_cast<float>(b.a2);
+
+  // One sample of the cascade: s' = A s + B u, y = C s + D u
+  Matrix4 transition = {
+    { -a.a1, 1.0, 0.0, 0.0 },
+    { -a.a2, 0.0, 0.0, 0.0 },
+    { b.b1 - b.a1 * b.b0, 0.0, -b.a1, 1.0 },
+    { b.b2 - b.a2 * b.b0, 0.0, -b.a2, 0.0 },
+  };
+  double input[4] = { a.b1 - a.a1 * a.b0, a.b2 - a.a2 * a.b0, a.b0 * (b.b1 - b.a1 * b.b0),
+                      a.b0 * (b.b2 - b.a2 * b.b0) };
+  double output[4] = { b.b0, 0.0, 1.0, 0.0 };
+  double direct = a.b0 * b.b0;
+
+  // powers[k] = A^k, inputs[k] = A^k B
+  Matrix4 powers[5];
+  double inputs[4][4];
+  std::memset(powers, 0, sizeof(powers));
+  for (int i = 0; i < 4; i++)
+    powers[0][i][i] = 1.0;
+  for (int k = 1; k <= 4; k++)
+    Multiply(powers[k - 1], transition, powers[k]);
+  for (int k = 0; k < 4; k++)
+    Multiply(powers[k], input, inputs[k]);
+
+  // y[k] = C A^k s + sum(j < k) C A^(k-1-j) B u[j] + D u[k]
+  for (int k = 0; k < 4; k++) {
+    for (int c = 0; c < 4; c++) {
+      double ys = 0.0;
+      for (int r = 0; r < 4; r++)
+        ys += output[r] * powers[k][r][c];
+      ys_[c][k] = static_cast<float>(ys);
+    }
+    for (int j = 0; j < 4; j++) {
+      double yu = 0.0;
+      if (j == k) {
+        yu = direct;
+      } else if (j < k) {
+        for (int r = 0; r < 4; r++)
+          yu += output[r] * inputs[k - 1 - j][r];
+      }
+      yu_[j][k] = static_cast<float>(yu);
+    }
+  }
+  // s[4] = A^4 s + sum(j) A^(3-j) B u[j]
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      ss_[c][r] = static_cast<float>(powers[4][r][c]);
+      su_[c][r] = static_cast<float>(inputs[3 - c][r]);
+    }
+  }
+  Reset();
+}
+
+void KWeightingFilter::Reset() {
+  std::fill(state_, state_ + 4, 0.f);
+}
+
+void KWeightingFilter::ProcessScalar(const float* in, float* out, size_t n) {
+  float s1a = state_[0], s2a = state_[1], s1b = state_[2], s2b = state_[3];
+  for (size_t i = 0; i < n; i++) {
+    float u = in[i];
+    float v = b0a_ * u + s1a;
+    s1a = b1a_ * u - a1a_ * v + s2a;
+    s2a = b2a_ * u - a2a_ * v;
+    float y = b0b_ * v + s1b;
+    s1b = b1b_ * v - a1b_ * y + s2b;
+    s2b = b2b_ * v - a2b_ * y;
+    out[i] = y;
+  }
+  state_[0] = s1a, state_[1] = s2a, state_[2] = s1b, state_[3] = s2b;
+}
+
+void KWeightingFilter::Process(const float* in, float* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_SSE2
+  __m128 ys[4], yu[4], ss[4], su[4];
+  for (int c = 0; c < 4; c++) {
+    ys[c] = _mm_loadu_ps(ys_[c]);
+    yu[c] = _mm_loadu_ps(yu_[c]);
+    ss[c] = _mm_loadu_ps(ss_[c]);
+    su[c] = _mm_loadu_ps(su_[c]);
+  }
+  __m128 state = _mm_loadu_ps(state_);
+  for (; i + 4 <= n; i += 4) {
+    __m128 u = _mm_loadu_ps(in + i);
+    __m128 s0 = _mm_shuffle_ps(state, state, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 s1 = _mm_shuffle_ps(state, state, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 s2 = _mm_shuffle_ps(state, state, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 s3 = _mm_shuffle_ps(state, state, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 u0 = _mm_shuffle_ps(u, u, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 u1 = _mm_shuffle_ps(u, u, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 u2 = _mm_shuffle_ps(u, u, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 u3 = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ys[0], s0), _mm_mul_ps(ys[1], s1)),
+                          _mm_add_ps(_mm_mul_ps(ys[2], s2), _mm_mul_ps(ys[3], s3)));
+    y = _mm_add_ps(y, _mm_add_ps(_mm_add_ps(_mm_mul_ps(yu[0], u0), _mm_mul_ps(yu[1], u1)),
+                                 _mm_add_ps(_mm_mul_ps(yu[2], u2), _mm_mul_ps(yu[3], u3))));
+    __m128 next = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ss[0], s0), _mm_mul_ps(ss[1], s1)),
+                             _mm_add_ps(_mm_mul_ps(ss[2], s2), _mm_mul_ps(ss[3], s3)));
+    state = _mm_add_ps(next, _mm_add_ps(_mm_add_ps(_mm_mul_ps(su[0], u0), _mm_mul_ps(su[1], u1)),
+                                        _mm_add_ps(_mm_mul_ps(su[2], u2), _mm_mul_ps(su[3], u3))));
+    _mm_storeu_ps(out + i, y);
+  }
+  _mm_storeu_ps(state_, state);
+#endif
+  ProcessScalar(in + i, out + i, n - i);
+}
+
+LoudnessMeter::LoudnessMeter(uint32_t sample_rate)
+  : filter_(sample_rate)
+  , hop_samples_(std::max(1u, sample_rate / 10))
+  , weighted_(kBlockSamples) {
+  size_t bins = static_cast<size_t>((kHistogramMaxLufs - kAbsoluteGateLufs) / kHistogramStep);
+  histogram_count_.assign(bins, 0);
+  histogram_energy_.assign(bins, 0.0);
+}
+
+void LoudnessMeter::Add(const float* samples, size_t n) {
+  while (n > 0) {
+    size_t count = std::min(std::min(n, static_cast<size_t>(hop_samples_ - hop_fill_)), weighted_.size());
+    filter_.Process(samples, weighted_.data(), count);
+    float peak = 0.f;
+    EnergyAndPeak(weighted_.data(), count, &current_energy_, &peak);
+    hop_fill_ += static_cast<uint32_t>(count);
+    samples += count;
+    n -= count;
+    if (hop_fill_ < hop_samples_)
+      continue;
+
+    // 400 ms blocks overlap by 75%, one ends with every 100 ms hop
+    hop_energy_[num_hops_ % 4] = current_energy_;
+    num_hops_++;
+    current_energy_ = 0.0;
+    hop_fill_ = 0;
+    if (num_hops_ >= 4)
+      addBlock((hop_energy_[0] + hop_energy_[1] + hop_energy_[2] + hop_energy_[3]) / (4.0 * hop_samples_));
+  }
+}
+
+void LoudnessMeter::addBlock(double mean_square) {
+  num_blocks_++;
+  momentary_ = mean_square;
+  double loudness = MeanSquareToLufs(mean_square);
+  if (!(loudness > kAbsoluteGateLufs))
+    return;
+  size_t bin = std::min(histogram_count_.size() - 1,
+                        static_cast<size_t>((loudness - kAbsoluteGateLufs) / kHistogramStep));
+  histogram_count_[bin]++;
+  histogram_energy_[bin] += mean_square;
+}
+
+double LoudnessMeter::GetIntegratedLoudness() const {
+  uint64_t count = 0;
+  double energy = 0.0;
+  for (size_t bin = 0; bin < histogram_count_.size(); bin++) {
+    count += histogram_count_[bin];
+    energy += histogram_energy_[bin];
+  }
+  if (count == 0)
+    return -std::numeric_limits<double>::infinity();
+
+  // Relative gate, bins are in or out by their center
+  double gate = MeanSquareToLufs(energy / count) + kRelativeGateLu;
+  count = 0;
+  energy = 0.0;
+  for (size_t bin = 0; bin < histogram_count_.size(); bin++) {
+    if (kAbsoluteGateLufs + (bin + 0.5) * kHistogramStep >= gate) {
+      count += histogram_count_[bin];
+      energy += histogram_energy_[bin];
+    }
+  }
+  return count ? MeanSquareToLufs(energy / count) : -std::numeric_limits<double>::infinity();
+}
+
+double LoudnessMeter::GetMomentaryLoudness() const {
+  return num_blocks_ ? MeanSquareToLufs(momentary_) : -std::numeric_limits<double>::infinity();
+}
+
+TruePeakDetector::TruePeakDetector() {
+  // 48 tap windowed sinc interpolating by 4, each phase normalized to unity gain
+  const int kLength = kTaps * 4;
+  double taps[kLength];
+  for (int k = 0; k < kLength; k++) {
+    double x = (k - (kLength - 1) / 2.0) / 4.0;
+    double sinc = std::sin(kPi * x) / (kPi * x);
+    double window = 0.5 - 0.5 * std::cos(2.0 * kPi * (k + 0.5) / kLength);
+    taps[k] = sinc * window;
+  }
+  for (int phase = 0; phase < 4; phase++) {
+    double sum = 0.0;
+    for (uint32_t t = 0; t < kTaps; t++)
+      sum += taps[4 * t + phase];
+    for (uint32_t t = 0; t < kTaps; t++)
+      coefficients_[t][phase] = static_cast<float>(taps[4 * t + phase] / sum);
+  }
+  Reset();
+}
+
+void TruePeakDetector::Reset() {
+  buffer_.assign(kTaps - 1, 0.f);
+}
+
+void TruePeakDetector::Process(const float* in, float* peaks, size_t n) {
+  const size_t history = kTaps - 1;
+  buffer_.resize(history + n);
+  std::copy(in, in + n, buffer_.begin() + history);
+  const float* x = buffer_.data() + history;
+#if DSP_HAVE_SSE2
+  __m128 taps[kTaps];
+  for (uint32_t t = 0; t < kTaps; t++)
+    taps[t] = _mm_loadu_ps(coefficients_[t]);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+#endif
+  for (size_t i = 0; i < n; i++) {
+    float peak = std::fabs(x[static_cast<ptrdiff_t>(i) - static_cast<ptrdiff_t>(kDelay)]);
+#if DSP_HAVE_SSE2
+    __m128 acc = _mm_setzero_ps();
+    for (uint32_t t = 0; t < kTaps; t++)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(x[static_cast<ptrdiff_t>(i) - t]), taps[t]));
+    acc = _mm_and_ps(acc, abs_mask);
+    acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    peak = std::max(peak, _mm_cvtss_f32(acc));
+#else
+    for (int phase = 0; phase < 4; phase++) {
+      float acc = 0.f;
+      for (uint32_t t = 0; t < kTaps; t++)
+        acc += x[static_cast<ptrdiff_t>(i) - t] * coefficients_[t][phase];
+      peak = std::max(peak, std::fabs(acc));
+    }
+#endif
+    peaks[i] = peak;
+  }
+  std::copy(buffer_.end() - history, buffer_.end(), buffer_.begin());
+  buffer_.resize(history);
+}
+
+LoudnessNormalizer::LoudnessNormalizer(uint32_t sample_rate, const LoudnessOptions& options)
+  : options_(options)
+  , input_meter_(sample_rate)
+  , output_meter_(sample_rate)
+  , ramp_samples_(std::max(1u, sample_rate / 10))
+  , limit_(static_cast<float>(std::pow(10.0, options.true_peak_db / 20.0)))
+  , lookahead_(std::max(1u, static_cast<uint32_t>(std::lround(options.lookahead_ms * sample_rate / 1000.0))))
+  , release_(static_cast<float>(std::exp(-1000.0 / (std::max(1.0, options.release_ms) * sample_rate))))
+  , peaks_(kBlockSamples)
+  , min_value_(lookahead_ + 3)
+  , min_index_(lookahead_ + 3)
+  , average_(lookahead_, 1.f)
+  , average_sum_(lookahead_)
+  , delay_(GetLatency(), 0.f) {}
+
+void LoudnessNormalizer::SetKnownLoudness(double lufs) {
+  known_loudness_ = true;
+  double gain_db = std::isfinite(lufs) ? options_.target_lufs - lufs : 0.0;
+  gain_db = std::max(-options_.max_gain_db, std::min(options_.max_gain_db, gain_db));
+  gain_ = target_gain_ = static_cast<float>(std::pow(10.0, gain_db / 20.0));
+  ramp_left_ = 0;
+}
+
+double LoudnessNormalizer::GetGainDb() const {
+  return 20.0 * std::log10(gain_);
+}
+
+double LoudnessNormalizer::GetMaxReductionDb() const {
+  return min_gain_ < 1.f ? -20.0 * std::log10(min_gain_) : 0.0;
+}
+
+void LoudnessNormalizer::Process(float* samples, size_t n) {
+  for (size_t offset = 0; offset < n;) {
+    size_t count = std::min(n - offset, peaks_.size());
+    float* block = samples + offset;
+    if (!known_loudness_) {
+      input_meter_.Add(block, count);
+      if (input_meter_.GetNumBlocks() != seen_blocks_) {
+        seen_blocks_ = input_meter_.GetNumBlocks();
+        double loudness = input_meter_.GetIntegratedLoudness();
+        if (std::isfinite(loudness)) {
+          double gain_db = std::max(-options_.max_gain_db, std::min(options_.max_gain_db,
+                                                                   options_.target_lufs - loudness));
+          target_gain_ = static_cast<float>(std::pow(10.0, gain_db / 20.0));
+          gain_step_ = (target_gain_ - gain_) / ramp_samples_;
+          ramp_left_ = ramp_samples_;
+        }
+      }
+    }
+    applyGain(block, count);
+    limit(block, count);
+    output_meter_.Add(block, count);
+    offset += count;
+  }
+}
+
+void LoudnessNormalizer::Flush(float* tail) {
+  std::fill(tail, tail + GetLatency(), 0.f);
+  limit(tail, GetLatency());
+  output_meter_.Add(tail, GetLatency());
+}
+
+void LoudnessNormalizer::ProcessBuffer(float* samples, size_t n) {
+  Process(samples, n);
+  std::vector<float> tail(GetLatency());
+  Flush(tail.data());
+  for (size_t i = 0; i < n; i++) {
+    size_t source = i + GetLatency();
+    samples[i] = source < n ? samples[source] : tail[source - n];
+  }
+}
+
+void LoudnessNormalizer::applyGain(float* samples, size_t n) {
+  size_t i = 0;
+  for (; i < n && ramp_left_ > 0; i++, ramp_left_--) {
+    gain_ += gain_step_;
+    samples[i] *= gain_;
+  }
+  if (ramp_left_ == 0)
+    gain_ = target_gain_;
+  for (; i < n; i++)
+    samples[i] *= gain_;
+}
+
+void LoudnessNormalizer::limit(float* samples, size_t n) {
+  const size_t window = min_value_.size();
+  for (size_t offset = 0; offset < n;) {
+    size_t count = std::min(n - offset, peaks_.size());
+    float* block = samples + offset;
+    detector_.Process(block, peaks_.data(), count);
+    for (size_t i = 0; i < count; i++) {
+      float peak = peaks_[i];
+      float required = peak > limit_ ? limit_ / peak : 1.f;
+
+      // Sliding minimum, the gain reached at the delayed sample covers its neighbours too
+      while (min_size_ > 0 && min_value_[(min_head_ + min_size_ - 1) % window] >= required)
+        min_size_--;
+      min_value_[(min_head_ + min_size_) % window] = required;
+      min_index_[(min_head_ + min_size_) % window] = position_;
+      min_size_++;
+      if (min_index_[min_head_] + window <= position_) {
+        min_head_ = (min_head_ + 1) % window;
+        min_size_--;
+      }
+
+      // Instant attack, exponential release of the gain reduction, then smoothed over the look-ahead
+      reduction_ = std::max(1.f - min_value_[min_head_], reduction_ * release_);
+      float envelope = 1.f - reduction_;
+      average_sum_ += envelope - average_[average_pos_];
+      average_[average_pos_] = envelope;
+      average_pos_ = (average_pos_ + 1) % average_.size();
+      float gain = static_cast<float>(average_sum_ / average_.size());
+      if (gain > kUnityGain)
+        gain = 1.f;
+
+      float delayed = delay_[delay_pos_];
+      delay_[delay_pos_] = block[i];
+      delay_pos_ = (delay_pos_ + 1) % delay_.size();
+      block[i] = delayed * gain;
+      if (gain < kUnityGain) {
+        limited_samples_++;
+        min_gain_ = std::min(min_gain_, gain);
+      }
+      position_++;
+    }
+    offset += count;
+  }
+}
+
+}  // namespace dsp
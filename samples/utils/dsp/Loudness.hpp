@@ -0,0 +1,182 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Loudness measurement and normalization following ITU-R BS.1770-4 / EBU R128 for a single channel.
+// Levels are in LUFS, true peak in dBTP.
+
+namespace dsp {
+
+// Biquad coefficients, a0 normalized to 1
+struct BiquadCoefficients {
+  double b0, b1, b2, a1, a2;
+};
+
+// BS.1770 K-weighting: high shelf followed by a high pass. The cascade is run as a 4th order state
+// space system on blocks of 4 samples, so the vector path does not wait for the previous output on
+// every sample.
+class KWeightingFilter {
+ public:
+  explicit KWeightingFilter(uint32_t sample_rate);
+  // Filters n samples, in and out may be the same buffer
+  void Process(const float* in, float* out, size_t n);
+  // Same filter as a plain biquad cascade, one sample at a time
+  void ProcessScalar(const float* in, float* out, size_t n);
+  void Reset();
+  // Designs the two stages for sample_rate
+  static void Design(uint32_t sample_rate, BiquadCoefficients* shelf, BiquadCoefficients* highpass);
+
+ private:
+  float b0a_, b1a_, b2a_, a1a_, a2a_;
+  float b0b_, b1b_, b2b_, a1b_, a2b_;
+  // Transposed direct form II states of both stages {s1 shelf, s2 shelf, s1 high pass, s2 high pass}
+  float state_[4];
+  // Block matrices stored by column, ys/yu map state/input to the 4 outputs, ss/su to the next state
+  float ys_[4][4];
+  float yu_[4][4];
+  float ss_[4][4];
+  float su_[4][4];
+};
+
+// Momentary and gated integrated loudness, updated every 100 ms. Gating uses a histogram of the
+// 400 ms block energies, so the integrated loudness is available at any time without keeping the
+// blocks.
+class LoudnessMeter {
+ public:
+  explicit LoudnessMeter(uint32_t sample_rate);
+  void Add(const float* samples, size_t n);
+  // Integrated loudness of everything added so far, -inf if no block passed the -70 LUFS gate
+  double GetIntegratedLoudness() const;
+  // Loudness of the last 400 ms block, -inf before the first block
+  double GetMomentaryLoudness() const;
+  // Number of 400 ms blocks, one every 100 ms
+  uint64_t GetNumBlocks() const { return num_blocks_; }
+
+ private:
+  void addBlock(double mean_square);
+
+ private:
+  KWeightingFilter filter_;
+  uint32_t hop_samples_;
+  std::vector<float> weighted_;
+  // Energies of the last 4 hops of 100 ms
+  double hop_energy_[4] = {};
+  double current_energy_ = 0.0;
+  uint32_t hop_fill_ = 0;
+  uint64_t num_hops_ = 0;
+  uint64_t num_blocks_ = 0;
+  double momentary_ = 0.0;
+  // Count and summed mean square of the blocks per 0.1 LU from the absolute gate up
+  std::vector<uint32_t> histogram_count_;
+  std::vector<double> histogram_energy_;
+};
+
+// Peak of the 4x oversampled signal (BS.1770-4 Annex 2, 48 tap interpolation filter). peaks[i]
+// covers the signal between input samples i - 6 and i - 5, including sample i - 6.
+class TruePeakDetector {
+ public:
+  static const uint32_t kDelay = 6;
+
+  TruePeakDetector();
+  void Process(const float* in, float* peaks, size_t n);
+  void Reset();
+
+ private:
+  static const uint32_t kTaps = 12;
+  // Polyphase coefficients, coefficients_[t][phase] weights the sample t steps back
+  float coefficients_[kTaps][4];
+  // Previous kTaps - 1 samples followed by the current block
+  std::vector<float> buffer_;
+};
+
+struct LoudnessOptions {
+  double target_lufs = -23.0;
+  double true_peak_db = -1.0;
+  double lookahead_ms = 5.0;
+  double release_ms = 50.0;
+  // Largest boost or cut applied by the normalization gain
+  double max_gain_db = 20.0;
+};
+
+// Normalization gain followed by a look-ahead true-peak limiter. Streaming: the gain follows the
+// integrated loudness measured so far and is ramped over 100 ms on every update. Two pass: the
+// loudness of the whole signal is passed to SetKnownLoudness() and the gain is constant.
+class LoudnessNormalizer {
+ public:
+  LoudnessNormalizer(uint32_t sample_rate, const LoudnessOptions& options);
+  // Switches to a constant gain for a signal of known integrated loudness
+  void SetKnownLoudness(double lufs);
+  // Normalizes n samples in place. The output is delayed by GetLatency() samples.
+  void Process(float* samples, size_t n);
+  // Writes the GetLatency() samples still held back by the limiter
+  void Flush(float* tail);
+  // Normalizes a complete signal in place, without the latency
+  void ProcessBuffer(float* samples, size_t n);
+  uint32_t GetLatency() const { return lookahead_ + TruePeakDetector::kDelay; }
+  // Loudness of the input measured so far (streaming only) and of the output
+  const LoudnessMeter& GetInputMeter() const { return input_meter_; }
+  const LoudnessMeter& GetOutputMeter() const { return output_meter_; }
+  // Current normalization gain
+  double GetGainDb() const;
+  // Largest limiter gain reduction so far, positive dB
+  double GetMaxReductionDb() const;
+  // Samples the limiter reduced
+  uint64_t GetLimitedSamples() const { return limited_samples_; }
+
+ private:
+  // Applies the gain, ramping towards target_gain_
+  void applyGain(float* samples, size_t n);
+  // Runs the limiter on n samples in place, output delayed by GetLatency()
+  void limit(float* samples, size_t n);
+
+ private:
+  LoudnessOptions options_;
+  LoudnessMeter input_meter_;
+  LoudnessMeter output_meter_;
+  TruePeakDetector detector_;
+  bool known_loudness_ = false;
+  uint64_t seen_blocks_ = 0;
+  uint32_t ramp_samples_;
+  float gain_ = 1.f;
+  float target_gain_ = 1.f;
+  float gain_step_ = 0.f;
+  uint32_t ramp_left_ = 0;
+  float limit_;
+  uint32_t lookahead_;
+  // Per sample decay of the gain reduction
+  float release_;
+  std::vector<float> peaks_;
+  // Sliding minimum of the required gain over lookahead_ + 3 samples, monotonic queue in a ring
+  std::vector<float> min_value_;
+  std::vector<uint64_t> min_index_;
+  size_t min_head_ = 0;
+  size_t min_size_ = 0;
+  // 1 - limiter gain before smoothing
+  float reduction_ = 0.f;
+  // Moving average of the envelope over lookahead_ samples
+  std::vector<float> average_;
+  double average_sum_;
+  size_t average_pos_ = 0;
+  // Gained samples waiting for their limiter gain
+  std::vector<float> delay_;
+  size_t delay_pos_ = 0;
+  uint64_t position_ = 0;
+  float min_gain_ = 1.f;
+  uint64_t limited_samples_ = 0;
+};
+
+}  // namespace dsp
@@ -0,0 +1,195 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "RealFFT.hpp"
+
+#include <assert.h>
+
+#include <cmath>
+
+#include "SimdKernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace dsp {
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+}  // namespace
+
+uint32_t RealFFT::NextPowerOfTwo(uint32_t n) {
+  uint32_t size = 4;
+  while (size < n)
+    size <<= 1;
+  return size;
+}
+
+RealFFT::RealFFT(uint32_t size)
+  : size_(size)
+  , half_(size / 2) {
+  assert(size >= 4 && (size & (size - 1)) == 0);
+
+  uint32_t bits = 0;
+  while ((1u << bits) < half_)
+    bits++;
+  bitrev_.resize(half_);
+  for (uint32_t i = 0; i < half_; i++) {
+    uint32_t r = 0;
+    for (uint32_t b = 0; b < bits; b++)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    bitrev_[i] = r;
+  }
+
+  twiddleRe_.resize(half_);
+  twiddleIm_.resize(half_);
+  for (uint32_t h = 1; h < half_; h <<= 1) {
+    for (uint32_t j = 0; j < h; j++) {
+      double angle = -kPi * j / h;
+      twiddleRe_[h - 1 + j] = static_cast<float>(std::cos(angle));
+      twiddleIm_[h - 1 + j] = static_cast<float>(std::sin(angle));
+    }
+  }
+
+  splitRe_.resize(half_ + 1);
+  splitIm_.resize(half_ + 1);
+  for (uint32_t k = 0; k <= half_; k++) {
+    double angle = -2.0 * kPi * k / size_;
+    splitRe_[k] = static_cast<float>(std::cos(angle));
+    splitIm_[k] = static_cast<float>(std::sin(angle));
+  }
+
+  workRe_.resize(half_);
+  workIm_.resize(half_);
+  binRe_.resize(half_ + 1);
+  binIm_.resize(half_ + 1);
+}
+
+void RealFFT::complexFFT() {
+  float* re = workRe_.data();
+  float* im = workIm_.data();
+
+  for (uint32_t h = 1; h < half_; h <<= 1) {
+    const float* wr = &twiddleRe_[h - 1];
+    const float* wi = &twiddleIm_[h - 1];
+    for (uint32_t i = 0; i < half_; i += 2 * h) {
+      uint32_t j = 0;
+#if DSP_HAVE_SSE2
+      for (; j + 4 <= h; j += 4) {
+        __m128 ar = _mm_loadu_ps(re + i + j);
+        __m128 ai = _mm_loadu_ps(im + i + j);
+        __m128 br = _mm_loadu_ps(re + i + j + h);
+        __m128 bi = _mm_loadu_ps(im + i + j + h);
+        __m128 cr = _mm_loadu_ps(wr + j);
+        __m128 ci = _mm_loadu_ps(wi + j);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(br, cr), _mm_mul_ps(bi, ci));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(br, ci), _mm_mul_ps(bi, cr));
+        _mm_storeu_ps(re + i + j, _mm_add_ps(ar, tr));
+        _mm_storeu_ps(im + i + j, _mm_add_ps(ai, ti));
+        _mm_storeu_ps(re + i + j + h, _mm_sub_ps(ar, tr));
+        _mm_storeu_ps(im + i + j + h, _mm_sub_ps(ai, ti));
+      }
+#endif
+      for (; j < h; j++) {
+        float tr = re[i + j + h] * wr[j] - im[i + j + h] * wi[j];
+        float ti = re[i + j + h] * wi[j] + im[i + j + h] * wr[j];
+        re[i + j + h] = re[i + j] - tr;
+        im[i + j + h] = im[i + j] - ti;
+        re[i + j] += tr;
+        im[i + j] += ti;
+      }
+    }
+  }
+}
+
+void RealFFT::Forward(const float* in, float* re, float* im) {
+  // Pack even/odd samples as real/imaginary parts in bit reversed order
+  for (uint32_t n = 0; n < half_; n++) {
+    workRe_[bitrev_[n]] = in[2 * n];
+    workIm_[bitrev_[n]] = in[2 * n + 1];
+  }
+
+  complexFFT();
+
+  // Split Z[k] into the spectra of even and odd samples and combine them
+  splitBins(re, im, 0, 1);
+  uint32_t k = 1;
+#if DSP_HAVE_SSE2
+  // Z[half_ - k] for 4 consecutive k is a reversed load
+  const __m128 half4 = _mm_set1_ps(0.5f);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  for (; k + 4 <= half_; k += 4) {
+    __m128 zr = _mm_loadu_ps(&workRe_[k]);
+    __m128 zi = _mm_loadu_ps(&workIm_[k]);
+    __m128 cr = _mm_loadu_ps(&workRe_[half_ - k - 3]);
+    __m128 ci = _mm_loadu_ps(&workIm_[half_ - k - 3]);
+    cr = _mm_shuffle_ps(cr, cr, _MM_SHUFFLE(0, 1, 2, 3));
+    ci = _mm_xor_ps(_mm_shuffle_ps(ci, ci, _MM_SHUFFLE(0, 1, 2, 3)), sign);
+    __m128 er = _mm_mul_ps(half4, _mm_add_ps(zr, cr));
+    __m128 ei = _mm_mul_ps(half4, _mm_add_ps(zi, ci));
+    __m128 orr = _mm_mul_ps(half4, _mm_sub_ps(zi, ci));
+    __m128 oi = _mm_xor_ps(_mm_mul_ps(half4, _mm_sub_ps(zr, cr)), sign);
+    __m128 wr = _mm_loadu_ps(&splitRe_[k]);
+    __m128 wi = _mm_loadu_ps(&splitIm_[k]);
+    _mm_storeu_ps(re + k, _mm_sub_ps(_mm_add_ps(er, _mm_mul_ps(wr, orr)), _mm_mul_ps(wi, oi)));
+    _mm_storeu_ps(im + k, _mm_add_ps(_mm_add_ps(ei, _mm_mul_ps(wr, oi)), _mm_mul_ps(wi, orr)));
+  }
+#endif
+  splitBins(re, im, k, half_ + 1);
+}
+
+void RealFFT::splitBins(float* re, float* im, uint32_t begin, uint32_t end) {
+  for (uint32_t k = begin; k < end; k++) {
+    uint32_t a = k % half_;
+    uint32_t b = (half_ - k) % half_;
+    float zr = workRe_[a], zi = workIm_[a];
+    float cr = workRe_[b], ci = -workIm_[b];
+    float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    // (Z - conj) / 2i
+    float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+    re[k] = er + splitRe_[k] * orr - splitIm_[k] * oi;
+    im[k] = ei + splitRe_[k] * oi + splitIm_[k] * orr;
+  }
+}
+
+void RealFFT::Inverse(const float* re, const float* im, float* out) {
+  // Undo the split step: Z[k] = E[k] + i O[k] with E and O the spectra of even and odd samples.
+  // The inverse transform of Z is taken as the conjugate of the forward transform of conj(Z).
+  for (uint32_t k = 0; k < half_; k++) {
+    float xr = re[k], xi = im[k];
+    float cr = re[half_ - k], ci = -im[half_ - k];
+    float er = 0.5f * (xr + cr), ei = 0.5f * (xi + ci);
+    // (X - conj) / 2 * conj(W^k)
+    float dr = 0.5f * (xr - cr), di = 0.5f * (xi - ci);
+    float orr = dr * splitRe_[k] + di * splitIm_[k];
+    float oi = di * splitRe_[k] - dr * splitIm_[k];
+    workRe_[bitrev_[k]] = er - oi;
+    workIm_[bitrev_[k]] = -(ei + orr);
+  }
+
+  complexFFT();
+
+  const float scale = 1.f / half_;
+  for (uint32_t n = 0; n < half_; n++) {
+    out[2 * n] = workRe_[n] * scale;
+    out[2 * n + 1] = -workIm_[n] * scale;
+  }
+}
+
+void RealFFT::PowerSpectrum(const float* in, float* power) {
+  Forward(in, binRe_.data(), binIm_.data());
+  dsp::PowerSpectrum(binRe_.data(), binIm_.data(), power, half_ + 1);
+}
+
+}  // namespace dsp
@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace dsp {
+
+// Real-input FFT plan for a fixed power of two size. The transform is computed as a half size
+// complex FFT followed by a split step, so a plan should be created once and reused per frame.
+class RealFFT {
+ public:
+  // Constructor. size must be a power of two >= 4
+  explicit RealFFT(uint32_t size);
+  // Returns transform size
+  uint32_t GetSize() const { return size_; }
+  // Returns number of output bins (size / 2 + 1)
+  uint32_t GetNumBins() const { return half_ + 1; }
+  // Computes GetNumBins() complex bins of size real samples
+  void Forward(const float* in, float* re, float* im);
+  // Computes size real samples of GetNumBins() complex bins, scaled so Inverse(Forward(x)) == x
+  void Inverse(const float* re, const float* im, float* out);
+  // Computes |X[k]|^2 for GetNumBins() bins of size real samples
+  void PowerSpectrum(const float* in, float* power);
+  // Returns the smallest power of two >= n (at least 4)
+  static uint32_t NextPowerOfTwo(uint32_t n);
+
+ private:
+  // In-place complex FFT of half_ points on work buffers
+  void complexFFT();
+  // Split step of Forward() for bins [begin, end)
+  void splitBins(float* re, float* im, uint32_t begin, uint32_t end);
+
+ private:
+  // Real transform size
+  uint32_t size_;
+  // Complex transform size
+  uint32_t half_;
+  // Bit reversal permutation of half_ points
+  std::vector<uint32_t> bitrev_;
+  // Per-stage twiddles, stage with butterfly span h starts at offset h - 1
+  std::vector<float> twiddleRe_;
+  std::vector<float> twiddleIm_;
+  // exp(-2*pi*i*k/size_) for the split step
+  std::vector<float> splitRe_;
+  std::vector<float> splitIm_;
+  // Scratch buffers
+  std::vector<float> workRe_;
+  std::vector<float> workIm_;
+  std::vector<float> binRe_;
+  std::vector<float> binIm_;
+};
+
+}  // namespace dsp
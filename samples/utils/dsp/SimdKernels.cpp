@@ -0,0 +1,613 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "SimdKernels.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define DSP_HAVE_AVX 1
+#include <immintrin.h>
+#endif
+// GCC and Clang compile the F16C and AVX-512 kernels for their instruction sets even when the rest
+// of the file does not target them, and use them when the CPU has them
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_HAVE_CPU_DISPATCH 1
+#endif
+// MSVC has no __F16C__, /arch:AVX2 implies it
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define DSP_HAVE_F16C 1
+#define DSP_TARGET_F16C
+#include <immintrin.h>
+#elif DSP_HAVE_CPU_DISPATCH
+#define DSP_HAVE_F16C 1
+#define DSP_TARGET_F16C __attribute__((target("avx,f16c")))
+#include <immintrin.h>
+#endif
+#if defined(__AVX512F__)
+#define DSP_HAVE_AVX512 1
+#define DSP_TARGET_AVX512
+#include <immintrin.h>
+#elif DSP_HAVE_CPU_DISPATCH
+#define DSP_HAVE_AVX512 1
+#define DSP_TARGET_AVX512 __attribute__((target("avx512f")))
+#include <immintrin.h>
+#endif
+// GCC 12 warns about the _mm512_undefined_*() operands inside the AVX-512 intrinsics (GCC bug 105593)
+#if DSP_HAVE_AVX512 && defined(__GNUC__) && !defined(__clang__) && __GNUC__ == 12
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace dsp {
+
+namespace {
+
+const float kLog10Of2 = 0.30102999566f;
+
+#if DSP_HAVE_SSE2
+inline float HorizontalMax(__m128 v) {
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(v);
+}
+
+inline double HorizontalSum(__m128 v) {
+  float lanes[4];
+  _mm_storeu_ps(lanes, v);
+  return static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+}
+
+inline __m128 Abs(__m128 v) {
+  return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+}
+
+// log2(x) for x > 0: exponent from the float bits, mantissa m in [1, 2) through
+// ln(m) = 2 * atanh((m - 1) / (m + 1)) truncated after the y^9 term (error < 1e-6).
+inline __m128 Log2(__m128 x) {
+  __m128i bits = _mm_castps_si128(x);
+  __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+  __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                           _mm_set1_epi32(0x3f800000)));
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 y = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+  __m128 y2 = _mm_mul_ps(y, y);
+  __m128 p = _mm_set1_ps(1.0f / 9.0f);
+  p = _mm_add_ps(_mm_mul_ps(p, y2), _mm_set1_ps(1.0f / 7.0f));
+  p = _mm_add_ps(_mm_mul_ps(p, y2), _mm_set1_ps(1.0f / 5.0f));
+  p = _mm_add_ps(_mm_mul_ps(p, y2), _mm_set1_ps(1.0f / 3.0f));
+  p = _mm_add_ps(_mm_mul_ps(p, y2), one);
+  // 2 / ln(2)
+  __m128 lnm = _mm_mul_ps(_mm_mul_ps(p, y), _mm_set1_ps(2.88539008178f));
+  return _mm_add_ps(exponent, lnm);
+}
+#endif
+
+#if DSP_HAVE_AVX
+inline float HorizontalMax(__m256 v) {
+  return HorizontalMax(_mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+inline double HorizontalSum(__m256 v) {
+  return HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+#endif
+
+inline uint32_t FloatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline float BitsToFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint16_t FloatToHalfScalar(float value) {
+  uint32_t bits = FloatBits(value);
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+  // Infinity, NaN becomes a quiet NaN with the upper payload bits as with F16C
+  if (magnitude >= 0x7f800000)
+    return static_cast<uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 | ((magnitude >> 13) & 0x3ff) : 0));
+  // 65520 and above round to infinity
+  if (magnitude >= 0x477ff000)
+    return static_cast<uint16_t>(sign | 0x7c00);
+  if (magnitude < 0x38800000) {
+    // Subnormal half: multiples of 2^-24, below 2^-25 rounds to zero
+    if (magnitude < 0x33000000)
+      return static_cast<uint16_t>(sign);
+    uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - (magnitude >> 23);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (rest > midpoint || (rest == midpoint && (half & 1)))
+      half++;
+    return static_cast<uint16_t>(sign | half);
+  }
+  // Rebias the exponent from 127 to 15 and round away 13 mantissa bits, a carry moves into the exponent
+  magnitude -= 0x38000000;
+  return static_cast<uint16_t>(sign | ((magnitude + 0xfff + ((magnitude >> 13) & 1)) >> 13));
+}
+
+float HalfToFloatScalar(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0)
+    return BitsToFloat(sign | FloatBits(mantissa * (1.f / 16777216.f)));
+  if (exponent == 31)
+    return BitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+  return BitsToFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t FloatToBFloat16Scalar(float value) {
+  uint32_t bits = FloatBits(value);
+  if ((bits & 0x7fffffff) > 0x7f800000)
+    return static_cast<uint16_t>((bits | 0x400000) >> 16);
+  return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+#if DSP_HAVE_F16C
+bool HasF16c() {
+#if defined(__F16C__) || defined(_MSC_VER)
+  return true;
+#elif defined(__clang__)
+  // Older Clang does not know "f16c", every AVX2 CPU has it
+  static const bool has_f16c = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+  return has_f16c;
+#else
+  static const bool has_f16c = (__builtin_cpu_init(), __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"));
+  return has_f16c;
+#endif
+}
+
+// The kernels below convert from sample i on and return the first sample they left for the next one
+
+DSP_TARGET_F16C size_t FloatToHalfF16c(const float* in, uint16_t* out, size_t i, size_t n) {
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  return i;
+}
+
+DSP_TARGET_F16C size_t HalfToFloatF16c(const uint16_t* in, float* out, size_t i, size_t n) {
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+  return i;
+}
+#endif
+
+#if DSP_HAVE_AVX512
+bool HasAvx512() {
+#if defined(__AVX512F__)
+  return true;
+#else
+  static const bool has_avx512 = (__builtin_cpu_init(), __builtin_cpu_supports("avx512f"));
+  return has_avx512;
+#endif
+}
+
+DSP_TARGET_AVX512 size_t FloatToHalfAvx512(const float* in, uint16_t* out, size_t i, size_t n) {
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  return i;
+}
+
+DSP_TARGET_AVX512 size_t HalfToFloatAvx512(const uint16_t* in, float* out, size_t i, size_t n) {
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))));
+  return i;
+}
+
+DSP_TARGET_AVX512 size_t FloatToBFloat16Avx512(const float* in, uint16_t* out, size_t i, size_t n) {
+  for (; i + 16 <= n; i += 16) {
+    __m512 v = _mm512_loadu_ps(in + i);
+    __m512i bits = _mm512_castps_si512(v);
+    __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+    __m512i rounded = _mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff)));
+    __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+    rounded = _mm512_mask_or_epi32(rounded, nan, bits, _mm512_set1_epi32(0x400000));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtepi32_epi16(_mm512_srli_epi32(rounded, 16)));
+  }
+  return i;
+}
+
+DSP_TARGET_AVX512 size_t BFloat16ToFloatAvx512(const uint16_t* in, float* out, size_t i, size_t n) {
+  for (; i + 16 <= n; i += 16) {
+    __m512i bits = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+    _mm512_storeu_ps(out + i, _mm512_castsi512_ps(_mm512_slli_epi32(bits, 16)));
+  }
+  return i;
+}
+
+DSP_TARGET_AVX512 size_t FloatToInt16Avx512(const float* in, float gain, int16_t* out, size_t i, size_t n) {
+  const __m512 gain16 = _mm512_set1_ps(gain);
+  for (; i + 16 <= n; i += 16) {
+    __m512i q = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_loadu_ps(in + i), gain16));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtsepi32_epi16(q));
+  }
+  return i;
+}
+
+DSP_TARGET_AVX512 size_t Int16ToFloatAvx512(const int16_t* in, float scale, float* out, size_t i, size_t n) {
+  const __m512 scale16 = _mm512_set1_ps(scale);
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+    _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale16));
+  }
+  return i;
+}
+#endif
+
+}  // namespace
+
+float MaxAbsDiff(const float* a, const float* b, size_t n) {
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  size_t i = 0;
+  float result = 0.f;
+  // max drops NaN operands, so NaN differences are collected separately
+#if DSP_HAVE_AVX
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 acc8 = _mm256_setzero_ps();
+  __m256 nan8 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    acc8 = _mm256_max_ps(acc8, _mm256_andnot_ps(sign, d));
+    nan8 = _mm256_or_ps(nan8, _mm256_cmp_ps(d, d, _CMP_UNORD_Q));
+  }
+  if (_mm256_movemask_ps(nan8))
+    return kNaN;
+  result = HorizontalMax(acc8);
+#endif
+#if DSP_HAVE_SSE2
+  __m128 acc4 = _mm_set1_ps(result);
+  __m128 nan4 = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    acc4 = _mm_max_ps(acc4, Abs(d));
+    nan4 = _mm_or_ps(nan4, _mm_cmpunord_ps(d, d));
+  }
+  if (_mm_movemask_ps(nan4))
+    return kNaN;
+  result = HorizontalMax(acc4);
+#endif
+  for (; i < n; i++) {
+    float d = std::fabs(a[i] - b[i]);
+    if (std::isnan(d))
+      return kNaN;
+    result = std::max(result, d);
+  }
+
+  return result;
+}
+
+void SignalErrorEnergy(const float* ref, const float* test, size_t n, double* signalEnergy, double* errorEnergy) {
+  size_t i = 0;
+  double signal = 0.0;
+  double error = 0.0;
+#if DSP_HAVE_AVX
+  __m256 sig8 = _mm256_setzero_ps();
+  __m256 err8 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 r = _mm256_loadu_ps(ref + i);
+    __m256 d = _mm256_sub_ps(r, _mm256_loadu_ps(test + i));
+    sig8 = _mm256_add_ps(sig8, _mm256_mul_ps(r, r));
+    err8 = _mm256_add_ps(err8, _mm256_mul_ps(d, d));
+  }
+  signal += HorizontalSum(sig8);
+  error += HorizontalSum(err8);
+#endif
+#if DSP_HAVE_SSE2
+  __m128 sig4 = _mm_setzero_ps();
+  __m128 err4 = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 r = _mm_loadu_ps(ref + i);
+    __m128 d = _mm_sub_ps(r, _mm_loadu_ps(test + i));
+    sig4 = _mm_add_ps(sig4, _mm_mul_ps(r, r));
+    err4 = _mm_add_ps(err4, _mm_mul_ps(d, d));
+  }
+  signal += HorizontalSum(sig4);
+  error += HorizontalSum(err4);
+#endif
+  for (; i < n; i++) {
+    float d = ref[i] - test[i];
+    signal += ref[i] * ref[i];
+    error += d * d;
+  }
+
+  *signalEnergy += signal;
+  *errorEnergy += error;
+}
+
+void PowerSpectrum(const float* re, const float* im, float* power, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX
+  for (; i + 8 <= n; i += 8) {
+    __m256 r = _mm256_loadu_ps(re + i);
+    __m256 m = _mm256_loadu_ps(im + i);
+    _mm256_storeu_ps(power + i, _mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(m, m)));
+  }
+#endif
+#if DSP_HAVE_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128 r = _mm_loadu_ps(re + i);
+    __m128 m = _mm_loadu_ps(im + i);
+    _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+  }
+#endif
+  for (; i < n; i++)
+    power[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+float LogSpectralDistance(const float* a, const float* b, size_t n, float floor) {
+  if (n == 0)
+    return 0.f;
+
+  size_t i = 0;
+  double sum = 0.0;
+  // 10 * log10(x) = 10 * log10(2) * log2(x), squared below
+  const float scale = 10.0f * kLog10Of2;
+#if DSP_HAVE_SSE2
+  const __m128 floor4 = _mm_set1_ps(floor);
+  const __m128 scale4 = _mm_set1_ps(scale);
+  __m128 acc = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 ratio = _mm_div_ps(_mm_add_ps(_mm_loadu_ps(a + i), floor4), _mm_add_ps(_mm_loadu_ps(b + i), floor4));
+    __m128 db = _mm_mul_ps(Log2(ratio), scale4);
+    acc = _mm_add_ps(acc, _mm_mul_ps(db, db));
+  }
+  sum += HorizontalSum(acc);
+#endif
+  for (; i < n; i++) {
+    float db = 10.0f * std::log10((a[i] + floor) / (b[i] + floor));
+    sum += db * db;
+  }
+
+  return static_cast<float>(std::sqrt(sum / n));
+}
+
+void ApplyWindow(const float* in, const float* window, float* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(window + i)));
+#endif
+#if DSP_HAVE_SSE2
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(window + i)));
+#endif
+  for (; i < n; i++)
+    out[i] = in[i] * window[i];
+}
+
+void EnergyAndPeak(const float* x, size_t n, double* energy, float* peak) {
+  size_t i = 0;
+  double sum = 0.0;
+  float max = *peak;
+#if DSP_HAVE_AVX
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 sum8 = _mm256_setzero_ps();
+  __m256 max8 = _mm256_set1_ps(max);
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(v, v));
+    max8 = _mm256_max_ps(max8, _mm256_andnot_ps(sign, v));
+  }
+  sum += HorizontalSum(sum8);
+  max = HorizontalMax(max8);
+#endif
+#if DSP_HAVE_SSE2
+  __m128 sum4 = _mm_setzero_ps();
+  __m128 max4 = _mm_set1_ps(max);
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(x + i);
+    sum4 = _mm_add_ps(sum4, _mm_mul_ps(v, v));
+    max4 = _mm_max_ps(max4, Abs(v));
+  }
+  sum += HorizontalSum(sum4);
+  max = HorizontalMax(max4);
+#endif
+  for (; i < n; i++) {
+    sum += x[i] * x[i];
+    max = std::max(max, std::fabs(x[i]));
+  }
+
+  *energy += sum;
+  *peak = max;
+}
+
+void WeightedSum(const float* power, const float* weight, size_t n, double* total, double* weighted) {
+  size_t i = 0;
+  double sum = 0.0;
+  double weighted_sum = 0.0;
+#if DSP_HAVE_AVX
+  __m256 sum8 = _mm256_setzero_ps();
+  __m256 weighted8 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 p = _mm256_loadu_ps(power + i);
+    sum8 = _mm256_add_ps(sum8, p);
+    weighted8 = _mm256_add_ps(weighted8, _mm256_mul_ps(p, _mm256_loadu_ps(weight + i)));
+  }
+  sum += HorizontalSum(sum8);
+  weighted_sum += HorizontalSum(weighted8);
+#endif
+#if DSP_HAVE_SSE2
+  __m128 sum4 = _mm_setzero_ps();
+  __m128 weighted4 = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    __m128 p = _mm_loadu_ps(power + i);
+    sum4 = _mm_add_ps(sum4, p);
+    weighted4 = _mm_add_ps(weighted4, _mm_mul_ps(p, _mm_loadu_ps(weight + i)));
+  }
+  sum += HorizontalSum(sum4);
+  weighted_sum += HorizontalSum(weighted4);
+#endif
+  for (; i < n; i++) {
+    sum += power[i];
+    weighted_sum += power[i] * weight[i];
+  }
+
+  *total += sum;
+  *weighted += weighted_sum;
+}
+
+float MaxAbs(const float* x, size_t n) {
+  size_t i = 0;
+  float result = 0.f;
+#if DSP_HAVE_AVX
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 max8 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8)
+    max8 = _mm256_max_ps(max8, _mm256_andnot_ps(sign, _mm256_loadu_ps(x + i)));
+  result = HorizontalMax(max8);
+#endif
+#if DSP_HAVE_SSE2
+  __m128 max4 = _mm_set1_ps(result);
+  for (; i + 4 <= n; i += 4)
+    max4 = _mm_max_ps(max4, Abs(_mm_loadu_ps(x + i)));
+  result = HorizontalMax(max4);
+#endif
+  for (; i < n; i++)
+    result = std::max(result, std::fabs(x[i]));
+  return result;
+}
+
+void FloatToHalf(const float* in, uint16_t* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = FloatToHalfAvx512(in, out, i, n);
+#endif
+#if DSP_HAVE_F16C
+  if (HasF16c())
+    i = FloatToHalfF16c(in, out, i, n);
+#endif
+  for (; i < n; i++)
+    out[i] = FloatToHalfScalar(in[i]);
+}
+
+void HalfToFloat(const uint16_t* in, float* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = HalfToFloatAvx512(in, out, i, n);
+#endif
+#if DSP_HAVE_F16C
+  if (HasF16c())
+    i = HalfToFloatF16c(in, out, i, n);
+#endif
+  for (; i < n; i++)
+    out[i] = HalfToFloatScalar(in[i]);
+}
+
+void FloatToBFloat16(const float* in, uint16_t* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = FloatToBFloat16Avx512(in, out, i, n);
+#endif
+#if DSP_HAVE_SSE2
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i bias = _mm_set1_epi32(0x7fff);
+  const __m128i quiet = _mm_set1_epi32(0x400000);
+  auto round4 = [&](__m128 v) {
+    __m128i bits = _mm_castps_si128(v);
+    __m128i lsb = _mm_and_si128(_mm_srli_epi32(bits, 16), one);
+    __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(lsb, bias));
+    __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(v, v));
+    rounded = _mm_or_si128(_mm_andnot_si128(nan, rounded), _mm_and_si128(nan, _mm_or_si128(bits, quiet)));
+    // Sign extending shift, so the saturating pack keeps all 16 bits
+    return _mm_srai_epi32(rounded, 16);
+  };
+  for (; i + 8 <= n; i += 8) {
+    __m128i low = round4(_mm_loadu_ps(in + i));
+    __m128i high = round4(_mm_loadu_ps(in + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = FloatToBFloat16Scalar(in[i]);
+}
+
+void BFloat16ToFloat(const uint16_t* in, float* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = BFloat16ToFloatAvx512(in, out, i, n);
+#endif
+#if DSP_HAVE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_ps(out + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, v)));
+    _mm_storeu_ps(out + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, v)));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = BitsToFloat(static_cast<uint32_t>(in[i]) << 16);
+}
+
+void FloatToInt16(const float* in, float gain, int16_t* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = FloatToInt16Avx512(in, gain, out, i, n);
+#endif
+#if DSP_HAVE_SSE2
+  // Converts with the current rounding mode, round to nearest even by default
+  const __m128 gain4 = _mm_set1_ps(gain);
+  for (; i + 8 <= n; i += 8) {
+    __m128i low = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), gain4));
+    __m128i high = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), gain4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(low, high));
+  }
+#endif
+  for (; i < n; i++) {
+    float value = std::nearbyint(in[i] * gain);
+    out[i] = static_cast<int16_t>(std::max(-32768.f, std::min(32767.f, value)));
+  }
+}
+
+void Int16ToFloat(const int16_t* in, float scale, float* out, size_t n) {
+  size_t i = 0;
+#if DSP_HAVE_AVX512
+  if (HasAvx512())
+    i = Int16ToFloatAvx512(in, scale, out, i, n);
+#endif
+#if DSP_HAVE_SSE2
+  const __m128 scale4 = _mm_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    // Sign extension: the samples into the upper halves, then an arithmetic shift
+    __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale4));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale4));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = in[i] * scale;
+}
+
+}  // namespace dsp
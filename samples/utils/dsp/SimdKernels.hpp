@@ -0,0 +1,51 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorized float kernels used by the sample utilities. SSE2 is used on x86-64 and AVX when the
+// compiler targets it. The F16C and AVX-512 conversions are used when the compiler targets them or,
+// with GCC and Clang, when the CPU has them. A scalar fallback is used everywhere else.
+namespace dsp {
+
+// Returns max(|a[i] - b[i]|), NaN if any difference is NaN
+float MaxAbsDiff(const float* a, const float* b, size_t n);
+// Accumulates sum(ref[i]^2) into signalEnergy and sum((ref[i] - test[i])^2) into errorEnergy
+void SignalErrorEnergy(const float* ref, const float* test, size_t n, double* signalEnergy, double* errorEnergy);
+// Writes re[i]^2 + im[i]^2 into power
+void PowerSpectrum(const float* re, const float* im, float* power, size_t n);
+// Returns sqrt(mean((10 * log10((a[i] + floor) / (b[i] + floor)))^2)) in dB
+float LogSpectralDistance(const float* a, const float* b, size_t n, float floor);
+// Multiplies in by window into out
+void ApplyWindow(const float* in, const float* window, float* out, size_t n);
+// Accumulates sum(x[i]^2) into energy, raises peak to max(|x[i]|)
+void EnergyAndPeak(const float* x, size_t n, double* energy, float* peak);
+// Accumulates sum(power[i]) into total and sum(power[i] * weight[i]) into weighted
+void WeightedSum(const float* power, const float* weight, size_t n, double* total, double* weighted);
+// Returns max(|x[i]|)
+float MaxAbs(const float* x, size_t n);
+
+// Reduced precision formats of pipeline::PackedFrames. All round to nearest even, the vector and
+// scalar paths give the same bits.
+// IEEE half precision, values beyond its range become infinity
+void FloatToHalf(const float* in, uint16_t* out, size_t n);
+void HalfToFloat(const uint16_t* in, float* out, size_t n);
+// bfloat16, the upper 16 bits of the float
+void FloatToBFloat16(const float* in, uint16_t* out, size_t n);
+void BFloat16ToFloat(const uint16_t* in, float* out, size_t n);
+// out[i] = in[i] * gain saturated to int16. Non-finite samples are not preserved.
+void FloatToInt16(const float* in, float gain, int16_t* out, size_t n);
+// out[i] = in[i] * scale
+void Int16ToFloat(const int16_t* in, float scale, float* out, size_t n);
+
+}  // namespace dsp
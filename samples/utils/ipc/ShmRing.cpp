@@ -0,0 +1,525 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "ShmRing.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IPC_HAVE_PAUSE 1
+#endif
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Rings need lock free atomics, they are shared between processes");
+
+namespace ipc {
+
+namespace {
+
+const char kScheme[] = "shm://";
+const uint32_t kMagic = 0x4e414652;  // "NAFR"
+const uint32_t kVersion = 1;
+const size_t kCacheLine = 64;
+// Sleeps are bounded so a peer that exited without closing is noticed
+const int64_t kMaxSleepNs = 100000000;
+
+// Precedes the samples of every slot
+struct alignas(kCacheLine) SlotHeader {
+  uint32_t num_samples;
+  int64_t publish_ns;
+};
+
+// POSIX names are one path component, the ring's lives under /dev/shm on Linux
+std::string GetSegmentName(const std::string& name) { return "/nvafx." + name; }
+
+bool IsValidName(const std::string& name) {
+  return !name.empty() && name.size() < 200 && std::all_of(name.begin(), name.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+  });
+}
+
+inline void CpuRelax() {
+#ifdef IPC_HAVE_PAUSE
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+#ifdef __linux__
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected, int64_t timeout_ns) {
+  timespec timeout;
+  timeout.tv_sec = static_cast<time_t>(timeout_ns / 1000000000);
+  timeout.tv_nsec = static_cast<long>(timeout_ns % 1000000000);
+  // Not FUTEX_PRIVATE_FLAG, the word is shared with another process
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+#else
+// Other systems have no futex on shared memory, the waiter polls
+void FutexWait(std::atomic<uint32_t>*, uint32_t, int64_t timeout_ns) {
+  std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(timeout_ns, 200000)));
+}
+
+void FutexWake(std::atomic<uint32_t>*) {}
+#endif
+
+}  // namespace
+
+// At the start of the segment, the slots follow at data_offset
+struct ShmRing::Header {
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t sample_rate;
+  uint32_t num_channels;
+  uint32_t frame_samples;
+  uint32_t num_slots;
+  uint64_t slot_bytes;
+  uint64_t data_offset;
+  uint64_t segment_bytes;
+  // Process ids of the attached sides by RingRole, 0 before attaching
+  std::atomic<int32_t> pids[2];
+  // Bit 1 << RingRole once a side closed
+  std::atomic<uint32_t> closed;
+  // Frames published, advanced by the producer
+  alignas(kCacheLine) std::atomic<uint32_t> head;
+  std::atomic<uint32_t> consumer_wake;
+  std::atomic<uint32_t> consumer_waiting;
+  // Frames released, advanced by the consumer
+  alignas(kCacheLine) std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> producer_wake;
+  std::atomic<uint32_t> producer_waiting;
+};
+
+bool IsShmUrl(const std::string& text) { return text.compare(0, sizeof(kScheme) - 1, kScheme) == 0; }
+
+bool ParseShmUrl(const std::string& url, ShmUrl* parsed) {
+  if (!IsShmUrl(url)) {
+    std::cerr << "Not an shm:// URL: " << url << std::endl;
+    return false;
+  }
+  std::string name = url.substr(sizeof(kScheme) - 1);
+  std::string query;
+  std::size_t query_pos = name.find('?');
+  if (query_pos != std::string::npos) {
+    query = name.substr(query_pos + 1);
+    name.resize(query_pos);
+  }
+  if (!IsValidName(name)) {
+    std::cerr << "Invalid ring name in " << url << ", use letters, digits, '_', '-' and '.'" << std::endl;
+    return false;
+  }
+  parsed->name = name;
+
+  std::size_t begin = 0;
+  while (begin < query.size()) {
+    std::size_t end = query.find('&', begin);
+    if (end == std::string::npos)
+      end = query.size();
+    std::string option = query.substr(begin, end - begin);
+    begin = end + 1;
+    std::size_t equals = option.find('=');
+    std::string key = option.substr(0, equals);
+    std::string value = equals == std::string::npos ? std::string() : option.substr(equals + 1);
+    double number = std::strtod(value.c_str(), nullptr);
+    if (key == "slots" && number >= 2 && number <= 4096) {
+      parsed->num_slots = static_cast<uint32_t>(number);
+    } else if (key == "wait_ms" && number > 0) {
+      parsed->wait_ms = number;
+    } else if (key == "spin_us" && number >= 0) {
+      parsed->spin_us = number;
+    } else {
+      std::cerr << "Invalid option " << option << " in " << url << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int64_t ShmRing::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+ShmRing::ShmRing(const std::string& name, RingRole role, bool owner, double spin_us)
+  : name_(name)
+  , role_(role)
+  , owner_(owner)
+  // With one core spinning only delays the other side
+  , max_spin_ns_(std::thread::hardware_concurrency() > 1 ? static_cast<int64_t>(spin_us * 1000.0) : 0)
+  , spin_ns_(max_spin_ns_) {}
+
+#ifdef _WIN32
+
+ShmRing::~ShmRing() {}
+
+std::unique_ptr<ShmRing> ShmRing::Create(const std::string& name, const RingLayout&, RingRole, double) {
+  std::cerr << "Shared memory rings are not supported on Windows: " << name << std::endl;
+  return nullptr;
+}
+
+std::unique_ptr<ShmRing> ShmRing::Open(const std::string& name, RingRole, double, double) {
+  std::cerr << "Shared memory rings are not supported on Windows: " << name << std::endl;
+  return nullptr;
+}
+
+float* ShmRing::BeginWrite(double) { return nullptr; }
+void ShmRing::EndWrite(uint32_t) {}
+const float* ShmRing::BeginRead(double, uint32_t*, int64_t*) { return nullptr; }
+void ShmRing::EndRead() {}
+void ShmRing::Close() {}
+bool ShmRing::IsEnded() const { return true; }
+
+#else
+
+ShmRing::~ShmRing() {
+  if (!header_)
+    return;
+  Close();
+  header_->pids[static_cast<int>(role_)].store(0);
+  munmap(header_, mapped_bytes_);
+  if (owner_)
+    shm_unlink(GetSegmentName(name_).c_str());
+}
+
+bool ShmRing::map(int fd, size_t bytes) {
+  void* address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED) {
+    std::cerr << "Unable to map ring " << name_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  header_ = static_cast<Header*>(address);
+  mapped_bytes_ = bytes;
+  return true;
+}
+
+bool ShmRing::attach() {
+  int32_t expected = 0;
+  if (!header_->pids[static_cast<int>(role_)].compare_exchange_strong(expected, static_cast<int32_t>(getpid()))) {
+    std::cerr << "Ring " << name_ << " already has a " << (role_ == RingRole::kProducer ? "producer" : "consumer")
+              << " (process " << expected << ")" << std::endl;
+    return false;
+  }
+  layout_.sample_rate = header_->sample_rate;
+  layout_.num_channels = header_->num_channels;
+  layout_.frame_samples = header_->frame_samples;
+  layout_.num_slots = header_->num_slots;
+  slot_bytes_ = header_->slot_bytes;
+  index_ = role_ == RingRole::kProducer ? header_->head.load() : header_->tail.load();
+  stats_.spin_us = spin_ns_ / 1000.0;
+  return true;
+}
+
+std::unique_ptr<ShmRing> ShmRing::Create(const std::string& name, const RingLayout& layout, RingRole role,
+                                         double spin_us) {
+  if (!IsValidName(name) || layout.num_channels == 0 || layout.frame_samples == 0 || layout.num_slots < 2) {
+    std::cerr << "Invalid ring " << name << std::endl;
+    return nullptr;
+  }
+  const std::string segment = GetSegmentName(name);
+  // A ring of a process that crashed keeps its name until removed
+  shm_unlink(segment.c_str());
+  int fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    std::cerr << "Unable to create ring " << name << ": " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  const size_t data_offset = (sizeof(Header) + kCacheLine - 1) / kCacheLine * kCacheLine;
+  const size_t slot_bytes = (sizeof(SlotHeader) + sizeof(float) * layout.num_channels * layout.frame_samples +
+                             kCacheLine - 1) / kCacheLine * kCacheLine;
+  const size_t segment_bytes = data_offset + slot_bytes * layout.num_slots;
+  std::unique_ptr<ShmRing> ring(new ShmRing(name, role, true, spin_us));
+  bool mapped = ftruncate(fd, static_cast<off_t>(segment_bytes)) == 0 && ring->map(fd, segment_bytes);
+  if (!mapped && !ring->header_)
+    std::cerr << "Unable to size ring " << name << ": " << std::strerror(errno) << std::endl;
+  close(fd);
+  if (!mapped) {
+    shm_unlink(segment.c_str());
+    return nullptr;
+  }
+  // The new pages are zero, so are the counters and pids
+  Header* header = new (ring->header_) Header();
+  header->version = kVersion;
+  header->sample_rate = layout.sample_rate;
+  header->num_channels = layout.num_channels;
+  header->frame_samples = layout.frame_samples;
+  header->num_slots = layout.num_slots;
+  header->slot_bytes = slot_bytes;
+  header->data_offset = data_offset;
+  header->segment_bytes = segment_bytes;
+  // Published last, Open() waits for it
+  header->magic.store(kMagic, std::memory_order_release);
+  if (!ring->attach())
+    return nullptr;
+  return ring;
+}
+
+std::unique_ptr<ShmRing> ShmRing::Open(const std::string& name, RingRole role, double wait_ms, double spin_us) {
+  if (!IsValidName(name)) {
+    std::cerr << "Invalid ring " << name << std::endl;
+    return nullptr;
+  }
+  const std::string segment = GetSegmentName(name);
+  const int64_t deadline = Now() + static_cast<int64_t>(wait_ms * 1e6);
+  std::unique_ptr<ShmRing> ring(new ShmRing(name, role, false, spin_us));
+  while (true) {
+    int fd = shm_open(segment.c_str(), O_RDWR, 0);
+    if (fd >= 0) {
+      struct stat status;
+      if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header)) {
+        bool mapped = ring->map(fd, static_cast<size_t>(status.st_size));
+        close(fd);
+        if (!mapped)
+          return nullptr;
+        if (ring->header_->magic.load(std::memory_order_acquire) == kMagic)
+          break;
+        munmap(ring->header_, ring->mapped_bytes_);
+        ring->header_ = nullptr;
+      } else {
+        close(fd);
+      }
+    } else if (errno != ENOENT) {
+      std::cerr << "Unable to open ring " << name << ": " << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    if (Now() >= deadline) {
+      std::cerr << "Timed out waiting for ring " << name << std::endl;
+      return nullptr;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const Header* header = ring->header_;
+  if (header->version != kVersion || header->segment_bytes > ring->mapped_bytes_ ||
+      header->data_offset + header->slot_bytes * header->num_slots > header->segment_bytes) {
+    std::cerr << "Ring " << name << " has an unknown layout" << std::endl;
+    return nullptr;
+  }
+  if (!ring->attach())
+    return nullptr;
+  return ring;
+}
+
+float* ShmRing::slotData(uint32_t index) const {
+  uint8_t* slot = reinterpret_cast<uint8_t*>(header_) + header_->data_offset +
+                  static_cast<size_t>(index % layout_.num_slots) * slot_bytes_;
+  return reinterpret_cast<float*>(slot + sizeof(SlotHeader));
+}
+
+bool ShmRing::peerClosed() const {
+  const int peer = role_ == RingRole::kProducer ? static_cast<int>(RingRole::kConsumer)
+                                                : static_cast<int>(RingRole::kProducer);
+  return (header_->closed.load(std::memory_order_acquire) & (1u << peer)) != 0;
+}
+
+bool ShmRing::peerGone() const {
+  if (peer_gone_)
+    return true;
+  const int peer = role_ == RingRole::kProducer ? static_cast<int>(RingRole::kConsumer)
+                                                : static_cast<int>(RingRole::kProducer);
+  if (peerClosed()) {
+    peer_gone_ = true;
+  } else if (int32_t pid = header_->pids[peer].load()) {
+    peer_attached_ = true;
+    // Exited without closing, e.g. killed
+    peer_gone_ = kill(pid, 0) != 0 && errno == ESRCH;
+  } else {
+    // Detached after closing, or not attached yet
+    peer_gone_ = peer_attached_;
+  }
+  return peer_gone_;
+}
+
+template <typename Ready>
+bool ShmRing::wait(std::atomic<uint32_t>& wake_word, std::atomic<uint32_t>& waiting, double timeout_ms,
+                   Ready ready) {
+  if (ready())
+    return true;
+  const int64_t begin = Now();
+  if (spin_ns_ > 0) {
+    int64_t elapsed = 0;
+    while (elapsed < spin_ns_) {
+      for (int i = 0; i < 32; i++)
+        CpuRelax();
+      if (ready()) {
+        // Spin a little longer than waits have taken lately
+        spin_ns_ = std::max(max_spin_ns_ / 16, std::min(max_spin_ns_, spin_ns_ + (2 * elapsed - spin_ns_) / 4));
+        stats_.spin_waits++;
+        return true;
+      }
+      elapsed = Now() - begin;
+    }
+    // The other side runs at a slower pace, spinning would only burn the core
+    spin_ns_ = std::max(max_spin_ns_ / 16, spin_ns_ / 2);
+  }
+  stats_.sleep_waits++;
+  const int64_t deadline =
+    timeout_ms < 0.0 ? std::numeric_limits<int64_t>::max() : begin + static_cast<int64_t>(timeout_ms * 1e6);
+  while (true) {
+    // Registered before the last check, the other side then bumps wake_word after its change
+    waiting.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t observed = wake_word.load();
+    if (ready() || peerGone()) {
+      waiting.store(0, std::memory_order_relaxed);
+      return ready();
+    }
+    int64_t now = Now();
+    if (now >= deadline) {
+      waiting.store(0, std::memory_order_relaxed);
+      return false;
+    }
+    FutexWait(&wake_word, observed, std::min(deadline - now, kMaxSleepNs));
+    waiting.store(0, std::memory_order_relaxed);
+    if (ready())
+      return true;
+  }
+}
+
+void ShmRing::notify(std::atomic<uint32_t>& wake_word, std::atomic<uint32_t>& waiting) {
+  // Pairs with the fence in wait(): either the waiter sees the change or this sees the waiter
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed)) {
+    wake_word.fetch_add(1);
+    FutexWake(&wake_word);
+    stats_.wakes++;
+  }
+}
+
+float* ShmRing::BeginWrite(double timeout_ms) {
+  if (closed_)
+    return nullptr;
+  const uint32_t num_slots = layout_.num_slots;
+  // Also ends the wait when the consumer closed, peerGone() tells
+  bool ready = wait(header_->producer_wake, header_->producer_waiting, timeout_ms, [this, num_slots] {
+    return index_ - header_->tail.load(std::memory_order_acquire) < num_slots;
+  });
+  if (!ready || peerClosed())
+    return nullptr;
+  in_slot_ = true;
+  return slotData(index_);
+}
+
+void ShmRing::EndWrite(uint32_t num_samples) {
+  if (!in_slot_)
+    return;
+  float* data = slotData(index_);
+  num_samples = std::min(num_samples, layout_.frame_samples);
+  if (num_samples < layout_.frame_samples) {
+    for (uint32_t ch = 0; ch < layout_.num_channels; ch++)
+      std::fill(GetChannel(data, ch) + num_samples, GetChannel(data, ch) + layout_.frame_samples, 0.f);
+  }
+  SlotHeader* slot = reinterpret_cast<SlotHeader*>(data) - 1;
+  slot->num_samples = num_samples;
+  slot->publish_ns = Now();
+  header_->head.store(++index_, std::memory_order_release);
+  in_slot_ = false;
+  stats_.frames++;
+  notify(header_->consumer_wake, header_->consumer_waiting);
+}
+
+const float* ShmRing::BeginRead(double timeout_ms, uint32_t* num_samples, int64_t* publish_ns) {
+  if (closed_)
+    return nullptr;
+  // Ready when a frame is there, or the producer closed (peerGone() after the frames were read)
+  bool ready = wait(header_->consumer_wake, header_->consumer_waiting, timeout_ms, [this] {
+    return header_->head.load(std::memory_order_acquire) != index_;
+  });
+  if (!ready)
+    return nullptr;
+  const float* data = slotData(index_);
+  const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(data) - 1;
+  *num_samples = slot->num_samples;
+  if (publish_ns)
+    *publish_ns = slot->publish_ns;
+  in_slot_ = true;
+  return data;
+}
+
+void ShmRing::EndRead() {
+  if (!in_slot_)
+    return;
+  header_->tail.store(++index_, std::memory_order_release);
+  in_slot_ = false;
+  stats_.frames++;
+  notify(header_->producer_wake, header_->producer_waiting);
+}
+
+void ShmRing::Close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  header_->closed.fetch_or(1u << static_cast<int>(role_));
+  // Unconditional, a waiter may be between its check and its sleep
+  header_->consumer_wake.fetch_add(1);
+  header_->producer_wake.fetch_add(1);
+  FutexWake(&header_->consumer_wake);
+  FutexWake(&header_->producer_wake);
+}
+
+bool ShmRing::IsEnded() const {
+  if (role_ == RingRole::kConsumer && header_->head.load(std::memory_order_acquire) != index_)
+    return false;
+  return closed_ || peerGone();
+}
+
+#endif
+
+RingStats ShmRing::GetStats() const {
+  RingStats stats = stats_;
+  stats.spin_us = spin_ns_ / 1000.0;
+  return stats;
+}
+
+void ShmRing::PrintReport(std::ostream& out, const std::string& label) const {
+  RingStats stats = GetStats();
+  const uint64_t waits = stats.spin_waits + stats.sleep_waits;
+  out << label << " ring " << name_ << ": " << stats.frames << " frames of " << layout_.frame_samples << " x "
+      << layout_.num_channels << " samples, " << waits << " waits (" << stats.spin_waits << " ended spinning, "
+      << stats.sleep_waits << " slept), " << stats.wakes << " wakes sent, spin limit " << std::fixed
+      << std::setprecision(1) << stats.spin_us << " us" << std::endl;
+  out.unsetf(std::ios::fixed);
+}
+
+std::unique_ptr<ShmRing> CreateShmRing(const std::string& url, RingLayout layout, RingRole role, double* wait_ms) {
+  ShmUrl parsed;
+  if (!ParseShmUrl(url, &parsed))
+    return nullptr;
+  layout.num_slots = parsed.num_slots;
+  if (wait_ms)
+    *wait_ms = parsed.wait_ms;
+  return ShmRing::Create(parsed.name, layout, role, parsed.spin_us);
+}
+
+}  // namespace ipc
@@ -0,0 +1,151 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Audio frames between processes on one machine through POSIX shared memory, one single producer,
+// single consumer ring per stream. A slot holds one frame in the planar layout NvAFX_Run() takes,
+// channel c at GetChannel(slot, c), so the effects process runs the effect on the slots of its
+// input ring and writes straight into the slots of its output ring. A waiting side spins for a
+// while adapted to how long its recent waits took, then sleeps on a futex (Linux) which the other
+// side only wakes when a waiter is registered. Streams are named by URLs:
+//   shm://name?slots=8&wait_ms=10000&spin_us=50
+// The process that knows the frame layout (effects_demo, from the effect) creates the ring, the
+// other attaches by name. Not available on Windows.
+namespace ipc {
+
+struct ShmUrl {
+  std::string name;
+  uint32_t num_slots = 8;
+  // For the other side to attach and send its first frame
+  double wait_ms = 10000.0;
+  // Longest spin before sleeping, 0 to sleep at once
+  double spin_us = 50.0;
+};
+
+// True for shm:// URLs
+bool IsShmUrl(const std::string& text);
+// Returns false and prints the reason if url is malformed
+bool ParseShmUrl(const std::string& url, ShmUrl* parsed);
+
+enum class RingRole {
+  kProducer,
+  kConsumer,
+};
+
+struct RingLayout {
+  uint32_t sample_rate = 48000;
+  uint32_t num_channels = 1;
+  // Samples per channel of a frame
+  uint32_t frame_samples = 480;
+  uint32_t num_slots = 8;
+};
+
+struct RingStats {
+  uint64_t frames = 0;
+  // Waits which ended while spinning, and those which slept
+  uint64_t spin_waits = 0;
+  uint64_t sleep_waits = 0;
+  // Futex wakes issued for the other side
+  uint64_t wakes = 0;
+  // Current spin limit
+  double spin_us = 0.0;
+};
+
+class ShmRing {
+ public:
+  ~ShmRing();
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  // Creates the segment name, replacing one left by a crashed process, and attaches as role
+  static std::unique_ptr<ShmRing> Create(const std::string& name, const RingLayout& layout, RingRole role,
+                                         double spin_us);
+  // Attaches as role to the segment name, waiting up to wait_ms for another process to create it
+  static std::unique_ptr<ShmRing> Open(const std::string& name, RingRole role, double wait_ms, double spin_us);
+
+  const RingLayout& GetLayout() const { return layout_; }
+  float* GetChannel(float* slot, uint32_t channel) const { return slot + channel * layout_.frame_samples; }
+  const float* GetChannel(const float* slot, uint32_t channel) const {
+    return slot + channel * layout_.frame_samples;
+  }
+
+  // Producer: the next free slot, waiting up to timeout_ms while the ring is full. nullptr on
+  // timeout or when the consumer is gone. Timeouts below 0 wait until the other side ends.
+  float* BeginWrite(double timeout_ms);
+  // Publishes the slot with num_samples samples per channel, the rest of each channel is zeroed
+  void EndWrite(uint32_t num_samples);
+  // Consumer: the next frame and its samples per channel, waiting up to timeout_ms. nullptr on
+  // timeout or at the end of the stream, see IsEnded(). publish_ns is Now() of EndWrite().
+  const float* BeginRead(double timeout_ms, uint32_t* num_samples, int64_t* publish_ns = nullptr);
+  // Returns the slot to the producer
+  void EndRead();
+  // This side is done, the other side's waits return
+  void Close();
+
+  // The other side closed, or its process exited, and for the consumer every frame was read
+  bool IsEnded() const;
+
+  RingStats GetStats() const;
+  void PrintReport(std::ostream& out, const std::string& label) const;
+
+  // Nanoseconds on the monotonic clock, comparable between processes
+  static int64_t Now();
+
+ private:
+  struct Header;
+
+  ShmRing(const std::string& name, RingRole role, bool owner, double spin_us);
+  bool map(int fd, size_t bytes);
+  bool attach();
+  float* slotData(uint32_t index) const;
+  // Waits until ready() or timeout. wake_word is bumped by the other side when it changes the state.
+  template <typename Ready>
+  bool wait(std::atomic<uint32_t>& wake_word, std::atomic<uint32_t>& waiting, double timeout_ms, Ready ready);
+  void notify(std::atomic<uint32_t>& wake_word, std::atomic<uint32_t>& waiting);
+  bool peerClosed() const;
+  // Closed, or its process exited (a system call, only checked before sleeping)
+  bool peerGone() const;
+
+ private:
+  const std::string name_;
+  const RingRole role_;
+  // The creator removes the name when it detaches
+  const bool owner_;
+  RingLayout layout_;
+  Header* header_ = nullptr;
+  size_t mapped_bytes_ = 0;
+  size_t slot_bytes_ = 0;
+  // Frames this side published or released, the ring counters only this side advances
+  uint32_t index_ = 0;
+  bool in_slot_ = false;
+  bool closed_ = false;
+  mutable bool peer_attached_ = false;
+  mutable bool peer_gone_ = false;
+  const int64_t max_spin_ns_;
+  int64_t spin_ns_;
+  RingStats stats_;
+};
+
+// Parses url and creates the ring with the layout of the effect's frames (slot count from the URL),
+// nullptr if that fails
+std::unique_ptr<ShmRing> CreateShmRing(const std::string& url, RingLayout layout, RingRole role,
+                                       double* wait_ms = nullptr);
+
+}  // namespace ipc
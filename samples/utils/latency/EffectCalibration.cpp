@@ -0,0 +1,71 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "EffectCalibration.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <utils/pipeline/EffectPipeline.hpp>
+#include <utils/pipeline/FrameStages.hpp>
+#include <utils/pipeline/RunStage.hpp>
+#include <utils/replay/CapturedCalls.hpp>
+#include <utils/trace/Trace.hpp>
+
+namespace latency {
+
+bool CalibrateEffect(NvAFX_Handle handle, const startup::EffectProperties& properties, double max_delay_secs,
+                     DelayEstimate* estimate) {
+  TRACE_SCOPE("calibrate_latency");
+  const unsigned num_input_channels = properties.num_input_channels;
+  const unsigned num_output_channels = properties.num_output_channels;
+  const unsigned input_frame_samples = properties.num_input_samples_per_frame;
+  const unsigned output_frame_samples = properties.num_output_samples_per_frame;
+  if (!pipeline::IsSupportedLayout(num_input_channels, num_output_channels)) {
+    std::cerr << "Unsupported channel layout: " << num_input_channels << " in, " << num_output_channels << " out"
+              << std::endl;
+    return false;
+  }
+  ProbeSignal probe(std::min(properties.input_sample_rate, properties.output_sample_rate), max_delay_secs);
+  std::vector<float> input = probe.Render(properties.input_sample_rate);
+  size_t num_frames = (input.size() + input_frame_samples - 1) / input_frame_samples;
+  input.resize(num_frames * input_frame_samples, 0.f);
+  std::vector<float> farend(num_input_channels > 1 ? input.size() : 0, 0.f);
+  std::vector<float> output(num_frames * output_frame_samples);
+  std::vector<float> frame(output_frame_samples * num_output_channels);
+  const float* inputs[2] = { input.data(), farend.data() };
+  float* outputs[1] = { frame.data() };
+  std::cout << "Calibrating latency with " << probe.GetProbes().size() << " probes, " << probe.GetDurationSecs()
+            << " secs of audio" << std::endl;
+
+  pipeline::CollectStage collect_stage(output.data(), 0, output_frame_samples, num_output_channels);
+  auto run_probe = [&](auto& run_stage) {
+    return pipeline::Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs, outputs, 0,
+                              input.size(), run_stage, collect_stage);
+  };
+  NvAFX_Status status = replay::CapturedReset(handle);
+  if (status == NVAFX_STATUS_SUCCESS) {
+    if (!pipeline::WithRunStage(handle, input_frame_samples, output_frame_samples, run_probe))
+      return false;
+    status = replay::CapturedReset(handle);
+  }
+  if (status != NVAFX_STATUS_SUCCESS) {
+    std::cerr << "NvAFX_Reset() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_Reset", status);
+    return false;
+  }
+
+  *estimate = EstimateDelay(probe, output.data(), output.size(), properties.output_sample_rate);
+  estimate->Print(std::cout, properties.output_sample_rate);
+  return true;
+}
+
+}  // namespace latency
@@ -0,0 +1,27 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <nvAudioEffects.h>
+
+#include <utils/startup/StartupProfile.hpp>
+
+#include "LatencyCalibration.hpp"
+
+namespace latency {
+
+// Runs a ProbeSignal covering delays up to max_delay_secs through the loaded effect and estimates
+// the delay of its output. Probes go to the first input channel, a far end stays silent. The handle
+// starts and ends the calibration from a reset state. Prints the estimate.
+bool CalibrateEffect(NvAFX_Handle handle, const startup::EffectProperties& properties, double max_delay_secs,
+                     DelayEstimate* estimate);
+
+}  // namespace latency
@@ -0,0 +1,278 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "LatencyCalibration.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <utils/dsp/RealFFT.hpp>
+
+namespace latency {
+
+namespace {
+
+const char kTableHeader[] = "# effects_demo latency table v1";
+const double kPi = 3.14159265358979323846;
+// Silence before the first probe, so a reset effect has settled
+const double kLeadSecs = 0.5;
+// Silence after each probe on top of the max delay
+const double kGapSecs = 0.2;
+// Earliest delay searched, effects may be slightly non-causal after resampling
+const double kMinDelaySecs = -0.005;
+
+// Raised cosine fade in and out over fade_secs
+double Fade(double t, double duration, double fade_secs) {
+  double edge = std::min(t, duration - t);
+  if (edge >= fade_secs)
+    return 1.0;
+  return edge <= 0.0 ? 0.0 : 0.5 - 0.5 * std::cos(kPi * edge / fade_secs);
+}
+
+// First sample at or after secs
+int64_t FirstSample(double secs, uint32_t sample_rate) {
+  return static_cast<int64_t>(std::ceil(secs * sample_rate - 1e-9));
+}
+
+// Effect and model key and the sample rates, as the first three fields of a table line
+std::string MakeTableKey(const std::string& key, uint32_t input_sample_rate, uint32_t output_sample_rate) {
+  return key + ' ' + std::to_string(input_sample_rate) + ' ' + std::to_string(output_sample_rate);
+}
+
+}  // namespace
+
+const char* GetProbeKindName(ProbeKind kind) {
+  switch (kind) {
+  case ProbeKind::kImpulse:
+    return "impulse";
+  case ProbeKind::kChirp:
+    return "chirp";
+  default:
+    return "voice";
+  }
+}
+
+ProbeSignal::ProbeSignal(uint32_t bandwidth_rate, double max_delay_secs)
+  : max_frequency_(0.4 * bandwidth_rate), max_delay_secs_(max_delay_secs) {
+  // Each kind twice, a single miss still leaves a median
+  const ProbeKind kKinds[] = { ProbeKind::kImpulse, ProbeKind::kChirp, ProbeKind::kVoice,
+                               ProbeKind::kImpulse, ProbeKind::kChirp, ProbeKind::kVoice };
+  double t = kLeadSecs;
+  for (ProbeKind kind : kKinds) {
+    double duration = kind == ProbeKind::kImpulse ? 0.002 : kind == ProbeKind::kChirp ? 0.5 : 0.6;
+    probes_.push_back({ kind, t, duration });
+    t += duration + max_delay_secs_ + kGapSecs;
+  }
+  duration_secs_ = t;
+}
+
+double ProbeSignal::value(const Probe& probe, double t) const {
+  if (t < 0.0 || t >= probe.duration_secs)
+    return 0.0;
+  const double duration = probe.duration_secs;
+  switch (probe.kind) {
+  case ProbeKind::kImpulse:
+    return 0.8 * (0.5 - 0.5 * std::cos(2.0 * kPi * t / duration));
+  case ProbeKind::kChirp: {
+    const double f0 = 100.0;
+    const double rate = std::log(max_frequency_ / f0);
+    double phase = 2.0 * kPi * f0 * duration / rate * (std::exp(t * rate / duration) - 1.0);
+    return 0.5 * std::sin(phase) * Fade(t, duration, 0.01);
+  }
+  default: {
+    // Fundamental glides from 110 to 160 Hz, harmonics fall off as 1/k like a glottal pulse train
+    double phase = 2.0 * kPi * (110.0 * t + 25.0 * t * t / duration);
+    int num_harmonics = std::max(1, std::min(30, static_cast<int>(max_frequency_ / 160.0)));
+    double sum = 0.0;
+    for (int k = 1; k <= num_harmonics; k++)
+      sum += std::sin(k * phase) / k;
+    double envelope = 0.6 + 0.4 * std::sin(2.0 * kPi * 4.0 * t);
+    return 0.2 * envelope * sum * Fade(t, duration, 0.02);
+  }
+  }
+}
+
+std::vector<float> ProbeSignal::Render(uint32_t sample_rate) const {
+  std::vector<float> samples(static_cast<size_t>(FirstSample(duration_secs_, sample_rate)));
+  for (const Probe& probe : probes_) {
+    for (int64_t n = FirstSample(probe.begin_secs, sample_rate); n < static_cast<int64_t>(samples.size()); n++) {
+      double t = static_cast<double>(n) / sample_rate - probe.begin_secs;
+      if (t >= probe.duration_secs)
+        break;
+      samples[n] = static_cast<float>(value(probe, t));
+    }
+  }
+  return samples;
+}
+
+std::vector<float> ProbeSignal::RenderProbe(size_t index, uint32_t sample_rate) const {
+  const Probe& probe = probes_[index];
+  int64_t first = FirstSample(probe.begin_secs, sample_rate);
+  std::vector<float> samples(static_cast<size_t>(FirstSample(probe.begin_secs + probe.duration_secs, sample_rate) -
+                                                 first));
+  for (size_t i = 0; i < samples.size(); i++)
+    samples[i] = static_cast<float>(value(probe, static_cast<double>(first + i) / sample_rate - probe.begin_secs));
+  return samples;
+}
+
+void DelayEstimate::Print(std::ostream& out, uint32_t sample_rate) const {
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::left << "  " << std::setw(10) << "Probe" << std::setw(14) << "Delay (ms)" << std::setw(12)
+      << "Samples" << "Confidence" << std::endl;
+  for (const ProbeResult& probe : probes) {
+    out << "  " << std::setw(10) << GetProbeKindName(probe.kind) << std::setprecision(3) << std::setw(14)
+        << 1000.0 * probe.delay_samples / sample_rate << std::setprecision(2) << std::setw(12) << probe.delay_samples
+        << std::setprecision(3) << probe.confidence << (probe.inverted ? " (inverted)" : "")
+        << (probe.confidence < kMinConfidence ? " (ignored)" : "") << std::endl;
+  }
+  out << std::right;
+  if (valid) {
+    out << "Algorithmic delay " << std::setprecision(3) << 1000.0 * delay_secs << " ms (" << std::setprecision(2)
+        << delay_samples << " samples at " << sample_rate << " Hz), spread " << spread_samples << " samples, "
+        << num_valid << " of " << probes.size() << " probes" << (inverted ? ", polarity inverted" : "") << std::endl;
+  } else {
+    out << "No probe was found in the output with confidence " << std::setprecision(2) << kMinConfidence
+        << " or more, the delay is unknown" << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+DelayEstimate EstimateDelay(const ProbeSignal& signal, const float* output, size_t num_samples,
+                            uint32_t output_rate) {
+  DelayEstimate estimate;
+  const int64_t min_lag = static_cast<int64_t>(std::floor(kMinDelaySecs * output_rate));
+  const int64_t max_lag = static_cast<int64_t>(std::ceil(signal.GetMaxDelaySecs() * output_rate));
+  const size_t num_lags = static_cast<size_t>(max_lag - min_lag + 1);
+
+  std::vector<double> delays;
+  size_t num_inverted = 0;
+  for (size_t i = 0; i < signal.GetProbes().size(); i++) {
+    ProbeResult result;
+    result.kind = signal.GetProbes()[i].kind;
+    std::vector<float> reference = signal.RenderProbe(i, output_rate);
+    const size_t length = reference.size();
+    const int64_t first = FirstSample(signal.GetProbes()[i].begin_secs, output_rate) + min_lag;
+
+    // c[j] = sum reference[n] * output[first + n + j], the transform is long enough not to wrap
+    dsp::RealFFT fft(dsp::RealFFT::NextPowerOfTwo(static_cast<uint32_t>(length + num_lags - 1)));
+    const size_t size = fft.GetSize();
+    const size_t num_bins = fft.GetNumBins();
+    std::vector<float> a(size, 0.f), b(size, 0.f);
+    std::copy(reference.begin(), reference.end(), a.begin());
+    for (size_t n = 0; n < length + num_lags - 1; n++) {
+      int64_t index = first + static_cast<int64_t>(n);
+      if (index >= 0 && index < static_cast<int64_t>(num_samples))
+        b[n] = output[index];
+    }
+    std::vector<float> a_re(num_bins), a_im(num_bins), b_re(num_bins), b_im(num_bins);
+    fft.Forward(a.data(), a_re.data(), a_im.data());
+    fft.Forward(b.data(), b_re.data(), b_im.data());
+    for (size_t k = 0; k < num_bins; k++) {
+      float re = a_re[k] * b_re[k] + a_im[k] * b_im[k];
+      float im = a_re[k] * b_im[k] - a_im[k] * b_re[k];
+      a_re[k] = re;
+      a_im[k] = im;
+    }
+    std::vector<float> correlation(size);
+    fft.Inverse(a_re.data(), a_im.data(), correlation.data());
+
+    size_t peak = 0;
+    for (size_t j = 1; j < num_lags; j++) {
+      if (std::fabs(correlation[j]) > std::fabs(correlation[peak]))
+        peak = j;
+    }
+    const float sign = correlation[peak] < 0.f ? -1.f : 1.f;
+    double offset = 0.0;
+    if (peak > 0 && peak + 1 < num_lags) {
+      // Vertex of the parabola through the peak and its neighbours
+      double left = sign * correlation[peak - 1], center = sign * correlation[peak];
+      double right = sign * correlation[peak + 1];
+      double curvature = left - 2.0 * center + right;
+      if (curvature < 0.0)
+        offset = std::max(-0.5, std::min(0.5, 0.5 * (left - right) / curvature));
+    }
+    double reference_energy = 0.0, output_energy = 0.0;
+    for (size_t n = 0; n < length; n++) {
+      reference_energy += static_cast<double>(a[n]) * a[n];
+      output_energy += static_cast<double>(b[peak + n]) * b[peak + n];
+    }
+    result.delay_samples = static_cast<double>(min_lag) + peak + offset;
+    result.inverted = sign < 0.f;
+    if (reference_energy > 0.0 && output_energy > 0.0)
+      result.confidence = std::fabs(correlation[peak]) / std::sqrt(reference_energy * output_energy);
+    if (result.confidence >= kMinConfidence) {
+      delays.push_back(result.delay_samples);
+      estimate.confidence = std::max(estimate.confidence, result.confidence);
+      num_inverted += result.inverted;
+    }
+    estimate.probes.push_back(result);
+  }
+
+  estimate.num_valid = delays.size();
+  if (delays.empty())
+    return estimate;
+  std::sort(delays.begin(), delays.end());
+  size_t middle = delays.size() / 2;
+  estimate.valid = true;
+  estimate.delay_samples = delays.size() % 2 ? delays[middle] : 0.5 * (delays[middle - 1] + delays[middle]);
+  estimate.delay_secs = estimate.delay_samples / output_rate;
+  estimate.spread_samples = delays.back() - delays.front();
+  estimate.inverted = 2 * num_inverted > delays.size();
+  return estimate;
+}
+
+DelayTable::DelayTable(const std::string& path) : table_(path, kTableHeader, 3) {}
+
+bool DelayTable::Lookup(const std::string& key, uint32_t input_sample_rate, uint32_t output_sample_rate,
+                        DelayEntry* entry) {
+  std::string value;
+  if (!table_.Lookup(MakeTableKey(key, input_sample_rate, output_sample_rate), &value))
+    return false;
+  std::istringstream fields(value);
+  DelayEntry found;
+  found.input_sample_rate = input_sample_rate;
+  found.output_sample_rate = output_sample_rate;
+  if (!(fields >> found.delay_samples >> found.confidence))
+    return false;
+  *entry = found;
+  return true;
+}
+
+std::vector<DelayEntry> DelayTable::LookupAll(const std::string& key, uint32_t input_sample_rate) {
+  const std::string prefix = key + ' ' + std::to_string(input_sample_rate) + ' ';
+  std::vector<DelayEntry> entries;
+  for (const auto& table_entry : table_.GetEntries()) {
+    if (table_entry.first.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    DelayEntry entry;
+    entry.input_sample_rate = input_sample_rate;
+    std::istringstream rate(table_entry.first.substr(prefix.size()));
+    std::istringstream fields(table_entry.second);
+    if (rate >> entry.output_sample_rate && fields >> entry.delay_samples >> entry.confidence)
+      entries.push_back(entry);
+  }
+  std::sort(entries.begin(), entries.end(), [](const DelayEntry& a, const DelayEntry& b) {
+    return a.output_sample_rate < b.output_sample_rate;
+  });
+  return entries;
+}
+
+bool DelayTable::Store(const std::string& key, const DelayEntry& entry) {
+  std::ostringstream value;
+  value << std::setprecision(10) << entry.delay_samples << ' ' << std::setprecision(4) << entry.confidence;
+  return table_.Store(MakeTableKey(key, entry.input_sample_rate, entry.output_sample_rate), value.str());
+}
+
+}  // namespace latency
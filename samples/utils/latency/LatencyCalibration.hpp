@@ -0,0 +1,130 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <utils/cache/KeyedTextTable.hpp>
+
+// Measurement of the algorithmic delay of an effect: known probes are run through it and found
+// again in the output by cross-correlation. Results are kept per effect, models and sample rates.
+namespace latency {
+
+enum class ProbeKind {
+  // Hann shaped click of 2 ms
+  kImpulse,
+  // Exponential sine sweep from 100 Hz to 0.4 times the lower sample rate
+  kChirp,
+  // Harmonics of a gliding 110 - 160 Hz fundamental with a syllable rate envelope, for effects
+  // which only pass speech
+  kVoice,
+};
+
+const char* GetProbeKindName(ProbeKind kind);
+
+// Sequence of probes separated by silence. Probes are defined in continuous time, so the signal
+// fed to the effect and the reference the output is compared against can be rendered at their own
+// sample rates.
+class ProbeSignal {
+ public:
+  struct Probe {
+    ProbeKind kind;
+    double begin_secs;
+    double duration_secs;
+  };
+
+  // bandwidth_rate is the lower of the input and output sample rate. Delays up to max_delay_secs are
+  // measured, the silence after each probe is longer.
+  ProbeSignal(uint32_t bandwidth_rate, double max_delay_secs);
+
+  // Renders the whole signal at sample_rate
+  std::vector<float> Render(uint32_t sample_rate) const;
+  // Renders one probe at sample_rate from its begin
+  std::vector<float> RenderProbe(size_t index, uint32_t sample_rate) const;
+
+  const std::vector<Probe>& GetProbes() const { return probes_; }
+  double GetDurationSecs() const { return duration_secs_; }
+  double GetMaxDelaySecs() const { return max_delay_secs_; }
+
+ private:
+  double value(const Probe& probe, double t) const;
+
+  const double max_frequency_;
+  const double max_delay_secs_;
+  std::vector<Probe> probes_;
+  double duration_secs_ = 0.0;
+};
+
+struct ProbeResult {
+  ProbeKind kind;
+  // Delay in output samples, fractional from interpolating the correlation peak
+  double delay_samples = 0.0;
+  // Normalized correlation at the peak, 1 for an output which is a scaled copy of the probe
+  double confidence = 0.0;
+  bool inverted = false;
+};
+
+struct DelayEstimate {
+  bool valid = false;
+  // Median over the probes with enough confidence
+  double delay_samples = 0.0;
+  double delay_secs = 0.0;
+  // Difference between the largest and smallest delay of those probes
+  double spread_samples = 0.0;
+  double confidence = 0.0;
+  // Most probes came out with inverted polarity
+  bool inverted = false;
+  size_t num_valid = 0;
+  std::vector<ProbeResult> probes;
+
+  void Print(std::ostream& out, uint32_t sample_rate) const;
+};
+
+// Probes below this normalized correlation are not counted, e.g. a click removed by a denoiser
+const double kMinConfidence = 0.3;
+
+// Finds each probe of signal in output, num_samples samples at output_rate produced from
+// signal.Render() at the input rate. Delays from -5 ms to the signal's max delay are searched.
+DelayEstimate EstimateDelay(const ProbeSignal& signal, const float* output, size_t num_samples,
+                            uint32_t output_rate);
+
+struct DelayEntry {
+  uint32_t input_sample_rate = 0;
+  uint32_t output_sample_rate = 0;
+  // In output samples
+  double delay_samples = 0.0;
+  double confidence = 0.0;
+};
+
+// Small text file of measured delays keyed by startup::PropertyCache::MakeKey() of the effect and
+// models and by the sample rates.
+class DelayTable {
+ public:
+  explicit DelayTable(const std::string& path);
+
+  bool Lookup(const std::string& key, uint32_t input_sample_rate, uint32_t output_sample_rate, DelayEntry* entry);
+  // Entries of key at input_sample_rate for any output rate, ordered by output rate. Used before the
+  // effect is loaded, when the output rate is not known yet.
+  std::vector<DelayEntry> LookupAll(const std::string& key, uint32_t input_sample_rate);
+  // Adds or replaces an entry and rewrites the file
+  bool Store(const std::string& key, const DelayEntry& entry);
+
+ private:
+  cache::KeyedTextTable table_;
+};
+
+}  // namespace latency
@@ -0,0 +1,36 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "EffectMetrics.hpp"
+
+namespace metrics {
+
+EffectMetrics& EffectMetrics::Get() {
+  static EffectMetrics effect_metrics;
+  return effect_metrics;
+}
+
+EffectMetrics::EffectMetrics() {
+  Registry& registry = Registry::Get();
+  frames_processed = registry.AddCounter("nvafx_frames_processed_total", "Frames passed through NvAFX_Run");
+  input_samples_processed = registry.AddCounter("nvafx_input_samples_processed_total",
+                                                "Input samples passed through NvAFX_Run");
+  run_latency = registry.AddHistogram("nvafx_run_latency_seconds", "NvAFX_Run call latency",
+                                      { 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1 });
+  frame_rtf = registry.AddHistogram("nvafx_frame_rtf", "Per frame processing time / frame duration",
+                                    { 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 2.0 });
+  rtf = registry.AddGauge("nvafx_rtf", "Processing time / audio duration of the current file");
+  input_queue_frames = registry.AddGauge("nvafx_input_queue_frames", "Input frames waiting to be processed");
+  handles_active = registry.AddGauge("nvafx_handles_active", "Effect handles currently created");
+  algorithmic_delay = registry.AddGauge("nvafx_algorithmic_delay_seconds",
+                                        "Measured delay of the effect output, for lip-sync of live output");
+}
+
+}  // namespace metrics
@@ -0,0 +1,34 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include "Metrics.hpp"
+
+namespace metrics {
+
+// Session metrics of effects_demo, exported through metrics_port / metrics_file
+struct EffectMetrics {
+  Counter frames_processed;
+  Counter input_samples_processed;
+  Histogram run_latency;
+  Histogram frame_rtf;
+  Gauge rtf;
+  Gauge input_queue_frames;
+  Gauge handles_active;
+  Gauge algorithmic_delay;
+
+  static EffectMetrics& Get();
+
+ private:
+  EffectMetrics();
+};
+
+}  // namespace metrics
@@ -0,0 +1,409 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "Metrics.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define CLOSE_SOCKET closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define CLOSE_SOCKET close
+#endif
+
+namespace metrics {
+
+namespace {
+
+thread_local Shard* t_shard = nullptr;
+// Set once the thread's shard was returned, e.g. metrics updated by later thread_local destructors
+thread_local bool t_shard_released = false;
+
+// Returns the thread's shard to the registry when the thread exits. Only touched when a shard is
+// taken, the hot path reads the trivially destructible t_shard.
+struct ShardOwner {
+  ~ShardOwner() {
+    if (t_shard)
+      Registry::Get().ReleaseShard(t_shard);
+    t_shard = nullptr;
+    t_shard_released = true;
+  }
+};
+thread_local ShardOwner t_shard_owner;
+
+uint64_t DoubleToBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double BitsToDouble(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+std::string FormatValue(double value) {
+  if (std::isinf(value))
+    return value > 0 ? "+Inf" : "-Inf";
+  if (std::isnan(value))
+    return "NaN";
+  std::ostringstream oss;
+  oss.precision(12);
+  oss << value;
+  return oss.str();
+}
+
+std::string WithLabels(const std::string& name, const std::string& labels, const std::string& extra = "") {
+  if (labels.empty() && extra.empty())
+    return name;
+  return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+
+}  // namespace
+
+Shard::Shard() {
+  for (uint32_t i = 0; i < kMaxSlots; i++)
+    slots[i].store(0, std::memory_order_relaxed);
+}
+
+void Shard::AddDouble(uint32_t slot, double value) {
+  double current = BitsToDouble(slots[slot].load(std::memory_order_relaxed));
+  slots[slot].store(DoubleToBits(current + value), std::memory_order_relaxed);
+}
+
+void Counter::Inc(uint64_t value) const {
+  if (slot_ == Shard::kNoSlot)
+    return;
+  Registry::Get().GetShard()->Add(slot_, value);
+}
+
+void Gauge::Add(double delta) const {
+  if (!value_)
+    return;
+  double current = value_->load(std::memory_order_relaxed);
+  while (!value_->compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Observe(double value) const {
+  if (!bounds_)
+    return;
+  Shard* shard = Registry::Get().GetShard();
+  const uint32_t num_bounds = static_cast<uint32_t>(bounds_->size());
+  uint32_t bucket = 0;
+  while (bucket < num_bounds && value > (*bounds_)[bucket])
+    bucket++;
+  shard->Add(slot_ + bucket, 1);
+  shard->Add(slot_ + num_bounds + 1, 1);
+  shard->AddDouble(slot_ + num_bounds + 2, value);
+}
+
+Registry& Registry::Get() {
+  static Registry registry;
+  return registry;
+}
+
+Shard* Registry::GetShard() {
+  if (!t_shard) {
+    if (t_shard_released)
+      return &discarded_;
+    // Registers the destructor that releases the shard
+    (void)&t_shard_owner;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_shards_.empty()) {
+      shards_.emplace_back(new Shard());
+      free_shards_.push_back(shards_.back().get());
+    }
+    t_shard = free_shards_.back();
+    free_shards_.pop_back();
+  }
+  return t_shard;
+}
+
+void Registry::ReleaseShard(Shard* shard) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The owner has exited, nothing writes the shard while it is folded
+  for (const auto& metric : metrics_) {
+    if (metric->type == Type::kGauge)
+      continue;
+    const uint32_t num_slots = metric->type == Type::kHistogram ? static_cast<uint32_t>(metric->bounds.size()) + 3 : 1;
+    for (uint32_t i = 0; i < num_slots; i++) {
+      const uint32_t slot = metric->slot + i;
+      const uint64_t value = shard->slots[slot].exchange(0, std::memory_order_relaxed);
+      // The histogram sum is a double
+      if (metric->type == Type::kHistogram && i == num_slots - 1)
+        retired_.AddDouble(slot, BitsToDouble(value));
+      else
+        retired_.Add(slot, value);
+    }
+  }
+  free_shards_.push_back(shard);
+}
+
+Registry::Metric* Registry::find(const std::string& name, const std::string& labels) {
+  for (auto& metric : metrics_) {
+    if (metric->name == name && metric->labels == labels)
+      return metric.get();
+  }
+  return nullptr;
+}
+
+uint32_t Registry::allocateSlots(uint32_t count) {
+  if (next_slot_ + count > Shard::kMaxSlots) {
+    if (!slots_exhausted_)
+      fprintf(stderr, "Too many metrics, metrics registered from now on are not recorded\n");
+    slots_exhausted_ = true;
+    return Shard::kNoSlot;
+  }
+  uint32_t slot = next_slot_;
+  next_slot_ += count;
+  return slot;
+}
+
+Counter Registry::AddCounter(const std::string& name, const std::string& help, const std::string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Metric* metric = find(name, labels))
+    return Counter(metric->slot);
+
+  uint32_t slot = allocateSlots(1);
+  if (slot == Shard::kNoSlot)
+    return Counter();
+  std::unique_ptr<Metric> metric(new Metric{ name, help, labels, Type::kCounter, slot, {}, nullptr });
+  metrics_.push_back(std::move(metric));
+  return Counter(metrics_.back()->slot);
+}
+
+Gauge Registry::AddGauge(const std::string& name, const std::string& help, const std::string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Metric* metric = find(name, labels))
+    return Gauge(metric->gauge.get());
+
+  std::unique_ptr<Metric> metric(new Metric{ name, help, labels, Type::kGauge, 0, {},
+                                             std::unique_ptr<std::atomic<double>>(new std::atomic<double>(0.0)) });
+  metrics_.push_back(std::move(metric));
+  return Gauge(metrics_.back()->gauge.get());
+}
+
+Histogram Registry::AddHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                                 const std::string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Metric* metric = find(name, labels))
+    return Histogram(metric->slot, &metric->bounds);
+
+  uint32_t slot = allocateSlots(static_cast<uint32_t>(bounds.size()) + 3);
+  if (slot == Shard::kNoSlot)
+    return Histogram();
+  std::unique_ptr<Metric> metric(new Metric{ name, help, labels, Type::kHistogram, slot, bounds, nullptr });
+  metrics_.push_back(std::move(metric));
+  return Histogram(slot, &metrics_.back()->bounds);
+}
+
+uint64_t Registry::sum(uint32_t slot) {
+  uint64_t total = retired_.slots[slot].load(std::memory_order_relaxed);
+  for (const auto& shard : shards_)
+    total += shard->slots[slot].load(std::memory_order_relaxed);
+  return total;
+}
+
+double Registry::sumDouble(uint32_t slot) {
+  double total = BitsToDouble(retired_.slots[slot].load(std::memory_order_relaxed));
+  for (const auto& shard : shards_)
+    total += BitsToDouble(shard->slots[slot].load(std::memory_order_relaxed));
+  return total;
+}
+
+std::string Registry::Scrape() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Labelled series may be registered at any time, group them by family in registration order
+  std::vector<const Metric*> ordered;
+  for (const auto& metric : metrics_) {
+    bool seen = false;
+    for (const Metric* other : ordered)
+      seen = seen || other->name == metric->name;
+    if (seen)
+      continue;
+    for (const auto& series : metrics_) {
+      if (series->name == metric->name)
+        ordered.push_back(series.get());
+    }
+  }
+
+  std::ostringstream out;
+  std::string last_name;
+  for (const Metric* metric : ordered) {
+    if (metric->name != last_name) {
+      static const char* kTypeNames[] = { "counter", "gauge", "histogram" };
+      out << "# HELP " << metric->name << " " << metric->help << "\n"
+          << "# TYPE " << metric->name << " " << kTypeNames[static_cast<int>(metric->type)] << "\n";
+      last_name = metric->name;
+    }
+
+    switch (metric->type) {
+    case Type::kCounter:
+      out << WithLabels(metric->name, metric->labels) << " " << sum(metric->slot) << "\n";
+      break;
+    case Type::kGauge:
+      out << WithLabels(metric->name, metric->labels) << " "
+          << FormatValue(metric->gauge->load(std::memory_order_relaxed)) << "\n";
+      break;
+    case Type::kHistogram: {
+      const uint32_t num_bounds = static_cast<uint32_t>(metric->bounds.size());
+      uint64_t cumulative = 0;
+      for (uint32_t i = 0; i <= num_bounds; i++) {
+        cumulative += sum(metric->slot + i);
+        std::string le = "le=\"" + (i < num_bounds ? FormatValue(metric->bounds[i]) : std::string("+Inf")) + "\"";
+        out << WithLabels(metric->name + "_bucket", metric->labels, le) << " " << cumulative << "\n";
+      }
+      out << WithLabels(metric->name + "_sum", metric->labels) << " "
+          << FormatValue(sumDouble(metric->slot + num_bounds + 2)) << "\n"
+          << WithLabels(metric->name + "_count", metric->labels) << " " << sum(metric->slot + num_bounds + 1)
+          << "\n";
+      break;
+    }
+    }
+  }
+  return out.str();
+}
+
+Exporter::~Exporter() {
+  Stop();
+}
+
+bool Exporter::StartHttp(uint16_t port) {
+#ifdef _WIN32
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    return false;
+#endif
+  socket_t listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_socket == INVALID_SOCKET)
+    return false;
+
+  int reuse = 1;
+  setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_socket, 4) != 0) {
+    CLOSE_SOCKET(listen_socket);
+    return false;
+  }
+
+  listen_socket_ = static_cast<intptr_t>(listen_socket);
+  running_ = true;
+  http_thread_ = std::thread(&Exporter::httpLoop, this);
+  return true;
+}
+
+void Exporter::httpLoop() {
+  socket_t listen_socket = static_cast<socket_t>(listen_socket_);
+  while (running_) {
+    // Poll so Stop() does not have to wait for a client
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(listen_socket, &read_set);
+    timeval timeout = { 0, 200000 };
+    if (select(static_cast<int>(listen_socket) + 1, &read_set, nullptr, nullptr, &timeout) <= 0)
+      continue;
+
+    socket_t client = accept(listen_socket, nullptr, nullptr);
+    if (client == INVALID_SOCKET)
+      continue;
+
+    char request[1024];
+    int received = recv(client, request, sizeof(request) - 1, 0);
+    request[received > 0 ? received : 0] = '\0';
+
+    std::string body;
+    std::string status;
+    if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+      status = "200 OK";
+      body = Registry::Get().Scrape();
+    } else {
+      status = "404 Not Found";
+      body = "Not found\n";
+    }
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    std::string data = response.str();
+    send(client, data.data(), static_cast<int>(data.size()), 0);
+    CLOSE_SOCKET(client);
+  }
+  CLOSE_SOCKET(listen_socket);
+#ifdef _WIN32
+  WSACleanup();
+#endif
+}
+
+void Exporter::StartFileDump(const std::string& file, uint32_t interval_ms) {
+  dump_file_ = file;
+  interval_ms_ = interval_ms;
+  running_ = true;
+  dump_thread_ = std::thread(&Exporter::dumpLoop, this);
+}
+
+bool Exporter::writeDump() {
+  // Write next to the target and rename so readers never see a partial file
+  std::string tmp_file = dump_file_ + ".tmp";
+  FILE* fp = fopen(tmp_file.c_str(), "wb");
+  if (!fp)
+    return false;
+  std::string data = Registry::Get().Scrape();
+  bool written = fwrite(data.data(), 1, data.size(), fp) == data.size();
+  fclose(fp);
+  remove(dump_file_.c_str());
+  return written && rename(tmp_file.c_str(), dump_file_.c_str()) == 0;
+}
+
+void Exporter::dumpLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    wakeup_.wait_for(lock, std::chrono::milliseconds(interval_ms_), [this] { return !running_; });
+    if (!writeDump())
+      fprintf(stderr, "Unable to write metrics file: %s\n", dump_file_.c_str());
+  }
+}
+
+void Exporter::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wakeup_.notify_all();
+  if (http_thread_.joinable())
+    http_thread_.join();
+  if (dump_thread_.joinable())
+    dump_thread_.join();
+}
+
+}  // namespace metrics
@@ -0,0 +1,158 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Prometheus style metrics for long running sessions. Counters and histograms are updated on the
+// hot path without locks: every thread writes to its own shard of relaxed atomics and the shards
+// are only summed when the metrics are scraped or dumped. When a thread exits its values are
+// folded into a retired total and its shard is reused by the next thread.
+
+namespace metrics {
+
+// Per-thread storage. Only the owning thread writes, the exporter reads.
+struct Shard {
+  static const uint32_t kMaxSlots = 1024;
+  // Slot of metrics registered after all slots were taken, updating them does nothing
+  static const uint32_t kNoSlot = UINT32_MAX;
+  std::atomic<uint64_t> slots[kMaxSlots];
+
+  Shard();
+  void Add(uint32_t slot, uint64_t value) {
+    slots[slot].store(slots[slot].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+  void AddDouble(uint32_t slot, double value);
+};
+
+// Monotonic counter
+class Counter {
+ public:
+  Counter() = default;
+  explicit Counter(uint32_t slot) : slot_(slot) {}
+  void Inc(uint64_t value = 1) const;
+
+ private:
+  uint32_t slot_ = Shard::kNoSlot;
+};
+
+// Value which can go up and down, e.g. a queue depth. Gauges are global and not sharded since
+// their value is set rather than accumulated.
+class Gauge {
+ public:
+  Gauge() = default;
+  explicit Gauge(std::atomic<double>* value) : value_(value) {}
+  void Set(double value) const { if (value_) value_->store(value, std::memory_order_relaxed); }
+  void Add(double delta) const;
+
+ private:
+  std::atomic<double>* value_ = nullptr;
+};
+
+// Histogram with fixed upper bounds
+class Histogram {
+ public:
+  Histogram() = default;
+  Histogram(uint32_t slot, const std::vector<double>* bounds) : slot_(slot), bounds_(bounds) {}
+  void Observe(double value) const;
+
+ private:
+  // Layout: one slot per bound, +Inf, count, sum (double bits)
+  uint32_t slot_ = 0;
+  const std::vector<double>* bounds_ = nullptr;
+};
+
+class Registry {
+ public:
+  static Registry& Get();
+  // labels are in Prometheus syntax without braces, e.g. status="NVAFX_STATUS_FAILED".
+  // Registering an existing name/labels pair returns the existing metric. Once all shard slots are
+  // taken, new counters and histograms are returned as no-ops.
+  Counter AddCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+  Gauge AddGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+  Histogram AddHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                         const std::string& labels = "");
+  // Returns all metrics in Prometheus text exposition format
+  std::string Scrape();
+  // Returns the calling thread's shard, taking a free one on first use. The shard is returned to
+  // the registry when the thread exits.
+  Shard* GetShard();
+  // Folds the values of shard into the retired total and makes it free for reuse
+  void ReleaseShard(Shard* shard);
+
+ private:
+  enum class Type { kCounter, kGauge, kHistogram };
+  struct Metric {
+    std::string name;
+    std::string help;
+    std::string labels;
+    Type type;
+    uint32_t slot;
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<double>> gauge;
+  };
+
+  Registry() = default;
+  Metric* find(const std::string& name, const std::string& labels);
+  uint32_t allocateSlots(uint32_t count);
+  uint64_t sum(uint32_t slot);
+  double sumDouble(uint32_t slot);
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Metric>> metrics_;
+  // Shards of running threads and free ones (all zero), in no particular order
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::vector<Shard*> free_shards_;
+  // Values of exited threads
+  Shard retired_;
+  // Written by threads whose shard was already released, never summed
+  Shard discarded_;
+  uint32_t next_slot_ = 0;
+  bool slots_exhausted_ = false;
+};
+
+// Serves Registry::Scrape() on a local HTTP port and/or writes it to a file on an interval
+class Exporter {
+ public:
+  ~Exporter();
+  // Serves GET /metrics on 127.0.0.1:port. Returns false if the port could not be bound.
+  bool StartHttp(uint16_t port);
+  // Rewrites file every interval_ms milliseconds
+  void StartFileDump(const std::string& file, uint32_t interval_ms);
+  // Stops background threads, writes the dump file one last time
+  void Stop();
+
+ private:
+  void httpLoop();
+  void dumpLoop();
+  bool writeDump();
+
+ private:
+  std::atomic<bool> running_{ false };
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::thread http_thread_;
+  std::thread dump_thread_;
+  intptr_t listen_socket_ = -1;
+  std::string dump_file_;
+  uint32_t interval_ms_ = 0;
+};
+
+}  // namespace metrics
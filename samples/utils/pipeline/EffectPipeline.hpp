@@ -0,0 +1,117 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <initializer_list>
+#include <tuple>
+#include <utility>
+
+#include <utils/trace/Trace.hpp>
+
+// Frame loop specialized at compile time on channel counts and the list of per-frame stages.
+// Effect type, channel layout and enabled features are resolved once when the pipeline is
+// instantiated, so the loop itself has no virtual calls, string compares or layout branches.
+//
+// A stage is any type with
+//   template <typename FrameT> bool Process(FrameT& frame);
+// Stages run in order for every frame, a stage returning false stops the pipeline.
+
+namespace pipeline {
+
+// Planar buffers of one frame, laid out as NvAFX_Run expects them
+template <unsigned kInputChannels, unsigned kOutputChannels>
+struct Frame {
+  static const unsigned kNumInputChannels = kInputChannels;
+  static const unsigned kNumOutputChannels = kOutputChannels;
+
+  const float* input[kInputChannels];
+  float* output[kOutputChannels];
+  // Index of the frame within the input
+  size_t index;
+  // Offset of the first input sample of the frame
+  size_t offset;
+};
+
+template <unsigned kInputChannels, unsigned kOutputChannels, typename... Stages>
+class EffectPipeline {
+ public:
+  typedef Frame<kInputChannels, kOutputChannels> FrameType;
+
+  EffectPipeline(unsigned samples_per_frame, Stages&... stages)
+    : samples_per_frame_(samples_per_frame)
+    , stages_(stages...) {}
+
+  // Runs all stages on every frame of inputs in [begin, end). inputs holds one planar buffer per
+  // input channel, outputs one frame sized buffer per output channel. Returns false if a stage
+  // failed. Null inputs are provided per frame by a stage, e.g. UnpackStage (PackedFrames.hpp).
+  bool Run(const float* const* inputs, float* const* outputs, size_t begin, size_t end) {
+    FrameType frame;
+    for (unsigned ch = 0; ch < kOutputChannels; ch++)
+      frame.output[ch] = outputs[ch];
+
+    frame.index = begin / samples_per_frame_;
+    for (size_t offset = begin; offset < end; offset += samples_per_frame_, frame.index++) {
+      for (unsigned ch = 0; ch < kInputChannels; ch++)
+        frame.input[ch] = inputs[ch] ? inputs[ch] + offset : nullptr;
+      frame.offset = offset;
+      TRACE_SCOPE_ARG("frame", "index", frame.index);
+      if (!processStages(frame, std::index_sequence_for<Stages...>()))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  template <size_t... I>
+  bool processStages(FrameType& frame, std::index_sequence<I...>) {
+    bool success = true;
+    // Expands to stage0.Process(frame) && stage1.Process(frame) && ...
+    (void)std::initializer_list<int>{ (success = success && std::get<I>(stages_).Process(frame), 0)... };
+    return success;
+  }
+
+ private:
+  const unsigned samples_per_frame_;
+  std::tuple<Stages&...> stages_;
+};
+
+// Deduces the stage types, e.g. MakePipeline<1, 1>(frame_size, run_stage, write_stage)
+template <unsigned kInputChannels, unsigned kOutputChannels, typename... Stages>
+EffectPipeline<kInputChannels, kOutputChannels, Stages...> MakePipeline(unsigned samples_per_frame,
+                                                                        Stages&... stages) {
+  return EffectPipeline<kInputChannels, kOutputChannels, Stages...>(samples_per_frame, stages...);
+}
+
+// Channel layouts of the SDK effects: 1 in / 1 out, and near end + far end in / 1 out for AEC
+inline bool IsSupportedLayout(unsigned num_input_channels, unsigned num_output_channels) {
+  return num_output_channels == 1 && (num_input_channels == 1 || num_input_channels == 2);
+}
+
+// Selects the pipeline instantiation matching the runtime channel layout and runs it. Called once
+// per stream, returns false for layouts rejected by IsSupportedLayout().
+template <typename... Stages>
+bool Dispatch(unsigned num_input_channels, unsigned num_output_channels, unsigned samples_per_frame,
+              const float* const* inputs, float* const* outputs, size_t begin, size_t end, Stages&... stages) {
+  if (num_output_channels != 1)
+    return false;
+  switch (num_input_channels) {
+  case 1:
+    return MakePipeline<1, 1>(samples_per_frame, stages...).Run(inputs, outputs, begin, end);
+  case 2:
+    return MakePipeline<2, 1>(samples_per_frame, stages...).Run(inputs, outputs, begin, end);
+  default:
+    return false;
+  }
+}
+
+}  // namespace pipeline
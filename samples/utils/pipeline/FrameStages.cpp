@@ -0,0 +1,149 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "FrameStages.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include <utils/config_reader/ConfigReader.hpp>
+
+namespace pipeline {
+
+namespace {
+
+// Keys of the checkpoint file
+const char kCheckpointInputVariable[] = "input_wav";
+const char kCheckpointFrameSizeVariable[] = "frame_size";
+const char kCheckpointFrameOffsetVariable[] = "input_frame_offset";
+const char kCheckpointOutputBytesVariable[] = "output_bytes";
+
+}  // namespace
+
+bool WriteCheckpoint(const std::string& checkpoint_file, const Checkpoint& checkpoint) {
+  // Replace the previous checkpoint only once the new one is complete
+  std::string tmp_file = checkpoint_file + ".tmp";
+  {
+    std::ofstream out(tmp_file, std::ios_base::out | std::ios_base::trunc);
+    out << "# effects_demo checkpoint, use --resume to continue" << std::endl
+        << kCheckpointInputVariable << " " << checkpoint.input_wav << std::endl
+        << kCheckpointFrameSizeVariable << " " << checkpoint.frame_size << std::endl
+        << kCheckpointFrameOffsetVariable << " " << checkpoint.frame_offset << std::endl
+        << kCheckpointOutputBytesVariable << " " << checkpoint.output_bytes << std::endl;
+    if (!out.good())
+      return false;
+  }
+  std::remove(checkpoint_file.c_str());
+  return std::rename(tmp_file.c_str(), checkpoint_file.c_str()) == 0;
+}
+
+bool ReadCheckpoint(const std::string& checkpoint_file, Checkpoint* checkpoint) {
+  ConfigReader reader;
+  if (!reader.Load(checkpoint_file) || !reader.IsConfigValueAvailable(kCheckpointInputVariable) ||
+      !reader.IsConfigValueAvailable(kCheckpointFrameSizeVariable) ||
+      !reader.IsConfigValueAvailable(kCheckpointFrameOffsetVariable) ||
+      !reader.IsConfigValueAvailable(kCheckpointOutputBytesVariable)) {
+    return false;
+  }
+  checkpoint->input_wav = reader.GetConfigValue(kCheckpointInputVariable);
+  checkpoint->frame_size =
+    static_cast<unsigned>(std::strtoul(reader.GetConfigValue(kCheckpointFrameSizeVariable).c_str(), nullptr, 10));
+  checkpoint->frame_offset = std::strtoull(reader.GetConfigValue(kCheckpointFrameOffsetVariable).c_str(), nullptr, 10);
+  checkpoint->output_bytes = static_cast<uint32_t>(
+    std::strtoul(reader.GetConfigValue(kCheckpointOutputBytesVariable).c_str(), nullptr, 10));
+  return true;
+}
+
+void WriteStage::SetAlignment(int64_t delay, size_t position) {
+  delay_ = delay;
+  position_ = position;
+  silence_ = delay < 0 && position == 0 ? static_cast<size_t>(-delay) : 0;
+  written_ = position == 0 ? 0 : static_cast<size_t>(std::max<int64_t>(0, static_cast<int64_t>(position) - delay));
+}
+
+bool WriteStage::Append(const float* samples, size_t num_samples) {
+  if (silence_ > 0) {
+    size_t count = std::min(silence_, length_ - std::min(length_, written_));
+    silence_ = 0;
+    if (!push(nullptr, count))
+      return false;
+  }
+  // Appended sample position_ is output sample position_ - delay_
+  size_t skip = 0;
+  if (static_cast<int64_t>(position_) < delay_)
+    skip = static_cast<size_t>(std::min<int64_t>(num_samples, delay_ - static_cast<int64_t>(position_)));
+  position_ += num_samples;
+  return push(samples + skip, std::min(num_samples - skip, length_ - std::min(length_, written_)));
+}
+
+bool WriteStage::Flush() {
+  if (block_size_ == 0)
+    return true;
+  TRACE_SCOPE("writeChunk");
+  bool success = sink_.Write(block_.data(), static_cast<uint32_t>(block_size_));
+  block_size_ = 0;
+  if (!success)
+    std::cerr << "Unable to write output" << std::endl;
+  return success;
+}
+
+bool WriteStage::push(const float* samples, size_t num_samples) {
+  written_ += num_samples;
+  while (num_samples > 0) {
+    size_t count = std::min(num_samples, block_.size() - block_size_);
+    if (samples) {
+      std::copy(samples, samples + count, block_.begin() + block_size_);
+      samples += count;
+    } else {
+      std::fill(block_.begin() + block_size_, block_.begin() + block_size_ + count, 0.f);
+    }
+    block_size_ += count;
+    num_samples -= count;
+    if (block_size_ == block_.size() && !Flush())
+      return false;
+  }
+  return true;
+}
+
+void CheckpointStage::write(size_t frame_offset) {
+  TRACE_SCOPE("checkpoint");
+  uint64_t position = 0;
+  if (!write_stage_.Flush() || !sink_.Checkpoint(&position)) {
+    std::cerr << "Unable to write checkpoint: " << checkpoint_file_ << std::endl;
+    return;
+  }
+  Checkpoint checkpoint;
+  checkpoint.input_wav = input_wav_;
+  checkpoint.frame_size = samples_per_frame_;
+  checkpoint.frame_offset = frame_offset;
+  checkpoint.output_bytes = static_cast<uint32_t>(position);
+  if (!WriteCheckpoint(checkpoint_file_, checkpoint))
+    std::cerr << "Unable to write checkpoint: " << checkpoint_file_ << std::endl;
+}
+
+bool LoudnessStreamStage::Finish() {
+  std::vector<float> tail(normalizer_.GetLatency());
+  normalizer_.Flush(tail.data());
+  size_t skip = std::min(skip_, tail.size());
+  return write_stage_.Append(tail.data() + skip, tail.size() - skip);
+}
+
+bool LoudnessTwoPassStage::Finish() {
+  TRACE_SCOPE("loudness_normalize");
+  auto start = std::chrono::high_resolution_clock::now();
+  normalizer_.SetKnownLoudness(meter_.GetIntegratedLoudness());
+  normalizer_.ProcessBuffer(output_.data(), output_.size());
+  secs_ += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  return write_stage_.Append(output_.data(), output_.size());
+}
+
+}  // namespace pipeline
@@ -0,0 +1,378 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/analysis/SignalAnalyzer.hpp>
+#include <utils/audio_io/AudioStream.hpp>
+#include <utils/dsp/Loudness.hpp>
+#include <utils/metrics/EffectMetrics.hpp>
+#include <utils/trace/Trace.hpp>
+
+#include "Migration.hpp"
+
+// Per-frame stages of the effects_demo pipelines, see EffectPipeline.hpp. Everything that does not
+// change between frames is fixed when a stage is constructed. The stage running the effect itself is
+// RunStage (RunStage.hpp), the one restoring packed inputs UnpackStage (PackedFrames.hpp).
+namespace pipeline {
+
+// Totals shared by the stages of one file
+struct ProcessingState {
+  float frame_in_secs = 0.f;
+  float expected_audio_duration = 0.f;
+  float total_run_time = 0.f;
+  float total_audio_duration = 0.f;
+  std::chrono::high_resolution_clock::time_point frame_start;
+};
+
+// Input position matching output_bytes of output synced to disk, for --resume
+struct Checkpoint {
+  std::string input_wav;
+  unsigned frame_size = 0;
+  size_t frame_offset = 0;
+  uint32_t output_bytes = 0;
+};
+
+// Replaces checkpoint_file once the new checkpoint is complete
+bool WriteCheckpoint(const std::string& checkpoint_file, const Checkpoint& checkpoint);
+// Returns false if the file is missing or incomplete
+bool ReadCheckpoint(const std::string& checkpoint_file, Checkpoint* checkpoint);
+
+// Reads the input frames from sources, one per input channel, as the pipeline reaches them, so decoding
+// overlaps processing and only the buffered blocks of the input are held in memory. Frames past length
+// samples, or past the end of a source, are silence. Runs first, the pipeline is dispatched with null
+// input pointers.
+class ReadStage {
+ public:
+  ReadStage(audio_io::AudioSource* const* sources, unsigned num_channels, unsigned samples_per_frame, size_t length)
+    : sources_(sources, sources + num_channels), frames_(num_channels, std::vector<float>(samples_per_frame)),
+      length_(length) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    const uint32_t frame_samples = static_cast<uint32_t>(frames_[0].size());
+    const uint32_t wanted = frame.offset < length_ ?
+      static_cast<uint32_t>(std::min<size_t>(frame_samples, length_ - frame.offset)) : 0u;
+    for (unsigned ch = 0; ch < FrameT::kNumInputChannels; ch++) {
+      float* samples = frames_[ch].data();
+      uint32_t num_read = wanted ? sources_[ch]->Read(samples, wanted) : 0u;
+      std::fill(samples + num_read, samples + frame_samples, 0.f);
+      frame.input[ch] = samples;
+    }
+    return true;
+  }
+
+ private:
+  std::vector<audio_io::AudioSource*> sources_;
+  std::vector<std::vector<float>> frames_;
+  const size_t length_;
+};
+
+// Marks the frame start and publishes the input backlog
+class FrameStartStage {
+ public:
+  FrameStartStage(ProcessingState& state, size_t end_offset, unsigned samples_per_frame)
+    : state_(state), end_offset_(end_offset), samples_per_frame_(samples_per_frame) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    size_t queued_frames = (end_offset_ - frame.offset) / samples_per_frame_;
+    TRACE_COUNTER("input_frames_queued", queued_frames);
+    metrics::EffectMetrics::Get().input_queue_frames.Set(static_cast<double>(queued_frames));
+    state_.frame_start = std::chrono::high_resolution_clock::now();
+    return true;
+  }
+
+ private:
+  ProcessingState& state_;
+  const size_t end_offset_;
+  const unsigned samples_per_frame_;
+};
+
+// Runs the frames through migration, which moves the stream to its spare handle every interval_frames.
+// Takes the place of RunStage when migrate_interval_secs is set.
+class MigratingRunStage {
+ public:
+  MigratingRunStage(SessionMigration& migration, size_t interval_frames)
+    : migration_(migration), interval_frames_(interval_frames) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    if (frame.index > 0 && frame.index % interval_frames_ == 0 && !migration_.IsMigrating()) {
+      TRACE_SCOPE("migration_reset");
+      if (!migration_.Request())
+        return false;
+    }
+    return migration_.Process(frame.input, frame.output);
+  }
+
+ private:
+  SessionMigration& migration_;
+  const size_t interval_frames_;
+};
+
+// Accounts the run time of the frame
+class StatsStage {
+ public:
+  StatsStage(ProcessingState& state, unsigned samples_per_frame)
+    : state_(state), samples_per_frame_(samples_per_frame), metrics_(metrics::EffectMetrics::Get()) {}
+
+  template <typename FrameT>
+  bool Process(FrameT&) {
+    float frame_run_time =
+      std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - state_.frame_start).count();
+    state_.total_run_time += frame_run_time;
+    state_.total_audio_duration += state_.frame_in_secs;
+    metrics_.frames_processed.Inc();
+    metrics_.input_samples_processed.Inc(samples_per_frame_);
+    metrics_.run_latency.Observe(frame_run_time);
+    metrics_.frame_rtf.Observe(frame_run_time / state_.frame_in_secs);
+    metrics_.rtf.Set(state_.total_run_time / state_.total_audio_duration);
+    return true;
+  }
+
+ private:
+  ProcessingState& state_;
+  const unsigned samples_per_frame_;
+  metrics::EffectMetrics& metrics_;
+};
+
+// Draws the progress bar in steps of 10%
+class ProgressStage {
+ public:
+  explicit ProgressStage(const ProcessingState& state) : state_(state) {}
+
+  template <typename FrameT>
+  bool Process(FrameT&) {
+    if ((state_.total_audio_duration / state_.expected_audio_duration) >= checkpoint_) {
+      TRACE_SCOPE("progress");
+      progress_bar_[(int)(checkpoint_ * 10.0f)] = '=';
+      std::cout << "Processed: " << progress_bar_ << checkpoint_ * 100.f << "%" << (checkpoint_ >= 1 ? "\n" : "\r");
+      std::cout.flush();
+      checkpoint_ += 0.1f;
+    }
+    return true;
+  }
+
+ private:
+  const ProcessingState& state_;
+  float checkpoint_ = 0.1f;
+  std::string progress_bar_ = "[          ] ";
+};
+
+// Appends output frames to the sink. Frames are collected into blocks so the sink, which may be an
+// encoder, is called once per block instead of once per frame.
+class WriteStage {
+ public:
+  static const unsigned kFramesPerBlock = 32;
+
+  WriteStage(audio_io::AudioSink& sink, unsigned samples_per_frame, unsigned num_channels)
+    : sink_(sink), frame_samples_(samples_per_frame * num_channels), block_(frame_samples_ * kFramesPerBlock) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    return Append(frame.output[0], frame_samples_);
+  }
+
+  // Aligns the output with the input: the first delay samples appended are dropped, a negative delay
+  // is written as silence first. position is the number of samples appended by an earlier run.
+  void SetAlignment(int64_t delay, size_t position);
+  // Samples after the first length are not written, e.g. the output of frames flushing a delayed tail
+  void SetLength(size_t length) { length_ = length; }
+
+  // Appends samples which need not be a whole frame
+  bool Append(const float* samples, size_t num_samples);
+  // Writes the frames collected so far
+  bool Flush();
+
+ private:
+  // Copies samples, or zeros if null, into blocks
+  bool push(const float* samples, size_t num_samples);
+
+  audio_io::AudioSink& sink_;
+  const size_t frame_samples_;
+  std::vector<float> block_;
+  size_t block_size_ = 0;
+  // Alignment, samples appended and written
+  int64_t delay_ = 0;
+  size_t position_ = 0;
+  size_t written_ = 0;
+  size_t silence_ = 0;
+  size_t length_ = SIZE_MAX;
+};
+
+// Periodically syncs the output and records the matching input position
+class CheckpointStage {
+ public:
+  CheckpointStage(WriteStage& write_stage, audio_io::AudioSink& sink, const std::string& checkpoint_file,
+                  const std::string& input_wav, unsigned samples_per_frame, float interval_secs)
+    : write_stage_(write_stage)
+    , sink_(sink)
+    , checkpoint_file_(checkpoint_file)
+    , input_wav_(input_wav)
+    , samples_per_frame_(samples_per_frame)
+    , interval_secs_(interval_secs)
+    , last_tick_(std::chrono::high_resolution_clock::now()) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    if (std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - last_tick_).count() <
+          interval_secs_) {
+      return true;
+    }
+    write(frame.index + 1);
+    last_tick_ = std::chrono::high_resolution_clock::now();
+    return true;
+  }
+
+ private:
+  // Syncs the output and records that frame_offset frames of input produced it
+  void write(size_t frame_offset);
+
+  WriteStage& write_stage_;
+  audio_io::AudioSink& sink_;
+  const std::string& checkpoint_file_;
+  const std::string& input_wav_;
+  const unsigned samples_per_frame_;
+  const float interval_secs_;
+  std::chrono::high_resolution_clock::time_point last_tick_;
+};
+
+// Copies output frames from first_frame on into a contiguous buffer
+class CollectStage {
+ public:
+  CollectStage(float* output, size_t first_frame, unsigned samples_per_frame, unsigned num_channels)
+    : output_(output), first_frame_(first_frame), frame_samples_(samples_per_frame * num_channels) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    if (frame.index >= first_frame_) {
+      std::copy(frame.output[0], frame.output[0] + frame_samples_,
+                output_ + (frame.index - first_frame_) * frame_samples_);
+    }
+    return true;
+  }
+
+ private:
+  float* const output_;
+  const size_t first_frame_;
+  const size_t frame_samples_;
+};
+
+// Normalizes the output in one pass and writes it. The limiter look-ahead delays the output, so the
+// first GetLatency() samples are dropped and Finish() writes the samples held back at the end.
+class LoudnessStreamStage {
+ public:
+  LoudnessStreamStage(dsp::LoudnessNormalizer& normalizer, WriteStage& write_stage, unsigned samples_per_frame)
+    : normalizer_(normalizer), write_stage_(write_stage), frame_samples_(samples_per_frame),
+      skip_(normalizer.GetLatency()) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    TRACE_SCOPE("loudness");
+    auto start = std::chrono::high_resolution_clock::now();
+    normalizer_.Process(frame.output[0], frame_samples_);
+    size_t skip = std::min(skip_, frame_samples_);
+    skip_ -= skip;
+    secs_ += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return write_stage_.Append(frame.output[0] + skip, frame_samples_ - skip);
+  }
+
+  bool Finish();
+
+  double GetSecs() const { return secs_; }
+
+ private:
+  dsp::LoudnessNormalizer& normalizer_;
+  WriteStage& write_stage_;
+  const size_t frame_samples_;
+  size_t skip_;
+  double secs_ = 0.0;
+};
+
+// Measures the loudness of the output while collecting it. Finish() normalizes the collected output
+// to the measured loudness and writes it, so the output is not read back from disk.
+class LoudnessTwoPassStage {
+ public:
+  LoudnessTwoPassStage(dsp::LoudnessNormalizer& normalizer, WriteStage& write_stage, uint32_t sample_rate,
+                       unsigned samples_per_frame)
+    : normalizer_(normalizer), write_stage_(write_stage), meter_(sample_rate), frame_samples_(samples_per_frame) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    TRACE_SCOPE("loudness_measure");
+    auto start = std::chrono::high_resolution_clock::now();
+    meter_.Add(frame.output[0], frame_samples_);
+    output_.insert(output_.end(), frame.output[0], frame.output[0] + frame_samples_);
+    secs_ += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+  }
+
+  bool Finish();
+
+  double GetInputLoudness() const { return meter_.GetIntegratedLoudness(); }
+  double GetSecs() const { return secs_; }
+
+ private:
+  dsp::LoudnessNormalizer& normalizer_;
+  WriteStage& write_stage_;
+  dsp::LoudnessMeter meter_;
+  const size_t frame_samples_;
+  std::vector<float> output_;
+  double secs_ = 0.0;
+};
+
+// Hands the first input channel and the output of the first num_frames frames to the signal analyzer.
+// Frames after them only flush the delayed output.
+class AnalysisStage {
+ public:
+  AnalysisStage(analysis::SignalAnalyzer& analyzer, size_t num_frames) : analyzer_(analyzer), num_frames_(num_frames) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    if (frame.index < num_frames_)
+      analyzer_.Push(frame.input[0], frame.output[0]);
+    return true;
+  }
+
+ private:
+  analysis::SignalAnalyzer& analyzer_;
+  const size_t num_frames_;
+};
+
+// Simulates the input data rate of a mic
+class RealTimeStage {
+ public:
+  explicit RealTimeStage(const ProcessingState& state) : state_(state) {}
+
+  template <typename FrameT>
+  bool Process(FrameT&) {
+    TRACE_SCOPE("real_time_sleep");
+    std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - state_.frame_start;
+    float sleep_time_secs = state_.frame_in_secs - elapsed.count();
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(sleep_time_secs * 1000)));
+    return true;
+  }
+
+ private:
+  const ProcessingState& state_;
+};
+
+}  // namespace pipeline
@@ -0,0 +1,173 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "Migration.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <utility>
+
+namespace pipeline {
+
+namespace {
+
+double ElapsedMs(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+}  // namespace
+
+SessionMigration::SessionMigration(void* active, void* spare, unsigned num_input_channels, unsigned input_samples,
+                                   unsigned num_output_channels, unsigned output_samples,
+                                   const MigrationOptions& options, RunFunction run, ResetFunction reset)
+  : active_(active), spare_(spare), num_input_channels_(num_input_channels), input_samples_(input_samples),
+    num_output_channels_(num_output_channels), output_samples_(output_samples), options_(options),
+    run_(std::move(run)), reset_(std::move(reset)),
+    shape_(options.history_frames > 0 ? CrossfadeShape::kEqualGain : CrossfadeShape::kEqualPower),
+    history_capacity_(options.history_frames + 1),
+    history_(history_capacity_ * num_input_channels * input_samples),
+    history_input_(num_input_channels),
+    scratch_(static_cast<size_t>(num_output_channels) * output_samples),
+    scratch_output_(num_output_channels) {
+  for (unsigned ch = 0; ch < num_output_channels_; ch++)
+    scratch_output_[ch] = scratch_.data() + ch * output_samples_;
+}
+
+bool SessionMigration::Request() {
+  if (state_ != State::kIdle)
+    return false;
+  MigrationStats stats;
+  stats.request_frame = num_frames_;
+  auto begin = std::chrono::steady_clock::now();
+  bool reset = reset_(spare_);
+  stats.warmup_ms = ElapsedMs(begin);
+  if (!reset)
+    return false;
+  stats_.push_back(stats);
+  next_frame_ = num_frames_ - std::min(num_frames_, options_.history_frames);
+  crossfade_position_ = 0;
+  mismatch_energy_ = 0.0;
+  source_energy_ = 0.0;
+  state_ = State::kWarmup;
+  return true;
+}
+
+bool SessionMigration::Process(const float** input, float** output) {
+  if (options_.history_frames > 0)
+    pushHistory(input);
+  const size_t frame = num_frames_++;
+  if (!run_(active_, input, output))
+    return false;
+  if (state_ == State::kIdle)
+    return true;
+
+  MigrationStats& stats = stats_.back();
+  if (state_ == State::kWarmup) {
+    // A rate below 2 would never catch up with the stream
+    size_t budget = options_.warmup_rate == 0 ? frame - next_frame_ : std::max<size_t>(options_.warmup_rate, 2);
+    auto begin = std::chrono::steady_clock::now();
+    for (; next_frame_ < frame && budget > 0; next_frame_++, budget--) {
+      loadHistory(next_frame_);
+      if (!run_(spare_, history_input_.data(), scratch_output_.data()))
+        return false;
+      stats.warmup_frames++;
+    }
+    stats.warmup_ms += ElapsedMs(begin);
+    if (next_frame_ < frame)
+      return true;
+    state_ = State::kCrossfade;
+  }
+  return runCrossfade(input, output, &stats);
+}
+
+bool SessionMigration::runCrossfade(const float** input, float** output, MigrationStats* stats) {
+  auto begin = std::chrono::steady_clock::now();
+  if (!run_(spare_, input, scratch_output_.data()))
+    return false;
+  stats->crossfade_ms += ElapsedMs(begin);
+  next_frame_++;
+
+  for (unsigned ch = 0; ch < num_output_channels_; ch++) {
+    const float* source = output[ch];
+    const float* destination = scratch_output_[ch];
+    for (unsigned i = 0; i < output_samples_; i++) {
+      double diff = static_cast<double>(destination[i]) - source[i];
+      mismatch_energy_ += diff * diff;
+      source_energy_ += static_cast<double>(source[i]) * source[i];
+    }
+    if (options_.crossfade_frames == 0) {
+      std::memcpy(output[ch], destination, output_samples_ * sizeof(float));
+    } else {
+      CrossfadePart(output[ch], destination, crossfade_position_ * output_samples_, output_samples_,
+                    options_.crossfade_frames * output_samples_, shape_);
+    }
+  }
+  if (++crossfade_position_ < options_.crossfade_frames)
+    return true;
+
+  // Floor keeps silent input from reporting a division by zero
+  const double kFloor = 1e-20;
+  stats->mismatch_db = 10.0 * std::log10((mismatch_energy_ + kFloor) / (source_energy_ + kFloor));
+  stats->handover_frames = num_frames_ - stats->request_frame;
+  std::swap(active_, spare_);
+  state_ = State::kIdle;
+  return true;
+}
+
+void SessionMigration::pushHistory(const float* const* input) {
+  const size_t frame_size = static_cast<size_t>(num_input_channels_) * input_samples_;
+  float* slot = history_.data() + (num_frames_ % history_capacity_) * frame_size;
+  for (unsigned ch = 0; ch < num_input_channels_; ch++)
+    std::memcpy(slot + ch * input_samples_, input[ch], input_samples_ * sizeof(float));
+}
+
+void SessionMigration::loadHistory(size_t frame) {
+  const size_t frame_size = static_cast<size_t>(num_input_channels_) * input_samples_;
+  const float* slot = history_.data() + (frame % history_capacity_) * frame_size;
+  for (unsigned ch = 0; ch < num_input_channels_; ch++)
+    history_input_[ch] = slot + ch * input_samples_;
+}
+
+void SessionMigration::PrintReport(std::ostream& out, double frame_ms) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(2) << "Migrations (history " << options_.history_frames
+      << " frames, warm-up rate " << options_.warmup_rate << ", crossfade " << options_.crossfade_frames
+      << " frames):" << std::endl;
+  size_t completed = 0;
+  double warmup_ms = 0.0;
+  double crossfade_ms = 0.0;
+  double handover_frames = 0.0;
+  for (size_t i = 0; i < stats_.size(); i++) {
+    const MigrationStats& stats = stats_[i];
+    if (stats.handover_frames == 0)
+      continue;
+    out << "  at frame " << stats.request_frame << ": warm-up " << stats.warmup_frames << " frames in "
+        << stats.warmup_ms << " ms, handover after " << stats.handover_frames << " frames ("
+        << stats.handover_frames * frame_ms << " ms of audio), crossfade runs " << stats.crossfade_ms
+        << " ms, mismatch " << stats.mismatch_db << " dB" << std::endl;
+    completed++;
+    warmup_ms += stats.warmup_ms;
+    crossfade_ms += stats.crossfade_ms;
+    handover_frames += static_cast<double>(stats.handover_frames);
+  }
+  if (completed > 0) {
+    out << "  average: " << (warmup_ms + crossfade_ms) / completed << " ms of extra effect time, handover after "
+        << handover_frames / completed << " frames" << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace pipeline
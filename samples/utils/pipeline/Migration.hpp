@@ -0,0 +1,130 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "Segments.hpp"
+
+// Moving a running stream from one effect instance to another (e.g. when rebalancing handles
+// between devices) without an audible reset. Effect state can not be read out of an instance, so
+// the destination rebuilds it from the recent input: the stream keeps a rolling history of input
+// frames, a migration resets the destination and replays the history into it while the source
+// keeps producing the output, then both run for a few frames that are crossfaded before the
+// destination takes over.
+namespace pipeline {
+
+struct MigrationOptions {
+  // Input frames kept for replay, the destination state is rebuilt from this much audio
+  size_t history_frames = 50;
+  // History frames replayed per live frame, at least 2 so the destination catches up with the
+  // stream. 0 replays the whole history within the frame that requested the migration.
+  size_t warmup_rate = 4;
+  // Frames output as a crossfade of source and destination, 0 switches within one frame
+  size_t crossfade_frames = 2;
+};
+
+// Cost and quality of one migration
+struct MigrationStats {
+  // Stream frame at which the migration was requested
+  size_t request_frame = 0;
+  // Frames run on the destination before the crossfade, their output is dropped
+  size_t warmup_frames = 0;
+  // Time spent resetting the destination and running the warm-up frames
+  double warmup_ms = 0.0;
+  // Stream frames from the request until the destination alone produced the output
+  size_t handover_frames = 0;
+  // Time spent running the destination during the crossfade
+  double crossfade_ms = 0.0;
+  // Energy of the difference between destination and source output over the crossfade frames,
+  // relative to the source output. Lower means the destination state matched the source better.
+  double mismatch_db = 0.0;
+};
+
+class SessionMigration {
+ public:
+  // Runs one frame through an effect instance, returns false on failure
+  typedef std::function<bool(void* instance, const float** input, float** output)> RunFunction;
+  // Clears the state of an instance, returns false on failure
+  typedef std::function<bool(void* instance)> ResetFunction;
+
+  // active produces the output until the first migration, spare is the first destination.
+  // Input frames have num_input_channels planar channels of input_samples samples, output frames
+  // num_output_channels of output_samples.
+  SessionMigration(void* active, void* spare, unsigned num_input_channels, unsigned input_samples,
+                   unsigned num_output_channels, unsigned output_samples, const MigrationOptions& options,
+                   RunFunction run, ResetFunction reset);
+
+  // Starts moving the stream to the spare instance with the next frame. Returns false if a
+  // migration is already in progress or the destination could not be reset.
+  bool Request();
+  // Runs the next stream frame, output holds the frame of the instance that currently owns the
+  // stream, or the crossfade of both while switching
+  bool Process(const float** input, float** output);
+
+  bool IsMigrating() const { return state_ != State::kIdle; }
+  // Instance that currently owns the stream
+  void* GetActive() const { return active_; }
+  // One entry per migration, the last one may still be in progress
+  const std::vector<MigrationStats>& GetStats() const { return stats_; }
+  // Prints every completed migration and the average cost, frame_ms is the duration of one frame
+  void PrintReport(std::ostream& out, double frame_ms) const;
+
+ private:
+  enum class State {
+    kIdle,
+    kWarmup,
+    kCrossfade,
+  };
+
+  // Copies the frame into the history
+  void pushHistory(const float* const* input);
+  // Points history_input_ at a frame still held in the history
+  void loadHistory(size_t frame);
+  bool runCrossfade(const float** input, float** output, MigrationStats* stats);
+
+  void* active_;
+  void* spare_;
+  const unsigned num_input_channels_;
+  const unsigned input_samples_;
+  const unsigned num_output_channels_;
+  const unsigned output_samples_;
+  const MigrationOptions options_;
+  const RunFunction run_;
+  const ResetFunction reset_;
+  // Destination starts from a warmed up state and its output matches the source, unless there is no history
+  const CrossfadeShape shape_;
+
+  State state_ = State::kIdle;
+  // Stream frames seen so far
+  size_t num_frames_ = 0;
+  // Next stream frame the destination runs
+  size_t next_frame_ = 0;
+  // Crossfade frames already output
+  size_t crossfade_position_ = 0;
+  double mismatch_energy_ = 0.0;
+  double source_energy_ = 0.0;
+  // history_frames + 1 frames, frame f is at slot f % capacity
+  size_t history_capacity_;
+  std::vector<float> history_;
+  std::vector<const float*> history_input_;
+  // Destination output, dropped while warming up
+  std::vector<float> scratch_;
+  std::vector<float*> scratch_output_;
+  std::vector<MigrationStats> stats_;
+};
+
+}  // namespace pipeline
@@ -0,0 +1,146 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "PackedFrames.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <utils/dsp/SimdKernels.hpp>
+
+namespace pipeline {
+
+bool ParseTransportFormat(const std::string& name, TransportFormat* format) {
+  if (name == "float32")
+    *format = TransportFormat::kFloat32;
+  else if (name == "fp16")
+    *format = TransportFormat::kFloat16;
+  else if (name == "bf16")
+    *format = TransportFormat::kBFloat16;
+  else if (name == "int16")
+    *format = TransportFormat::kInt16;
+  else
+    return false;
+  return true;
+}
+
+const char* GetTransportFormatName(TransportFormat format) {
+  switch (format) {
+  case TransportFormat::kFloat16:
+    return "fp16";
+  case TransportFormat::kBFloat16:
+    return "bf16";
+  case TransportFormat::kInt16:
+    return "int16";
+  default:
+    return "float32";
+  }
+}
+
+size_t GetPackedFrameBytes(TransportFormat format, size_t frame_samples) {
+  switch (format) {
+  case TransportFormat::kFloat32:
+    return frame_samples * sizeof(float);
+  case TransportFormat::kInt16:
+    return sizeof(float) + frame_samples * sizeof(int16_t);
+  default:
+    return frame_samples * sizeof(uint16_t);
+  }
+}
+
+PackedFrames::PackedFrames(TransportFormat format, size_t frame_samples)
+  : format_(format), frame_samples_(frame_samples), frame_bytes_(GetPackedFrameBytes(format, frame_samples)) {}
+
+void PackedFrames::Assign(const float* samples, size_t num_frames) {
+  data_.resize(num_frames * frame_bytes_);
+  data_.shrink_to_fit();
+  num_frames_ = num_frames;
+  for (size_t i = 0; i < num_frames; i++)
+    pack(samples + i * frame_samples_, data_.data() + i * frame_bytes_);
+}
+
+void PackedFrames::Append(const float* frame) {
+  data_.resize((num_frames_ + 1) * frame_bytes_);
+  pack(frame, data_.data() + num_frames_ * frame_bytes_);
+  num_frames_++;
+}
+
+void PackedFrames::pack(const float* frame, uint8_t* out) {
+  // Frames start at multiples of 2 bytes, enough for the 16 bit formats. The int16 scale is copied.
+  switch (format_) {
+  case TransportFormat::kFloat32:
+    memcpy(out, frame, frame_bytes_);
+    break;
+  case TransportFormat::kFloat16:
+    dsp::FloatToHalf(frame, reinterpret_cast<uint16_t*>(out), frame_samples_);
+    break;
+  case TransportFormat::kBFloat16:
+    dsp::FloatToBFloat16(frame, reinterpret_cast<uint16_t*>(out), frame_samples_);
+    break;
+  case TransportFormat::kInt16: {
+    // The peak maps to 32767, a silent or non-finite frame gets scale 0
+    float peak = dsp::MaxAbs(frame, frame_samples_);
+    float scale = peak > 0.f && std::isfinite(peak) ? peak / 32767.f : 0.f;
+    memcpy(out, &scale, sizeof(scale));
+    dsp::FloatToInt16(frame, scale > 0.f ? 1.f / scale : 0.f, reinterpret_cast<int16_t*>(out + sizeof(scale)),
+                      frame_samples_);
+    break;
+  }
+  }
+}
+
+void PackedFrames::Unpack(size_t index, float* out) const {
+  if (index >= num_frames_) {
+    std::fill(out, out + frame_samples_, 0.f);
+    return;
+  }
+  const uint8_t* in = data_.data() + index * frame_bytes_;
+  switch (format_) {
+  case TransportFormat::kFloat32:
+    memcpy(out, in, frame_bytes_);
+    break;
+  case TransportFormat::kFloat16:
+    dsp::HalfToFloat(reinterpret_cast<const uint16_t*>(in), out, frame_samples_);
+    break;
+  case TransportFormat::kBFloat16:
+    dsp::BFloat16ToFloat(reinterpret_cast<const uint16_t*>(in), out, frame_samples_);
+    break;
+  case TransportFormat::kInt16: {
+    float scale;
+    memcpy(&scale, in, sizeof(scale));
+    dsp::Int16ToFloat(reinterpret_cast<const int16_t*>(in + sizeof(scale)), scale, out, frame_samples_);
+    break;
+  }
+  }
+}
+
+double TransportError::GetSnrDb() const {
+  if (error_energy <= 0.0)
+    return std::numeric_limits<double>::infinity();
+  return 10.0 * std::log10(std::max(signal_energy, 1e-30) / error_energy);
+}
+
+void MeasureTransportError(const PackedFrames& packed, const float* reference, size_t num_frames,
+                           TransportError* error) {
+  const size_t frame_samples = packed.GetFrameSamples();
+  std::vector<float> frame(frame_samples);
+  for (size_t i = 0; i < num_frames; i++) {
+    const float* expected = reference + i * frame_samples;
+    packed.Unpack(i, frame.data());
+    error->max_abs = std::max(error->max_abs, dsp::MaxAbsDiff(expected, frame.data(), frame_samples));
+    dsp::SignalErrorEnergy(expected, frame.data(), frame_samples, &error->signal_energy, &error->error_energy);
+  }
+}
+
+}  // namespace pipeline
@@ -0,0 +1,109 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Frame buffers held in a reduced precision transport format, e.g. whole-file inputs of many
+// streams. Samples are restored to float one frame at a time, right before NvAFX_Run.
+namespace pipeline {
+
+enum class TransportFormat {
+  kFloat32,
+  // IEEE half precision, 11 bit mantissa
+  kFloat16,
+  // bfloat16, 8 bit mantissa with the float range
+  kBFloat16,
+  // 16 bit integers with a float scale per frame from the frame's peak
+  kInt16,
+};
+
+// float32, fp16, bf16 or int16
+bool ParseTransportFormat(const std::string& name, TransportFormat* format);
+const char* GetTransportFormatName(TransportFormat format);
+// Size of a frame in the format, including the int16 scale
+size_t GetPackedFrameBytes(TransportFormat format, size_t frame_samples);
+
+class PackedFrames {
+ public:
+  PackedFrames(TransportFormat format, size_t frame_samples);
+
+  // Packs num_frames frames of samples, replacing the content
+  void Assign(const float* samples, size_t num_frames);
+  // Packs one frame after the others
+  void Append(const float* frame);
+  // Restores frame index into frame_samples floats. Safe to call from several threads.
+  void Unpack(size_t index, float* out) const;
+
+  TransportFormat GetFormat() const { return format_; }
+  size_t GetFrameSamples() const { return frame_samples_; }
+  size_t GetFrameBytes() const { return frame_bytes_; }
+  size_t GetNumFrames() const { return num_frames_; }
+  size_t GetBytes() const { return data_.size(); }
+
+ private:
+  void pack(const float* frame, uint8_t* out);
+
+  const TransportFormat format_;
+  const size_t frame_samples_;
+  const size_t frame_bytes_;
+  size_t num_frames_ = 0;
+  std::vector<uint8_t> data_;
+};
+
+// Difference between packed frames and the samples they were packed from
+struct TransportError {
+  float max_abs = 0.f;
+  double signal_energy = 0.0;
+  double error_energy = 0.0;
+
+  // Signal to error ratio in dB, infinite for a lossless transport
+  double GetSnrDb() const;
+};
+
+// Adds the error of the first num_frames frames of packed against reference to error
+void MeasureTransportError(const PackedFrames& packed, const float* reference, size_t num_frames,
+                           TransportError* error);
+
+// Pipeline stage restoring the input frames from packed buffers, one per input channel. Runs first,
+// the pipeline is dispatched with null input pointers.
+class UnpackStage {
+ public:
+  UnpackStage(const PackedFrames* const* inputs, unsigned num_channels)
+    : inputs_(inputs, inputs + num_channels), frames_(num_channels) {
+    for (unsigned ch = 0; ch < num_channels; ch++)
+      frames_[ch].resize(inputs[ch]->GetFrameSamples());
+  }
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    for (unsigned ch = 0; ch < FrameT::kNumInputChannels; ch++) {
+      inputs_[ch]->Unpack(frame.index, frames_[ch].data());
+      frame.input[ch] = frames_[ch].data();
+      bytes_read_ += inputs_[ch]->GetFrameBytes();
+    }
+    return true;
+  }
+
+  uint64_t GetBytesRead() const { return bytes_read_; }
+
+ private:
+  std::vector<const PackedFrames*> inputs_;
+  std::vector<std::vector<float>> frames_;
+  uint64_t bytes_read_ = 0;
+};
+
+}  // namespace pipeline
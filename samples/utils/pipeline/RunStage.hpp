@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <iostream>
+
+#include <nvAudioEffects.h>
+
+#include <utils/replay/CapturedCalls.hpp>
+#include <utils/replay/ReplayLog.hpp>
+#include <utils/trace/Trace.hpp>
+
+// Pipeline stage running the effect on the frame, see EffectPipeline.hpp
+namespace pipeline {
+
+// Runs the effect on the frame. Only RunStage<true> records the calls for replay, it is used when
+// replay_capture is set (see WithRunStage()).
+template <bool kCapture>
+class RunStage {
+ public:
+  RunStage(NvAFX_Handle handle, unsigned samples_per_frame, unsigned output_samples_per_frame)
+    : handle_(handle), samples_per_frame_(samples_per_frame), output_samples_per_frame_(output_samples_per_frame) {}
+
+  template <typename FrameT>
+  bool Process(FrameT& frame) {
+    return Run(handle_, frame.input, frame.output, FrameT::kNumInputChannels, FrameT::kNumOutputChannels);
+  }
+
+  bool Run(NvAFX_Handle handle, const float** input, float** output, unsigned num_input_channels,
+           unsigned num_output_channels) {
+    TRACE_SCOPE("NvAFX_Run");
+    NvAFX_Status status;
+    if (kCapture) {
+      replay::Recorder& recorder = replay::Recorder::Get();
+      uint64_t begin = recorder.Now();
+      status = NvAFX_Run(handle, input, output, samples_per_frame_, num_input_channels);
+      if (recorder.IsOpen()) {
+        recorder.RecordRun(handle, begin, status, input, num_input_channels, samples_per_frame_, output,
+                           num_output_channels, output_samples_per_frame_);
+      }
+    } else {
+      status = NvAFX_Run(handle, input, output, samples_per_frame_, num_input_channels);
+    }
+    if (status != NVAFX_STATUS_SUCCESS) {
+      std::cerr << "NvAFX_Run() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+      replay::CountError("NvAFX_Run", status);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  const NvAFX_Handle handle_;
+  const unsigned samples_per_frame_;
+  const unsigned output_samples_per_frame_;
+};
+
+// Calls process with the RunStage of handle matching the replay capture setting
+template <typename Process>
+bool WithRunStage(NvAFX_Handle handle, unsigned samples_per_frame, unsigned output_samples_per_frame,
+                  Process process) {
+  if (replay::Recorder::Get().IsOpen()) {
+    RunStage<true> run_stage(handle, samples_per_frame, output_samples_per_frame);
+    return process(run_stage);
+  }
+  RunStage<false> run_stage(handle, samples_per_frame, output_samples_per_frame);
+  return process(run_stage);
+}
+
+
+}  // namespace pipeline
@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "SegmentRunner.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include <utils/metrics/EffectMetrics.hpp>
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/replay/CapturedCalls.hpp>
+#include <utils/trace/Trace.hpp>
+
+#include "EffectPipeline.hpp"
+#include "FrameStages.hpp"
+#include "RunStage.hpp"
+
+namespace pipeline {
+
+SegmentRunner::SegmentRunner(const startup::EffectProperties& properties, const float* const* inputs,
+                             const PackedFrames* const* packed_inputs)
+  : properties_(properties) {
+  for (unsigned ch = 0; ch < 2; ch++) {
+    inputs_[ch] = ch < properties.num_input_channels ? inputs[ch] : nullptr;
+    packed_inputs_[ch] = ch < properties.num_input_channels ? packed_inputs[ch] : nullptr;
+  }
+}
+
+bool SegmentRunner::runSegment(NvAFX_Handle handle, const Segment& segment, std::vector<float>* segment_output) {
+  // Handles may still hold state from a previous run
+  NvAFX_Status status = replay::CapturedReset(handle);
+  if (status != NVAFX_STATUS_SUCCESS) {
+    std::cerr << "NvAFX_Reset() failed with error " << replay::GetErrorCodeString(status) << std::endl;
+    replay::CountError("NvAFX_Reset", status);
+    return false;
+  }
+  const unsigned num_input_channels = properties_.num_input_channels;
+  const unsigned num_output_channels = properties_.num_output_channels;
+  const unsigned input_frame_samples = properties_.num_input_samples_per_frame;
+  const unsigned output_frame_samples = properties_.num_output_samples_per_frame;
+  const size_t frame_samples = static_cast<size_t>(output_frame_samples) * num_output_channels;
+  segment_output->resize((segment.end_frame - segment.output_frame) * frame_samples);
+  std::vector<float> frame(frame_samples);
+  float* outputs[1] = { frame.data() };
+  CollectStage collect_stage(segment_output->data(), segment.output_frame, output_frame_samples,
+                             num_output_channels);
+  size_t begin = segment.first_frame * input_frame_samples;
+  size_t end = segment.end_frame * input_frame_samples;
+  auto run_frames = [&](auto& run_stage) {
+    if (packed_inputs_[0]) {
+      // Every segment restores its frames into its own buffers
+      UnpackStage unpack_stage(packed_inputs_, num_input_channels);
+      return Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs_, outputs, begin, end,
+                      unpack_stage, run_stage, collect_stage);
+    }
+    return Dispatch(num_input_channels, num_output_channels, input_frame_samples, inputs_, outputs, begin, end,
+                    run_stage, collect_stage);
+  };
+  bool success = WithRunStage(handle, input_frame_samples, output_frame_samples, run_frames);
+  metrics::EffectMetrics::Get().frames_processed.Inc(segment.end_frame - segment.first_frame);
+  return success;
+}
+
+double SegmentRunner::Run(const std::vector<NvAFX_Handle>& handles, scheduler::DeviceScheduler* device_scheduler,
+                          const std::vector<Segment>& segments, CrossfadeShape shape, std::vector<float>* output) {
+  const size_t frame_samples =
+    static_cast<size_t>(properties_.num_output_samples_per_frame) * properties_.num_output_channels;
+  std::vector<std::vector<float>> segment_outputs(segments.size());
+
+  auto start_tick = std::chrono::high_resolution_clock::now();
+  if (device_scheduler) {
+    float frame_in_secs = static_cast<float>(properties_.num_input_samples_per_frame) /
+                          static_cast<float>(properties_.input_sample_rate);
+    for (size_t k = 0; k < segments.size(); k++) {
+      scheduler::Job job;
+      job.audio_secs = (segments[k].end_frame - segments[k].first_frame) * frame_in_secs;
+      job.run = [&, k](void* instance, int) {
+        TRACE_SCOPE_ARG("segment", "index", k);
+        return runSegment(static_cast<NvAFX_Handle>(instance), segments[k], &segment_outputs[k]);
+      };
+      device_scheduler->Submit(std::move(job));
+    }
+    if (!device_scheduler->Wait())
+      return -1.0;
+  } else {
+    std::unique_ptr<bool[]> segment_success(new bool[segments.size()]());
+    std::vector<std::thread> workers;
+    for (size_t k = 0; k < segments.size(); k++) {
+      workers.emplace_back([&, k] {
+        TRACE_THREAD_NAME("segment");
+        placement::ThreadScope placement_scope(placement::Role::kWorker, "segment");
+        TRACE_SCOPE_ARG("segment", "index", k);
+        segment_success[k] = runSegment(handles[k], segments[k], &segment_outputs[k]);
+      });
+    }
+    for (std::thread& worker : workers)
+      worker.join();
+    for (size_t k = 0; k < segments.size(); k++) {
+      if (!segment_success[k])
+        return -1.0;
+    }
+  }
+  double wall_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_tick).count();
+
+  // Segments in order, each one crossfades into the tail of the previous one
+  TRACE_SCOPE("stitch_segments");
+  output->assign(segments.back().end_frame * frame_samples, 0.f);
+  for (size_t k = 0; k < segments.size(); k++) {
+    const Segment& segment = segments[k];
+    size_t crossfade_samples = (segment.begin_frame - segment.output_frame) * frame_samples;
+    Crossfade(output->data() + segment.output_frame * frame_samples, segment_outputs[k].data(), crossfade_samples,
+              shape);
+    std::copy(segment_outputs[k].begin() + crossfade_samples, segment_outputs[k].end(),
+              output->begin() + segment.begin_frame * frame_samples);
+  }
+  return wall_time;
+}
+
+}  // namespace pipeline
@@ -0,0 +1,50 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <nvAudioEffects.h>
+
+#include <utils/scheduler/DeviceScheduler.hpp>
+#include <utils/startup/StartupProfile.hpp>
+
+#include "PackedFrames.hpp"
+#include "Segments.hpp"
+
+namespace pipeline {
+
+// Runs the segments of a whole-file input (Segments.hpp) in parallel, each from a reset handle, and
+// stitches their outputs.
+class SegmentRunner {
+ public:
+  // inputs holds one planar buffer per input channel. With packed_inputs (one per input channel, or
+  // null) the frames are restored from them instead and inputs is not read.
+  SegmentRunner(const startup::EffectProperties& properties, const float* const* inputs,
+                const PackedFrames* const* packed_inputs);
+
+  // Runs every segment on its own thread and handle, or as jobs of device_scheduler if given, and
+  // stitches the outputs into output. Returns wall time, negative on failure.
+  double Run(const std::vector<NvAFX_Handle>& handles, scheduler::DeviceScheduler* device_scheduler,
+             const std::vector<Segment>& segments, CrossfadeShape shape, std::vector<float>* output);
+
+ private:
+  // Runs one segment from a reset handle
+  bool runSegment(NvAFX_Handle handle, const Segment& segment, std::vector<float>* segment_output);
+
+  const startup::EffectProperties properties_;
+  const float* inputs_[2];
+  const PackedFrames* packed_inputs_[2];
+};
+
+}  // namespace pipeline
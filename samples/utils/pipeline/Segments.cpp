@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "Segments.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pipeline {
+
+std::vector<Segment> PlanSegments(size_t num_frames, unsigned num_segments, size_t preroll_frames,
+                                  size_t crossfade_frames) {
+  std::vector<Segment> segments;
+  if (num_frames == 0)
+    return segments;
+  size_t count = std::max<size_t>(1, std::min<size_t>(num_segments, num_frames));
+  segments.resize(count);
+  for (size_t k = 0; k < count; k++) {
+    Segment& segment = segments[k];
+    segment.begin_frame = num_frames * k / count;
+    segment.end_frame = num_frames * (k + 1) / count;
+    if (k == 0) {
+      segment.output_frame = segment.first_frame = 0;
+      continue;
+    }
+    size_t previous_length = segment.begin_frame - segments[k - 1].begin_frame;
+    segment.output_frame = segment.begin_frame - std::min(crossfade_frames, previous_length);
+    segment.first_frame = segment.output_frame - std::min(preroll_frames, segment.output_frame);
+  }
+  return segments;
+}
+
+void Crossfade(float* dst, const float* src, size_t n, CrossfadeShape shape) {
+  CrossfadePart(dst, src, 0, n, n, shape);
+}
+
+void CrossfadePart(float* dst, const float* src, size_t offset, size_t count, size_t n, CrossfadeShape shape) {
+  const double kHalfPi = 1.57079632679489661923;
+  for (size_t i = 0; i < count; i++) {
+    double phase = kHalfPi * (static_cast<double>(offset + i) + 0.5) / static_cast<double>(n);
+    double fade_out = std::cos(phase);
+    double fade_in = std::sin(phase);
+    if (shape == CrossfadeShape::kEqualGain) {
+      fade_out *= fade_out;
+      fade_in *= fade_in;
+    }
+    dst[i] = static_cast<float>(dst[i] * fade_out + src[i] * fade_in);
+  }
+}
+
+}  // namespace pipeline
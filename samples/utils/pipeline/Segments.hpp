@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+// Splitting one long input into segments that are processed independently (e.g. on one effect
+// handle each) and stitched back together. Every segment after the first starts with a warm-up
+// pre-roll whose output is dropped, followed by a crossfade region overlapping the end of the
+// previous segment.
+namespace pipeline {
+
+// Frame ranges of one segment, first_frame <= output_frame <= begin_frame < end_frame
+struct Segment {
+  // First input frame run through the effect, frames before output_frame only warm it up
+  size_t first_frame;
+  // First frame whose output is kept, [output_frame, begin_frame) is crossfaded with the previous segment
+  size_t output_frame;
+  // First frame owned by the segment
+  size_t begin_frame;
+  // One past the last frame
+  size_t end_frame;
+};
+
+// Splits num_frames frames into num_segments segments of about equal length. The crossfade is
+// limited to the length of the previous segment, the pre-roll to the start of the input.
+std::vector<Segment> PlanSegments(size_t num_frames, unsigned num_segments, size_t preroll_frames,
+                                  size_t crossfade_frames);
+
+// Gain curves of the crossfade between two segments
+enum class CrossfadeShape {
+  // sin / cos ramps, keeps the level constant when the overlapping outputs are uncorrelated
+  kEqualPower,
+  // sin^2 / cos^2 ramps, keeps the level constant when the outputs agree (effect fully warmed up)
+  kEqualGain,
+};
+
+// Crossfades n samples, dst fades out and src fades in
+void Crossfade(float* dst, const float* src, size_t n, CrossfadeShape shape);
+// Crossfades count samples starting at sample offset of an n sample crossfade, for crossfades that
+// are applied one frame at a time
+void CrossfadePart(float* dst, const float* src, size_t offset, size_t count, size_t n, CrossfadeShape shape);
+
+}  // namespace pipeline
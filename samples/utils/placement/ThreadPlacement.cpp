@@ -0,0 +1,364 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "ThreadPlacement.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace placement {
+
+namespace {
+
+// "0-3,8" from a sorted list
+std::string FormatCpuList(const std::vector<int>& cpus) {
+  std::ostringstream out;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t end = i;
+    while (end + 1 < cpus.size() && cpus[end + 1] == cpus[end] + 1)
+      end++;
+    out << (i > 0 ? "," : "") << cpus[i];
+    if (end > i)
+      out << "-" << cpus[end];
+    i = end + 1;
+  }
+  return out.str();
+}
+
+#ifdef __linux__
+long CurrentThreadId() {
+  return static_cast<long>(syscall(SYS_gettid));
+}
+
+// NUMA node of cpu from sysfs, -1 if unknown
+int GetCpuNode(int cpu) {
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    return -1;
+  int node = -1;
+  while (dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+std::vector<int> GetAffinity(long tid) {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(static_cast<pid_t>(tid), sizeof(set), &set) != 0)
+    return cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set))
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::string GetPolicy() {
+  int policy = sched_getscheduler(0);
+  if (policy < 0)
+    return "unknown";
+  policy &= ~SCHED_RESET_ON_FORK;
+  sched_param param;
+  sched_getparam(0, &param);
+  if (policy == SCHED_FIFO)
+    return "SCHED_FIFO " + std::to_string(param.sched_priority);
+  if (policy == SCHED_RR)
+    return "SCHED_RR " + std::to_string(param.sched_priority);
+  return "SCHED_OTHER";
+}
+#elif defined(_WIN32)
+long CurrentThreadId() {
+  return static_cast<long>(GetCurrentThreadId());
+}
+
+int GetCpuNode(int cpu) {
+  UCHAR node = 0;
+  if (cpu > 255 || !GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node))
+    return -1;
+  return node;
+}
+#else
+long CurrentThreadId() {
+  return -1;
+}
+
+int GetCpuNode(int) {
+  return -1;
+}
+#endif
+
+}  // namespace
+
+const char* GetRoleName(Role role) {
+  switch (role) {
+  case Role::kFeed:
+    return "feed";
+  case Role::kIo:
+    return "io";
+  case Role::kWorker:
+    return "worker";
+  default:
+    return "unknown";
+  }
+}
+
+bool ParseCpuList(const std::string& text, std::vector<int>* cpus) {
+  cpus->clear();
+  std::istringstream in(text);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    char* end = nullptr;
+    long first = strtol(range.c_str(), &end, 10);
+    long last = first;
+    if (end == range.c_str() || first < 0)
+      return false;
+    if (*end == '-') {
+      const char* second = end + 1;
+      last = strtol(second, &end, 10);
+      if (end == second || last < first)
+        return false;
+    }
+    if (*end != '\0' || last >= 4096)
+      return false;
+    for (long cpu = first; cpu <= last; cpu++)
+      cpus->push_back(static_cast<int>(cpu));
+  }
+  std::sort(cpus->begin(), cpus->end());
+  cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+  return !cpus->empty();
+}
+
+ThreadPlacement& ThreadPlacement::Get() {
+  static ThreadPlacement placement;
+  return placement;
+}
+
+void ThreadPlacement::SetCpus(Role role, const std::vector<int>& cpus) {
+  roles_[static_cast<int>(role)].cpus = cpus;
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void ThreadPlacement::SetRealtimePriority(Role role, int priority) {
+  roles_[static_cast<int>(role)].realtime_priority = priority;
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+size_t ThreadPlacement::Enter(Role role, const char* name) {
+  const RoleConfig& config = roles_[static_cast<int>(role)];
+  Record record;
+  record.name = name;
+  record.role = role;
+  record.tid = CurrentThreadId();
+  record.node = -1;
+  record.running = true;
+
+  std::string placement_error;
+#ifdef __linux__
+  if (!config.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : config.cpus) {
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      placement_error = std::string(" (affinity failed: ") + strerror(errno) + ")";
+  }
+  std::string realtime_error;
+  if (config.realtime_priority > 0) {
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.realtime_priority;
+    // Threads and processes started from here do not inherit the real-time policy
+    if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+      realtime_error = std::string(" (SCHED_FIFO failed: ") + strerror(errno) + ")";
+  }
+  std::vector<int> effective = GetAffinity(record.tid);
+  record.cpus = FormatCpuList(effective) + placement_error;
+  record.node = effective.empty() ? -1 : GetCpuNode(effective.front());
+  record.policy = GetPolicy() + realtime_error;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (int cpu : config.cpus) {
+    if (cpu < 64)
+      mask |= static_cast<DWORD_PTR>(1) << cpu;
+  }
+  DWORD_PTR previous = mask ? SetThreadAffinityMask(GetCurrentThread(), mask) : 0;
+  if (mask && !previous)
+    placement_error = " (affinity failed)";
+  record.cpus = (mask ? FormatCpuList(config.cpus) : std::string("all")) + placement_error;
+  record.node = config.cpus.empty() ? -1 : GetCpuNode(config.cpus.front());
+  record.policy = "normal";
+  if (config.realtime_priority > 0) {
+    record.policy = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)
+                    ? "time critical" : "normal (time critical failed)";
+  }
+#else
+  record.cpus = "all (placement not supported)";
+  record.policy = "normal";
+#endif
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_.push_back(record);
+  return records_.size() - 1;
+}
+
+void ThreadPlacement::Leave(size_t record) {
+  Counters counters;
+  bool read = readCounters(CurrentThreadId(), &counters);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (record >= records_.size())
+    return;
+  if (read)
+    records_[record].counters = counters;
+  records_[record].running = false;
+}
+
+bool ThreadPlacement::readCounters(long tid, Counters* counters) {
+#ifdef __linux__
+  const std::string task = "/proc/self/task/" + std::to_string(tid);
+  std::ifstream status(task + "/status");
+  if (!status)
+    return false;
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0)
+      counters->voluntary_switches = strtoull(line.c_str() + 24, nullptr, 10);
+    else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0)
+      counters->involuntary_switches = strtoull(line.c_str() + 27, nullptr, 10);
+  }
+  // Only with CONFIG_SCHED_DEBUG
+  std::ifstream sched(task + "/sched");
+  while (std::getline(sched, line)) {
+    if (line.compare(0, 16, "se.nr_migrations") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos)
+        counters->migrations = strtoull(line.c_str() + colon + 1, nullptr, 10);
+    }
+  }
+  // Field 39 of stat, counted after the command name which may contain spaces
+  std::ifstream stat(task + "/stat");
+  std::getline(stat, line);
+  size_t paren = line.rfind(')');
+  if (paren != std::string::npos) {
+    std::istringstream fields(line.substr(paren + 2));
+    std::string field;
+    for (int i = 3; i <= 39 && fields >> field; i++) {
+      if (i == 39)
+        counters->last_cpu = atoi(field.c_str());
+    }
+  }
+  return true;
+#else
+  (void)tid;
+  (void)counters;
+  return false;
+#endif
+}
+
+void ThreadPlacement::PrintReport(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Record& record : records_) {
+    if (record.running)
+      readCounters(record.tid, &record.counters);
+  }
+  out << "Thread placement:" << std::endl
+      << "  " << std::left << std::setw(16) << "thread" << std::setw(8) << "role" << std::setw(10) << "tid"
+      << std::setw(12) << "cpus" << std::setw(6) << "node" << std::right << std::setw(8) << "last cpu"
+      << std::setw(12) << "voluntary" << std::setw(12) << "preempted" << std::setw(12) << "migrations"
+      << "  policy" << std::endl;
+  for (const Record& record : records_) {
+    const Counters& counters = record.counters;
+    out << "  " << std::left << std::setw(16) << record.name << std::setw(8) << GetRoleName(record.role)
+        << std::setw(10) << record.tid << std::setw(12) << record.cpus << std::setw(6)
+        << (record.node >= 0 ? std::to_string(record.node) : std::string("-")) << std::right << std::setw(8)
+        << (counters.last_cpu >= 0 ? std::to_string(counters.last_cpu) : std::string("-")) << std::setw(12)
+        << counters.voluntary_switches << std::setw(12) << counters.involuntary_switches << std::setw(12)
+        << (counters.migrations != UINT64_MAX ? std::to_string(counters.migrations) : std::string("-")) << "  "
+        << record.policy << std::endl;
+  }
+}
+
+LocalBuffer::LocalBuffer(size_t count) : count_(count), bytes_(count * sizeof(float)) {
+  if (bytes_ == 0)
+    return;
+#ifdef __linux__
+  // Fresh pages from mmap are placed on first touch, by this thread. A preferred policy for the
+  // node of the current CPU also holds under a process wide interleave policy (numactl).
+  void* memory = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return;
+  int node = GetCpuNode(sched_getcpu());
+#ifdef SYS_mbind
+  if (node >= 0 && node < 64) {
+    const int kMpolPreferred = 1;
+    unsigned long nodemask = 1ul << node;
+    syscall(SYS_mbind, memory, bytes_, kMpolPreferred, &nodemask, 64, 0);
+  }
+#endif
+  data_ = static_cast<float*>(memory);
+  memset(data_, 0, bytes_);
+#elif defined(_WIN32)
+  PROCESSOR_NUMBER processor;
+  GetCurrentProcessorNumberEx(&processor);
+  USHORT node = 0;
+  void* memory = nullptr;
+  if (GetNumaProcessorNodeEx(&processor, &node)) {
+    memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                                node);
+  }
+  if (!memory)
+    memory = VirtualAlloc(nullptr, bytes_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  data_ = static_cast<float*>(memory);
+  if (data_)
+    memset(data_, 0, bytes_);
+#else
+  data_ = static_cast<float*>(calloc(count, sizeof(float)));
+#endif
+}
+
+LocalBuffer::~LocalBuffer() {
+  if (!data_)
+    return;
+#ifdef __linux__
+  munmap(data_, bytes_);
+#elif defined(_WIN32)
+  VirtualFree(data_, 0, MEM_RELEASE);
+#else
+  free(data_);
+#endif
+}
+
+}  // namespace placement
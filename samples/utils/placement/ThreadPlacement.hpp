@@ -0,0 +1,133 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Placement of the pipeline threads: each thread declares its role (frame feed loop, I/O, worker)
+// and is pinned to the CPU set configured for that role, optionally with a real-time priority.
+// Tracked threads are reported with their effective placement and how often they were switched
+// out or moved between CPUs. Nothing is changed or tracked unless a role is configured.
+namespace placement {
+
+enum class Role {
+  // Thread running the effect frame by frame
+  kFeed,
+  // Decoding, file reads and writes
+  kIo,
+  // Segment, device and analysis workers
+  kWorker,
+  kCount,
+};
+
+const char* GetRoleName(Role role);
+
+// Parses a CPU list like "0-3,8,10-11". Returns false on a syntax error.
+bool ParseCpuList(const std::string& text, std::vector<int>* cpus);
+
+class ThreadPlacement {
+ public:
+  static ThreadPlacement& Get();
+
+  // Restricts threads of role to cpus. Configure before the threads start.
+  void SetCpus(Role role, const std::vector<int>& cpus);
+  // Requests SCHED_FIFO at priority (1-99) for threads of role, 0 keeps the normal policy. Without
+  // the permission the thread keeps running at normal priority and the report says why.
+  void SetRealtimePriority(Role role, int priority);
+  // True once anything was configured
+  bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Places the calling thread according to role and starts tracking it. Returns its record.
+  size_t Enter(Role role, const char* name);
+  // Captures the counters of the calling thread, which is about to stop running as record
+  void Leave(size_t record);
+  // Prints every tracked thread, counters of threads still running are read now
+  void PrintReport(std::ostream& out);
+
+ private:
+  struct RoleConfig {
+    std::vector<int> cpus;
+    int realtime_priority = 0;
+  };
+  struct Counters {
+    // Switched out while waiting, or preempted
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    // Moves to another CPU, UINT64_MAX if the kernel does not report them
+    uint64_t migrations = UINT64_MAX;
+    int last_cpu = -1;
+  };
+  struct Record {
+    std::string name;
+    Role role;
+    long tid;
+    // Effective affinity, NUMA node of its first CPU (-1 if unknown) and scheduling policy
+    std::string cpus;
+    int node;
+    std::string policy;
+    bool running;
+    Counters counters;
+  };
+
+  static bool readCounters(long tid, Counters* counters);
+
+  std::atomic<bool> enabled_{false};
+  RoleConfig roles_[static_cast<int>(Role::kCount)];
+  std::mutex mutex_;
+  std::vector<Record> records_;
+};
+
+// Places the current thread for the lifetime of the scope, see ThreadPlacement::Enter()
+class ThreadScope {
+ public:
+  ThreadScope(Role role, const char* name) {
+    ThreadPlacement& placement = ThreadPlacement::Get();
+    if (placement.IsEnabled())
+      record_ = static_cast<long>(placement.Enter(role, name));
+  }
+  ~ThreadScope() {
+    if (record_ >= 0)
+      ThreadPlacement::Get().Leave(static_cast<size_t>(record_));
+  }
+  ThreadScope(const ThreadScope&) = delete;
+  ThreadScope& operator=(const ThreadScope&) = delete;
+
+ private:
+  long record_ = -1;
+};
+
+// Frame buffer whose pages are placed on the NUMA node the allocating thread runs on. Allocate it
+// on the thread that uses it, after the thread was placed. The buffer starts zeroed.
+class LocalBuffer {
+ public:
+  explicit LocalBuffer(size_t count);
+  ~LocalBuffer();
+  LocalBuffer(const LocalBuffer&) = delete;
+  LocalBuffer& operator=(const LocalBuffer&) = delete;
+
+  float* get() const { return data_; }
+  size_t size() const { return count_; }
+
+ private:
+  float* data_ = nullptr;
+  size_t count_ = 0;
+  size_t bytes_ = 0;
+};
+
+}  // namespace placement
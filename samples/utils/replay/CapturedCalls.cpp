@@ -0,0 +1,140 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "CapturedCalls.hpp"
+
+#include <utils/metrics/Metrics.hpp>
+
+#include "ReplayLog.hpp"
+
+namespace replay {
+
+const std::string GetErrorCodeString(NvAFX_Status status) {
+  switch (status) {
+  case NVAFX_STATUS_SUCCESS:
+    return "NVAFX_STATUS_SUCCESS";
+  case NVAFX_STATUS_FAILED:
+    return "NVAFX_STATUS_FAILED";
+  case NVAFX_STATUS_INVALID_HANDLE:
+    return "NVAFX_STATUS_INVALID_HANDLE";
+  case NVAFX_STATUS_INVALID_PARAM:
+    return "NVAFX_STATUS_INVALID_PARAM";
+  case NVAFX_STATUS_IMMUTABLE_PARAM:
+    return "NVAFX_STATUS_IMMUTABLE_PARAM";
+  case NVAFX_STATUS_INSUFFICIENT_DATA:
+    return "NVAFX_STATUS_INSUFFICIENT_DATA";
+  case NVAFX_STATUS_EFFECT_NOT_AVAILABLE:
+    return "NVAFX_STATUS_EFFECT_NOT_AVAILABLE";
+  case NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL:
+    return "NVAFX_STATUS_OUTPUT_BUFFER_TOO_SMALL";
+  case NVAFX_STATUS_MODEL_LOAD_FAILED:
+    return "NVAFX_STATUS_MODEL_LOAD_FAILED";
+  case NVAFX_STATUS_32_SERVER_NOT_REGISTERED:
+    return "NVAFX_STATUS_32_SERVER_NOT_REGISTERED";
+  case NVAFX_STATUS_32_COM_ERROR:
+    return "NVAFX_STATUS_32_COM_ERROR";
+  case NVAFX_STATUS_GPU_UNSUPPORTED:
+    return "NVAFX_STATUS_GPU_UNSUPPORTED";
+  case NVAFX_STATUS_CUDA_CONTEXT_CREATION_FAILED:
+    return "NVAFX_STATUS_CUDA_CONTEXT_CREATION_FAILED";
+  default:
+    return "NVAFX_STATUS_UNKNOWN";
+  }
+}
+
+void CountError(const char* call, NvAFX_Status status) {
+  std::string labels = std::string("call=\"") + call + "\",status=\"" + GetErrorCodeString(status) + "\"";
+  metrics::Registry::Get().AddCounter("nvafx_errors_total", "Failed SDK calls by call and status", labels).Inc();
+}
+
+NvAFX_Status CapturedCreate(const char* effect, bool chained, NvAFX_Handle* handle) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = chained ? NvAFX_CreateChainedEffect(effect, handle) : NvAFX_CreateEffect(effect, handle);
+  if (recorder.IsOpen() && status == NVAFX_STATUS_SUCCESS)
+    recorder.RecordCreate(*handle, begin, status, effect, chained);
+  return status;
+}
+
+NvAFX_Status CapturedSetString(NvAFX_Handle handle, NvAFX_ParameterSelector param, const char* value) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_SetString(handle, param, value);
+  if (recorder.IsOpen())
+    recorder.RecordSetString(handle, begin, status, param, value);
+  return status;
+}
+
+NvAFX_Status CapturedSetStringList(NvAFX_Handle handle, NvAFX_ParameterSelector param, const char** values,
+                                   unsigned count) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_SetStringList(handle, param, values, count);
+  if (recorder.IsOpen())
+    recorder.RecordSetStringList(handle, begin, status, param, values, count);
+  return status;
+}
+
+NvAFX_Status CapturedSetFloat(NvAFX_Handle handle, NvAFX_ParameterSelector param, float value) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_SetFloat(handle, param, value);
+  if (recorder.IsOpen())
+    recorder.RecordSetFloat(handle, begin, status, param, value);
+  return status;
+}
+
+NvAFX_Status CapturedSetFloatList(NvAFX_Handle handle, NvAFX_ParameterSelector param, float* values,
+                                  unsigned count) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_SetFloatList(handle, param, values, count);
+  if (recorder.IsOpen())
+    recorder.RecordSetFloatList(handle, begin, status, param, values, count);
+  return status;
+}
+
+NvAFX_Status CapturedSetU32(NvAFX_Handle handle, NvAFX_ParameterSelector param, unsigned value) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_SetU32(handle, param, value);
+  if (recorder.IsOpen())
+    recorder.RecordSetU32(handle, begin, status, param, value);
+  return status;
+}
+
+NvAFX_Status CapturedLoad(NvAFX_Handle handle) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_Load(handle);
+  if (recorder.IsOpen())
+    recorder.RecordLoad(handle, begin, status);
+  return status;
+}
+
+NvAFX_Status CapturedReset(NvAFX_Handle handle) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_Reset(handle);
+  if (recorder.IsOpen())
+    recorder.RecordReset(handle, begin, status);
+  return status;
+}
+
+NvAFX_Status CapturedDestroy(NvAFX_Handle handle) {
+  Recorder& recorder = Recorder::Get();
+  uint64_t begin = recorder.Now();
+  NvAFX_Status status = NvAFX_DestroyEffect(handle);
+  if (recorder.IsOpen())
+    recorder.RecordDestroy(handle, begin, status);
+  return status;
+}
+
+}  // namespace replay
@@ -0,0 +1,39 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <string>
+
+#include <nvAudioEffects.h>
+
+// NvAFX calls of the sample apps that change effect state. Each one is also appended to the replay
+// capture when one is open (Recorder::Get()); without a capture they cost one relaxed load on top of
+// the call. NvAFX_Run is recorded by RunStage<true> (utils/pipeline/RunStage.hpp).
+namespace replay {
+
+// Name of an NvAFX_Status, e.g. "NVAFX_STATUS_FAILED"
+const std::string GetErrorCodeString(NvAFX_Status status);
+// Counts a failed SDK call in the nvafx_errors_total metric, keyed on the call and its status
+void CountError(const char* call, NvAFX_Status status);
+
+NvAFX_Status CapturedCreate(const char* effect, bool chained, NvAFX_Handle* handle);
+NvAFX_Status CapturedSetString(NvAFX_Handle handle, NvAFX_ParameterSelector param, const char* value);
+NvAFX_Status CapturedSetStringList(NvAFX_Handle handle, NvAFX_ParameterSelector param, const char** values,
+                                   unsigned count);
+NvAFX_Status CapturedSetFloat(NvAFX_Handle handle, NvAFX_ParameterSelector param, float value);
+NvAFX_Status CapturedSetFloatList(NvAFX_Handle handle, NvAFX_ParameterSelector param, float* values,
+                                  unsigned count);
+NvAFX_Status CapturedSetU32(NvAFX_Handle handle, NvAFX_ParameterSelector param, unsigned value);
+NvAFX_Status CapturedLoad(NvAFX_Handle handle);
+NvAFX_Status CapturedReset(NvAFX_Handle handle);
+NvAFX_Status CapturedDestroy(NvAFX_Handle handle);
+
+}  // namespace replay
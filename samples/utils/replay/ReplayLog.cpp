@@ -0,0 +1,463 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "ReplayLog.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace replay {
+
+namespace {
+
+// The mapping grows by doubling from kInitialCapacity, at most by kMaxGrowth at a time
+const uint64_t kInitialCapacity = 16ull << 20;
+const uint64_t kMaxGrowth = 256ull << 20;
+
+uint64_t Align8(uint64_t size) { return (size + 7) & ~7ull; }
+
+void PutBytes(std::vector<uint8_t>* payload, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  payload->insert(payload->end(), bytes, bytes + size);
+}
+
+void PutU32(std::vector<uint8_t>* payload, uint32_t value) { PutBytes(payload, &value, sizeof(value)); }
+
+// Length, characters and padding to 4 bytes so that following floats stay aligned
+void PutString(std::vector<uint8_t>* payload, const char* value) {
+  uint32_t length = value ? static_cast<uint32_t>(std::strlen(value)) : 0u;
+  PutU32(payload, length);
+  PutBytes(payload, value, length);
+  payload->resize(payload->size() + ((4 - length % 4) % 4), 0);
+}
+
+}  // namespace
+
+uint64_t OutputHash(const float* const* frames, unsigned num_channels, unsigned num_samples) {
+  // FNV-1a over 32-bit words, only needs to be stable between capture and replay
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned c = 0; c < num_channels; c++) {
+    for (unsigned i = 0; i < num_samples; i++) {
+      uint32_t word;
+      std::memcpy(&word, &frames[c][i], sizeof(word));
+      hash ^= word;
+      hash *= 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+Recorder& Recorder::Get() {
+  static Recorder recorder;
+  return recorder;
+}
+
+Recorder::Recorder() : open_(false), start_(std::chrono::steady_clock::now()) {}
+
+Recorder::~Recorder() {
+  if (IsOpen())
+    Close();
+}
+
+bool Recorder::Open(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (open_.load(std::memory_order_relaxed)) {
+    std::cerr << "Replay capture is already open" << std::endl;
+    return false;
+  }
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cerr << "Unable to create replay capture: " << path << std::endl;
+    return false;
+  }
+  file_ = file;
+#else
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    std::cerr << "Unable to create replay capture: " << path << std::endl;
+    return false;
+  }
+#endif
+  used_ = 0;
+  num_records_ = 0;
+  failed_ = false;
+  handles_.clear();
+  next_handle_ = 1;
+  if (!grow(kInitialCapacity)) {
+    std::cerr << "Unable to map replay capture: " << path << std::endl;
+    unmap();
+    return false;
+  }
+
+  LogHeader header = {};
+  std::memcpy(header.magic, kLogMagic, sizeof(header.magic));
+  header.version = kLogVersion;
+  header.header_size = sizeof(LogHeader);
+  header.start_unix_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+  std::memcpy(data_, &header, sizeof(header));
+  used_ = sizeof(header);
+  start_ = std::chrono::steady_clock::now();
+  open_.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+bool Recorder::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!open_.load(std::memory_order_relaxed))
+    return false;
+  open_.store(false, std::memory_order_relaxed);
+  bool success = !failed_;
+#ifdef _WIN32
+  if (data_)
+    success = FlushViewOfFile(data_, 0) && success;
+  unmap();
+  LARGE_INTEGER size;
+  size.QuadPart = static_cast<LONGLONG>(used_);
+  success = SetFilePointerEx(file_, size, nullptr, FILE_BEGIN) && SetEndOfFile(file_) && success;
+  CloseHandle(file_);
+  file_ = nullptr;
+#else
+  unmap();
+  success = ftruncate(fd_, static_cast<off_t>(used_)) == 0 && success;
+  success = close(fd_) == 0 && success;
+  fd_ = -1;
+#endif
+  handles_.clear();
+  return success;
+}
+
+bool Recorder::grow(uint64_t capacity) {
+  unmap();
+#ifdef _WIN32
+  HANDLE mapping = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(capacity >> 32),
+                                      static_cast<DWORD>(capacity & 0xffffffffull), nullptr);
+  if (!mapping)
+    return false;
+  void* data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(capacity));
+  if (!data) {
+    CloseHandle(mapping);
+    return false;
+  }
+  mapping_ = mapping;
+#else
+  // The new space reads as zeros, i.e. as the end of the log
+  if (ftruncate(fd_, static_cast<off_t>(capacity)) != 0)
+    return false;
+  void* data = mmap(nullptr, static_cast<size_t>(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED)
+    return false;
+#endif
+  data_ = static_cast<uint8_t*>(data);
+  capacity_ = capacity;
+  return true;
+}
+
+void Recorder::unmap() {
+#ifdef _WIN32
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+  mapping_ = nullptr;
+#else
+  if (data_)
+    munmap(data_, static_cast<size_t>(capacity_));
+#endif
+  data_ = nullptr;
+  capacity_ = 0;
+}
+
+void Recorder::append(const void* handle, RecordType type, uint64_t begin_ns, int32_t status, const Piece* pieces,
+                      size_t num_pieces) {
+  uint64_t end_ns = Now();
+  uint64_t payload_size = 0;
+  for (size_t i = 0; i < num_pieces; i++)
+    payload_size += pieces[i].size;
+  const uint64_t record_size = sizeof(RecordHeader) + Align8(payload_size);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!open_.load(std::memory_order_relaxed) || failed_)
+    return;
+  uint32_t id;
+  if (type == RecordType::kCreate) {
+    id = next_handle_++;
+    handles_[handle] = id;
+  } else {
+    auto it = handles_.find(handle);
+    if (it == handles_.end())
+      return;
+    id = it->second;
+    if (type == RecordType::kDestroy)
+      handles_.erase(it);
+  }
+
+  if (used_ + record_size > capacity_) {
+    uint64_t capacity = capacity_ + (capacity_ < kMaxGrowth ? capacity_ : kMaxGrowth);
+    while (used_ + record_size > capacity)
+      capacity += kMaxGrowth;
+    if (!grow(capacity)) {
+      std::cerr << "Unable to grow replay capture, recording stopped" << std::endl;
+      failed_ = true;
+      return;
+    }
+  }
+
+  uint8_t* record = data_ + used_;
+  RecordHeader header = { RecordType::kNone, id, static_cast<uint32_t>(payload_size), status, begin_ns,
+                          end_ns - begin_ns };
+  std::memcpy(record, &header, sizeof(header));
+  uint8_t* payload = record + sizeof(header);
+  for (size_t i = 0; i < num_pieces; i++) {
+    std::memcpy(payload, pieces[i].data, pieces[i].size);
+    payload += pieces[i].size;
+  }
+  // Publish the record last, a reader of a live or torn log sees it complete or not at all
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(record, &type, sizeof(type));
+  used_ += record_size;
+  num_records_++;
+}
+
+void Recorder::RecordCreate(const void* handle, uint64_t begin_ns, int32_t status, const char* effect,
+                            bool chained) {
+  std::vector<uint8_t> payload;
+  PutU32(&payload, chained ? 1u : 0u);
+  PutString(&payload, effect);
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kCreate, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordSetString(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                               const char* value) {
+  std::vector<uint8_t> payload;
+  PutString(&payload, param);
+  PutString(&payload, value);
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kSetString, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordSetStringList(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                                   const char* const* values, unsigned count) {
+  std::vector<uint8_t> payload;
+  PutString(&payload, param);
+  PutU32(&payload, count);
+  for (unsigned i = 0; i < count; i++)
+    PutString(&payload, values[i]);
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kSetStringList, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordSetFloat(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                              float value) {
+  std::vector<uint8_t> payload;
+  PutString(&payload, param);
+  PutBytes(&payload, &value, sizeof(value));
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kSetFloat, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordSetFloatList(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                                  const float* values, unsigned count) {
+  std::vector<uint8_t> payload;
+  PutString(&payload, param);
+  PutU32(&payload, count);
+  PutBytes(&payload, values, count * sizeof(float));
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kSetFloatList, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordSetU32(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                            uint32_t value) {
+  std::vector<uint8_t> payload;
+  PutString(&payload, param);
+  PutU32(&payload, value);
+  Piece piece = { payload.data(), payload.size() };
+  append(handle, RecordType::kSetU32, begin_ns, status, &piece, 1);
+}
+
+void Recorder::RecordLoad(const void* handle, uint64_t begin_ns, int32_t status) {
+  append(handle, RecordType::kLoad, begin_ns, status, nullptr, 0);
+}
+
+void Recorder::RecordRun(const void* handle, uint64_t begin_ns, int32_t status, const float* const* input,
+                         unsigned num_input_channels, unsigned num_input_samples, const float* const* output,
+                         unsigned num_output_channels, unsigned num_output_samples) {
+  // The input is copied straight into the mapping, one piece per channel
+  const unsigned kMaxChannels = 8;
+  if (num_input_channels > kMaxChannels)
+    return;
+  RunInfo info = { num_input_samples, num_input_channels, num_output_samples, num_output_channels,
+                   OutputHash(output, num_output_channels, num_output_samples) };
+  Piece pieces[1 + kMaxChannels];
+  pieces[0] = { &info, sizeof(info) };
+  for (unsigned c = 0; c < num_input_channels; c++)
+    pieces[1 + c] = { input[c], num_input_samples * sizeof(float) };
+  append(handle, RecordType::kRun, begin_ns, status, pieces, 1 + num_input_channels);
+}
+
+void Recorder::RecordReset(const void* handle, uint64_t begin_ns, int32_t status) {
+  append(handle, RecordType::kReset, begin_ns, status, nullptr, 0);
+}
+
+void Recorder::RecordDestroy(const void* handle, uint64_t begin_ns, int32_t status) {
+  append(handle, RecordType::kDestroy, begin_ns, status, nullptr, 0);
+}
+
+bool PayloadReader::read(void* value, size_t size) {
+  if (size > size_ - offset_)
+    return false;
+  std::memcpy(value, data_ + offset_, size);
+  offset_ += size;
+  return true;
+}
+
+bool PayloadReader::ReadString(std::string* value) {
+  uint32_t length;
+  if (!ReadU32(&length))
+    return false;
+  size_t padded = length + (4 - length % 4) % 4;
+  if (padded > size_ - offset_)
+    return false;
+  value->assign(reinterpret_cast<const char*>(data_ + offset_), length);
+  offset_ += padded;
+  return true;
+}
+
+bool PayloadReader::ReadFloats(const float** samples, size_t count) {
+  if (count > (size_ - offset_) / sizeof(float))
+    return false;
+  *samples = reinterpret_cast<const float*>(data_ + offset_);
+  offset_ += count * sizeof(float);
+  return true;
+}
+
+LogReader::~LogReader() {
+#ifdef _WIN32
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+  if (file_)
+    CloseHandle(file_);
+#else
+  if (data_)
+    munmap(const_cast<uint8_t*>(data_), static_cast<size_t>(size_));
+#endif
+}
+
+bool LogReader::Open(const std::string& path) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cerr << "Unable to open replay log: " << path << std::endl;
+    return false;
+  }
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(LogHeader))) {
+    std::cerr << "Not a replay log: " << path << std::endl;
+    return false;
+  }
+  mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_)
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  size_ = static_cast<uint64_t>(size.QuadPart);
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Unable to open replay log: " << path << std::endl;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(LogHeader))) {
+    std::cerr << "Not a replay log: " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data != MAP_FAILED) {
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = static_cast<uint64_t>(info.st_size);
+  }
+#endif
+  if (!data_) {
+    std::cerr << "Unable to map replay log: " << path << std::endl;
+    return false;
+  }
+  std::memcpy(&header_, data_, sizeof(header_));
+  if (std::memcmp(header_.magic, kLogMagic, sizeof(kLogMagic)) != 0 || header_.version != kLogVersion ||
+      header_.header_size != sizeof(LogHeader)) {
+    std::cerr << "Not a replay log or unsupported version: " << path << std::endl;
+    return false;
+  }
+  Rewind();
+  return true;
+}
+
+bool LogReader::Next(Record* record) {
+  if (!data_ || size_ - offset_ < sizeof(RecordHeader))
+    return false;
+  std::memcpy(&record->header, data_ + offset_, sizeof(RecordHeader));
+  if (record->header.type == RecordType::kNone)
+    return false;
+  uint64_t record_size = sizeof(RecordHeader) + Align8(record->header.size);
+  if (record->header.type > RecordType::kDestroy || record_size > size_ - offset_) {
+    truncated_ = true;
+    return false;
+  }
+  record->payload = data_ + offset_ + sizeof(RecordHeader);
+  offset_ += record_size;
+  return true;
+}
+
+const char* RecordTypeName(RecordType type) {
+  switch (type) {
+  case RecordType::kCreate:
+    return "create";
+  case RecordType::kSetString:
+    return "set_string";
+  case RecordType::kSetStringList:
+    return "set_string_list";
+  case RecordType::kSetFloat:
+    return "set_float";
+  case RecordType::kSetFloatList:
+    return "set_float_list";
+  case RecordType::kSetU32:
+    return "set_u32";
+  case RecordType::kLoad:
+    return "load";
+  case RecordType::kRun:
+    return "run";
+  case RecordType::kReset:
+    return "reset";
+  case RecordType::kDestroy:
+    return "destroy";
+  default:
+    return "none";
+  }
+}
+
+}  // namespace replay
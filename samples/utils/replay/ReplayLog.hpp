@@ -0,0 +1,231 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Capture of the NvAFX calls of a session for offline replay. Every Create / Set* / Load / Run /
+// Reset / Destroy is appended to a memory-mapped log together with its start time, duration and
+// status; Run records also carry the input frame and a hash of the output, so a replay can re-drive
+// the effect with the same audio and timing and check that it produces the same output.
+//
+// The log is a LogHeader followed by records, each a RecordHeader and an 8-byte aligned payload.
+// A record becomes visible once its type is written, a log cut short by a crash is read up to the
+// last complete record.
+
+namespace replay {
+
+const char kLogMagic[8] = { 'A', 'F', 'X', 'R', 'E', 'P', 'L', '1' };
+const uint32_t kLogVersion = 1;
+
+enum class RecordType : uint32_t {
+  // Marks the end of the log
+  kNone = 0,
+  // Payload: chained (u32), effect selector (string)
+  kCreate = 1,
+  // Payload: parameter (string), value (string)
+  kSetString = 2,
+  // Payload: parameter (string), count (u32), values (string each)
+  kSetStringList = 3,
+  // Payload: parameter (string), value (f32)
+  kSetFloat = 4,
+  // Payload: parameter (string), count (u32), values (f32 each)
+  kSetFloatList = 5,
+  // Payload: parameter (string), value (u32)
+  kSetU32 = 6,
+  // No payload
+  kLoad = 7,
+  // Payload: RunInfo, then num_input_channels planar frames of num_input_samples f32
+  kRun = 8,
+  // No payload
+  kReset = 9,
+  // No payload
+  kDestroy = 10,
+};
+
+#pragma pack(push, 1)
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  // Wall clock at the start of the capture, nanoseconds since the Unix epoch
+  uint64_t start_unix_ns;
+};
+
+struct RecordHeader {
+  RecordType type;
+  // Identifies the handle within the log, assigned in order of creation starting from 1
+  uint32_t handle;
+  // Payload bytes, without padding
+  uint32_t size;
+  // NvAFX_Status returned by the call
+  int32_t status;
+  // Start of the call, nanoseconds since the start of the capture
+  uint64_t timestamp_ns;
+  // Duration of the call in nanoseconds
+  uint64_t duration_ns;
+};
+
+struct RunInfo {
+  uint32_t num_input_samples;
+  uint32_t num_input_channels;
+  uint32_t num_output_samples;
+  uint32_t num_output_channels;
+  // OutputHash() of the output frames
+  uint64_t output_hash;
+};
+#pragma pack(pop)
+
+// FNV-1a hash of num_channels planar frames of num_samples samples
+uint64_t OutputHash(const float* const* frames, unsigned num_channels, unsigned num_samples);
+
+// Appends records to a memory-mapped log. The mapping grows in chunks and the file is truncated to
+// the used size when closed. Calls may come from several threads.
+class Recorder {
+ public:
+  // The recorder of the process, used by the NvAFX call wrappers
+  static Recorder& Get();
+
+  Recorder();
+  ~Recorder();
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+
+  // Creates (or truncates) the log file and starts the capture clock
+  bool Open(const std::string& path);
+  // Unmaps the log and truncates it to the recorded records. Returns false if the file could not be
+  // finalized or records were lost.
+  bool Close();
+  bool IsOpen() const { return open_.load(std::memory_order_relaxed); }
+  // Nanoseconds since Open()
+  uint64_t Now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_).count());
+  }
+  uint64_t GetNumRecords() const { return num_records_; }
+  uint64_t GetBytes() const { return used_; }
+
+  // begin_ns is the Now() taken before the call, the duration is measured up to the record call.
+  // Records of handles the recorder has not seen created are dropped.
+  void RecordCreate(const void* handle, uint64_t begin_ns, int32_t status, const char* effect, bool chained);
+  void RecordSetString(const void* handle, uint64_t begin_ns, int32_t status, const char* param, const char* value);
+  void RecordSetStringList(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                           const char* const* values, unsigned count);
+  void RecordSetFloat(const void* handle, uint64_t begin_ns, int32_t status, const char* param, float value);
+  void RecordSetFloatList(const void* handle, uint64_t begin_ns, int32_t status, const char* param,
+                          const float* values, unsigned count);
+  void RecordSetU32(const void* handle, uint64_t begin_ns, int32_t status, const char* param, uint32_t value);
+  void RecordLoad(const void* handle, uint64_t begin_ns, int32_t status);
+  void RecordRun(const void* handle, uint64_t begin_ns, int32_t status, const float* const* input,
+                 unsigned num_input_channels, unsigned num_input_samples, const float* const* output,
+                 unsigned num_output_channels, unsigned num_output_samples);
+  void RecordReset(const void* handle, uint64_t begin_ns, int32_t status);
+  void RecordDestroy(const void* handle, uint64_t begin_ns, int32_t status);
+
+ private:
+  struct Piece {
+    const void* data;
+    size_t size;
+  };
+
+  // Appends a record made of the given payload pieces. Takes mutex_.
+  void append(const void* handle, RecordType type, uint64_t begin_ns, int32_t status, const Piece* pieces,
+              size_t num_pieces);
+  // Maps at least capacity bytes of the file, mutex_ held
+  bool grow(uint64_t capacity);
+  void unmap();
+
+ private:
+  std::atomic<bool> open_;
+  std::chrono::steady_clock::time_point start_;
+  std::mutex mutex_;
+  std::unordered_map<const void*, uint32_t> handles_;
+  uint32_t next_handle_ = 1;
+  uint8_t* data_ = nullptr;
+  uint64_t capacity_ = 0;
+  uint64_t used_ = 0;
+  uint64_t num_records_ = 0;
+  bool failed_ = false;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+};
+
+// Record read back from a log. The payload points into the mapping of the LogReader.
+struct Record {
+  RecordHeader header;
+  const uint8_t* payload;
+};
+
+// Reads the fields of a record payload in order. Each read fails once the payload is exhausted.
+class PayloadReader {
+ public:
+  explicit PayloadReader(const Record& record) : data_(record.payload), size_(record.header.size) {}
+
+  bool ReadU32(uint32_t* value) { return read(value, sizeof(*value)); }
+  bool ReadFloat(float* value) { return read(value, sizeof(*value)); }
+  bool ReadString(std::string* value);
+  bool ReadRunInfo(RunInfo* value) { return read(value, sizeof(*value)); }
+  // Points samples at count floats of the payload, which are 4-byte aligned
+  bool ReadFloats(const float** samples, size_t count);
+
+ private:
+  bool read(void* value, size_t size);
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+// Maps a log read-only and iterates its records
+class LogReader {
+ public:
+  LogReader() = default;
+  ~LogReader();
+  LogReader(const LogReader&) = delete;
+  LogReader& operator=(const LogReader&) = delete;
+
+  bool Open(const std::string& path);
+  const LogHeader& GetHeader() const { return header_; }
+  // Returns the next record, false at the end of the log
+  bool Next(Record* record);
+  // Starts over from the first record
+  void Rewind() { offset_ = sizeof(LogHeader); }
+  // True if reading stopped at a damaged record rather than at the end of the log
+  bool IsTruncated() const { return truncated_; }
+
+ private:
+  LogHeader header_ = {};
+  const uint8_t* data_ = nullptr;
+  uint64_t size_ = 0;
+  uint64_t offset_ = 0;
+  bool truncated_ = false;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+
+// Name of a record type for reports
+const char* RecordTypeName(RecordType type);
+
+}  // namespace replay
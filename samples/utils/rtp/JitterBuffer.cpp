@@ -0,0 +1,233 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "JitterBuffer.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <iomanip>
+
+namespace rtp {
+
+namespace {
+
+// Sequence numbers remembered for duplicate detection
+const size_t kSeenSequences = 1024;
+// A packet this far behind the playout position means the sender restarted its timestamps
+const double kResyncSecs = 1.0;
+// Received audio fades in over this long after a concealment
+const double kFadeInSecs = 0.0025;
+
+}  // namespace
+
+JitterBuffer::JitterBuffer(uint32_t sample_rate, uint32_t num_channels, const JitterBufferOptions& options)
+  : sample_rate_(sample_rate), num_channels_(num_channels), options_(options), seen_(kSeenSequences, INT64_MIN) {}
+
+void JitterBuffer::Push(uint16_t sequence, uint32_t timestamp, const float* samples, uint32_t num_frames,
+                        double arrival_secs) {
+  if (num_frames == 0)
+    return;
+  int64_t ext_sequence;
+  int64_t ext_timestamp;
+  if (!started_) {
+    ext_sequence = sequence;
+    ext_timestamp = timestamp;
+    highest_sequence_ = next_sequence_ = ext_sequence;
+    last_timestamp_ = base_timestamp_ = position_ = ext_timestamp;
+    base_time_ = arrival_secs;
+    history_.assign(static_cast<size_t>(num_frames) * num_channels_, 0.f);
+  } else {
+    // Unwrap relative to the newest packet, so reordering around a wrap is handled
+    ext_sequence = highest_sequence_ + static_cast<int16_t>(sequence - static_cast<uint16_t>(highest_sequence_));
+    ext_timestamp = last_timestamp_ + static_cast<int32_t>(timestamp - static_cast<uint32_t>(last_timestamp_));
+  }
+
+  int64_t& seen = seen_[static_cast<size_t>(ext_sequence & (kSeenSequences - 1))];
+  if (seen == ext_sequence) {
+    stats_.duplicates++;
+    return;
+  }
+  seen = ext_sequence;
+  if (ext_sequence < highest_sequence_) {
+    stats_.reordered++;
+  } else {
+    highest_sequence_ = ext_sequence;
+    last_timestamp_ = ext_timestamp;
+  }
+
+  // RFC 3550 6.4.1: smoothed difference in transit time of consecutive arrivals
+  if (started_) {
+    double difference = (arrival_secs - last_arrival_) -
+                        static_cast<double>(ext_timestamp - last_arrival_timestamp_) / sample_rate_;
+    jitter_secs_ += (fabs(difference) - jitter_secs_) / 16.0;
+  }
+  started_ = true;
+  last_arrival_ = arrival_secs;
+  last_arrival_timestamp_ = ext_timestamp;
+  packet_frames_ = num_frames;
+
+  if (ext_timestamp + num_frames + static_cast<int64_t>(kResyncSecs * sample_rate_) < position_) {
+    // Restart the schedule at this packet
+    packets_.clear();
+    position_ = base_timestamp_ = ext_timestamp;
+    base_time_ = arrival_secs;
+    next_sequence_ = ext_sequence;
+  }
+  double start_time = arrival_secs - static_cast<double>(ext_timestamp - base_timestamp_) / sample_rate_;
+  base_time_ = std::min(base_time_, start_time);
+
+  if (ext_timestamp + num_frames <= position_) {
+    stats_.late++;
+    return;
+  }
+  if (packets_.count(ext_timestamp)) {
+    stats_.duplicates++;
+    return;
+  }
+  Packet& packet = packets_[ext_timestamp];
+  packet.sequence = ext_sequence;
+  packet.num_frames = num_frames;
+  packet.arrival = arrival_secs;
+  packet.started = false;
+  packet.samples.assign(samples, samples + static_cast<size_t>(num_frames) * num_channels_);
+  stats_.received++;
+}
+
+double JitterBuffer::targetDelay() const {
+  double delay = static_cast<double>(packet_frames_) / sample_rate_ + options_.jitter_factor * jitter_secs_;
+  return std::min(std::max(delay, options_.min_delay_ms / 1000.0), options_.max_delay_ms / 1000.0);
+}
+
+double JitterBuffer::GetPlayoutTime(uint32_t num_frames) const {
+  return base_time_ + static_cast<double>(position_ + num_frames - base_timestamp_) / sample_rate_ + targetDelay();
+}
+
+void JitterBuffer::Pop(float* out, uint32_t num_frames, double now_secs) {
+  double depth_ms = 0.0;
+  if (!packets_.empty()) {
+    const auto& newest = *packets_.rbegin();
+    depth_ms = std::max<double>(0.0, static_cast<double>(newest.first + newest.second.num_frames - position_)) *
+               1000.0 / sample_rate_;
+  }
+  depth_sum_ms_ += depth_ms;
+  depth_samples_++;
+  stats_.max_depth_ms = std::max(stats_.max_depth_ms, depth_ms);
+
+  while (num_frames > 0) {
+    auto it = packets_.begin();
+    uint32_t count;
+    if (it != packets_.end() && it->first <= position_) {
+      Packet& packet = it->second;
+      int64_t offset = position_ - it->first;
+      if (offset >= packet.num_frames) {
+        // Overlapped by the packets before it
+        packets_.erase(it);
+        continue;
+      }
+      if (!packet.started) {
+        packet.started = true;
+        stats_.played++;
+        if (packet.sequence > next_sequence_)
+          stats_.lost += static_cast<uint64_t>(packet.sequence - next_sequence_);
+        next_sequence_ = std::max(next_sequence_, packet.sequence + 1);
+        double latency_ms = (now_secs - packet.arrival) * 1000.0;
+        latency_sum_ms_ += latency_ms;
+        stats_.max_latency_ms = std::max(stats_.max_latency_ms, latency_ms);
+      }
+      count = std::min(num_frames, static_cast<uint32_t>(packet.num_frames - offset));
+      playReceived(packet.samples.data() + offset * num_channels_, count, out);
+      if (offset + count == packet.num_frames)
+        packets_.erase(it);
+    } else {
+      count = num_frames;
+      if (it != packets_.end())
+        count = static_cast<uint32_t>(std::min<int64_t>(num_frames, it->first - position_));
+      conceal(count, out);
+    }
+    out += static_cast<size_t>(count) * num_channels_;
+    position_ += count;
+    num_frames -= count;
+  }
+}
+
+void JitterBuffer::playReceived(const float* samples, uint32_t count, float* out) {
+  const uint32_t history_frames = static_cast<uint32_t>(history_.size() / num_channels_);
+  uint32_t fade = 0;
+  if (conceal_run_ > 0)
+    fade = std::min(count, std::max(1u, static_cast<uint32_t>(kFadeInSecs * sample_rate_)));
+  for (uint32_t i = 0; i < count; i++) {
+    float weight = (i + 1.f) / (fade + 1.f);
+    for (unsigned ch = 0; ch < num_channels_; ch++) {
+      float sample = samples[i * num_channels_ + ch];
+      out[i * num_channels_ + ch] = i < fade ? weight * sample + (1.f - weight) * concealSample(ch) : sample;
+      history_[history_pos_ * num_channels_ + ch] = sample;
+    }
+    history_pos_ = (history_pos_ + 1) % history_frames;
+  }
+  conceal_run_ = 0;
+}
+
+void JitterBuffer::conceal(uint32_t count, float* out) {
+  if (conceal_run_ == 0) {
+    // Waveform to repeat, oldest frame first
+    const size_t split = static_cast<size_t>(history_pos_) * num_channels_;
+    repeat_.resize(history_.size());
+    std::copy(history_.begin() + split, history_.end(), repeat_.begin());
+    std::copy(history_.begin(), history_.begin() + split, repeat_.end() - split);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    for (unsigned ch = 0; ch < num_channels_; ch++)
+      out[i * num_channels_ + ch] = concealSample(ch);
+  }
+  stats_.concealed_frames += count;
+}
+
+float JitterBuffer::concealSample(unsigned ch) {
+  const uint64_t repeat_frames = repeat_.size() / num_channels_;
+  const double fade_frames = static_cast<double>(repeat_frames) * std::max(1u, options_.fade_repetitions);
+  float gain = static_cast<float>(std::max(0.0, 1.0 - static_cast<double>(conceal_run_) / fade_frames));
+  float sample = gain * repeat_[(conceal_run_ % repeat_frames) * num_channels_ + ch];
+  if (ch + 1 == num_channels_)
+    conceal_run_++;
+  return sample;
+}
+
+JitterStats JitterBuffer::GetStats() const {
+  JitterStats stats = stats_;
+  // Concealment still running with nothing buffered is the end of the stream so far, not a gap
+  if (packets_.empty())
+    stats.concealed_frames -= std::min(stats.concealed_frames, conceal_run_);
+  stats.jitter_ms = jitter_secs_ * 1000.0;
+  stats.target_delay_ms = started_ ? targetDelay() * 1000.0 : 0.0;
+  stats.avg_depth_ms = depth_samples_ ? depth_sum_ms_ / depth_samples_ : 0.0;
+  stats.avg_latency_ms = stats_.played ? latency_sum_ms_ / stats_.played : 0.0;
+  return stats;
+}
+
+void JitterBuffer::PrintReport(std::ostream& out) const {
+  JitterStats stats = GetStats();
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(2) << "Jitter buffer: " << stats.received << " packets received, "
+      << stats.played << " played, " << stats.lost << " lost, " << stats.late << " late, " << stats.reordered
+      << " reordered, " << stats.duplicates << " duplicates" << std::endl
+      << "  jitter " << stats.jitter_ms << " ms, playout delay " << stats.target_delay_ms << " ms (bounds "
+      << options_.min_delay_ms << " - " << options_.max_delay_ms << " ms)" << std::endl
+      << "  depth " << stats.avg_depth_ms << " ms average, " << stats.max_depth_ms << " ms max" << std::endl
+      << "  added latency " << stats.avg_latency_ms << " ms average, " << stats.max_latency_ms << " ms max"
+      << std::endl
+      << "  concealed " << stats.concealed_frames * 1000.0 / sample_rate_ << " ms of audio" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace rtp
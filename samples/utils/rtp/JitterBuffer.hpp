@@ -0,0 +1,137 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+// Reordering and playout of audio packets that arrive with network jitter. Packets are placed by
+// their RTP timestamp and played out on a schedule that trails the fastest packet seen by an
+// adaptive delay: one packet plus a multiple of the RFC 3550 interarrival jitter, within bounds.
+// Audio missing at playout time is concealed by repeating the last received waveform, fading
+// to silence if the gap goes on. Output can be taken in any frame size, independent of the
+// packet size. Times are seconds on a monotonic clock, passed in by the caller.
+namespace rtp {
+
+struct JitterBufferOptions {
+  // Bounds of the adaptive playout delay
+  double min_delay_ms = 20.0;
+  double max_delay_ms = 200.0;
+  // Interarrival jitter covered by the playout delay, on top of one packet
+  double jitter_factor = 3.0;
+  // Repetitions of the last waveform until concealment has faded to silence
+  unsigned fade_repetitions = 4;
+};
+
+struct JitterStats {
+  // Packets accepted into the buffer, and played out of it
+  uint64_t received = 0;
+  uint64_t played = 0;
+  // Dropped as copies of a packet already seen
+  uint64_t duplicates = 0;
+  // Arrived after a packet with a higher sequence number
+  uint64_t reordered = 0;
+  // Arrived after their playout time and were dropped
+  uint64_t late = 0;
+  // Missing at playout time, whether they arrived late or never
+  uint64_t lost = 0;
+  // Sample frames concealed in gaps of the stream
+  uint64_t concealed_frames = 0;
+  // RFC 3550 interarrival jitter and the playout delay derived from it
+  double jitter_ms = 0.0;
+  double target_delay_ms = 0.0;
+  // Audio buffered ahead of the playout position, sampled at every playout
+  double avg_depth_ms = 0.0;
+  double max_depth_ms = 0.0;
+  // Time packets waited in the buffer from arrival until their first frame was played
+  double avg_latency_ms = 0.0;
+  double max_latency_ms = 0.0;
+};
+
+class JitterBuffer {
+ public:
+  JitterBuffer(uint32_t sample_rate, uint32_t num_channels, const JitterBufferOptions& options);
+
+  // Adds a packet of num_frames interleaved sample frames that arrived at arrival_secs
+  void Push(uint16_t sequence, uint32_t timestamp, const float* samples, uint32_t num_frames, double arrival_secs);
+  // False until the first packet arrived
+  bool IsStarted() const { return started_; }
+  // No audio is buffered ahead of the playout position
+  bool IsEmpty() const { return packets_.empty(); }
+  // Time at which the next num_frames frames are due. Only valid once started.
+  double GetPlayoutTime(uint32_t num_frames) const;
+  // Outputs the next num_frames frames, concealing those whose packets are missing
+  void Pop(float* out, uint32_t num_frames, double now_secs);
+
+  JitterStats GetStats() const;
+  void PrintReport(std::ostream& out) const;
+
+ private:
+  struct Packet {
+    int64_t sequence;
+    uint32_t num_frames;
+    double arrival;
+    bool started;
+    std::vector<float> samples;
+  };
+
+  // Current playout delay in seconds
+  double targetDelay() const;
+  // Copies count received frames, fading in from the concealment if one just ended
+  void playReceived(const float* samples, uint32_t count, float* out);
+  // Writes count concealment frames
+  void conceal(uint32_t count, float* out);
+  // Next concealment frame for channel ch, advancing after the last channel
+  float concealSample(unsigned ch);
+
+  const uint32_t sample_rate_;
+  const unsigned num_channels_;
+  const JitterBufferOptions options_;
+
+  bool started_ = false;
+  // Extended (unwrapped) sequence number and timestamp of the newest packet by sequence
+  int64_t highest_sequence_ = 0;
+  int64_t last_timestamp_ = 0;
+  // Timestamp of the first packet, and the earliest time it could have arrived: the playout
+  // clock runs from the packet with the shortest transit
+  int64_t base_timestamp_ = 0;
+  double base_time_ = 0.0;
+  // Previous arrival for the jitter estimate
+  double last_arrival_ = 0.0;
+  int64_t last_arrival_timestamp_ = 0;
+  double jitter_secs_ = 0.0;
+  uint32_t packet_frames_ = 0;
+  // Timestamp of the next frame to play
+  int64_t position_ = 0;
+  // Sequence number expected next in playout order
+  int64_t next_sequence_ = 0;
+  std::map<int64_t, Packet> packets_;
+  // Sequence numbers seen recently, slot sequence % size
+  std::vector<int64_t> seen_;
+
+  // The last received frames, one packet of the size the stream started with, oldest at history_pos_
+  std::vector<float> history_;
+  uint32_t history_pos_ = 0;
+  // Snapshot of the history repeated while concealing, and how many frames were concealed
+  std::vector<float> repeat_;
+  uint64_t conceal_run_ = 0;
+
+  JitterStats stats_;
+  uint64_t depth_samples_ = 0;
+  double depth_sum_ms_ = 0.0;
+  double latency_sum_ms_ = 0.0;
+};
+
+}  // namespace rtp
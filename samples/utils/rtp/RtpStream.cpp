@@ -0,0 +1,491 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "RtpStream.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include <utils/placement/ThreadPlacement.hpp>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace rtp {
+
+namespace {
+
+const char kScheme[] = "rtp://";
+// Largest UDP payload
+const size_t kMaxDatagram = 65507;
+// How often the receive thread checks for shutdown
+const int kReceivePollMs = 50;
+
+#ifdef _WIN32
+const uintptr_t kNoSocket = INVALID_SOCKET;
+
+bool StartSockets() {
+  static const bool started = [] {
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }();
+  return started;
+}
+
+void CloseSocket(uintptr_t socket) { closesocket(static_cast<SOCKET>(socket)); }
+#else
+const int kNoSocket = -1;
+
+bool StartSockets() { return true; }
+
+void CloseSocket(int socket) { close(socket); }
+#endif
+
+bool Resolve(const std::string& host, uint16_t port, sockaddr_in* address) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host.empty() ? "0.0.0.0" : host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+    std::cerr << "Unable to resolve " << host << std::endl;
+    return false;
+  }
+  memcpy(address, result->ai_addr, sizeof(*address));
+  address->sin_port = htons(port);
+  freeaddrinfo(result);
+  return true;
+}
+
+uint32_t LoadBigEndian32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+void StoreBigEndian32(uint32_t value, uint8_t* data) {
+  data[0] = static_cast<uint8_t>(value >> 24);
+  data[1] = static_cast<uint8_t>(value >> 16);
+  data[2] = static_cast<uint8_t>(value >> 8);
+  data[3] = static_cast<uint8_t>(value);
+}
+
+}  // namespace
+
+bool IsRtpUrl(const std::string& text) {
+  return text.compare(0, sizeof(kScheme) - 1, kScheme) == 0;
+}
+
+bool ParseRtpUrl(const std::string& url, RtpUrl* parsed) {
+  if (!IsRtpUrl(url)) {
+    std::cerr << "Not an rtp:// URL: " << url << std::endl;
+    return false;
+  }
+  std::string address = url.substr(sizeof(kScheme) - 1);
+  std::string query;
+  std::size_t query_pos = address.find('?');
+  if (query_pos != std::string::npos) {
+    query = address.substr(query_pos + 1);
+    address.resize(query_pos);
+  }
+  std::size_t port_pos = address.rfind(':');
+  long port = port_pos == std::string::npos ? 0 : std::strtol(address.c_str() + port_pos + 1, nullptr, 10);
+  if (port <= 0 || port > 65535) {
+    std::cerr << "Missing or invalid port in " << url << std::endl;
+    return false;
+  }
+  parsed->host = address.substr(0, port_pos);
+  parsed->port = static_cast<uint16_t>(port);
+
+  std::size_t begin = 0;
+  while (begin < query.size()) {
+    std::size_t end = query.find('&', begin);
+    if (end == std::string::npos)
+      end = query.size();
+    std::string option = query.substr(begin, end - begin);
+    begin = end + 1;
+    std::size_t equals = option.find('=');
+    std::string key = option.substr(0, equals);
+    std::string value = equals == std::string::npos ? std::string() : option.substr(equals + 1);
+    double number = std::strtod(value.c_str(), nullptr);
+    if (key == "rate" && number > 0) {
+      parsed->sample_rate = static_cast<uint32_t>(number);
+    } else if (key == "channels" && number >= 1) {
+      parsed->num_channels = static_cast<uint32_t>(number);
+    } else if (key == "format" && (value == "l16" || value == "float")) {
+      parsed->format = value == "l16" ? PayloadFormat::kL16 : PayloadFormat::kFloat32;
+    } else if (key == "pt" && number >= 0 && number < 128) {
+      parsed->payload_type = static_cast<uint8_t>(number);
+    } else if (key == "packet_ms" && number > 0) {
+      parsed->packet_ms = number;
+    } else if (key == "wait_ms" && number > 0) {
+      parsed->wait_ms = number;
+    } else if (key == "idle_ms" && number > 0) {
+      parsed->idle_ms = number;
+    } else if (key == "min_delay_ms" && number >= 0) {
+      parsed->jitter.min_delay_ms = number;
+    } else if (key == "max_delay_ms" && number > 0) {
+      parsed->jitter.max_delay_ms = number;
+    } else {
+      std::cerr << "Invalid option " << option << " in " << url << std::endl;
+      return false;
+    }
+  }
+  parsed->jitter.max_delay_ms = std::max(parsed->jitter.max_delay_ms, parsed->jitter.min_delay_ms);
+  return true;
+}
+
+void WriteRtpHeader(const RtpHeader& header, uint8_t* out) {
+  out[0] = 0x80;  // version 2, no padding, extension or CSRCs
+  out[1] = static_cast<uint8_t>((header.marker ? 0x80 : 0) | (header.payload_type & 0x7f));
+  out[2] = static_cast<uint8_t>(header.sequence >> 8);
+  out[3] = static_cast<uint8_t>(header.sequence);
+  StoreBigEndian32(header.timestamp, out + 4);
+  StoreBigEndian32(header.ssrc, out + 8);
+}
+
+bool ParseRtpPacket(const uint8_t* data, size_t size, RtpHeader* header, const uint8_t** payload,
+                    size_t* payload_size) {
+  if (size < kRtpHeaderSize || (data[0] >> 6) != 2)
+    return false;
+  size_t offset = kRtpHeaderSize + 4 * static_cast<size_t>(data[0] & 0x0f);
+  if (data[0] & 0x10) {
+    if (offset + 4 > size)
+      return false;
+    offset += 4 + 4 * (static_cast<size_t>(data[offset + 2]) << 8 | data[offset + 3]);
+  }
+  size_t padding = (data[0] & 0x20) ? data[size - 1] : 0;
+  if (offset + padding > size)
+    return false;
+  header->marker = (data[1] & 0x80) != 0;
+  header->payload_type = data[1] & 0x7f;
+  header->sequence = static_cast<uint16_t>(data[2] << 8 | data[3]);
+  header->timestamp = LoadBigEndian32(data + 4);
+  header->ssrc = LoadBigEndian32(data + 8);
+  *payload = data + offset;
+  *payload_size = size - offset - padding;
+  return true;
+}
+
+size_t GetBytesPerSample(PayloadFormat format) {
+  return format == PayloadFormat::kL16 ? 2 : 4;
+}
+
+void DecodePayload(PayloadFormat format, const uint8_t* payload, size_t num_samples, float* out) {
+  if (format == PayloadFormat::kL16) {
+    for (size_t i = 0; i < num_samples; i++)
+      out[i] = static_cast<int16_t>(payload[2 * i] << 8 | payload[2 * i + 1]) / 32768.f;
+  } else {
+    for (size_t i = 0; i < num_samples; i++) {
+      uint32_t bits = LoadBigEndian32(payload + 4 * i);
+      memcpy(&out[i], &bits, sizeof(bits));
+    }
+  }
+}
+
+void EncodePayload(PayloadFormat format, const float* samples, size_t num_samples, uint8_t* out) {
+  if (format == PayloadFormat::kL16) {
+    for (size_t i = 0; i < num_samples; i++) {
+      float scaled = std::min(std::max(samples[i] * 32768.f, -32768.f), 32767.f);
+      int16_t value = static_cast<int16_t>(lrintf(scaled));
+      out[2 * i] = static_cast<uint8_t>(static_cast<uint16_t>(value) >> 8);
+      out[2 * i + 1] = static_cast<uint8_t>(value);
+    }
+  } else {
+    for (size_t i = 0; i < num_samples; i++) {
+      uint32_t bits;
+      memcpy(&bits, &samples[i], sizeof(bits));
+      StoreBigEndian32(bits, out + 4 * i);
+    }
+  }
+}
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UdpSocket::UdpSocket() : socket_(kNoSocket) {}
+
+UdpSocket::~UdpSocket() {
+  if (socket_ != kNoSocket)
+    CloseSocket(socket_);
+}
+
+bool UdpSocket::open() {
+  if (!StartSockets()) {
+    std::cerr << "Unable to initialize sockets" << std::endl;
+    return false;
+  }
+  socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_ == kNoSocket) {
+    std::cerr << "Unable to create a UDP socket" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::Bind(const std::string& host, uint16_t port) {
+  sockaddr_in address;
+  if (!Resolve(host, port, &address) || !open())
+    return false;
+  // Room for bursts while the receive thread is descheduled
+  int buffer_size = 1 << 20;
+  setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&buffer_size), sizeof(buffer_size));
+  if (bind(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    std::cerr << "Unable to bind UDP port " << host << ":" << port << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::Connect(const std::string& host, uint16_t port) {
+  sockaddr_in address;
+  if (!Resolve(host, port, &address) || !open())
+    return false;
+  if (connect(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    std::cerr << "Unable to address " << host << ":" << port << std::endl;
+    return false;
+  }
+  return true;
+}
+
+uint16_t UdpSocket::GetLocalPort() const {
+  sockaddr_in address;
+  socklen_t length = sizeof(address);
+  if (socket_ == kNoSocket || getsockname(socket_, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    return 0;
+  return ntohs(address.sin_port);
+}
+
+bool UdpSocket::Send(const uint8_t* data, size_t size) {
+  return send(socket_, reinterpret_cast<const char*>(data), static_cast<int>(size), 0) == static_cast<int>(size);
+}
+
+int UdpSocket::Receive(uint8_t* data, size_t capacity, int timeout_ms) {
+  fd_set read_set;
+  FD_ZERO(&read_set);
+  FD_SET(socket_, &read_set);
+  timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  int ready = select(static_cast<int>(socket_ + 1), &read_set, nullptr, nullptr, &timeout);
+  if (ready <= 0)
+    return ready;
+  int size = static_cast<int>(recv(socket_, reinterpret_cast<char*>(data), static_cast<int>(capacity), 0));
+#ifndef _WIN32
+  if (size < 0 && (errno == EAGAIN || errno == EINTR || errno == ECONNREFUSED))
+    return 0;
+#endif
+  return size;
+}
+
+RtpSource::RtpSource(const RtpUrl& url)
+  : url_(url), jitter_buffer_(url.sample_rate, url.num_channels, url.jitter) {
+  if (!socket_.Bind(url_.host, url_.port))
+    return;
+  valid_ = true;
+  receive_thread_ = std::thread(&RtpSource::receiveLoop, this);
+}
+
+RtpSource::~RtpSource() {
+  stop_ = true;
+  if (receive_thread_.joinable())
+    receive_thread_.join();
+}
+
+void RtpSource::receiveLoop() {
+  placement::ThreadScope placement_scope(placement::Role::kIo, "rtp_receive");
+  std::vector<uint8_t> datagram(kMaxDatagram);
+  std::vector<float> samples;
+  const size_t frame_bytes = GetBytesPerSample(url_.format) * url_.num_channels;
+  while (!stop_) {
+    int size = socket_.Receive(datagram.data(), datagram.size(), kReceivePollMs);
+    if (size < 0) {
+      std::cerr << "Receiving on UDP port " << url_.port << " failed" << std::endl;
+      break;
+    }
+    if (size == 0)
+      continue;
+    double arrival = Now();
+    RtpHeader header;
+    const uint8_t* payload;
+    size_t payload_size;
+    bool parsed = ParseRtpPacket(datagram.data(), static_cast<size_t>(size), &header, &payload, &payload_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!parsed || payload_size % frame_bytes != 0 || (jitter_buffer_.IsStarted() && header.ssrc != ssrc_)) {
+      rejected_++;
+      continue;
+    }
+    ssrc_ = header.ssrc;
+    uint32_t num_frames = static_cast<uint32_t>(payload_size / frame_bytes);
+    samples.resize(static_cast<size_t>(num_frames) * url_.num_channels);
+    DecodePayload(url_.format, payload, samples.size(), samples.data());
+    jitter_buffer_.Push(header.sequence, header.timestamp, samples.data(), num_frames, arrival);
+    last_arrival_ = arrival;
+    packet_ready_.notify_one();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ended_ = true;
+  packet_ready_.notify_one();
+}
+
+uint32_t RtpSource::Read(float* out, uint32_t num_samples) {
+  uint32_t num_frames = num_samples / url_.num_channels;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!jitter_buffer_.IsStarted()) {
+    std::chrono::duration<double, std::milli> wait(url_.wait_ms);
+    if (!packet_ready_.wait_for(lock, wait, [this] { return jitter_buffer_.IsStarted() || ended_; }) ||
+        !jitter_buffer_.IsStarted()) {
+      std::cerr << "No RTP packets received on port " << url_.port << std::endl;
+      return 0;
+    }
+  }
+  if (ended_ || num_frames == 0)
+    return 0;
+  // The playout time is taken again after every packet, the delay may have adapted
+  double now = Now();
+  double due;
+  while (!ended_ && (due = jitter_buffer_.GetPlayoutTime(num_frames)) > now) {
+    packet_ready_.wait_for(lock, std::chrono::duration<double>(due - now));
+    now = Now();
+  }
+  if (ended_ || (jitter_buffer_.IsEmpty() && (now - last_arrival_) * 1000.0 > url_.idle_ms)) {
+    ended_ = true;
+    return 0;
+  }
+  jitter_buffer_.Pop(out, num_frames, now);
+  return num_frames * url_.num_channels;
+}
+
+JitterStats RtpSource::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jitter_buffer_.GetStats();
+}
+
+void RtpSource::PrintReport(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "RTP input on port " << url_.port << ", " << url_.sample_rate << " Hz, " << url_.num_channels
+      << (url_.format == PayloadFormat::kL16 ? " channel(s) L16" : " channel(s) float");
+  if (rejected_)
+    out << ", " << rejected_ << " packets rejected";
+  out << std::endl;
+  jitter_buffer_.PrintReport(out);
+}
+
+RtpSink::RtpSink(const RtpUrl& url, uint32_t sample_rate, uint32_t num_channels)
+  : url_(url), sample_rate_(sample_rate), num_channels_(num_channels),
+    packet_frames_(std::max(1u, static_cast<uint32_t>(url.packet_ms * sample_rate / 1000.0))) {
+  size_t max_frames = (kMaxDatagram - kRtpHeaderSize) / (GetBytesPerSample(url_.format) * num_channels_);
+  if (packet_frames_ > max_frames) {
+    std::cerr << url_.packet_ms << " ms packets exceed the UDP datagram size" << std::endl;
+    return;
+  }
+  if (!socket_.Connect(url_.host, url_.port))
+    return;
+  std::random_device random;
+  header_.payload_type = url_.payload_type;
+  header_.marker = true;
+  header_.sequence = static_cast<uint16_t>(random());
+  header_.timestamp = random();
+  header_.ssrc = random();
+  pending_.reserve(static_cast<size_t>(packet_frames_) * num_channels_);
+  packet_.resize(kRtpHeaderSize + GetBytesPerSample(url_.format) * packet_frames_ * num_channels_);
+  valid_ = true;
+}
+
+bool RtpSink::sendPacket(const float* samples, uint32_t num_frames) {
+  size_t num_samples = static_cast<size_t>(num_frames) * num_channels_;
+  WriteRtpHeader(header_, packet_.data());
+  EncodePayload(url_.format, samples, num_samples, packet_.data() + kRtpHeaderSize);
+  // A live stream goes on if nobody listens yet
+  if (socket_.Send(packet_.data(), kRtpHeaderSize + GetBytesPerSample(url_.format) * num_samples))
+    packets_sent_++;
+  else
+    send_errors_++;
+  header_.marker = false;
+  header_.sequence++;
+  header_.timestamp += num_frames;
+  return true;
+}
+
+bool RtpSink::Write(const float* data, uint32_t num_samples) {
+  const size_t packet_samples = static_cast<size_t>(packet_frames_) * num_channels_;
+  while (num_samples > 0) {
+    if (pending_.empty() && num_samples >= packet_samples) {
+      sendPacket(data, packet_frames_);
+      data += packet_samples;
+      num_samples -= static_cast<uint32_t>(packet_samples);
+      continue;
+    }
+    size_t count = std::min<size_t>(num_samples, packet_samples - pending_.size());
+    pending_.insert(pending_.end(), data, data + count);
+    data += count;
+    num_samples -= static_cast<uint32_t>(count);
+    if (pending_.size() == packet_samples) {
+      sendPacket(pending_.data(), packet_frames_);
+      pending_.clear();
+    }
+  }
+  return true;
+}
+
+bool RtpSink::Commit() {
+  if (!pending_.empty())
+    sendPacket(pending_.data(), static_cast<uint32_t>(pending_.size() / num_channels_));
+  pending_.clear();
+  return true;
+}
+
+void RtpSink::PrintReport(std::ostream& out) const {
+  out << "RTP output to " << url_.host << ":" << url_.port << ": " << packets_sent_ << " packets of "
+      << url_.packet_ms << " ms sent";
+  if (send_errors_)
+    out << ", " << send_errors_ << " failed";
+  out << std::endl;
+}
+
+std::unique_ptr<RtpSource> OpenRtpSource(const std::string& url) {
+  RtpUrl parsed;
+  if (!ParseRtpUrl(url, &parsed))
+    return nullptr;
+  std::unique_ptr<RtpSource> source(new RtpSource(parsed));
+  if (!source->IsValid())
+    return nullptr;
+  return source;
+}
+
+std::unique_ptr<RtpSink> CreateRtpSink(const std::string& url, uint32_t sample_rate, uint32_t num_channels) {
+  RtpUrl parsed;
+  if (!ParseRtpUrl(url, &parsed))
+    return nullptr;
+  std::unique_ptr<RtpSink> sink(new RtpSink(parsed, sample_rate, num_channels));
+  if (!sink->IsValid())
+    return nullptr;
+  return sink;
+}
+
+}  // namespace rtp
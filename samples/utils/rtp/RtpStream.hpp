@@ -0,0 +1,179 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/audio_io/AudioStream.hpp>
+
+#include "JitterBuffer.hpp"
+
+// Live audio as RTP over UDP (RFC 3550). Streams are described by URLs:
+//   rtp://host:port?rate=48000&channels=1&format=l16
+// A source binds host:port and receives, a sink sends to host:port. Payloads are L16 (RFC 3551,
+// 16 bit big endian) or float (32 bit big endian IEEE), one packet carries whole sample frames.
+// Further source options: min_delay_ms, max_delay_ms (jitter buffer bounds), wait_ms (for the
+// first packet) and idle_ms (silence after which the stream ends). Sink options: packet_ms and pt.
+namespace rtp {
+
+enum class PayloadFormat {
+  kL16,
+  kFloat32,
+};
+
+struct RtpUrl {
+  std::string host;
+  uint16_t port = 0;
+  uint32_t sample_rate = 48000;
+  uint32_t num_channels = 1;
+  PayloadFormat format = PayloadFormat::kL16;
+  // Dynamic payload type, receivers accept any
+  uint8_t payload_type = 96;
+  // Audio per sent packet
+  double packet_ms = 10.0;
+  double wait_ms = 10000.0;
+  double idle_ms = 1000.0;
+  JitterBufferOptions jitter;
+};
+
+// True for rtp:// URLs
+bool IsRtpUrl(const std::string& text);
+// Returns false and prints the reason if url is malformed
+bool ParseRtpUrl(const std::string& url, RtpUrl* parsed);
+
+struct RtpHeader {
+  uint8_t payload_type = 0;
+  bool marker = false;
+  uint16_t sequence = 0;
+  uint32_t timestamp = 0;
+  uint32_t ssrc = 0;
+};
+
+const size_t kRtpHeaderSize = 12;
+
+// Writes the fixed header (no CSRCs or extension) to out[kRtpHeaderSize]
+void WriteRtpHeader(const RtpHeader& header, uint8_t* out);
+// Parses a packet, skipping CSRCs, header extension and padding. Returns false if it is not RTP version 2.
+bool ParseRtpPacket(const uint8_t* data, size_t size, RtpHeader* header, const uint8_t** payload,
+                    size_t* payload_size);
+size_t GetBytesPerSample(PayloadFormat format);
+void DecodePayload(PayloadFormat format, const uint8_t* payload, size_t num_samples, float* out);
+void EncodePayload(PayloadFormat format, const float* samples, size_t num_samples, uint8_t* out);
+
+// Seconds on the monotonic clock used for packet arrival and playout times
+double Now();
+
+class UdpSocket {
+ public:
+  UdpSocket();
+  ~UdpSocket();
+  UdpSocket(const UdpSocket&) = delete;
+  UdpSocket& operator=(const UdpSocket&) = delete;
+
+  // Receives on host:port, port 0 picks a free one (see GetLocalPort)
+  bool Bind(const std::string& host, uint16_t port);
+  // Sends to host:port
+  bool Connect(const std::string& host, uint16_t port);
+  uint16_t GetLocalPort() const;
+  bool Send(const uint8_t* data, size_t size);
+  // Waits up to timeout_ms for a datagram. Returns its size, 0 on timeout, -1 on error.
+  int Receive(uint8_t* data, size_t capacity, int timeout_ms);
+
+ private:
+  bool open();
+
+#ifdef _WIN32
+  uintptr_t socket_;
+#else
+  int socket_;
+#endif
+};
+
+// Receives a stream on a background thread into a JitterBuffer. Read() paces the caller: it
+// returns each block when the block is due on the playout schedule, with missing packets
+// concealed. The stream ends when no packet arrived for idle_ms, or none at all for wait_ms.
+class RtpSource : public audio_io::AudioSource {
+ public:
+  explicit RtpSource(const RtpUrl& url);
+  ~RtpSource() override;
+  bool IsValid() const override { return valid_; }
+  uint32_t GetSampleRate() const override { return url_.sample_rate; }
+  uint32_t GetNumChannels() const override { return url_.num_channels; }
+  uint64_t GetLength() const override { return 0; }
+  uint32_t Read(float* out, uint32_t num_samples) override;
+
+  uint16_t GetLocalPort() const { return socket_.GetLocalPort(); }
+  JitterStats GetStats() const;
+  void PrintReport(std::ostream& out) const;
+
+ private:
+  void receiveLoop();
+
+ private:
+  const RtpUrl url_;
+  UdpSocket socket_;
+  bool valid_ = false;
+  mutable std::mutex mutex_;
+  std::condition_variable packet_ready_;
+  JitterBuffer jitter_buffer_;
+  double last_arrival_ = 0.0;
+  uint32_t ssrc_ = 0;
+  // Packets of other streams, or with a payload that does not hold whole frames
+  uint64_t rejected_ = 0;
+  bool ended_ = false;
+  std::atomic<bool> stop_{ false };
+  std::thread receive_thread_;
+};
+
+// Sends the written audio in packets of packet_ms, the last partial packet on Commit()
+class RtpSink : public audio_io::AudioSink {
+ public:
+  RtpSink(const RtpUrl& url, uint32_t sample_rate, uint32_t num_channels);
+  bool IsValid() const override { return valid_; }
+  bool Write(const float* data, uint32_t num_samples) override;
+  bool Commit() override;
+
+  void PrintReport(std::ostream& out) const;
+
+ private:
+  bool sendPacket(const float* samples, uint32_t num_frames);
+
+ private:
+  const RtpUrl url_;
+  const uint32_t sample_rate_;
+  const uint32_t num_channels_;
+  const uint32_t packet_frames_;
+  UdpSocket socket_;
+  bool valid_ = false;
+  RtpHeader header_;
+  std::vector<float> pending_;
+  std::vector<uint8_t> packet_;
+  uint64_t packets_sent_ = 0;
+  uint64_t send_errors_ = 0;
+};
+
+// Parse url and open the stream, nullptr if that fails. The sink takes the sample rate and channel
+// count of the audio written to it, not from the URL.
+std::unique_ptr<RtpSource> OpenRtpSource(const std::string& url);
+std::unique_ptr<RtpSink> CreateRtpSink(const std::string& url, uint32_t sample_rate, uint32_t num_channels);
+
+}  // namespace rtp
@@ -0,0 +1,255 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "DeviceScheduler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include <utils/placement/ThreadPlacement.hpp>
+#include <utils/trace/Trace.hpp>
+
+namespace scheduler {
+
+namespace {
+
+// Weight of a new measurement in the device speed
+const double kSpeedSmoothing = 0.3;
+
+}  // namespace
+
+DeviceScheduler::DeviceScheduler(DeviceBackend* backend, unsigned instances_per_device)
+  : backend_(backend), instances_per_device_(std::max(1u, instances_per_device)) {}
+
+DeviceScheduler::~DeviceScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread& worker : workers_)
+    worker.join();
+}
+
+bool DeviceScheduler::Start() {
+  std::vector<int> ids = backend_->GetDevices();
+  devices_.resize(ids.size());
+  for (size_t i = 0; i < ids.size(); i++)
+    devices_[i].id = ids[i];
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    starting_workers_ = static_cast<unsigned>(devices_.size()) * instances_per_device_;
+  }
+  for (size_t i = 0; i < devices_.size(); i++) {
+    for (unsigned k = 0; k < instances_per_device_; k++)
+      workers_.emplace_back(&DeviceScheduler::workerLoop, this, i);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  state_changed_.wait(lock, [this] { return starting_workers_ == 0; });
+  bool usable = false;
+  for (const Device& device : devices_) {
+    if (device.instances < instances_per_device_)
+      std::cerr << "Device " << device.id << ": " << device.instances << " of " << instances_per_device_
+                << " instances created" << std::endl;
+    usable = usable || device.instances > 0;
+  }
+  return usable;
+}
+
+double DeviceScheduler::getSpeed(const Device& device) const {
+  if (device.speed > 0.0)
+    return device.speed;
+  // Until a device is measured assume it is as fast as the measured ones
+  double sum = 0.0;
+  int count = 0;
+  for (const Device& other : devices_) {
+    if (other.speed > 0.0) {
+      sum += other.speed;
+      count++;
+    }
+  }
+  return count ? sum / count : 1.0;
+}
+
+double DeviceScheduler::getBacklogSecs(const Device& device) const {
+  // Running jobs are on average half done
+  return (device.queued_secs + 0.5 * device.running_secs) / (getSpeed(device) * device.instances);
+}
+
+size_t DeviceScheduler::pickDevice(double audio_secs) const {
+  size_t best = devices_.size();
+  double best_finish = 0.0;
+  // devices_ is in preference order, a later device has to be strictly better
+  for (size_t i = 0; i < devices_.size(); i++) {
+    const Device& device = devices_[i];
+    if (device.instances == 0)
+      continue;
+    double finish = getBacklogSecs(device) + audio_secs / getSpeed(device);
+    if (best == devices_.size() || finish < best_finish) {
+      best = i;
+      best_finish = finish;
+    }
+  }
+  return best;
+}
+
+void DeviceScheduler::Submit(Job job) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_jobs_ == 0)
+    first_submit_ = std::chrono::steady_clock::now();
+  pending_jobs_++;
+  size_t index = pickDevice(job.audio_secs);
+  if (index == devices_.size()) {
+    // No usable device
+    failed_ = true;
+    pending_jobs_--;
+    return;
+  }
+  Device& device = devices_[index];
+  device.queued_secs += job.audio_secs;
+  device.queue.push_back(std::move(job));
+  work_ready_.notify_all();
+}
+
+bool DeviceScheduler::takeJob(size_t device_index, Job* job) {
+  Device& device = devices_[device_index];
+  if (!device.queue.empty()) {
+    *job = std::move(device.queue.front());
+    device.queue.pop_front();
+    device.queued_secs -= job->audio_secs;
+    return true;
+  }
+
+  // Idle, take the last queued job of the device that is furthest behind if it finishes earlier here
+  size_t victim = devices_.size();
+  double victim_backlog = 0.0;
+  for (size_t i = 0; i < devices_.size(); i++) {
+    if (i == device_index || devices_[i].queue.empty())
+      continue;
+    double backlog = getBacklogSecs(devices_[i]);
+    if (victim == devices_.size() || backlog > victim_backlog) {
+      victim = i;
+      victim_backlog = backlog;
+    }
+  }
+  if (victim == devices_.size())
+    return false;
+  Device& other = devices_[victim];
+  if (other.queue.back().audio_secs / getSpeed(device) >= victim_backlog)
+    return false;
+
+  *job = std::move(other.queue.back());
+  other.queue.pop_back();
+  other.queued_secs -= job->audio_secs;
+  device.rebalanced_jobs++;
+  return true;
+}
+
+void DeviceScheduler::workerLoop(size_t device_index) {
+  TRACE_THREAD_NAME("device_worker");
+  placement::ThreadScope placement_scope(placement::Role::kWorker, "device_worker");
+  const int id = devices_[device_index].id;
+  void* instance = nullptr;
+  if (backend_->BindThread(id))
+    instance = backend_->CreateInstance(id);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (instance)
+    devices_[device_index].instances++;
+  starting_workers_--;
+  state_changed_.notify_all();
+  if (!instance)
+    return;
+
+  Device& device = devices_[device_index];
+  for (;;) {
+    Job job;
+    work_ready_.wait(lock, [&] { return stop_ || takeJob(device_index, &job); });
+    if (stop_ && !job.run)
+      break;
+
+    device.running_secs += job.audio_secs;
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    bool success;
+    {
+      TRACE_SCOPE_ARG("device_job", "device", id);
+      success = job.run(instance, id);
+    }
+    double busy_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lock.lock();
+
+    device.running_secs -= job.audio_secs;
+    device.jobs++;
+    device.busy_secs += busy_secs;
+    device.audio_secs += job.audio_secs;
+    if (busy_secs > 0.0 && job.audio_secs > 0.0) {
+      double speed = job.audio_secs / busy_secs;
+      device.speed = device.speed > 0.0 ? (1.0 - kSpeedSmoothing) * device.speed + kSpeedSmoothing * speed : speed;
+    }
+    failed_ = failed_ || !success;
+    if (--pending_jobs_ == 0)
+      wall_secs_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - first_submit_).count();
+    state_changed_.notify_all();
+    // A new speed changes which queued jobs other devices should take over
+    work_ready_.notify_all();
+  }
+  lock.unlock();
+  backend_->DestroyInstance(instance);
+}
+
+bool DeviceScheduler::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  state_changed_.wait(lock, [this] { return pending_jobs_ == 0; });
+  bool success = !failed_;
+  failed_ = false;
+  return success;
+}
+
+std::vector<DeviceStats> DeviceScheduler::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<DeviceStats> stats;
+  for (const Device& device : devices_) {
+    DeviceStats entry;
+    entry.device = device.id;
+    entry.instances = device.instances;
+    entry.jobs = device.jobs;
+    entry.rebalanced_jobs = device.rebalanced_jobs;
+    entry.busy_secs = device.busy_secs;
+    entry.audio_secs = device.audio_secs;
+    entry.utilisation = device.instances && wall_secs_ > 0.0 ? device.busy_secs / (device.instances * wall_secs_) : 0.0;
+    entry.rtf = device.audio_secs > 0.0 ? device.busy_secs / device.audio_secs : 0.0;
+    stats.push_back(entry);
+  }
+  return stats;
+}
+
+void DeviceScheduler::PrintStats(std::ostream& out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::left << std::setw(8) << "Device" << std::setw(11) << "Instances" << std::setw(7) << "Jobs"
+      << std::setw(12) << "Rebalanced" << std::setw(12) << "Audio (s)" << std::setw(11) << "Busy (s)" << std::setw(13)
+      << "Busy (%)" << "RTF" << std::endl;
+  for (const DeviceStats& stats : GetStats()) {
+    out << std::setw(8) << stats.device << std::setw(11) << stats.instances << std::setw(7) << stats.jobs
+        << std::setw(12) << stats.rebalanced_jobs << std::fixed << std::setprecision(2) << std::setw(12)
+        << stats.audio_secs << std::setw(11) << stats.busy_secs << std::setprecision(0) << std::setw(13)
+        << stats.utilisation * 100.0 << std::setprecision(4) << stats.rtf << std::endl;
+    out.unsetf(std::ios_base::floatfield);
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace scheduler
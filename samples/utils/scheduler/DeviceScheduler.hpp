@@ -0,0 +1,120 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Spreads jobs (files, streams or segments of one file) over the devices an effect supports. Every
+// device gets worker threads with one effect instance each. Jobs go to the device expected to finish
+// them first, from its measured speed and queued work, ties are broken by the device preference order.
+// Idle devices take queued jobs from devices that fell behind, e.g. because they are saturated.
+
+namespace scheduler {
+
+// Creates effect instances on a device. NvAFXBackend uses the SDK, SimulatedBackend stands in for
+// machines without GPUs.
+class DeviceBackend {
+ public:
+  virtual ~DeviceBackend() = default;
+  // Device ids in descending order of preference
+  virtual std::vector<int> GetDevices() = 0;
+  // Prepares the calling worker thread for device, called before any CreateInstance() on the thread
+  virtual bool BindThread(int device) = 0;
+  // Creates an instance on the device bound to the calling thread, nullptr on failure
+  virtual void* CreateInstance(int device) = 0;
+  virtual void DestroyInstance(void* instance) = 0;
+};
+
+// A unit of work
+struct Job {
+  // Seconds of audio, the estimate of the work and the base of the RTF
+  double audio_secs = 0.0;
+  // Runs the job on an instance of the device it was assigned to, returns false on failure
+  std::function<bool(void* instance, int device)> run;
+};
+
+struct DeviceStats {
+  int device;
+  unsigned instances;
+  size_t jobs;
+  // Jobs taken over from another device's queue
+  size_t rebalanced_jobs;
+  double busy_secs;
+  double audio_secs;
+  // Busy time over wall time of all instances
+  double utilisation;
+  // Processing time per second of audio
+  double rtf;
+};
+
+class DeviceScheduler {
+ public:
+  DeviceScheduler(DeviceBackend* backend, unsigned instances_per_device);
+  ~DeviceScheduler();
+
+  // Starts the workers and creates the instances. Devices without instances are left out, returns
+  // false if no device is usable.
+  bool Start();
+  void Submit(Job job);
+  // Waits for all submitted jobs, returns false if one of them failed
+  bool Wait();
+  std::vector<DeviceStats> GetStats() const;
+  void PrintStats(std::ostream& out) const;
+
+ private:
+  struct Device {
+    int id = 0;
+    unsigned instances = 0;
+    std::deque<Job> queue;
+    double queued_secs = 0.0;
+    double running_secs = 0.0;
+    // Seconds of audio per busy second of one instance, 0 until the first job finished
+    double speed = 0.0;
+    size_t jobs = 0;
+    size_t rebalanced_jobs = 0;
+    double busy_secs = 0.0;
+    double audio_secs = 0.0;
+  };
+
+  void workerLoop(size_t device_index);
+  // The following expect mutex_ to be held
+  double getSpeed(const Device& device) const;
+  double getBacklogSecs(const Device& device) const;
+  size_t pickDevice(double audio_secs) const;
+  bool takeJob(size_t device_index, Job* job);
+
+ private:
+  DeviceBackend* backend_;
+  const unsigned instances_per_device_;
+  mutable std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable state_changed_;
+  std::vector<Device> devices_;
+  std::vector<std::thread> workers_;
+  unsigned starting_workers_ = 0;
+  size_t pending_jobs_ = 0;
+  bool failed_ = false;
+  bool stop_ = false;
+  std::chrono::steady_clock::time_point first_submit_;
+  double wall_secs_ = 0.0;
+};
+
+}  // namespace scheduler
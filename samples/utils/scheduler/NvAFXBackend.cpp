@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "NvAFXBackend.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace scheduler {
+
+namespace {
+
+// The few CUDA driver entry points needed to bind a thread to a device
+struct CudaDriver {
+  typedef int (*InitFunction)(unsigned int flags);
+  typedef int (*DeviceGetFunction)(int* device, int ordinal);
+  typedef int (*PrimaryCtxRetainFunction)(void** context, int device);
+  typedef int (*PrimaryCtxReleaseFunction)(int device);
+  typedef int (*CtxSetCurrentFunction)(void* context);
+
+  InitFunction init = nullptr;
+  DeviceGetFunction device_get = nullptr;
+  PrimaryCtxRetainFunction primary_ctx_retain = nullptr;
+  PrimaryCtxReleaseFunction primary_ctx_release = nullptr;
+  CtxSetCurrentFunction ctx_set_current = nullptr;
+  bool loaded = false;
+
+  static const CudaDriver& Get() {
+    static CudaDriver driver;
+    return driver;
+  }
+
+ private:
+  CudaDriver() {
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA("nvcuda.dll");
+    auto symbol = [library](const char* name) {
+      return library ? reinterpret_cast<void*>(GetProcAddress(library, name)) : nullptr;
+    };
+#else
+    void* library = dlopen("libcuda.so.1", RTLD_NOW | RTLD_LOCAL);
+    auto symbol = [library](const char* name) { return library ? dlsym(library, name) : nullptr; };
+#endif
+    init = reinterpret_cast<InitFunction>(symbol("cuInit"));
+    device_get = reinterpret_cast<DeviceGetFunction>(symbol("cuDeviceGet"));
+    primary_ctx_retain = reinterpret_cast<PrimaryCtxRetainFunction>(symbol("cuDevicePrimaryCtxRetain"));
+    primary_ctx_release = reinterpret_cast<PrimaryCtxReleaseFunction>(symbol("cuDevicePrimaryCtxRelease_v2"));
+    ctx_set_current = reinterpret_cast<CtxSetCurrentFunction>(symbol("cuCtxSetCurrent"));
+    loaded = init && device_get && primary_ctx_retain && primary_ctx_release && ctx_set_current && init(0) == 0;
+  }
+};
+
+}  // namespace
+
+NvAFXBackend::NvAFXBackend(const std::vector<int>& devices, CreateFunction create, DestroyFunction destroy)
+  : devices_(devices), create_(create), destroy_(destroy), contexts_(devices.size(), nullptr) {}
+
+NvAFXBackend::~NvAFXBackend() {
+  const CudaDriver& driver = CudaDriver::Get();
+  for (size_t i = 0; i < devices_.size(); i++) {
+    int device;
+    if (contexts_[i] && driver.device_get(&device, devices_[i]) == 0)
+      driver.primary_ctx_release(device);
+  }
+}
+
+bool NvAFXBackend::BindThread(int device) {
+  const CudaDriver& driver = CudaDriver::Get();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!driver.loaded) {
+    // Without the driver every handle lands on the device the SDK picks, fine for one device
+    if (!warned_ && devices_.size() > 1)
+      std::cerr << "CUDA driver not available, handles can not be placed on a device" << std::endl;
+    warned_ = true;
+    return true;
+  }
+
+  size_t index = 0;
+  while (index < devices_.size() && devices_[index] != device)
+    index++;
+  if (index == devices_.size())
+    return false;
+  if (!contexts_[index]) {
+    int cu_device;
+    if (driver.device_get(&cu_device, device) != 0 || driver.primary_ctx_retain(&contexts_[index], cu_device) != 0) {
+      std::cerr << "Unable to create a CUDA context on device " << device << std::endl;
+      contexts_[index] = nullptr;
+      return false;
+    }
+  }
+  return driver.ctx_set_current(contexts_[index]) == 0;
+}
+
+void* NvAFXBackend::CreateInstance(int device) {
+  NvAFX_Handle handle = nullptr;
+  if (!create_(device, CudaDriver::Get().loaded, &handle))
+    return nullptr;
+  return handle;
+}
+
+void NvAFXBackend::DestroyInstance(void* instance) { destroy_(static_cast<NvAFX_Handle>(instance)); }
+
+}  // namespace scheduler
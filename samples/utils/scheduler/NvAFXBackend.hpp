@@ -0,0 +1,52 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <nvAudioEffects.h>
+
+#include "DeviceScheduler.hpp"
+
+namespace scheduler {
+
+// Runs effect instances on CUDA devices. Worker threads make the primary context of their device
+// current (CUDA driver loaded at runtime, the samples do not link CUDA) and handles are created with
+// NVAFX_PARAM_USER_CUDA_CONTEXT so the SDK uses that context.
+class NvAFXBackend : public DeviceBackend {
+ public:
+  // Creates and loads a configured handle. user_cuda_context is true when the calling thread has the
+  // device's context current and NVAFX_PARAM_USER_CUDA_CONTEXT must be set before loading.
+  typedef std::function<bool(int device, bool user_cuda_context, NvAFX_Handle* handle)> CreateFunction;
+  typedef std::function<void(NvAFX_Handle handle)> DestroyFunction;
+
+  NvAFXBackend(const std::vector<int>& devices, CreateFunction create, DestroyFunction destroy);
+  ~NvAFXBackend() override;
+
+  std::vector<int> GetDevices() override { return devices_; }
+  bool BindThread(int device) override;
+  void* CreateInstance(int device) override;
+  void DestroyInstance(void* instance) override;
+
+ private:
+  std::vector<int> devices_;
+  CreateFunction create_;
+  DestroyFunction destroy_;
+  std::mutex mutex_;
+  // Primary contexts retained by BindThread, per entry of devices_
+  std::vector<void*> contexts_;
+  bool warned_ = false;
+};
+
+}  // namespace scheduler
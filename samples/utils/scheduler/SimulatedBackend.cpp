@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "SimulatedBackend.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace scheduler {
+
+SimulatedBackend::SimulatedBackend(const std::vector<double>& speeds)
+  : num_devices_(speeds.size()), speeds_(new std::atomic<double>[speeds.size()]) {
+  for (size_t i = 0; i < num_devices_; i++)
+    speeds_[i].store(speeds[i]);
+}
+
+std::vector<int> SimulatedBackend::GetDevices() {
+  std::vector<int> devices;
+  for (size_t i = 0; i < num_devices_; i++)
+    devices.push_back(static_cast<int>(i));
+  return devices;
+}
+
+void* SimulatedBackend::CreateInstance(int device) { return new Instance{ device }; }
+
+void SimulatedBackend::DestroyInstance(void* instance) { delete static_cast<Instance*>(instance); }
+
+void SimulatedBackend::SetSpeed(int device, double speed) { speeds_[device].store(speed); }
+
+bool SimulatedBackend::Process(void* instance, double audio_secs, double frame_secs) {
+  const int device = static_cast<Instance*>(instance)->device;
+  // Sleep in batches of frames, per frame sleeps are below the timer resolution
+  const double kBatchSecs = 0.002;
+  auto deadline = std::chrono::steady_clock::now();
+  double batch_secs = 0.0;
+  for (double done = 0.0; done < audio_secs; done += frame_secs) {
+    double speed = speeds_[device].load();
+    if (speed <= 0.0)
+      return false;
+    batch_secs += frame_secs / speed;
+    if (batch_secs >= kBatchSecs) {
+      deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(batch_secs));
+      std::this_thread::sleep_until(deadline);
+      batch_secs = 0.0;
+    }
+  }
+  return true;
+}
+
+}  // namespace scheduler
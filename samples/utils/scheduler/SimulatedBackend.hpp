@@ -0,0 +1,48 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "DeviceScheduler.hpp"
+
+namespace scheduler {
+
+// Stand-in for GPUs on machines without them. Device i processes audio speeds[i] times faster than
+// real time by sleeping for the time the work would take; speeds can change while jobs run to
+// simulate a device that saturates.
+class SimulatedBackend : public DeviceBackend {
+ public:
+  explicit SimulatedBackend(const std::vector<double>& speeds);
+
+  std::vector<int> GetDevices() override;
+  bool BindThread(int device) override { return device >= 0 && device < static_cast<int>(num_devices_); }
+  void* CreateInstance(int device) override;
+  void DestroyInstance(void* instance) override;
+
+  void SetSpeed(int device, double speed);
+  // Processes audio_secs of audio on instance in frames of frame_secs, picking up speed changes
+  // between frames. Returns false if the device was configured with speed 0 (failed).
+  bool Process(void* instance, double audio_secs, double frame_secs = 0.01);
+
+ private:
+  struct Instance {
+    int device;
+  };
+
+  const size_t num_devices_;
+  std::unique_ptr<std::atomic<double>[]> speeds_;
+};
+
+}  // namespace scheduler
@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "NvAFXBatchRunner.hpp"
+
+#include <iostream>
+#include <utility>
+
+namespace session {
+
+NvAFXBatchRunner::NvAFXBatchRunner(unsigned num_streams, CreateFunction create, DestroyFunction destroy)
+  : num_streams_(num_streams), create_(create), destroy_(destroy) {}
+
+NvAFXBatchRunner::~NvAFXBatchRunner() {
+  if (spare_)
+    destroy_(spare_);
+}
+
+bool NvAFXBatchRunner::Init() {
+  if (!create_(&spare_)) {
+    spare_ = nullptr;
+    return false;
+  }
+  if (NvAFX_GetU32(spare_, NVAFX_PARAM_NUM_INPUT_CHANNELS, &num_input_channels_) != NVAFX_STATUS_SUCCESS) {
+    // Single input effects may not report it
+    num_input_channels_ = 1;
+  }
+  if (NvAFX_GetU32(spare_, NVAFX_PARAM_NUM_INPUT_SAMPLES_PER_FRAME, &input_samples_) != NVAFX_STATUS_SUCCESS ||
+      NvAFX_GetU32(spare_, NVAFX_PARAM_NUM_OUTPUT_SAMPLES_PER_FRAME, &output_samples_) != NVAFX_STATUS_SUCCESS) {
+    std::cerr << "NvAFX_GetU32() failed for the frame size" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void* NvAFXBatchRunner::CreateInstance() {
+  if (spare_)
+    return std::exchange(spare_, nullptr);
+  NvAFX_Handle handle = nullptr;
+  if (!create_(&handle))
+    return nullptr;
+  return handle;
+}
+
+void NvAFXBatchRunner::DestroyInstance(void* instance) { destroy_(static_cast<NvAFX_Handle>(instance)); }
+
+bool NvAFXBatchRunner::Run(void* instance, const float** inputs, float** outputs) {
+  if (NvAFX_Run(static_cast<NvAFX_Handle>(instance), inputs, outputs, input_samples_, num_input_channels_) !=
+      NVAFX_STATUS_SUCCESS) {
+    std::cerr << "NvAFX_Run() failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace session
@@ -0,0 +1,54 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <functional>
+
+#include <nvAudioEffects.h>
+
+#include "StreamSession.hpp"
+
+namespace session {
+
+// Runs batches on SDK handles created with NVAFX_PARAM_NUM_STREAMS streams
+class NvAFXBatchRunner : public BatchRunner {
+ public:
+  // Creates and loads a configured handle
+  typedef std::function<bool(NvAFX_Handle* handle)> CreateFunction;
+  typedef std::function<void(NvAFX_Handle handle)> DestroyFunction;
+
+  NvAFXBatchRunner(unsigned num_streams, CreateFunction create, DestroyFunction destroy);
+  ~NvAFXBatchRunner() override;
+
+  // Creates the first handle and reads the frame sizes from it, call before the getters
+  bool Init();
+
+  unsigned GetNumStreams() const override { return num_streams_; }
+  unsigned GetNumInputChannels() const override { return num_input_channels_; }
+  unsigned GetInputSamples() const override { return input_samples_; }
+  unsigned GetOutputSamples() const override { return output_samples_; }
+  void* CreateInstance() override;
+  void DestroyInstance(void* instance) override;
+  bool Run(void* instance, const float** inputs, float** outputs) override;
+
+ private:
+  const unsigned num_streams_;
+  CreateFunction create_;
+  DestroyFunction destroy_;
+  // Handle loaded by Init(), handed out by the first CreateInstance()
+  NvAFX_Handle spare_ = nullptr;
+  unsigned num_input_channels_ = 1;
+  unsigned input_samples_ = 0;
+  unsigned output_samples_ = 0;
+};
+
+}  // namespace session
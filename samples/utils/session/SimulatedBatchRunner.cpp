@@ -0,0 +1,50 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "SimulatedBatchRunner.hpp"
+
+#include <thread>
+
+namespace session {
+
+namespace {
+
+struct Instance {
+  uint64_t calls = 0;
+};
+
+}  // namespace
+
+SimulatedBatchRunner::SimulatedBatchRunner(unsigned num_streams, unsigned frame_samples,
+                                           std::chrono::microseconds batch_overhead,
+                                           std::chrono::microseconds stream_cost)
+  : num_streams_(num_streams)
+  , frame_samples_(frame_samples)
+  , batch_overhead_(batch_overhead)
+  , stream_cost_(stream_cost) {}
+
+void* SimulatedBatchRunner::CreateInstance() { return new Instance; }
+
+void SimulatedBatchRunner::DestroyInstance(void* instance) { delete static_cast<Instance*>(instance); }
+
+bool SimulatedBatchRunner::Run(void* instance, const float** inputs, float** outputs) {
+  // Sleep until a deadline, the copies below count as part of the cost
+  Clock::time_point deadline = Clock::now() + batch_overhead_ + stream_cost_ * num_streams_;
+  for (unsigned stream = 0; stream < num_streams_; stream++) {
+    for (unsigned i = 0; i < frame_samples_; i++)
+      outputs[stream][i] = 0.5f * inputs[stream][i];
+  }
+  static_cast<Instance*>(instance)->calls++;
+  std::this_thread::sleep_until(deadline);
+  return true;
+}
+
+}  // namespace session
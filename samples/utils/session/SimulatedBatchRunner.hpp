@@ -0,0 +1,43 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <chrono>
+
+#include "StreamSession.hpp"
+
+namespace session {
+
+// Stand-in for the SDK on machines without GPUs. A call sleeps for a fixed overhead plus a cost per
+// stream and writes half the first input channel to each output, so a session can check that it got
+// its own frame back.
+class SimulatedBatchRunner : public BatchRunner {
+ public:
+  SimulatedBatchRunner(unsigned num_streams, unsigned frame_samples, std::chrono::microseconds batch_overhead,
+                       std::chrono::microseconds stream_cost);
+
+  unsigned GetNumStreams() const override { return num_streams_; }
+  unsigned GetNumInputChannels() const override { return 1; }
+  unsigned GetInputSamples() const override { return frame_samples_; }
+  unsigned GetOutputSamples() const override { return frame_samples_; }
+  void* CreateInstance() override;
+  void DestroyInstance(void* instance) override;
+  bool Run(void* instance, const float** inputs, float** outputs) override;
+
+ private:
+  const unsigned num_streams_;
+  const unsigned frame_samples_;
+  const std::chrono::microseconds batch_overhead_;
+  const std::chrono::microseconds stream_cost_;
+};
+
+}  // namespace session
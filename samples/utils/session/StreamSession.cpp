@@ -0,0 +1,373 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "StreamSession.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+namespace session {
+
+namespace {
+
+std::atomic<size_t> g_frame_bytes{ 0 };
+std::atomic<size_t> g_num_frames{ 0 };
+
+// Timers resumed per pass of a thread, so batches are not held up by a burst of due sessions
+const size_t kMaxTimersPerPass = 64;
+
+}  // namespace
+
+void* Task::promise_type::operator new(size_t size) {
+  g_frame_bytes.fetch_add(size, std::memory_order_relaxed);
+  g_num_frames.fetch_add(1, std::memory_order_relaxed);
+  return ::operator new(size);
+}
+
+void Task::promise_type::operator delete(void* frame, size_t size) {
+  g_frame_bytes.fetch_sub(size, std::memory_order_relaxed);
+  g_num_frames.fetch_sub(1, std::memory_order_relaxed);
+  ::operator delete(frame);
+}
+
+std::suspend_never Task::promise_type::final_suspend() noexcept {
+  // Locals of the body, e.g. sessions, are already destroyed
+  if (executor)
+    executor->taskFinished();
+  return {};
+}
+
+size_t Task::GetFrameBytes() { return g_frame_bytes.load(std::memory_order_relaxed); }
+
+size_t Task::GetNumFrames() { return g_num_frames.load(std::memory_order_relaxed); }
+
+bool Session::ProcessAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  if (!session_->executor_)
+    return false;
+  Executor::Pending pending;
+  pending.handle = handle;
+  pending.input = input_;
+  pending.output = output_;
+  pending.result = &result_;
+  return session_->executor_->submit(session_, pending);
+}
+
+Session::Session(Session&& other) noexcept
+  : executor_(other.executor_), group_(other.group_), slot_(other.slot_) {
+  other.executor_ = nullptr;
+}
+
+Session& Session::operator=(Session&& other) noexcept {
+  if (this != &other) {
+    Close();
+    executor_ = other.executor_;
+    group_ = other.group_;
+    slot_ = other.slot_;
+    other.executor_ = nullptr;
+  }
+  return *this;
+}
+
+void Session::Close() {
+  if (executor_)
+    executor_->close(this);
+  executor_ = nullptr;
+}
+
+void ExecutorStats::Print(std::ostream& out, unsigned num_streams) const {
+  double slots = static_cast<double>(batches) * num_streams;
+  out << "Batches " << batches << " on " << instances << " instances of " << num_streams << " streams, "
+      << std::fixed << std::setprecision(1) << (batches ? static_cast<double>(frames) / batches : 0.0)
+      << " frames per batch (" << (slots > 0.0 ? 100.0 * frames / slots : 0.0) << "% of slots), " << forced_batches
+      << " run at max wait, " << late_frames << " late frames, " << failed_batches << " failed" << std::endl;
+  out.unsetf(std::ios::fixed);
+}
+
+Executor::Executor(BatchRunner* runner, const ExecutorOptions& options)
+  : runner_(runner)
+  , options_(options)
+  , num_streams_(runner->GetNumStreams())
+  , num_input_channels_(runner->GetNumInputChannels())
+  , input_samples_(runner->GetInputSamples())
+  , output_samples_(runner->GetOutputSamples())
+  , silence_(static_cast<size_t>(runner->GetInputSamples()) * runner->GetNumInputChannels(), 0.f) {
+  for (unsigned i = 0; i < std::max(1u, options_.num_threads); i++)
+    threads_.emplace_back(&Executor::workerLoop, this);
+}
+
+Executor::~Executor() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread& thread : threads_)
+    thread.join();
+  for (Group& group : groups_)
+    runner_->DestroyInstance(group.instance);
+}
+
+size_t Executor::GetSlotBytes() { return sizeof(Pending) + sizeof(uint8_t); }
+
+bool Executor::Reserve(size_t num_sessions) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (groups_.size() * num_streams_ < num_sessions) {
+    if (!addGroup())
+      return false;
+  }
+  return true;
+}
+
+void Executor::Spawn(Task task) {
+  std::coroutine_handle<Task::promise_type> handle = task.handle_;
+  task.handle_ = nullptr;
+  handle.promise().executor = this;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_tasks_++;
+  }
+  schedule(Clock::now(), handle);
+}
+
+void Executor::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_done_.wait(lock, [this] { return live_tasks_ == 0; });
+}
+
+ExecutorStats Executor::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ExecutorStats stats = stats_;
+  stats.instances = groups_.size();
+  return stats;
+}
+
+void Executor::schedule(Clock::time_point time, std::coroutine_handle<> handle) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timers_.push({ time, timer_sequence_++, handle });
+  }
+  work_ready_.notify_one();
+}
+
+void Executor::taskFinished() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--live_tasks_ == 0)
+    tasks_done_.notify_all();
+}
+
+bool Executor::addGroup() {
+  void* instance = runner_->CreateInstance();
+  if (!instance)
+    return false;
+  Group group;
+  group.instance = instance;
+  group.used.assign(num_streams_, 0);
+  group.pending.resize(num_streams_);
+  groups_.push_back(std::move(group));
+  return true;
+}
+
+bool Executor::bind(Session* session, Clock::time_point now) {
+  // Same phase: a batch that started within the window, it may already run if its sessions arrived
+  size_t best = groups_.size();
+  for (size_t i = 0; i < groups_.size(); i++) {
+    const Group& group = groups_[i];
+    if (group.occupied < num_streams_ && group.occupied > 0 && now - group.first_submit <= options_.phase_window &&
+        (best == groups_.size() || group.first_submit > groups_[best].first_submit)) {
+      best = i;
+    }
+  }
+  // An unused instance, or a new one
+  for (size_t i = 0; best == groups_.size() && i < groups_.size(); i++) {
+    if (groups_[i].occupied == 0)
+      best = i;
+  }
+  if (best == groups_.size() && (options_.max_instances == 0 || groups_.size() < options_.max_instances) &&
+      addGroup()) {
+    best = groups_.size() - 1;
+  }
+  // Any free slot, on the least occupied instance
+  for (size_t i = 0; best == groups_.size() && i < groups_.size(); i++) {
+    if (groups_[i].occupied < num_streams_ &&
+        (best == groups_.size() || groups_[i].occupied < groups_[best].occupied)) {
+      best = i;
+    }
+  }
+  if (best == groups_.size())
+    return false;
+
+  Group& group = groups_[best];
+  size_t slot = std::find(group.used.begin(), group.used.end(), 0) - group.used.begin();
+  group.used[slot] = 1;
+  group.occupied++;
+  session->group_ = static_cast<int32_t>(best);
+  session->slot_ = static_cast<int32_t>(slot);
+  open_sessions_++;
+  stats_.peak_sessions = std::max(stats_.peak_sessions, open_sessions_);
+  return true;
+}
+
+bool Executor::submit(Session* session, const Pending& pending) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    if (session->group_ < 0 && !bind(session, now)) {
+      std::cerr << "No free stream slot for a new session" << std::endl;
+      return false;
+    }
+    const size_t group_index = static_cast<size_t>(session->group_);
+    Group& group = groups_[group_index];
+    group.pending[session->slot_] = pending;
+    if (group.submitted++ == 0) {
+      group.first_submit = now;
+      deadlines_.push({ now + options_.max_wait, group_index, group.generation });
+    }
+    if (group.submitted == group.occupied)
+      dispatch(group_index, false);
+  }
+  work_ready_.notify_one();
+  return true;
+}
+
+void Executor::close(Session* session) {
+  if (session->group_ < 0)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t group_index = static_cast<size_t>(session->group_);
+    Group& group = groups_[group_index];
+    group.used[session->slot_] = 0;
+    group.occupied--;
+    open_sessions_--;
+    // The other sessions may only have been waiting for this one
+    if (group.submitted > 0 && group.submitted == group.occupied)
+      dispatch(group_index, false);
+  }
+  session->group_ = -1;
+  session->slot_ = -1;
+  work_ready_.notify_one();
+}
+
+void Executor::dispatch(size_t group_index, bool forced) {
+  Group& group = groups_[group_index];
+  if (group.running) {
+    // Runs once the previous batch returned, the instance processes one call at a time
+    group.due = true;
+    return;
+  }
+  Batch batch;
+  batch.group = group_index;
+  batch.pending.swap(group.pending);
+  group.pending.resize(num_streams_);
+  for (unsigned slot = 0; slot < num_streams_; slot++) {
+    if (batch.pending[slot].handle)
+      stats_.frames++;
+    else if (group.used[slot])
+      stats_.late_frames++;
+    else
+      stats_.idle_slots++;
+  }
+  stats_.batches++;
+  stats_.forced_batches += forced;
+  group.submitted = 0;
+  group.generation++;
+  group.running = true;
+  group.due = false;
+  batches_.push(std::move(batch));
+}
+
+void Executor::runBatch(Batch& batch, std::vector<const float*>& inputs, std::vector<float*>& outputs) {
+  // Idle slots read silence and write to scratch output
+  thread_local std::vector<float> scratch;
+  scratch.resize(output_samples_);
+  for (unsigned slot = 0; slot < num_streams_; slot++) {
+    const Pending& pending = batch.pending[slot];
+    const float* input = pending.handle ? pending.input : silence_.data();
+    for (unsigned ch = 0; ch < num_input_channels_; ch++)
+      inputs[slot * num_input_channels_ + ch] = input + static_cast<size_t>(ch) * input_samples_;
+    outputs[slot] = pending.handle ? pending.output : scratch.data();
+  }
+  Clock::time_point begin = Clock::now();
+  bool success = runner_->Run(groups_[batch.group].instance, inputs.data(), outputs.data());
+  double run_secs = std::chrono::duration<double>(Clock::now() - begin).count();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.run_secs += run_secs;
+    stats_.failed_batches += !success;
+    Group& group = groups_[batch.group];
+    group.running = false;
+    if (group.due)
+      dispatch(batch.group, false);
+  }
+  work_ready_.notify_one();
+  for (const Pending& pending : batch.pending) {
+    if (pending.handle) {
+      *pending.result = success;
+      pending.handle.resume();
+    }
+  }
+}
+
+void Executor::workerLoop() {
+  std::vector<const float*> inputs(static_cast<size_t>(num_streams_) * num_input_channels_);
+  std::vector<float*> outputs(num_streams_);
+  std::vector<std::coroutine_handle<>> due;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    Clock::time_point now = Clock::now();
+    // Batches whose sessions did not all arrive in time run without them
+    while (!deadlines_.empty() && deadlines_.top().time <= now) {
+      Deadline deadline = deadlines_.top();
+      deadlines_.pop();
+      Group& group = groups_[deadline.group];
+      if (deadline.generation == group.generation && group.submitted > 0)
+        dispatch(deadline.group, true);
+    }
+    if (!batches_.empty()) {
+      Batch batch = std::move(batches_.front());
+      batches_.pop();
+      lock.unlock();
+      runBatch(batch, inputs, outputs);
+      lock.lock();
+      continue;
+    }
+    while (!timers_.empty() && timers_.top().time <= now && due.size() < kMaxTimersPerPass) {
+      due.push_back(timers_.top().handle);
+      timers_.pop();
+    }
+    if (!due.empty()) {
+      lock.unlock();
+      for (std::coroutine_handle<> handle : due)
+        handle.resume();
+      due.clear();
+      lock.lock();
+      continue;
+    }
+    if (stop_)
+      break;
+    Clock::time_point wake = Clock::time_point::max();
+    if (!timers_.empty())
+      wake = timers_.top().time;
+    if (!deadlines_.empty())
+      wake = std::min(wake, deadlines_.top().time);
+    if (wake == Clock::time_point::max())
+      work_ready_.wait(lock);
+    else
+      work_ready_.wait_until(lock, wake);
+  }
+}
+
+}  // namespace session
@@ -0,0 +1,285 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Coroutine API for many live streams on a few threads. A stream is a Task which awaits
+// Session::Process() once per frame. The executor collects the frames of the sessions sharing an
+// instance of NVAFX_PARAM_NUM_STREAMS streams, runs them in one call and resumes the sessions when it
+// returns. Needs C++20, the rest of the samples build as C++14.
+
+namespace session {
+
+typedef std::chrono::steady_clock Clock;
+
+// Creates effect instances which process a fixed number of streams per call. NvAFXBatchRunner uses
+// the SDK, SimulatedBatchRunner stands in for machines without GPUs.
+class BatchRunner {
+ public:
+  virtual ~BatchRunner() = default;
+  // Streams per instance and per call
+  virtual unsigned GetNumStreams() const = 0;
+  virtual unsigned GetNumInputChannels() const = 0;
+  // Samples per channel of a frame of one stream, the output has one channel
+  virtual unsigned GetInputSamples() const = 0;
+  virtual unsigned GetOutputSamples() const = 0;
+  // nullptr on failure
+  virtual void* CreateInstance() = 0;
+  virtual void DestroyInstance(void* instance) = 0;
+  // Processes one frame of every stream of instance. inputs holds GetNumInputChannels() buffers per
+  // stream, outputs one per stream. Stream i keeps its state between calls.
+  virtual bool Run(void* instance, const float** inputs, float** outputs) = 0;
+};
+
+class Executor;
+
+// Coroutine type of a stream. It starts suspended and runs once handed to Executor::Spawn(), which
+// owns it until it returns. Sessions should be locals of the task: they are closed when the body
+// ends, before the executor learns that the task finished.
+class Task {
+ public:
+  struct promise_type {
+    Executor* executor = nullptr;
+
+    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept;
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    // Coroutine frames are counted, see GetFrameBytes()
+    static void* operator new(size_t size);
+    static void operator delete(void* frame, size_t size);
+  };
+
+  Task(Task&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+  Task& operator=(Task&&) = delete;
+  ~Task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  // Bytes and number of the coroutine frames currently allocated by tasks
+  static size_t GetFrameBytes();
+  static size_t GetNumFrames();
+
+ private:
+  friend class Executor;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// A stream on an instance slot. The slot is taken by the first Process() (sessions whose frames
+// arrive together share an instance) and kept until Close(), as the instance holds the state of
+// the stream.
+class Session {
+ public:
+  class ProcessAwaiter {
+   public:
+    bool await_ready() const noexcept { return false; }
+    // Returns false (resume at once, failed) when no slot is free
+    bool await_suspend(std::coroutine_handle<> handle);
+    // False if the batch failed
+    bool await_resume() const noexcept { return result_; }
+
+   private:
+    friend class Session;
+    ProcessAwaiter(Session* session, const float* input, float* output)
+      : session_(session), input_(input), output_(output) {}
+
+    Session* session_;
+    const float* input_;
+    float* output_;
+    bool result_ = false;
+  };
+
+  Session() = default;
+  Session(Session&& other) noexcept;
+  Session& operator=(Session&& other) noexcept;
+  ~Session() { Close(); }
+
+  // co_await session.Process(input, output) processes one frame: input holds the channels of the
+  // frame one after the other, output receives the output frame. Both must stay valid until resumed.
+  ProcessAwaiter Process(const float* input, float* output) { return ProcessAwaiter(this, input, output); }
+  // Frees the slot, the next session on it inherits the state of the stream
+  void Close();
+  bool IsOpen() const { return executor_ != nullptr; }
+
+ private:
+  friend class Executor;
+  explicit Session(Executor* executor) : executor_(executor) {}
+
+  Executor* executor_ = nullptr;
+  int32_t group_ = -1;
+  int32_t slot_ = -1;
+};
+
+struct ExecutorOptions {
+  unsigned num_threads = 4;
+  // Instances created at most, 0 for no limit
+  unsigned max_instances = 0;
+  // Longest a batch waits for the frames of all sessions on its instance after the first arrived.
+  // Missing frames are replaced by silence, as a lost packet would be, and go into the next batch.
+  std::chrono::microseconds max_wait{ 5000 };
+  // A new session joins an instance whose last batch started at most this long ago, so sessions with
+  // the same frame phase share instances. Otherwise it takes an unused instance if there is one.
+  std::chrono::microseconds phase_window{ 1000 };
+};
+
+struct ExecutorStats {
+  uint64_t batches = 0;
+  // Frames of sessions processed
+  uint64_t frames = 0;
+  // Slots without a session, run on silence
+  uint64_t idle_slots = 0;
+  // Frames of sessions which missed their batch, replaced by silence
+  uint64_t late_frames = 0;
+  // Batches run at max_wait rather than when complete
+  uint64_t forced_batches = 0;
+  uint64_t failed_batches = 0;
+  size_t instances = 0;
+  size_t peak_sessions = 0;
+  // Time spent in BatchRunner::Run()
+  double run_secs = 0.0;
+
+  void Print(std::ostream& out, unsigned num_streams) const;
+};
+
+class Executor {
+ public:
+  class SleepAwaiter {
+   public:
+    bool await_ready() const noexcept { return Clock::now() >= time_; }
+    void await_suspend(std::coroutine_handle<> handle) { executor_->schedule(time_, handle); }
+    void await_resume() const noexcept {}
+
+   private:
+    friend class Executor;
+    SleepAwaiter(Executor* executor, Clock::time_point time) : executor_(executor), time_(time) {}
+
+    Executor* executor_;
+    Clock::time_point time_;
+  };
+
+  Executor(BatchRunner* runner, const ExecutorOptions& options);
+  // Waits for the tasks and destroys the instances
+  ~Executor();
+
+  // Creates the instances for num_sessions sessions ahead of time. Instances created by Process()
+  // hold up the other sessions while the model loads.
+  bool Reserve(size_t num_sessions);
+  Session OpenSession() { return Session(this); }
+  // Starts task on one of the threads
+  void Spawn(Task task);
+  // co_await executor.SleepUntil(time) resumes the task on one of the threads at time
+  SleepAwaiter SleepUntil(Clock::time_point time) { return SleepAwaiter(this, time); }
+  // Waits until all spawned tasks returned
+  void Wait();
+
+  ExecutorStats GetStats() const;
+  // Bytes of executor state per slot, the share of a session
+  static size_t GetSlotBytes();
+
+ private:
+  friend class Session;
+  friend struct Task::promise_type;
+
+  // Frame of a session waiting for its batch
+  struct Pending {
+    std::coroutine_handle<> handle;
+    const float* input = nullptr;
+    float* output = nullptr;
+    bool* result = nullptr;
+  };
+  // An instance and its slots
+  struct Group {
+    void* instance = nullptr;
+    std::vector<uint8_t> used;
+    std::vector<Pending> pending;
+    unsigned occupied = 0;
+    unsigned submitted = 0;
+    // Arrival of the first frame of the last batch
+    Clock::time_point first_submit;
+    // Incremented when the open batch is dispatched, stale deadlines are skipped
+    uint64_t generation = 0;
+    bool running = false;
+    // The open batch is due but the previous one still runs
+    bool due = false;
+  };
+  struct Batch {
+    size_t group;
+    std::vector<Pending> pending;
+  };
+  struct Timer {
+    Clock::time_point time;
+    uint64_t sequence;
+    std::coroutine_handle<> handle;
+    bool operator>(const Timer& other) const {
+      return time != other.time ? time > other.time : sequence > other.sequence;
+    }
+  };
+  struct Deadline {
+    Clock::time_point time;
+    size_t group;
+    uint64_t generation;
+    bool operator>(const Deadline& other) const { return time > other.time; }
+  };
+
+  void schedule(Clock::time_point time, std::coroutine_handle<> handle);
+  bool submit(Session* session, const Pending& pending);
+  void close(Session* session);
+  void taskFinished();
+  void workerLoop();
+  void runBatch(Batch& batch, std::vector<const float*>& inputs, std::vector<float*>& outputs);
+  // The following expect mutex_ to be held
+  bool bind(Session* session, Clock::time_point now);
+  bool addGroup();
+  void dispatch(size_t group_index, bool forced);
+
+ private:
+  BatchRunner* runner_;
+  const ExecutorOptions options_;
+  const unsigned num_streams_;
+  const unsigned num_input_channels_;
+  const unsigned input_samples_;
+  const unsigned output_samples_;
+  // Input of idle slots and late sessions
+  std::vector<float> silence_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable tasks_done_;
+  std::vector<Group> groups_;
+  std::queue<Batch> batches_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+  uint64_t timer_sequence_ = 0;
+  size_t live_tasks_ = 0;
+  size_t open_sessions_ = 0;
+  ExecutorStats stats_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace session
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#include "StartupProfile.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace startup {
+
+namespace {
+
+const char kCacheHeader[] = "# effects_demo property cache v1";
+
+double ToMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// FNV-1a, keys only need to be stable across runs
+uint64_t Hash(const std::string& value) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : value) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+}  // namespace
+
+Profile& Profile::Get() {
+  static Profile profile;
+  return profile;
+}
+
+void Profile::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  start_ = std::chrono::steady_clock::now();
+  phases_.clear();
+  first_frame_ms_ = -1.0;
+}
+
+void Profile::Add(const std::string& phase, std::chrono::steady_clock::time_point begin,
+                  std::chrono::steady_clock::time_point end, bool background) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_.push_back({ phase, ToMs(begin - start_), ToMs(end - begin), background });
+}
+
+void Profile::MarkFirstFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (first_frame_ms_ < 0.0)
+    first_frame_ms_ = ToMs(std::chrono::steady_clock::now() - start_);
+}
+
+void Profile::Print(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Phase> phases = phases_;
+  std::stable_sort(phases.begin(), phases.end(),
+                   [](const Phase& a, const Phase& b) { return a.begin_ms < b.begin_ms; });
+
+  out << "Startup time (ms)" << std::endl;
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(2);
+  for (const Phase& phase : phases) {
+    out << "  " << std::left << std::setw(28) << phase.name + (phase.background ? " (background)" : "")
+        << std::right << std::setw(10) << phase.duration_ms << "  at " << phase.begin_ms << std::endl;
+  }
+  if (first_frame_ms_ >= 0.0)
+    out << "  " << std::left << std::setw(28) << "Time to first frame" << std::right << std::setw(10)
+        << first_frame_ms_ << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+std::string PropertyCache::MakeKey(const std::string& effect, const std::vector<std::string>& models) {
+  std::ostringstream key;
+  key << effect;
+  for (const std::string& model : models) {
+    key << '\n' << model;
+    struct stat info;
+    if (stat(model.c_str(), &info) == 0)
+      key << ' ' << static_cast<long long>(info.st_size) << ' ' << static_cast<long long>(info.st_mtime);
+  }
+  std::ostringstream hex;
+  hex << std::hex << std::setw(16) << std::setfill('0') << Hash(key.str());
+  return hex.str();
+}
+
+PropertyCache::PropertyCache(const std::string& path) : table_(path, kCacheHeader) {}
+
+bool PropertyCache::Lookup(const std::string& key, EffectProperties* properties) {
+  std::string value;
+  if (!table_.Lookup(key, &value))
+    return false;
+  std::istringstream fields(value);
+  EffectProperties entry;
+  if (!(fields >> entry.input_sample_rate >> entry.output_sample_rate >> entry.num_input_channels >>
+        entry.num_output_channels >> entry.num_input_samples_per_frame >> entry.num_output_samples_per_frame))
+    return false;
+  *properties = entry;
+  return true;
+}
+
+bool PropertyCache::Store(const std::string& key, const EffectProperties& properties) {
+  std::ostringstream value;
+  value << properties.input_sample_rate << ' ' << properties.output_sample_rate << ' '
+        << properties.num_input_channels << ' ' << properties.num_output_channels << ' '
+        << properties.num_input_samples_per_frame << ' ' << properties.num_output_samples_per_frame;
+  return table_.Store(key, value.str());
+}
+
+}  // namespace startup
@@ -0,0 +1,108 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <utils/cache/KeyedTextTable.hpp>
+
+// Startup timing breakdown and a cache of queried effect properties, so short runs spend as little
+// time as possible before the first frame.
+
+namespace startup {
+
+// Wall time of each startup phase. Phases can be recorded from any thread.
+class Profile {
+ public:
+  static Profile& Get();
+
+  // Marks the start of the process, phases are reported relative to it
+  void Start();
+  // Records a finished phase. Phases on other threads (background) overlap with the main thread.
+  void Add(const std::string& phase, std::chrono::steady_clock::time_point begin,
+           std::chrono::steady_clock::time_point end, bool background = false);
+  // Records the time from Start() to now as the time to first frame
+  void MarkFirstFrame();
+  // Prints the phases in the order they started
+  void Print(std::ostream& out) const;
+
+ private:
+  struct Phase {
+    std::string name;
+    double begin_ms;
+    double duration_ms;
+    bool background;
+  };
+
+  mutable std::mutex mutex_;
+  std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+  std::vector<Phase> phases_;
+  double first_frame_ms_ = -1.0;
+};
+
+// Times the enclosing scope as a phase of Profile::Get()
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const char* phase, bool background = false)
+    : phase_(phase), background_(background), begin_(std::chrono::steady_clock::now()) {}
+  ~ScopedPhase() { End(); }
+  // Ends the current phase and starts the next one
+  void Next(const char* phase) {
+    End();
+    phase_ = phase;
+    begin_ = std::chrono::steady_clock::now();
+  }
+  // Ends the current phase early
+  void End() {
+    if (phase_)
+      Profile::Get().Add(phase_, begin_, std::chrono::steady_clock::now(), background_);
+    phase_ = nullptr;
+  }
+
+ private:
+  const char* phase_;
+  const bool background_;
+  std::chrono::steady_clock::time_point begin_;
+};
+
+// Properties the app queries from a loaded effect
+struct EffectProperties {
+  uint32_t input_sample_rate = 0;
+  uint32_t output_sample_rate = 0;
+  uint32_t num_input_channels = 0;
+  uint32_t num_output_channels = 0;
+  uint32_t num_input_samples_per_frame = 0;
+  uint32_t num_output_samples_per_frame = 0;
+};
+
+// Small text file of EffectProperties keyed by effect and models. The size and modification time of
+// the model files are part of the key, so a replaced model is queried again.
+class PropertyCache {
+ public:
+  explicit PropertyCache(const std::string& path);
+
+  static std::string MakeKey(const std::string& effect, const std::vector<std::string>& models);
+  bool Lookup(const std::string& key, EffectProperties* properties);
+  // Adds or replaces an entry and rewrites the file
+  bool Store(const std::string& key, const EffectProperties& properties);
+
+ private:
+  cache::KeyedTextTable table_;
+};
+
+}  // namespace startup
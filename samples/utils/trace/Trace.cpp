@@ -0,0 +1,347 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "Trace.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace trace {
+
+namespace {
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+const uint32_t kPid = 1;
+// Thread buffers use their tid as packet sequence, counter descriptors get their own
+const uint32_t kCounterSequenceId = 0x7fffffff;
+
+std::string JsonEscape(const char* value) {
+  std::ostringstream oss;
+  for (const char* c = value; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      oss << '\\';
+    oss << *c;
+  }
+  return oss.str();
+}
+
+// Minimal protobuf writer for the subset of the Perfetto trace format used here
+class ProtoWriter {
+ public:
+  void Varint(uint32_t field, uint64_t value) {
+    Tag(field, 0);
+    RawVarint(value);
+  }
+  void Double(uint32_t field, double value) {
+    Tag(field, 1);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++)
+      data_.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+  }
+  void String(uint32_t field, const std::string& value) {
+    Tag(field, 2);
+    RawVarint(value.size());
+    data_.append(value);
+  }
+  void Message(uint32_t field, const ProtoWriter& message) { String(field, message.data_); }
+  const std::string& Data() const { return data_; }
+
+ private:
+  void Tag(uint32_t field, uint32_t wire_type) { RawVarint((field << 3) | wire_type); }
+  void RawVarint(uint64_t value) {
+    while (value >= 0x80) {
+      data_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    data_.push_back(static_cast<char>(value));
+  }
+
+  std::string data_;
+};
+
+// Perfetto field numbers (protos/perfetto/trace)
+enum : uint32_t {
+  kTracePacket = 1,
+  kPacketTimestamp = 8,
+  kPacketSequenceId = 10,
+  kPacketTrackEvent = 11,
+  kPacketTrackDescriptor = 60,
+  kEventDebugAnnotations = 4,
+  kEventType = 9,
+  kEventTrackUuid = 11,
+  kEventName = 23,
+  kEventDoubleCounterValue = 44,
+  kAnnotationIntValue = 4,
+  kAnnotationName = 10,
+  kTrackUuid = 1,
+  kTrackName = 2,
+  kTrackThread = 4,
+  kTrackCounter = 8,
+  kThreadPid = 1,
+  kThreadTid = 2,
+  kThreadName = 5,
+};
+
+enum : uint64_t {
+  kSliceBegin = 1,
+  kSliceEnd = 2,
+  kInstant = 3,
+  kCounter = 4,
+};
+
+// Begin or end of a complete event, sorted so slices nest properly on the thread track
+struct SliceEdge {
+  uint64_t timestamp;
+  uint64_t duration;
+  bool begin;
+  const Event* event;
+};
+
+bool EdgeBefore(const SliceEdge& a, const SliceEdge& b) {
+  if (a.timestamp != b.timestamp)
+    return a.timestamp < b.timestamp;
+  // At equal time ends go first; outer slices begin first and end last
+  if (a.begin != b.begin)
+    return !a.begin;
+  return a.begin ? a.duration > b.duration : a.duration < b.duration;
+}
+
+uint64_t CounterTrackUuid(const char* name) {
+  // FNV-1a, offset so counter tracks never collide with thread tracks
+  uint64_t hash = 1469598103934665603ull;
+  for (const char* c = name; *c; c++)
+    hash = (hash ^ static_cast<uint8_t>(*c)) * 1099511628211ull;
+  return hash | (1ull << 63);
+}
+
+}  // namespace
+
+ThreadBuffer::ThreadBuffer(uint32_t tid, const std::string& name)
+  : tid_(tid)
+  , name_(name)
+  , size_(0)
+  , dropped_(0) {
+}
+
+bool ThreadBuffer::Append(const Event& event) {
+  // Only the owning thread writes, so a relaxed load of our own size is sufficient
+  uint64_t size = size_.load(std::memory_order_relaxed);
+  uint64_t chunk = size / kEventsPerChunk;
+  if (chunk >= kMaxChunks) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (!chunks_[chunk])
+    chunks_[chunk].reset(new Event[kEventsPerChunk]);
+  chunks_[chunk][size % kEventsPerChunk] = event;
+  size_.store(size + 1, std::memory_order_release);
+  return true;
+}
+
+Tracer& Tracer::Get() {
+  static Tracer tracer;
+  return tracer;
+}
+
+bool Tracer::IsCompiledIn() {
+#ifdef NVAFX_ENABLE_TRACING
+  return true;
+#else
+  return false;
+#endif
+}
+
+Tracer::Tracer()
+  : enabled_(false)
+  , start_(std::chrono::steady_clock::now()) {
+}
+
+void Tracer::Start(const std::string& trace_file) {
+  trace_file_ = trace_file;
+  std::size_t dot_pos = trace_file.find_last_of('.');
+  format_ = (dot_pos != std::string::npos && trace_file.substr(dot_pos + 1) == "json") ? TraceFormat::kChromeJson
+                                                                                       : TraceFormat::kPerfetto;
+  start_ = std::chrono::steady_clock::now();
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+ThreadBuffer* Tracer::GetThreadBuffer() {
+  if (!t_buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t tid = static_cast<uint32_t>(buffers_.size()) + 1;
+    buffers_.emplace_back(new ThreadBuffer(tid, tid == 1 ? "main" : "thread " + std::to_string(tid)));
+    t_buffer = buffers_.back().get();
+  }
+  return t_buffer;
+}
+
+void Tracer::SetThreadName(const std::string& name) {
+  if (!IsEnabled())
+    return;
+  ThreadBuffer* buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer->SetName(name);
+}
+
+bool Tracer::Flush() {
+  if (!IsEnabled())
+    return true;
+
+  enabled_.store(false, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& buffer : buffers_) {
+    if (buffer->GetDropped())
+      printf("Trace buffer of %s full, %llu events dropped\n", buffer->GetName().c_str(),
+             static_cast<unsigned long long>(buffer->GetDropped()));
+  }
+  return format_ == TraceFormat::kChromeJson ? writeChromeJson(trace_file_) : writePerfetto(trace_file_);
+}
+
+bool Tracer::writeChromeJson(const std::string& trace_file) {
+  std::ofstream out(trace_file, std::ios_base::out | std::ios_base::trunc);
+  if (!out.is_open())
+    return false;
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  for (const auto& buffer : buffers_) {
+    out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << kPid
+        << ",\"tid\":" << buffer->GetTid() << ",\"args\":{\"name\":\"" << JsonEscape(buffer->GetName().c_str())
+        << "\"}}";
+    first = false;
+
+    uint64_t size = buffer->Size();
+    for (uint64_t i = 0; i < size; i++) {
+      const Event& event = buffer->At(i);
+      out << ",\n{\"name\":\"" << JsonEscape(event.name) << "\",\"pid\":" << kPid << ",\"tid\":" << buffer->GetTid()
+          << ",\"ts\":" << event.timestamp_ns / 1000.0;
+      switch (event.type) {
+      case EventType::kComplete:
+        out << ",\"ph\":\"X\",\"dur\":" << event.duration_ns / 1000.0;
+        break;
+      case EventType::kCounter:
+        out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        continue;
+      case EventType::kInstant:
+        out << ",\"ph\":\"i\",\"s\":\"t\"";
+        break;
+      }
+      if (event.arg_name)
+        out << ",\"args\":{\"" << JsonEscape(event.arg_name) << "\":" << event.value << "}";
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+
+  return out.good();
+}
+
+bool Tracer::writePerfetto(const std::string& trace_file) {
+  std::ofstream out(trace_file, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+  if (!out.is_open())
+    return false;
+
+  auto write_packet = [&out](const ProtoWriter& packet) {
+    ProtoWriter trace;
+    trace.Message(kTracePacket, packet);
+    out.write(trace.Data().data(), trace.Data().size());
+  };
+
+  // Counter tracks are shared by all threads, describe them before any event refers to them
+  std::map<uint64_t, const char*> counter_tracks;
+  for (const auto& buffer : buffers_) {
+    uint64_t size = buffer->Size();
+    for (uint64_t i = 0; i < size; i++) {
+      if (buffer->At(i).type == EventType::kCounter)
+        counter_tracks[CounterTrackUuid(buffer->At(i).name)] = buffer->At(i).name;
+    }
+  }
+  for (const auto& counter : counter_tracks) {
+    ProtoWriter descriptor;
+    descriptor.Varint(kTrackUuid, counter.first);
+    descriptor.String(kTrackName, counter.second);
+    descriptor.Message(kTrackCounter, ProtoWriter());
+    ProtoWriter packet;
+    packet.Varint(kPacketSequenceId, kCounterSequenceId);
+    packet.Message(kPacketTrackDescriptor, descriptor);
+    write_packet(packet);
+  }
+
+  for (const auto& buffer : buffers_) {
+    const uint64_t track_uuid = buffer->GetTid();
+    const uint32_t sequence_id = buffer->GetTid();
+
+    ProtoWriter thread;
+    thread.Varint(kThreadPid, kPid);
+    thread.Varint(kThreadTid, buffer->GetTid());
+    thread.String(kThreadName, buffer->GetName());
+    ProtoWriter descriptor;
+    descriptor.Varint(kTrackUuid, track_uuid);
+    descriptor.Message(kTrackThread, thread);
+    ProtoWriter packet;
+    packet.Varint(kPacketSequenceId, sequence_id);
+    packet.Message(kPacketTrackDescriptor, descriptor);
+    write_packet(packet);
+
+    std::vector<SliceEdge> edges;
+    uint64_t size = buffer->Size();
+    for (uint64_t i = 0; i < size; i++) {
+      const Event& event = buffer->At(i);
+      if (event.type == EventType::kComplete) {
+        edges.push_back({ event.timestamp_ns, event.duration_ns, true, &event });
+        edges.push_back({ event.timestamp_ns + event.duration_ns, event.duration_ns, false, &event });
+      } else {
+        edges.push_back({ event.timestamp_ns, 0, true, &event });
+      }
+    }
+    std::stable_sort(edges.begin(), edges.end(), EdgeBefore);
+
+    for (const SliceEdge& edge : edges) {
+      const Event& event = *edge.event;
+      ProtoWriter track_event;
+      if (event.type == EventType::kCounter) {
+        track_event.Varint(kEventType, kCounter);
+        track_event.Varint(kEventTrackUuid, CounterTrackUuid(event.name));
+        track_event.Double(kEventDoubleCounterValue, event.value);
+      } else {
+        track_event.Varint(kEventType, !edge.begin ? kSliceEnd : event.type == EventType::kInstant ? kInstant
+                                                                                                  : kSliceBegin);
+        track_event.Varint(kEventTrackUuid, track_uuid);
+        if (edge.begin) {
+          track_event.String(kEventName, event.name);
+          if (event.arg_name) {
+            ProtoWriter annotation;
+            annotation.String(kAnnotationName, event.arg_name);
+            annotation.Varint(kAnnotationIntValue, static_cast<uint64_t>(static_cast<int64_t>(event.value)));
+            track_event.Message(kEventDebugAnnotations, annotation);
+          }
+        }
+      }
+      ProtoWriter event_packet;
+      event_packet.Varint(kPacketTimestamp, edge.timestamp);
+      event_packet.Varint(kPacketSequenceId, sequence_id);
+      event_packet.Message(kPacketTrackEvent, track_event);
+      write_packet(event_packet);
+    }
+  }
+
+  return out.good();
+}
+
+}  // namespace trace
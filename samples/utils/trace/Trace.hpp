@@ -0,0 +1,176 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline tracing for the sample pipeline. Events are recorded into a per-thread buffer owned by
+// the recording thread (no locks on the hot path) and written out as Chrome trace JSON or Perfetto
+// protobuf by Tracer::Flush(). Tracing is compiled in only when NVAFX_ENABLE_TRACING is defined
+// (cmake -DENABLE_TRACING=ON), otherwise the TRACE_* macros expand to nothing.
+//
+// Names passed to the macros must be string literals or otherwise outlive the tracer.
+
+namespace trace {
+
+enum class EventType : uint8_t {
+  // Slice with begin time and duration
+  kComplete,
+  // Counter sample, shown as its own track
+  kCounter,
+  // Point in time
+  kInstant,
+};
+
+struct Event {
+  const char* name;
+  // Nanoseconds since tracer start
+  uint64_t timestamp_ns;
+  // Duration for complete events
+  uint64_t duration_ns;
+  // Counter value or event argument
+  double value;
+  // Name of the argument of a complete/instant event, nullptr if none
+  const char* arg_name;
+  EventType type;
+};
+
+// Single writer event buffer. Events are stored in fixed size chunks whose pointer table never
+// moves, so the flushing thread can read published events while the owner keeps appending.
+class ThreadBuffer {
+ public:
+  static const uint32_t kEventsPerChunk = 16384;
+  static const uint32_t kMaxChunks = 1024;
+
+  ThreadBuffer(uint32_t tid, const std::string& name);
+  // Appends an event, returns false if the buffer is full
+  bool Append(const Event& event);
+  // Number of events visible to readers
+  uint64_t Size() const { return size_.load(std::memory_order_acquire); }
+  // Returns published event i
+  const Event& At(uint64_t i) const { return chunks_[i / kEventsPerChunk][i % kEventsPerChunk]; }
+  uint32_t GetTid() const { return tid_; }
+  const std::string& GetName() const { return name_; }
+  void SetName(const std::string& name) { name_ = name; }
+  uint64_t GetDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  uint32_t tid_;
+  std::string name_;
+  std::unique_ptr<Event[]> chunks_[kMaxChunks];
+  std::atomic<uint64_t> size_;
+  std::atomic<uint64_t> dropped_;
+};
+
+enum class TraceFormat {
+  kChromeJson,
+  kPerfetto,
+};
+
+class Tracer {
+ public:
+  static Tracer& Get();
+  // Returns true if tracing support is compiled in
+  static bool IsCompiledIn();
+  // Enables recording. Format is picked from the extension: .json for Chrome trace, anything else
+  // (e.g. .perfetto-trace, .pftrace) for Perfetto protobuf.
+  void Start(const std::string& trace_file);
+  // Writes all recorded events. Returns false if the file could not be written.
+  bool Flush();
+  bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+  // Nanoseconds since Start()
+  uint64_t Now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_).count());
+  }
+  // Returns the calling thread's buffer, registering it on first use
+  ThreadBuffer* GetThreadBuffer();
+  // Names the calling thread in the trace
+  void SetThreadName(const std::string& name);
+
+ private:
+  Tracer();
+  bool writeChromeJson(const std::string& trace_file);
+  bool writePerfetto(const std::string& trace_file);
+
+ private:
+  std::atomic<bool> enabled_;
+  std::chrono::steady_clock::time_point start_;
+  std::string trace_file_;
+  TraceFormat format_ = TraceFormat::kChromeJson;
+  // Guards buffers_, only taken when a thread records its first event and at flush
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+inline void RecordEvent(EventType type, const char* name, uint64_t timestamp_ns, uint64_t duration_ns,
+                        double value, const char* arg_name) {
+  Tracer& tracer = Tracer::Get();
+  if (!tracer.IsEnabled())
+    return;
+  Event event = { name, timestamp_ns, duration_ns, value, arg_name, type };
+  tracer.GetThreadBuffer()->Append(event);
+}
+
+// Records a complete event covering its own lifetime
+class ScopedEvent {
+ public:
+  explicit ScopedEvent(const char* name, const char* arg_name = nullptr, double arg = 0.0)
+    : name_(name), arg_name_(arg_name), arg_(arg) {
+    if (Tracer::Get().IsEnabled())
+      start_ = Tracer::Get().Now();
+  }
+  ~ScopedEvent() {
+    Tracer& tracer = Tracer::Get();
+    if (tracer.IsEnabled())
+      RecordEvent(EventType::kComplete, name_, start_, tracer.Now() - start_, arg_, arg_name_);
+  }
+
+ private:
+  const char* name_;
+  const char* arg_name_;
+  double arg_;
+  uint64_t start_ = 0;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef NVAFX_ENABLE_TRACING
+// Traces the enclosing scope
+#define TRACE_SCOPE(name) trace::ScopedEvent TRACE_CONCAT(trace_scope_, __LINE__)(name)
+// Traces the enclosing scope with a numeric argument, e.g. the frame index
+#define TRACE_SCOPE_ARG(name, arg_name, arg) \
+  trace::ScopedEvent TRACE_CONCAT(trace_scope_, __LINE__)(name, arg_name, static_cast<double>(arg))
+// Records a counter value on its own track
+#define TRACE_COUNTER(name, value) \
+  trace::RecordEvent(trace::EventType::kCounter, name, trace::Tracer::Get().Now(), 0, \
+                     static_cast<double>(value), nullptr)
+// Records an instant event
+#define TRACE_INSTANT(name) \
+  trace::RecordEvent(trace::EventType::kInstant, name, trace::Tracer::Get().Now(), 0, 0.0, nullptr)
+#define TRACE_THREAD_NAME(name) trace::Tracer::Get().SetThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, arg_name, arg) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
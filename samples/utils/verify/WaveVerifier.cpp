@@ -0,0 +1,217 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#include "WaveVerifier.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include <utils/dsp/SimdKernels.hpp>
+#include <utils/wave_reader/waveReadWrite.hpp>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Frames with mean power below -60 dBFS are too quiet for a meaningful SNR
+const double kSilenceFramePower = 1e-6;
+// Power floor for log-spectral distance, keeps empty bins from dominating
+const float kSpectralFloor = 1e-9f;
+
+double ToDb(double signal, double error) {
+  if (error <= 0.0)
+    return std::numeric_limits<double>::infinity();
+  if (signal <= 0.0)
+    return -std::numeric_limits<double>::infinity();
+  return 10.0 * std::log10(signal / error);
+}
+
+// std::max, except that a NaN in either argument is kept
+float MaxOrNaN(float a, float b) {
+  return std::isnan(a) || a > b ? a : b;
+}
+
+std::string JsonEscape(const std::string& value) {
+  std::ostringstream oss;
+  for (char c : value) {
+    switch (c) {
+    case '"': oss << "\\\""; break;
+    case '\\': oss << "\\\\"; break;
+    case '\n': oss << "\\n"; break;
+    case '\r': oss << "\\r"; break;
+    case '\t': oss << "\\t"; break;
+    default: oss << c; break;
+    }
+  }
+  return oss.str();
+}
+
+// JSON has no representation for inf, emit null instead
+std::string JsonNumber(double value) {
+  if (!std::isfinite(value))
+    return "null";
+  std::ostringstream oss;
+  oss << std::setprecision(9) << value;
+  return oss.str();
+}
+
+}  // namespace
+
+WaveVerifier::WaveVerifier(uint32_t frame_size, const VerifyTolerance& tolerance, uint32_t window_frames)
+  : frame_size_(frame_size)
+  , window_frames_(window_frames)
+  , tolerance_(tolerance)
+  , fft_(dsp::RealFFT::NextPowerOfTwo(frame_size)) {
+  window_.resize(frame_size_);
+  for (uint32_t i = 0; i < frame_size_; i++)
+    window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * i / frame_size_));
+  fft_input_.assign(fft_.GetSize(), 0.f);
+  channel_.resize(frame_size_);
+  output_power_.resize(fft_.GetNumBins());
+  reference_power_.resize(fft_.GetNumBins());
+}
+
+bool WaveVerifier::compareFrame(const float* output, const float* reference, uint32_t len, VerifyReport* report) {
+  float max_abs = dsp::MaxAbsDiff(output, reference, len);
+  report->max_abs_error = MaxOrNaN(report->max_abs_error, max_abs);
+
+  double signal = 0.0, error = 0.0;
+  dsp::SignalErrorEnergy(reference, output, len, &signal, &error);
+  signal_energy_ += signal;
+  error_energy_ += error;
+
+  // Spectra are compared per channel, short trailing frames are zero padded
+  float lsd = 0.f;
+  const uint32_t samples = len / num_channels_;
+  for (uint32_t ch = 0; ch < num_channels_; ch++) {
+    for (uint32_t i = 0; i < samples; i++)
+      channel_[i] = output[i * num_channels_ + ch];
+    dsp::ApplyWindow(channel_.data(), window_.data(), fft_input_.data(), samples);
+    std::fill(fft_input_.begin() + samples, fft_input_.end(), 0.f);
+    fft_.PowerSpectrum(fft_input_.data(), output_power_.data());
+    for (uint32_t i = 0; i < samples; i++)
+      channel_[i] = reference[i * num_channels_ + ch];
+    dsp::ApplyWindow(channel_.data(), window_.data(), fft_input_.data(), samples);
+    fft_.PowerSpectrum(fft_input_.data(), reference_power_.data());
+    lsd = MaxOrNaN(lsd, dsp::LogSpectralDistance(output_power_.data(), reference_power_.data(),
+                                                 output_power_.size(), kSpectralFloor));
+  }
+  report->max_lsd_db = MaxOrNaN(report->max_lsd_db, lsd);
+  lsd_sum_ += lsd;
+
+  // Written so that NaN fails every test
+  std::ostringstream reason;
+  if (std::isnan(max_abs)) {
+    reason << "non-finite sample";
+  } else if (!(max_abs <= tolerance_.max_abs_error)) {
+    reason << "max abs error " << max_abs << " > " << tolerance_.max_abs_error;
+  } else if (signal / len > kSilenceFramePower && !(ToDb(signal, error) >= tolerance_.min_snr_db)) {
+    reason << "SNR " << ToDb(signal, error) << " dB < " << tolerance_.min_snr_db << " dB";
+  } else if (!(lsd <= tolerance_.max_lsd_db)) {
+    reason << "log-spectral distance " << lsd << " dB > " << tolerance_.max_lsd_db << " dB";
+  } else {
+    return true;
+  }
+
+  report->failure_reason = reason.str();
+  return false;
+}
+
+bool WaveVerifier::Compare(const std::string& output_wav, const std::string& reference_wav, VerifyReport* report) {
+  *report = VerifyReport();
+  report->output_wav = output_wav;
+  report->reference_wav = reference_wav;
+  report->frame_size = frame_size_;
+  report->tolerance = tolerance_;
+  signal_energy_ = error_energy_ = lsd_sum_ = 0.0;
+
+  CWaveFileStreamRead output(output_wav);
+  CWaveFileStreamRead reference(reference_wav);
+  if (!output.isValid() || !reference.isValid()) {
+    report->failure_reason = !output.isValid() ? "unable to read output wav" : "unable to read reference wav";
+    return false;
+  }
+  report->sample_rate = reference.GetSampleRate();
+  if (output.GetSampleRate() != reference.GetSampleRate() ||
+      output.GetNumChannels() != reference.GetNumChannels()) {
+    report->failure_reason = "sample rate or channel count mismatch";
+    return false;
+  }
+
+  // Interleaved channels are compared together as one frame
+  num_channels_ = reference.GetNumChannels();
+  const uint32_t frame_len = frame_size_ * num_channels_;
+  const uint32_t window_len = frame_len * window_frames_;
+  std::vector<float> output_window(window_len);
+  std::vector<float> reference_window(window_len);
+
+  bool passed = true;
+  while (passed) {
+    uint32_t output_read = output.ReadFloat(output_window.data(), window_len);
+    uint32_t reference_read = reference.ReadFloat(reference_window.data(), window_len);
+    uint32_t available = std::min(output_read, reference_read);
+    if (available == 0)
+      break;
+
+    for (uint32_t offset = 0; offset < available; offset += frame_len) {
+      uint32_t len = std::min(frame_len, available - offset);
+      if (!compareFrame(&output_window[offset], &reference_window[offset], len, report)) {
+        report->first_failed_frame = static_cast<int64_t>(report->frames_compared);
+        passed = false;
+        break;
+      }
+      report->frames_compared++;
+    }
+  }
+
+  if (passed && output.GetNumSamples() != reference.GetNumSamples()) {
+    std::ostringstream reason;
+    reason << "length mismatch: " << output.GetNumSamples() << " vs " << reference.GetNumSamples() << " samples";
+    report->failure_reason = reason.str();
+    report->first_failed_frame = static_cast<int64_t>(report->frames_compared);
+    passed = false;
+  }
+
+  report->snr_db = ToDb(signal_energy_, error_energy_);
+  uint64_t lsd_frames = report->frames_compared + (report->first_failed_frame >= 0 ? 1 : 0);
+  report->mean_lsd_db = lsd_frames ? lsd_sum_ / lsd_frames : 0.0;
+  report->passed = passed;
+  return passed;
+}
+
+bool WaveVerifier::WriteReport(const VerifyReport& report, const std::string& report_file) {
+  std::ofstream out(report_file, std::ios_base::out | std::ios_base::trunc);
+  if (!out.is_open())
+    return false;
+
+  out << "{\n"
+      << "  \"output_wav\": \"" << JsonEscape(report.output_wav) << "\",\n"
+      << "  \"reference_wav\": \"" << JsonEscape(report.reference_wav) << "\",\n"
+      << "  \"passed\": " << (report.passed ? "true" : "false") << ",\n"
+      << "  \"failure_reason\": \"" << JsonEscape(report.failure_reason) << "\",\n"
+      << "  \"sample_rate\": " << report.sample_rate << ",\n"
+      << "  \"frame_size\": " << report.frame_size << ",\n"
+      << "  \"frames_compared\": " << report.frames_compared << ",\n"
+      << "  \"first_failed_frame\": " << report.first_failed_frame << ",\n"
+      << "  \"max_abs_error\": " << JsonNumber(report.max_abs_error) << ",\n"
+      << "  \"snr_db\": " << JsonNumber(report.snr_db) << ",\n"
+      << "  \"mean_lsd_db\": " << JsonNumber(report.mean_lsd_db) << ",\n"
+      << "  \"max_lsd_db\": " << JsonNumber(report.max_lsd_db) << ",\n"
+      << "  \"tolerance\": {\n"
+      << "    \"max_abs_error\": " << JsonNumber(report.tolerance.max_abs_error) << ",\n"
+      << "    \"min_snr_db\": " << JsonNumber(report.tolerance.min_snr_db) << ",\n"
+      << "    \"max_lsd_db\": " << JsonNumber(report.tolerance.max_lsd_db) << "\n"
+      << "  }\n"
+      << "}\n";
+
+  return out.good();
+}
@@ -0,0 +1,83 @@
+/*
+* Copyright (c) 2022, NVIDIA Corporation.  All rights reserved.
+*
+* NVIDIA Corporation and its licensors retain all intellectual property
+* and proprietary rights in and to this software, related documentation
+* and any modifications thereto.  Any use, reproduction, disclosure or
+* distribution of this software and related documentation without an express
+* license agreement from NVIDIA Corporation is strictly prohibited.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <utils/dsp/RealFFT.hpp>
+
+// Per-frame limits a produced file has to stay within to match its reference
+struct VerifyTolerance {
+  // Largest allowed absolute sample difference
+  float max_abs_error = 1e-3f;
+  // Smallest allowed SNR in dB, frames quieter than -60 dBFS are not checked
+  float min_snr_db = 30.0f;
+  // Largest allowed log-spectral distance in dB
+  float max_lsd_db = 2.0f;
+};
+
+// Result of comparing an output wav file against a golden reference
+struct VerifyReport {
+  std::string output_wav;
+  std::string reference_wav;
+  uint32_t sample_rate = 0;
+  uint32_t frame_size = 0;
+  bool passed = false;
+  // Number of frames compared before finishing or stopping
+  uint64_t frames_compared = 0;
+  // First frame that exceeded tolerance, -1 if none
+  int64_t first_failed_frame = -1;
+  std::string failure_reason;
+  float max_abs_error = 0.f;
+  double snr_db = 0.0;
+  double mean_lsd_db = 0.0;
+  float max_lsd_db = 0.f;
+  VerifyTolerance tolerance;
+};
+
+// Compares two wav files frame by frame. Both files are streamed through a bounded window of
+// window_frames frames so memory use does not depend on file length. Comparison stops at the
+// first frame which exceeds the tolerance.
+class WaveVerifier {
+ public:
+  WaveVerifier(uint32_t frame_size, const VerifyTolerance& tolerance, uint32_t window_frames = 64);
+  // Compares output against reference, fills report. Returns true if files match within tolerance.
+  bool Compare(const std::string& output_wav, const std::string& reference_wav, VerifyReport* report);
+  // Writes report as JSON. Returns false if the file could not be written.
+  static bool WriteReport(const VerifyReport& report, const std::string& report_file);
+
+ private:
+  // Checks a single frame, updates report. Returns false if frame is over tolerance.
+  bool compareFrame(const float* output, const float* reference, uint32_t len, VerifyReport* report);
+
+ private:
+  uint32_t frame_size_;
+  uint32_t window_frames_;
+  uint32_t num_channels_ = 1;
+  VerifyTolerance tolerance_;
+  dsp::RealFFT fft_;
+  // Hann window of frame_size_ samples
+  std::vector<float> window_;
+  // Single channel of the current frame
+  std::vector<float> channel_;
+  // Windowed, zero padded frame
+  std::vector<float> fft_input_;
+  std::vector<float> output_power_;
+  std::vector<float> reference_power_;
+  // Accumulators
+  double signal_energy_ = 0.0;
+  double error_energy_ = 0.0;
+  double lsd_sum_ = 0.0;
+};
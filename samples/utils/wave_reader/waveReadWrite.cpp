@@ -25,68 +25,244 @@
 
 #include "waveReadWrite.hpp"
 
-const float * CWaveFileRead::GetFloatPCMData() {
-  int8_t* audioDataPtr = reinterpret_cast<int8_t*>(m_WaveData.get());
+const char* GetWaveStatusString(WaveStatus status) {
+  switch (status) {
+  case WAVE_STATUS_OK:
+    return "WAVE_STATUS_OK";
+  case WAVE_STATUS_READ_FAILED:
+    return "WAVE_STATUS_READ_FAILED";
+  case WAVE_STATUS_NOT_WAVE:
+    return "WAVE_STATUS_NOT_WAVE";
+  case WAVE_STATUS_CHUNK_OUT_OF_BOUNDS:
+    return "WAVE_STATUS_CHUNK_OUT_OF_BOUNDS";
+  case WAVE_STATUS_MISSING_FORMAT:
+    return "WAVE_STATUS_MISSING_FORMAT";
+  case WAVE_STATUS_UNSUPPORTED_FORMAT:
+    return "WAVE_STATUS_UNSUPPORTED_FORMAT";
+  case WAVE_STATUS_INVALID_CHANNELS:
+    return "WAVE_STATUS_INVALID_CHANNELS";
+  case WAVE_STATUS_INVALID_SAMPLE_RATE:
+    return "WAVE_STATUS_INVALID_SAMPLE_RATE";
+  case WAVE_STATUS_UNSUPPORTED_BITS:
+    return "WAVE_STATUS_UNSUPPORTED_BITS";
+  case WAVE_STATUS_INVALID_BLOCK_ALIGN:
+    return "WAVE_STATUS_INVALID_BLOCK_ALIGN";
+  case WAVE_STATUS_MISSING_DATA:
+    return "WAVE_STATUS_MISSING_DATA";
+  default:
+    return "UNKNOWN_WAVE_STATUS";
+  }
+}
 
-  if (m_floatWaveData.get())
-    return m_floatWaveData.get();
+WaveStatus ValidateWaveFormat(const waveFormat_ext& wfx) {
+  if (wfx.wFormatTag != WAVE_FORMAT_PCM && wfx.wFormatTag != WAVE_FORMAT_IEEE_FLOAT)
+    return WAVE_STATUS_UNSUPPORTED_FORMAT;
+  if (wfx.nChannels == 0 || wfx.nChannels > MAX_CHANNELS)
+    return WAVE_STATUS_INVALID_CHANNELS;
+  if (wfx.nSamplesPerSec == 0)
+    return WAVE_STATUS_INVALID_SAMPLE_RATE;
+  bool supportedBits = wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT
+                         ? wfx.wBitsPerSample == 32
+                         : (wfx.wBitsPerSample == 8 || wfx.wBitsPerSample == 16 || wfx.wBitsPerSample == 24 ||
+                            wfx.wBitsPerSample == 32);
+  if (!supportedBits)
+    return WAVE_STATUS_UNSUPPORTED_BITS;
+  // Readers stride by nBlockAlign / nChannels and convert wBitsPerSample, both have to agree
+  if (static_cast<uint32_t>(wfx.nBlockAlign) != static_cast<uint32_t>(wfx.nChannels) * (wfx.wBitsPerSample / 8))
+    return WAVE_STATUS_INVALID_BLOCK_ALIGN;
+  return WAVE_STATUS_OK;
+}
 
-  m_floatWaveData.reset(new float[m_nNumSamples]);
-  float* outputWaveData = m_floatWaveData.get();
-  if (m_WaveFormatEx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT) {
-    memcpy(outputWaveData, audioDataPtr, m_nNumSamples * sizeof(float));
-    return outputWaveData;
+void ConvertPCMToFloat(const uint8_t* src, float* dst, uint32_t numSamples, const waveFormat_ext& wfx) {
+  if (wfx.wFormatTag == WAVE_FORMAT_IEEE_FLOAT) {
+    memcpy(dst, src, static_cast<size_t>(numSamples) * sizeof(float));
+    return;
   }
 
-  for (uint32_t i = 0; i < m_nNumSamples; i++)   {
-    switch (m_WaveFormatEx.wBitsPerSample)     {
-    case 8: {
-      uint8_t audioSample = *(reinterpret_cast<uint8_t*>(audioDataPtr));
-      outputWaveData[i] = (audioSample - 128) / 128.0f;
-    }
+  // Samples are not aligned in general, they are loaded with memcpy or assembled from bytes
+  switch (wfx.wBitsPerSample) {
+  case 8:
+    for (uint32_t i = 0; i < numSamples; i++)
+      dst[i] = (src[i] - 128) / 128.0f;
     break;
-    case 16: {
-      int16_t audioSample = *(reinterpret_cast<int16_t*>(audioDataPtr));
-      outputWaveData[i] = audioSample / 32768.0f;
+  case 16:
+    for (uint32_t i = 0; i < numSamples; i++) {
+      int16_t audioSample;
+      memcpy(&audioSample, src + static_cast<size_t>(i) * 2, sizeof(audioSample));
+      dst[i] = audioSample / 32768.0f;
     }
     break;
-    case 24: {
-      int32_t audioSample = *(reinterpret_cast<int32_t*>(audioDataPtr));
-      uint8_t data0 = audioSample & 0x000000ff;
-      uint8_t data1 = static_cast<uint8_t>((audioSample & 0x0000ff00) >> 8);
-      uint8_t data2 = static_cast<uint8_t>((audioSample & 0x00ff0000) >> 16);
-      int32_t Value = ((data2 << 24) | (data1 << 16) | (data0 << 8)) >> 8;
-      outputWaveData[i] = Value / 8388608.0f;
+  case 24:
+    for (uint32_t i = 0; i < numSamples; i++) {
+      const uint8_t* sample = src + static_cast<size_t>(i) * 3;
+      // Only the 3 bytes of the sample are read, the sign comes from the arithmetic shift
+      uint32_t bits = (static_cast<uint32_t>(sample[0]) << 8) | (static_cast<uint32_t>(sample[1]) << 16) |
+                      (static_cast<uint32_t>(sample[2]) << 24);
+      dst[i] = (static_cast<int32_t>(bits) >> 8) / 8388608.0f;
     }
     break;
-    case 32: {
-      int32_t audioSample = *(reinterpret_cast<int32_t*>(audioDataPtr));
-      outputWaveData[i] = audioSample / 2147483648.0f;
+  case 32:
+    for (uint32_t i = 0; i < numSamples; i++) {
+      int32_t audioSample;
+      memcpy(&audioSample, src + static_cast<size_t>(i) * 4, sizeof(audioSample));
+      dst[i] = audioSample / 2147483648.0f;
     }
     break;
+  }
+}
+
+WaveStatus ParseWaveImage(const uint8_t* data, size_t sizeBytes, WaveFileInfo* info) {
+  // One pass over the chunk headers locates 'fmt ' and 'data'
+  CRiffChunkIndex chunkIndex;
+  if (!chunkIndex.Build(data, sizeBytes))
+    return chunkIndex.GetStatus();
+
+  const RiffChunkEntry* fmtChunk = chunkIndex.Find(MAKEFOURCC('f', 'm', 't', ' '));
+  if (!fmtChunk || fmtChunk->size < sizeof(waveFormat_basic))
+    return WAVE_STATUS_MISSING_FORMAT;
+  // cbSize is optional, never read past the fmt chunk
+  memset(&info->wfx, 0, sizeof(info->wfx));
+  memcpy(&info->wfx, data + fmtChunk->offset, std::min<size_t>(fmtChunk->size, sizeof(waveFormat_ext)));
+  if (info->wfx.wFormatTag == WAVE_FORMAT_PCM)
+    info->wfx.cbSize = 0;
+  WaveStatus status = ValidateWaveFormat(info->wfx);
+  if (status != WAVE_STATUS_OK)
+    return status;
+
+  const RiffChunkEntry* dataChunk = chunkIndex.Find(MAKEFOURCC('d', 'a', 't', 'a'));
+  if (!dataChunk)
+    return WAVE_STATUS_MISSING_DATA;
+  // A trailing partial sample is ignored
+  info->numSamples = dataChunk->size / (info->wfx.nBlockAlign / info->wfx.nChannels);
+  if (info->numSamples == 0)
+    return WAVE_STATUS_MISSING_DATA;
+  info->audioData = data + dataChunk->offset;
+  info->audioDataSize = dataChunk->size;
+  return WAVE_STATUS_OK;
+}
+
+uint64_t CRiffChunkIndex::addChunk(uint32_t chunkId, uint32_t size, uint64_t offset, uint64_t limit) {
+  uint64_t payload = offset + sizeof(RiffChunk);
+  // Offsets are stored in 32 bits like the RIFF sizes themselves
+  if (payload > UINT32_MAX)
+    return 0;
+  if (payload + size > limit) {
+    // Recorders that were interrupted leave a data size past the end of the file, keep what is there
+    if (chunkId != MAKEFOURCC('d', 'a', 't', 'a'))
+      return 0;
+    size = static_cast<uint32_t>(limit - payload);
+  }
+
+  bool required = chunkId == MAKEFOURCC('f', 'm', 't', ' ') || chunkId == MAKEFOURCC('d', 'a', 't', 'a');
+  if (m_numChunks < RIFF_INDEX_CAPACITY - 2 || (required && m_numChunks < RIFF_INDEX_CAPACITY)) {
+    RiffChunkEntry& entry = m_chunks[m_numChunks++];
+    entry.chunkId = chunkId;
+    entry.offset = static_cast<uint32_t>(payload);
+    entry.size = size;
+  } else {
+    m_truncated = true;
+  }
+
+  // Odd sized chunks are followed by a pad byte
+  return payload + size + (size & 1);
+}
+
+bool CRiffChunkIndex::Build(const uint8_t* data, size_t sizeBytes) {
+  m_numChunks = 0;
+  m_truncated = false;
+  m_status = WAVE_STATUS_NOT_WAVE;
+  if (!data || sizeBytes < sizeof(RiffHeader))
+    return false;
+
+  RiffHeader riffHeader;
+  memcpy(&riffHeader, data, sizeof(riffHeader));
+  if (riffHeader.chunkId != MAKEFOURCC('R', 'I', 'F', 'F') || riffHeader.fileTag != MAKEFOURCC('W', 'A', 'V', 'E'))
+    return false;
+  m_status = WAVE_STATUS_CHUNK_OUT_OF_BOUNDS;
+
+  uint64_t limit = std::min<uint64_t>(sizeBytes, static_cast<uint64_t>(riffHeader.chunkSize) + sizeof(RiffChunk));
+  uint64_t offset = sizeof(RiffHeader);
+  while (offset + sizeof(RiffChunk) <= limit) {
+    RiffChunk chunk;
+    memcpy(&chunk, data + offset, sizeof(chunk));
+    offset = addChunk(chunk.chunkId, chunk.chunkSize, offset, limit);
+    if (offset == 0)
+      return false;
+  }
+  m_status = WAVE_STATUS_OK;
+  return true;
+}
+
+bool CRiffChunkIndex::Build(FILE* fp) {
+  m_numChunks = 0;
+  m_truncated = false;
+  m_status = WAVE_STATUS_READ_FAILED;
+  if (!fp || fseek(fp, 0, SEEK_END) != 0)
+    return false;
+  long fileSize = ftell(fp);
+  if (fileSize < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    return false;
+  RiffHeader riffHeader;
+  m_status = WAVE_STATUS_NOT_WAVE;
+  if (fileSize < static_cast<long>(sizeof(RiffHeader)) || fread(&riffHeader, sizeof(riffHeader), 1, fp) != 1)
+    return false;
+  if (riffHeader.chunkId != MAKEFOURCC('R', 'I', 'F', 'F') || riffHeader.fileTag != MAKEFOURCC('W', 'A', 'V', 'E'))
+    return false;
+
+  uint64_t limit = std::min<uint64_t>(fileSize, static_cast<uint64_t>(riffHeader.chunkSize) + sizeof(RiffChunk));
+  uint64_t offset = sizeof(RiffHeader);
+  while (offset + sizeof(RiffChunk) <= limit) {
+    RiffChunk chunk;
+    if (fseek(fp, static_cast<long>(offset), SEEK_SET) != 0 || fread(&chunk, sizeof(chunk), 1, fp) != 1) {
+      m_status = WAVE_STATUS_READ_FAILED;
+      return false;
+    }
+    offset = addChunk(chunk.chunkId, chunk.chunkSize, offset, limit);
+    if (offset == 0) {
+      m_status = WAVE_STATUS_CHUNK_OUT_OF_BOUNDS;
+      return false;
     }
-    audioDataPtr += m_WaveFormatEx.nBlockAlign;
   }
+  m_status = WAVE_STATUS_OK;
+  return true;
+}
 
-  return outputWaveData;
+const RiffChunkEntry* CRiffChunkIndex::Find(uint32_t fourcc) const {
+  for (uint32_t i = 0; i < m_numChunks; i++) {
+    if (m_chunks[i].chunkId == fourcc)
+      return &m_chunks[i];
+  }
+  return nullptr;
+}
+
+const float * CWaveFileRead::GetFloatPCMData() {
+  if (m_floatWaveData.get())
+    return m_floatWaveData.get();
+  if (!m_WaveData)
+    return nullptr;
+
+  m_floatWaveData.reset(new float[m_nNumSamples]);
+  ConvertPCMToFloat(m_WaveData.get(), m_floatWaveData.get(), m_nNumSamples, m_WaveFormatEx);
+
+  return m_floatWaveData.get();
 }
 
 const float * CWaveFileRead::GetFloatPCMDataAligned(int alignSamples) {
-  if (!GetFloatPCMData())
+  if (alignSamples <= 0 || !GetFloatPCMData())
     return nullptr;
 
-  int totalAlignedSamples;
-  if (!(m_nNumSamples % alignSamples))
-    totalAlignedSamples = m_nNumSamples;
-  else
-    totalAlignedSamples = m_nNumSamples + (alignSamples - (m_nNumSamples % alignSamples));
+  uint64_t totalAlignedSamples = m_nNumSamples;
+  if (m_nNumSamples % alignSamples)
+    totalAlignedSamples += alignSamples - (m_nNumSamples % alignSamples);
+  if (totalAlignedSamples > UINT32_MAX)
+    return nullptr;
 
   m_floatWaveDataAligned.reset(new float[totalAlignedSamples]());
 
   for (uint32_t i = 0; i < m_nNumSamples; i++)
     m_floatWaveDataAligned[i] = m_floatWaveData[i];
 
-  m_NumAlignedSamples = totalAlignedSamples;
+  m_NumAlignedSamples = static_cast<uint32_t>(totalAlignedSamples);
   return m_floatWaveDataAligned.get();
 }
 
@@ -97,24 +273,6 @@ int CWaveFileRead::GetBitsPerSample() {
   return m_WaveFormatEx.wBitsPerSample;
 }
 
-const RiffChunk* CWaveFileRead::FindChunk(const uint8_t* data, size_t sizeBytes, uint32_t fourcc) {
-  if (!data)
-    return nullptr;
-
-  const uint8_t* ptr = data;
-  const uint8_t* end = data + sizeBytes;
-
-  while (end > (ptr + sizeof(RiffChunk))) {
-    const RiffChunk* header = reinterpret_cast<const RiffChunk*>(ptr);
-    if (header->chunkId == fourcc)
-      return header;
-
-    ptr += (header->chunkSize + sizeof(RiffChunk));
-  }
-
-  return nullptr;
-}
-
 CWaveFileRead::CWaveFileRead(std::string wavFile)
   : m_wavFile(wavFile)
   , m_nNumSamples(0)
@@ -129,11 +287,23 @@ CWaveFileRead::CWaveFileRead(std::string wavFile)
   if (PathFileExistsA(m_wavFile.c_str()))
 #endif
   {
-    if (readPCM(m_wavFile.c_str()) == 0)
-      m_validFile = true;
+    m_status = readPCM(m_wavFile.c_str());
+    m_validFile = m_status == WAVE_STATUS_OK;
   }
 }
 
+CWaveFileRead::CWaveFileRead(std::string wavFile, const uint8_t* image, size_t sizeBytes)
+  : m_wavFile(wavFile)
+  , m_nNumSamples(0)
+  , m_validFile(false)
+  , m_floatWaveData(nullptr)
+  , m_WaveDataSize(0)
+  , m_NumAlignedSamples(0) {
+  memset(&m_WaveFormatEx, 0, sizeof(m_WaveFormatEx));
+  m_status = readImage(image, sizeBytes);
+  m_validFile = m_status == WAVE_STATUS_OK;
+}
+
 inline bool loadFile(std::string const& infilename, std::string* outData) {
   std::string result;
   std::string filename = infilename;
@@ -163,83 +333,114 @@ inline std::string loadFile(const std::string& infilename) {
   return result;
 }
 
-int CWaveFileRead::readPCM(const char* szFileName) {
+WaveStatus CWaveFileRead::readPCM(const char* szFileName) {
   std::string fileData;
   if (loadFile(std::string(szFileName), &fileData) != true) {
-    return -1;
+    return WAVE_STATUS_READ_FAILED;
   }
 
-  const uint8_t* waveData = reinterpret_cast<const uint8_t*>(fileData.data());
-  size_t waveDataSize = fileData.length();
-  const uint8_t* waveEnd = waveData + waveDataSize;
-
+  return readImage(reinterpret_cast<const uint8_t*>(fileData.data()), fileData.length());
+}
 
-  // Locate RIFF 'WAVE'
-  const RiffChunk* riffChunk = FindChunk(waveData, waveDataSize, MAKEFOURCC('R', 'I', 'F', 'F'));
-  if (!riffChunk || riffChunk->chunkSize < 4) {
-    return -1;
+WaveStatus CWaveFileRead::readImage(const uint8_t* data, size_t sizeBytes) {
+  WaveFileInfo info;
+  WaveStatus status = ParseWaveImage(data, sizeBytes, &info);
+  if (status != WAVE_STATUS_OK) {
+    if (status == WAVE_STATUS_UNSUPPORTED_FORMAT && info.wfx.wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+      printf("WAVE_FORMAT_EXTENSIBLE is not supported. Please convert\n");
+    }
+    return status;
   }
 
-  const RiffHeader* riffHeader = reinterpret_cast<const RiffHeader*>(riffChunk);
-  if (riffHeader->fileTag != MAKEFOURCC('W', 'A', 'V', 'E')) {
-    return -1;
-  }
+  m_WaveData = std::make_unique<uint8_t[]>(info.audioDataSize);
+  m_WaveDataSize = info.audioDataSize;
+  memcpy(m_WaveData.get(), info.audioData, info.audioDataSize);
+  m_WaveFormatEx = info.wfx;
+  m_nNumSamples = info.numSamples;
 
-  // Locate 'fmt '
-  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(riffHeader) + sizeof(RiffHeader);
-  if ((ptr + sizeof(RiffChunk)) > waveEnd) {
-    return -1;
-  }
+  return WAVE_STATUS_OK;
+}
 
-  const RiffChunk* fmtChunk = FindChunk(ptr, riffHeader->chunkSize, MAKEFOURCC('f', 'm', 't', ' '));
-  if (!fmtChunk || fmtChunk->chunkSize < sizeof(waveFormat_basic)) {
-    return -1;
-  }
+CWaveFileStreamRead::CWaveFileStreamRead(std::string wavFile)
+  : m_wavFile(wavFile) {
+  memset(&m_WaveFormatEx, 0, sizeof(m_WaveFormatEx));
+  m_fp = fopen(m_wavFile.c_str(), "rb");
+  if (m_fp)
+    m_status = readHeader();
+  m_validFile = m_status == WAVE_STATUS_OK;
+}
 
-  ptr = reinterpret_cast<const uint8_t*>(fmtChunk) + sizeof(RiffChunk);
-  if (ptr + fmtChunk->chunkSize > waveEnd) {
-    return -1;
+CWaveFileStreamRead::~CWaveFileStreamRead() {
+  if (m_fp) {
+    fclose(m_fp);
+    m_fp = nullptr;
   }
+}
 
-  const waveFormat_basic_nopcm* wf = reinterpret_cast<const waveFormat_basic_nopcm*>(ptr);
-
-  if (!(wf->formatTag == WAVE_FORMAT_PCM || wf->formatTag == WAVE_FORMAT_IEEE_FLOAT)) {
-    if (wf->formatTag == WAVE_FORMAT_EXTENSIBLE) {
-      printf("WAVE_FORMAT_EXTENSIBLE is not supported. Please convert\n");
-    }
+WaveStatus CWaveFileStreamRead::readHeader() {
+  if (!m_chunkIndex.Build(m_fp))
+    return m_chunkIndex.GetStatus();
+
+  const RiffChunkEntry* fmtChunk = m_chunkIndex.Find(MAKEFOURCC('f', 'm', 't', ' '));
+  if (!fmtChunk || fmtChunk->size < sizeof(waveFormat_basic))
+    return WAVE_STATUS_MISSING_FORMAT;
+  waveFormat_ext wf;
+  memset(&wf, 0, sizeof(wf));
+  size_t toRead = std::min<size_t>(fmtChunk->size, sizeof(wf));
+  if (fseek(m_fp, static_cast<long>(fmtChunk->offset), SEEK_SET) != 0 || fread(&wf, toRead, 1, m_fp) != 1)
+    return WAVE_STATUS_READ_FAILED;
+  if (wf.wFormatTag == WAVE_FORMAT_PCM)
+    wf.cbSize = 0;
+  WaveStatus status = ValidateWaveFormat(wf);
+  if (status != WAVE_STATUS_OK)
+    return status;
+  m_WaveFormatEx = wf;
+
+  const RiffChunkEntry* dataChunk = m_chunkIndex.Find(MAKEFOURCC('d', 'a', 't', 'a'));
+  if (!dataChunk)
+    return WAVE_STATUS_MISSING_DATA;
+  m_dataOffset = static_cast<long>(dataChunk->offset);
+  m_nNumSamples = dataChunk->size / (m_WaveFormatEx.nBlockAlign / m_WaveFormatEx.nChannels);
+  if (m_nNumSamples == 0)
+    return WAVE_STATUS_MISSING_DATA;
+  return fseek(m_fp, m_dataOffset, SEEK_SET) == 0 ? WAVE_STATUS_OK : WAVE_STATUS_READ_FAILED;
+}
 
-    return -1;
-  }
+bool CWaveFileStreamRead::ReadChunk(const RiffChunkEntry& chunk, std::vector<uint8_t>* data) {
+  if (!m_fp)
+    return false;
 
-  ptr = reinterpret_cast<const uint8_t*>(riffHeader) + sizeof(RiffHeader);
-  if ((ptr + sizeof(RiffChunk)) > waveEnd) {
-    return -1;
-  }
+  long position = ftell(m_fp);
+  data->resize(chunk.size);
+  bool success = fseek(m_fp, static_cast<long>(chunk.offset), SEEK_SET) == 0 &&
+                 (chunk.size == 0 || fread(data->data(), chunk.size, 1, m_fp) == 1);
+  return fseek(m_fp, position, SEEK_SET) == 0 && success;
+}
 
-  const RiffChunk* dataChunk = FindChunk(ptr, riffChunk->chunkSize, MAKEFOURCC('d', 'a', 't', 'a'));
-  if (!dataChunk || !dataChunk->chunkSize) {
-    return -1;
-  }
+uint32_t CWaveFileStreamRead::ReadFloat(float* out, uint32_t numSamples) {
+  if (!m_validFile)
+    return 0;
 
+  numSamples = std::min(numSamples, m_nNumSamples - m_position);
+  const uint32_t bytesPerSample = m_WaveFormatEx.nBlockAlign / m_WaveFormatEx.nChannels;
+  m_rawBuffer.resize(static_cast<size_t>(numSamples) * bytesPerSample);
+  size_t read = fread(m_rawBuffer.data(), bytesPerSample, numSamples, m_fp);
+  ConvertPCMToFloat(m_rawBuffer.data(), out, static_cast<uint32_t>(read), m_WaveFormatEx);
+  m_position += static_cast<uint32_t>(read);
 
-  ptr = reinterpret_cast<const uint8_t*>(dataChunk) + sizeof(RiffChunk);
-  if (ptr + dataChunk->chunkSize > waveEnd) {
-    return -1;
-  }
+  return static_cast<uint32_t>(read);
+}
 
-  m_WaveData = std::make_unique<uint8_t[]>(dataChunk->chunkSize);
-  m_WaveDataSize = dataChunk->chunkSize;
-  memcpy(m_WaveData.get(), ptr, dataChunk->chunkSize);
-  if (wf->formatTag == WAVE_FORMAT_PCM) {
-    memcpy(&m_WaveFormatEx, reinterpret_cast<const waveFormat_basic*>(wf), sizeof(waveFormat_basic));
-    m_WaveFormatEx.cbSize = 0;
-  } else {
-    memcpy(&m_WaveFormatEx, reinterpret_cast<const waveFormat_ext*>(wf), sizeof(waveFormat_ext));
-  }
+bool CWaveFileStreamRead::SeekSample(uint32_t sample) {
+  if (!m_validFile || sample > m_nNumSamples)
+    return false;
 
-  m_nNumSamples = m_WaveDataSize / (m_WaveFormatEx.nBlockAlign / m_WaveFormatEx.nChannels);
+  const uint32_t bytesPerSample = m_WaveFormatEx.nBlockAlign / m_WaveFormatEx.nChannels;
+  if (fseek(m_fp, m_dataOffset + static_cast<long>(sample) * bytesPerSample, SEEK_SET) != 0)
+    return false;
 
-  return 0;
+  m_position = sample;
+  return true;
 }
 
 CWaveFileWrite::CWaveFileWrite(std::string wavFile, uint32_t samplesPerSec, uint32_t numChannels,
@@ -270,14 +471,26 @@ bool CWaveFileWrite::writeChunk(const void* data, uint32_t len) {
   if (!m_validState)
     return false;
 
+  if (m_output) {
+    if (!m_outputStarted) {
+      std::vector<uint8_t> header = buildHeader();
+      if (!m_output->Append(header.data(), header.size()))
+        return false;
+      m_outputStarted = true;
+    }
+    if (!m_output->Append(data, len))
+      return false;
+    m_cumulativeCount += len;
+    return true;
+  }
+
   if (!m_fp) {
     m_fp = fopen(m_wavFile.c_str(), "wb");
     if (!m_fp)
       return false;
 
-    int64_t offset = sizeof(RiffHeader) + sizeof(RiffChunk) +
-      sizeof(waveFormat_basic) + sizeof(RiffChunk);
-    if (fseek(m_fp, static_cast<long>(offset), SEEK_SET) != 0) {
+    // Header is written up front (and refreshed by updateHeader) so partial files are readable
+    if (!writeHeader()) {
       fclose(m_fp);
       m_fp = nullptr;
       return false;
@@ -292,41 +505,99 @@ bool CWaveFileWrite::writeChunk(const void* data, uint32_t len) {
   return true;
 }
 
-bool CWaveFileWrite::commitFile() {
-  if (!m_validState)
+bool CWaveFileWrite::setOutputFile(std::unique_ptr<WaveOutputFile> file) {
+  if (!m_validState || m_fp || m_outputStarted || !file)
     return false;
 
-  if (!m_fp)
+  m_output = std::move(file);
+  return true;
+}
+
+bool CWaveFileWrite::addChunk(uint32_t chunkId, const void* data, uint32_t size) {
+  if (!m_validState || m_fp || m_outputStarted)
     return false;
 
-  // pull fp to start of file to write headers.
-  fseek(m_fp, 0, SEEK_SET);
+  RiffChunk chunk;
+  chunk.chunkId = chunkId;
+  chunk.chunkSize = size;
+  const uint8_t* header = reinterpret_cast<const uint8_t*>(&chunk);
+  m_extraChunks.insert(m_extraChunks.end(), header, header + sizeof(chunk));
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(data);
+  m_extraChunks.insert(m_extraChunks.end(), payload, payload + size);
+  if (size & 1)
+    m_extraChunks.push_back(0);
+  return true;
+}
 
-  // write the riff chunk header
+std::vector<uint8_t> CWaveFileWrite::buildHeader() const {
+  // riff chunk header
   uint32_t fmtChunkSize = sizeof(waveFormat_basic);
   RiffHeader riffHeader;
   riffHeader.chunkId = MAKEFOURCC('R', 'I', 'F', 'F');
-  riffHeader.chunkSize = 4 + sizeof(RiffChunk) + sizeof(RiffChunk) + fmtChunkSize + m_cumulativeCount;
+  riffHeader.chunkSize = 4 + sizeof(RiffChunk) + sizeof(RiffChunk) + fmtChunkSize +
+                         static_cast<uint32_t>(m_extraChunks.size()) + m_cumulativeCount + (m_cumulativeCount & 1);
   riffHeader.fileTag = MAKEFOURCC('W', 'A', 'V', 'E');
-  if (fwrite(&riffHeader, sizeof(riffHeader), 1, m_fp) != 1)
-    return false;
 
   // fmt riff chunk
   RiffChunk fmtChunk;
   fmtChunk.chunkId = MAKEFOURCC('f', 'm', 't', ' ');
   fmtChunk.chunkSize = sizeof(waveFormat_basic);
-  if (fwrite(&fmtChunk, sizeof(RiffChunk), 1, m_fp) != 1)
-    return false;
-
-  // fixme: try using WAVEFORMATEX for size
-  if (fwrite(&m_wfx, sizeof(waveFormat_basic), 1, m_fp) != 1)
-    return false;
 
   // data riff chunk
   RiffChunk dataChunk;
   dataChunk.chunkId = MAKEFOURCC('d', 'a', 't', 'a');
   dataChunk.chunkSize = m_cumulativeCount;
-  if (fwrite(&dataChunk, sizeof(RiffChunk), 1, m_fp) != 1)
+
+  // fixme: try using WAVEFORMATEX for size
+  std::vector<uint8_t> header(sizeof(riffHeader) + sizeof(fmtChunk) + sizeof(waveFormat_basic) +
+                              m_extraChunks.size() + sizeof(dataChunk));
+  uint8_t* dst = header.data();
+  memcpy(dst, &riffHeader, sizeof(riffHeader));
+  dst += sizeof(riffHeader);
+  memcpy(dst, &fmtChunk, sizeof(fmtChunk));
+  dst += sizeof(fmtChunk);
+  memcpy(dst, &m_wfx, sizeof(waveFormat_basic));
+  dst += sizeof(waveFormat_basic);
+  if (!m_extraChunks.empty())
+    memcpy(dst, m_extraChunks.data(), m_extraChunks.size());
+  dst += m_extraChunks.size();
+  memcpy(dst, &dataChunk, sizeof(dataChunk));
+  return header;
+}
+
+bool CWaveFileWrite::writeHeader() {
+  std::vector<uint8_t> header = buildHeader();
+  return fwrite(header.data(), header.size(), 1, m_fp) == 1;
+}
+
+bool CWaveFileWrite::commitFile() {
+  if (!m_validState)
+    return false;
+
+  if (m_output) {
+    if (!m_outputStarted)
+      return false;
+    const uint8_t pad = 0;
+    if ((m_cumulativeCount & 1) && !m_output->Append(&pad, 1))
+      return false;
+    std::vector<uint8_t> header = buildHeader();
+    if (!m_output->WriteAt(0, header.data(), header.size()) || !m_output->Close())
+      return false;
+    m_commitDone = true;
+    m_validState = false;
+    return true;
+  }
+
+  if (!m_fp)
+    return false;
+
+  // RIFF chunks are word aligned, pad odd sized audio
+  if ((m_cumulativeCount & 1) && fputc(0, m_fp) == EOF)
+    return false;
+
+  // pull fp to start of file to write headers.
+  fseek(m_fp, 0, SEEK_SET);
+  if (!writeHeader())
     return false;
 
   fclose(m_fp);
@@ -336,3 +607,87 @@ bool CWaveFileWrite::commitFile() {
   m_validState = false;
   return true;
 }
+
+bool CWaveFileWrite::updateHeader() {
+  if (m_validState && m_outputStarted) {
+    std::vector<uint8_t> header = buildHeader();
+    return m_output->WriteAt(0, header.data(), header.size());
+  }
+  if (!m_validState || !m_fp)
+    return false;
+
+  long position = ftell(m_fp);
+  if (fseek(m_fp, 0, SEEK_SET) != 0)
+    return false;
+  bool written = writeHeader();
+  return fseek(m_fp, position, SEEK_SET) == 0 && written;
+}
+
+bool CWaveFileWrite::flush() {
+  // Writes through m_output are queued, wait for them
+  if (m_outputStarted)
+    return m_output->Sync();
+  return m_fp && fflush(m_fp) == 0;
+}
+
+bool CWaveFileWrite::sync() {
+  if (m_outputStarted)
+    return m_output->Sync();
+  if (!m_fp)
+    return false;
+
+  if (fflush(m_fp) != 0)
+    return false;
+#ifdef _WIN32
+  return _commit(_fileno(m_fp)) == 0;
+#else
+  return fsync(fileno(m_fp)) == 0;
+#endif
+}
+
+bool CWaveFileWrite::resume(uint32_t dataBytes) {
+  if (!m_validState || m_fp || m_output)
+    return false;
+
+  m_fp = fopen(m_wavFile.c_str(), "r+b");
+  if (!m_fp)
+    return false;
+
+  // Only continue files this class wrote with the same format
+  // and the same chunks added through addChunk()
+  const long headerSize = sizeof(RiffHeader) + sizeof(RiffChunk) + sizeof(waveFormat_basic) +
+                          static_cast<long>(m_extraChunks.size()) + sizeof(RiffChunk);
+  RiffHeader riffHeader;
+  RiffChunk fmtChunk;
+  waveFormat_basic wfx;
+  std::vector<uint8_t> extraChunks(m_extraChunks.size());
+  bool valid = fread(&riffHeader, sizeof(riffHeader), 1, m_fp) == 1 &&
+               fread(&fmtChunk, sizeof(fmtChunk), 1, m_fp) == 1 &&
+               fread(&wfx, sizeof(wfx), 1, m_fp) == 1 &&
+               (extraChunks.empty() || fread(extraChunks.data(), extraChunks.size(), 1, m_fp) == 1) &&
+               riffHeader.chunkId == MAKEFOURCC('R', 'I', 'F', 'F') &&
+               fmtChunk.chunkId == MAKEFOURCC('f', 'm', 't', ' ') &&
+               memcmp(&wfx, &m_wfx, sizeof(wfx)) == 0 && extraChunks == m_extraChunks &&
+               fseek(m_fp, 0, SEEK_END) == 0 && ftell(m_fp) >= headerSize + static_cast<long>(dataBytes);
+  if (!valid) {
+    fclose(m_fp);
+    m_fp = nullptr;
+    return false;
+  }
+
+  // Drop audio written after the checkpoint
+  fflush(m_fp);
+#ifdef _WIN32
+  bool truncated = _chsize_s(_fileno(m_fp), headerSize + static_cast<long long>(dataBytes)) == 0;
+#else
+  bool truncated = ftruncate(fileno(m_fp), headerSize + static_cast<off_t>(dataBytes)) == 0;
+#endif
+  m_cumulativeCount = dataBytes;
+  if (!truncated || fseek(m_fp, headerSize + static_cast<long>(dataBytes), SEEK_SET) != 0 || !updateHeader()) {
+    fclose(m_fp);
+    m_fp = nullptr;
+    return false;
+  }
+
+  return true;
+}
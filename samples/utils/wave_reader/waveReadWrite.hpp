@@ -15,9 +15,11 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -128,11 +130,97 @@ struct WaveFileInfo {
   // wave format extension pointer
   waveFormat_ext wfx;
   // audio data pointer
-  uint8_t* audioData;
+  const uint8_t* audioData;
   // audio data size
   uint32_t audioDataSize;
+  // Number of complete samples (all channels) in the audio data
+  uint32_t numSamples;
 };
 
+// Result of parsing a wav file. Files are untrusted input, every field that sizes or strides a read
+// is checked before it is used.
+enum WaveStatus {
+  WAVE_STATUS_OK = 0,
+  // File could not be opened or read
+  WAVE_STATUS_READ_FAILED,
+  // No RIFF/WAVE header
+  WAVE_STATUS_NOT_WAVE,
+  // A chunk other than 'data' extends past the end of the file
+  WAVE_STATUS_CHUNK_OUT_OF_BOUNDS,
+  // No 'fmt ' chunk, or one too small for the format
+  WAVE_STATUS_MISSING_FORMAT,
+  // Format tag other than PCM or IEEE float
+  WAVE_STATUS_UNSUPPORTED_FORMAT,
+  // No channels or more than MAX_CHANNELS
+  WAVE_STATUS_INVALID_CHANNELS,
+  // Sample rate of 0
+  WAVE_STATUS_INVALID_SAMPLE_RATE,
+  // Sample size other than 8, 16, 24 or 32 bit PCM or 32 bit float
+  WAVE_STATUS_UNSUPPORTED_BITS,
+  // Block size does not match the number of channels and the sample size
+  WAVE_STATUS_INVALID_BLOCK_ALIGN,
+  // No 'data' chunk, or not a single complete sample in it
+  WAVE_STATUS_MISSING_DATA,
+};
+
+// Returns the name of a status, e.g. for error messages
+const char* GetWaveStatusString(WaveStatus status);
+
+// Location of one top level chunk of a RIFF/WAVE file
+struct RiffChunkEntry {
+  // Chunk ID
+  uint32_t chunkId;
+  // Offset of the chunk payload from the start of the file
+  uint32_t offset;
+  // Payload size, without the pad byte that follows odd sized chunks
+  uint32_t size;
+};
+
+// Capacity of CRiffChunkIndex, the last two entries are kept for 'fmt ' and 'data'
+#define RIFF_INDEX_CAPACITY 32
+
+// Index of the top level chunks of a RIFF/WAVE file, built in one pass over the chunk headers.
+// Uses a fixed size table and does not allocate.
+class CRiffChunkIndex {
+ public:
+  // Indexes a file image in memory
+  bool Build(const uint8_t* data, size_t sizeBytes);
+  // Indexes an open file, reading only the chunk headers. The file position is undefined afterwards.
+  bool Build(FILE* fp);
+  // Returns the first chunk with the given ID, nullptr if there is none
+  const RiffChunkEntry* Find(uint32_t fourcc) const;
+  // Returns number of indexed chunks
+  uint32_t GetNumChunks() const { return m_numChunks; }
+  // Returns indexed chunk i, in file order
+  const RiffChunkEntry& GetChunk(uint32_t i) const { return m_chunks[i]; }
+  // Returns true, if chunks were left out because the table was full
+  bool IsTruncated() const { return m_truncated; }
+  // Returns why the last Build() failed
+  WaveStatus GetStatus() const { return m_status; }
+
+ private:
+  // Validates the chunk at offset against limit and records it. Returns offset of the next chunk
+  // header, 0 if the chunk is out of bounds.
+  uint64_t addChunk(uint32_t chunkId, uint32_t size, uint64_t offset, uint64_t limit);
+
+ private:
+  RiffChunkEntry m_chunks[RIFF_INDEX_CAPACITY];
+  uint32_t m_numChunks = 0;
+  bool m_truncated = false;
+  WaveStatus m_status = WAVE_STATUS_OK;
+};
+
+// Checks the fields of a PCM or IEEE float format that the readers rely on
+WaveStatus ValidateWaveFormat(const waveFormat_ext& wfx);
+
+// Parses a wav file image in memory. On success info describes the format and points at the audio
+// data inside data, which must outlive it.
+WaveStatus ParseWaveImage(const uint8_t* data, size_t sizeBytes, WaveFileInfo* info);
+
+// Converts numSamples PCM/float samples described by wfx into normalized float. wfx must pass
+// ValidateWaveFormat(), exactly numSamples * nBlockAlign / nChannels bytes of src are read.
+void ConvertPCMToFloat(const uint8_t* src, float* dst, uint32_t numSamples, const waveFormat_ext& wfx);
+
 enum WaveFileFlags {
   READ_WAVEFILE = 0,
   WRITE_WAVEFILE = 1
@@ -142,6 +230,8 @@ class CWaveFileRead {
  public:
    // Constructor
   explicit CWaveFileRead(std::string wavFile);
+  // Parses a file image already in memory (e.g. read by async_io::FilePrefetcher), wavFile only names it
+  CWaveFileRead(std::string wavFile, const uint8_t* image, size_t sizeBytes);
   // Returns sample rate of wav file
   uint32_t GetSampleRate() const { return m_WaveFormatEx.nSamplesPerSec; }
   // Returns size of wav data in bytes
@@ -162,12 +252,14 @@ class CWaveFileRead {
   int GetBitsPerSample();
   // Returns true, if file provided is valid wav file
   bool isValid() const { return m_validFile; }
+  // Returns why the file is not valid
+  WaveStatus GetStatus() const { return m_status; }
 
  private:
-  // Finds appropriate chunk
-  const RiffChunk* FindChunk(const uint8_t* data, size_t sizeBytes, uint32_t fourcc);
   // Load file and reads PCM data
-  int readPCM(const char* szFileName);
+  WaveStatus readPCM(const char* szFileName);
+  // Reads PCM data from a file image
+  WaveStatus readImage(const uint8_t* data, size_t sizeBytes);
 
  private:
   // Path to wav file
@@ -188,6 +280,80 @@ class CWaveFileRead {
   waveFormat_ext m_WaveFormatEx;
   // Number of aligned samples
   uint32_t m_NumAlignedSamples;
+  // Result of parsing the file
+  WaveStatus m_status = WAVE_STATUS_READ_FAILED;
+};
+
+// Streams samples from a wav file through a caller provided buffer instead of
+// loading the whole file. Used where references may be much larger than memory.
+class CWaveFileStreamRead {
+ public:
+  // Constructor
+  explicit CWaveFileStreamRead(std::string wavFile);
+  // Destructor
+  ~CWaveFileStreamRead();
+  // Returns sample rate of wav file
+  uint32_t GetSampleRate() const { return m_WaveFormatEx.nSamplesPerSec; }
+  // Returns number of channels
+  uint32_t GetNumChannels() const { return m_WaveFormatEx.nChannels; }
+  // Returns number of samples (all channels) in wav file
+  uint32_t GetNumSamples() const { return m_nNumSamples; }
+  // Returns wav file format
+  const waveFormat_ext& GetWaveFormat() const { return m_WaveFormatEx; }
+  // Returns true, if file provided is valid wav file
+  bool isValid() const { return m_validFile; }
+  // Returns why the file is not valid
+  WaveStatus GetStatus() const { return m_status; }
+  // Reads up to numSamples samples as float. Returns number of samples read.
+  uint32_t ReadFloat(float* out, uint32_t numSamples);
+  // Positions the stream at given sample index
+  bool SeekSample(uint32_t sample);
+  // Returns index of the next sample to be read
+  uint32_t Tell() const { return m_position; }
+  // Returns the chunks of the file
+  const CRiffChunkIndex& GetChunkIndex() const { return m_chunkIndex; }
+  // Reads the payload of an indexed chunk, the sample read position is not changed
+  bool ReadChunk(const RiffChunkEntry& chunk, std::vector<uint8_t>* data);
+
+ private:
+  // Parses RIFF/fmt/data headers without reading audio data
+  WaveStatus readHeader();
+
+ private:
+  // Path to wav file
+  std::string m_wavFile;
+  // File pointer
+  FILE* m_fp = nullptr;
+  // File Validation variable
+  bool m_validFile = false;
+  // Result of parsing the headers
+  WaveStatus m_status = WAVE_STATUS_READ_FAILED;
+  // Wave format extension
+  waveFormat_ext m_WaveFormatEx;
+  // Offset of first audio byte in file
+  long m_dataOffset = 0;
+  // Number of samples variable
+  uint32_t m_nNumSamples = 0;
+  // Read position in samples
+  uint32_t m_position = 0;
+  // Raw read buffer, reused across reads
+  std::vector<uint8_t> m_rawBuffer;
+  // Chunks of the file
+  CRiffChunkIndex m_chunkIndex;
+};
+
+// Destination of CWaveFileWrite other than a stdio file, e.g. an async_io::AsyncFileWriter
+class WaveOutputFile {
+ public:
+  virtual ~WaveOutputFile() {}
+  // Appends len bytes at the end of the file
+  virtual bool Append(const void* data, size_t len) = 0;
+  // Overwrites len bytes at offset of the data appended so far, used to rewrite the header
+  virtual bool WriteAt(uint64_t offset, const void* data, size_t len) = 0;
+  // Waits for all writes and flushes them to disk
+  virtual bool Sync() = 0;
+  // Waits for all writes and closes the file
+  virtual bool Close() = 0;
 };
 
 class CWaveFileWrite {
@@ -201,8 +367,28 @@ class CWaveFileWrite {
   bool writeChunk(const void *data, uint32_t len);
   // Commit file
   bool commitFile();
+  // Rewrites the header for the data written so far, so a partial file stays a valid wav
+  bool updateHeader();
+  // Flushes written data to the OS, so other processes reading the file see it
+  bool flush();
+  // Flushes written data to the OS and to disk
+  bool sync();
+  // Reopens an existing file written with the same format and continues after dataBytes bytes
+  // of audio. Anything written after dataBytes is discarded.
+  bool resume(uint32_t dataBytes);
   // Returns write count 
   uint32_t getWrittenCount() { return m_cumulativeCount; }
+  // Adds a chunk (e.g. LIST, bext, cue ) that is written unchanged between the fmt and data chunks.
+  // Only allowed before the first writeChunk().
+  bool addChunk(uint32_t chunkId, const void* data, uint32_t size);
+  // Writes through file instead of stdio. Only allowed before the first writeChunk(), resume() is
+  // not supported on such files.
+  bool setOutputFile(std::unique_ptr<WaveOutputFile> file);
+ private:
+  // RIFF, fmt and data headers for the data written so far
+  std::vector<uint8_t> buildHeader() const;
+  // Writes RIFF, fmt and data headers at current position
+  bool writeHeader();
  private:
   // State validation variable
   bool m_validState = false;
@@ -216,4 +402,10 @@ class CWaveFileWrite {
   waveFormat_ext m_wfx;
   // Commit check variable
   bool m_commitDone = false;
+  // Chunks added by addChunk, with chunk headers and pad bytes
+  std::vector<uint8_t> m_extraChunks;
+  // Set by setOutputFile, replaces m_fp
+  std::unique_ptr<WaveOutputFile> m_output;
+  // Header was appended to m_output
+  bool m_outputStarted = false;
 };